@@ -0,0 +1,232 @@
+/*
+ * emoticon_expand() benchmark
+ *
+ * compares old emoticon expansion (for every byte: walk whole emoticon
+ * list with strncmp, twice) with Aho-Corasick automaton from
+ * ekg/emoticons_ac.inc, on chat-sized messages, paragraphs and big pastes.
+ * emoticons are read from file in ~/.ekg2/emoticons format, or generated.
+ * prints MB/s for both and number of messages where outputs differ
+ * (they may, if one name is a prefix of another: old code took the first
+ * one from the list, new takes the longest).
+ *
+ * compile:
+ *	gcc -O2 -o emoticons_benchmark contrib/emoticons_benchmark.c -Iekg \
+ *		`pkg-config --cflags --libs glib-2.0`
+ *
+ * usage:
+ *	./emoticons_benchmark [emoticons file | count] [corpus file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "emoticons_ac.inc"
+
+static GPtrArray *names, *values;
+
+/* old emoticon_expand(), list replaced with arrays */
+static char *naive_expand(const char *s) {
+	const char *ss;
+	char *ms;
+	size_t n = 0;
+	guint i;
+
+	for (ss = s; *ss; ss++) {
+		size_t ns = strlen(ss);
+
+		for (i = 0; i < names->len; i++) {
+			size_t nn = strlen(names->pdata[i]);
+
+			if (ns >= nn && !strncmp(ss, names->pdata[i], nn))
+				break;
+		}
+
+		if (i < names->len) {
+			n += strlen(values->pdata[i]);
+			ss += strlen(names->pdata[i]) - 1;
+		} else
+			n++;
+	}
+
+	ms = g_malloc0(n + 1);
+
+	for (ss = s; *ss; ss++) {
+		size_t ns = strlen(ss);
+
+		for (i = 0; i < names->len; i++) {
+			size_t nn = strlen(names->pdata[i]);
+
+			if (ns >= nn && !strncmp(ss, names->pdata[i], nn))
+				break;
+		}
+
+		if (i < names->len) {
+			strcat(ms, values->pdata[i]);
+			ss += strlen(names->pdata[i]) - 1;
+		} else
+			ms[strlen(ms)] = *ss;
+	}
+
+	return ms;
+}
+
+static void emoticons_load(const char *file) {
+	gchar *buf, **lines, **l;
+
+	if (!g_file_get_contents(file, &buf, NULL, NULL)) {
+		fprintf(stderr, "can't read %s\n", file);
+		exit(1);
+	}
+
+	lines = g_strsplit(buf, "\n", 0);
+	for (l = lines; *l; l++) {
+		gchar **v;
+
+		if (**l == '#')
+			continue;
+		v = g_strsplit_set(*l, "\t", 2);
+		if (g_strv_length(v) == 2 && *v[0]) {
+			g_ptr_array_add(names, g_strdup(v[0]));
+			g_ptr_array_add(values, g_strdup(g_strstrip(v[1])));
+		}
+		g_strfreev(v);
+	}
+	g_strfreev(lines);
+	g_free(buf);
+}
+
+/* :-) ;-P <name> style emoticons, like in docs/emoticons.sample */
+static void emoticons_generate(int count) {
+	static const char *eyes = ":;8=", *noses = "-'o", *mouths = ")(PDO*|/]@";
+	int i;
+
+	for (i = 0; i < count; i++) {
+		gchar *name;
+
+		if (i % 3)
+			name = g_strdup_printf("%c%c%c%s", eyes[i % 4], noses[(i / 4) % 3], mouths[(i / 12) % 10],
+					i < 120 ? "" : ")");
+		else
+			name = g_strdup_printf("<%s%d>", (i & 1) ? "smile" : "grr", i);
+		g_ptr_array_add(names, name);
+		g_ptr_array_add(values, g_strdup_printf("\x1b[1m%s\x1b[0m", name));
+	}
+}
+
+static gchar *message_generate(GRand *r, gsize len) {
+	static const char *words[] = { "hej", "co", "tam", "u", "ciebie", "ekg2", "irc", "jabber",
+		"dzisiaj", "jutro", "https://ekg2.org/", "ok", "no", "nie", "wiem", "(tak)", ":", ";" };
+	GString *s = g_string_sized_new(len + 32);
+
+	while (s->len < len) {
+		if (g_rand_int_range(r, 0, 8) == 0)
+			g_string_append(s, names->pdata[g_rand_int_range(r, 0, names->len)]);
+		else
+			g_string_append(s, words[g_rand_int_range(r, 0, G_N_ELEMENTS(words))]);
+		g_string_append_c(s, ' ');
+	}
+	return g_string_free(s, FALSE);
+}
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(const char *title, GPtrArray *corpus, emoticons_ac_t *ac, int loops) {
+	gsize bytes = 0;
+	guint i, diff = 0;
+	double t0, t_naive, t_ac;
+	int n;
+
+	for (i = 0; i < corpus->len; i++) {
+		gchar *a = naive_expand(corpus->pdata[i]);
+		gchar *b = emoticons_ac_expand(ac, corpus->pdata[i]);
+
+		if (strcmp(a, b))
+			diff++;
+		bytes += strlen(corpus->pdata[i]);
+		g_free(a);
+		g_free(b);
+	}
+
+	t0 = now();
+	for (n = 0; n < loops; n++)
+		for (i = 0; i < corpus->len; i++)
+			g_free(naive_expand(corpus->pdata[i]));
+	t_naive = now() - t0;
+
+	t0 = now();
+	for (n = 0; n < loops; n++)
+		for (i = 0; i < corpus->len; i++)
+			g_free(emoticons_ac_expand(ac, corpus->pdata[i]));
+	t_ac = now() - t0;
+
+	printf("%-12s %6u msgs %9" G_GSIZE_FORMAT " bytes  naive %9.2f MB/s  aho-corasick %9.2f MB/s  (x%.1f)  differ: %u\n",
+			title, corpus->len, bytes,
+			bytes * loops / t_naive / 1e6, bytes * loops / t_ac / 1e6, t_naive / t_ac, diff);
+}
+
+int main(int argc, char **argv) {
+	GRand *r = g_rand_new_with_seed(2011);
+	emoticons_ac_t *ac;
+	GPtrArray *corpus;
+	double t0;
+	guint i;
+
+	names = g_ptr_array_new();
+	values = g_ptr_array_new();
+
+	if (argc > 1 && !g_ascii_isdigit(*argv[1]))
+		emoticons_load(argv[1]);
+	else
+		emoticons_generate(argc > 1 ? atoi(argv[1]) : 300);
+
+	t0 = now();
+	ac = emoticons_ac_new();
+	for (i = 0; i < names->len; i++)
+		emoticons_ac_add(ac, names->pdata[i], values->pdata[i]);
+	emoticons_ac_compile(ac);
+	printf("%u emoticons, automaton: %u states, %u columns, compiled in %.3f ms\n",
+			names->len, ac->states_count, ac->classes, (now() - t0) * 1e3);
+
+	if (argc > 2) {
+		gchar *buf, **lines;
+
+		if (!g_file_get_contents(argv[2], &buf, NULL, NULL)) {
+			fprintf(stderr, "can't read %s\n", argv[2]);
+			return 1;
+		}
+		corpus = g_ptr_array_new();
+		lines = g_strsplit(buf, "\n", 0);
+		for (i = 0; lines[i]; i++)
+			g_ptr_array_add(corpus, lines[i]);
+		bench("file", corpus, ac, 3);
+		g_free(buf);
+		return 0;
+	}
+
+	corpus = g_ptr_array_new();
+	for (i = 0; i < 2000; i++)
+		g_ptr_array_add(corpus, message_generate(r, 20 + g_rand_int_range(r, 0, 100)));
+	bench("chat", corpus, ac, 5);
+
+	corpus = g_ptr_array_new();
+	for (i = 0; i < 200; i++)
+		g_ptr_array_add(corpus, message_generate(r, 1000));
+	bench("paragraph", corpus, ac, 3);
+
+	corpus = g_ptr_array_new();
+	for (i = 0; i < 2; i++)
+		g_ptr_array_add(corpus, message_generate(r, 32768));
+	bench("paste", corpus, ac, 1);
+
+	emoticons_ac_free(ac);
+	return 0;
+}
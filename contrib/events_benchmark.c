@@ -0,0 +1,516 @@
+/*
+ * event_check() benchmark
+ *
+ * runs N status events against M /on rules, and compares old matching
+ * (for every event: walk all rules, array_make() their names and targets,
+ * format_string() and parse every target expression, then array_make()
+ * and format_string() actions) with compiled rules from
+ * ekg/events_rules.inc (index by event name, rules sorted by priority,
+ * static parts used as they are). commands aren't executed, both ways
+ * would do the same there. checks that the same rule is chosen and the
+ * same commands are prepared for every event.
+ *
+ * array_make() is copied from ekg/dynstuff.c, format_string() only
+ * substitutes %1..%9, which is all /on rules use.
+ *
+ * compile:
+ *	gcc -O2 -o events_benchmark contrib/events_benchmark.c -Iekg \
+ *		`pkg-config --cflags --libs glib-2.0`
+ *
+ * usage:
+ *	./events_benchmark [events [rules]]
+ */
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <glib.h>
+
+#define xstrcasestr strcasestr
+
+/* from ekg/dynstuff.c */
+static char **array_make(const char *string, const char *sep, int max, int trim, int quotes) {
+	const char *p, *q;
+	char **result = NULL;
+	int items = 0, last = 0;
+
+	if (!string || !sep)
+		goto failure;
+
+	for (p = string; ; ) {
+		int len = 0;
+		char *token = NULL;
+
+		if (max && items >= max - 1)
+			last = 1;
+
+		if (trim) {
+			while (*p && strchr(sep, *p))
+				p++;
+			if (!*p)
+				break;
+		}
+
+		if (quotes && (*p == '\'' || *p == '\"')) {
+			char sep = *p;
+			char *r;
+
+			for (q = p + 1, len = 0; *q; q++, len++) {
+				if (*q == '\\') {
+					q++;
+					if (!*q)
+						break;
+				} else if (*q == sep)
+					break;
+			}
+
+			if (last && q[0] && q[1])
+				goto way2;
+
+			len++;
+
+			r = token = g_malloc0(len + 1);
+			for (q = p + 1; *q; q++, r++) {
+				if (*q == '\\') {
+					q++;
+
+					if (!*q)
+						break;
+
+					switch (*q) {
+						case 'n': *r = '\n'; break;
+						case 'r': *r = '\r'; break;
+						case 't': *r = '\t'; break;
+						default: *r = *q;
+					}
+				} else if (*q == sep) {
+					break;
+				} else
+					*r = *q;
+			}
+
+			*r = 0;
+
+			p = (*q) ? q + 1 : q;
+
+		} else {
+way2:
+			for (q = p, len = 0; *q && (last || !strchr(sep, *q)); q++, len++);
+			token = g_strndup(p, len);
+			p = q;
+		}
+
+		result = g_realloc(result, (items + 2) * sizeof(char*));
+		result[items] = token;
+		result[++items] = NULL;
+
+		if (!*p)
+			break;
+
+		p++;
+	}
+
+failure:
+	if (!items)
+		result = g_new0(char *, 1);
+
+	return result;
+}
+
+static char *format_string(const char *format, ...) {
+	GString *s = g_string_new(NULL);
+	const char *args[9] = { NULL };
+	const char *p;
+	va_list ap;
+	int i, argc = 0;
+
+	for (p = format; *p; p++) {
+		if (*p == '%' && p[1] >= '1' && p[1] <= '9' && p[1] - '0' > argc)
+			argc = p[1] - '0';
+	}
+
+	va_start(ap, format);
+	for (i = 0; i < argc; i++)
+		args[i] = va_arg(ap, const char *);
+	va_end(ap);
+
+	for (p = format; *p; p++) {
+		if (*p == '\\' && (p[1] == '%' || p[1] == '\\'))
+			g_string_append_c(s, *++p);
+		else if (*p == '%' && p[1] >= '1' && p[1] <= '9') {
+			const char *a = args[*++p - '1'];
+
+			g_string_append(s, a ? a : "(null)");
+		} else
+			g_string_append_c(s, *p);
+	}
+
+	return g_string_free(s, FALSE);
+}
+
+static char *strip_spaces(char *line) {
+	return g_strstrip(line);
+}
+
+#include "events_rules.inc"
+
+typedef struct {
+	unsigned int id;
+	char *name, *target, *action;
+	int prio;
+} event_t;
+
+static GPtrArray *events;
+
+/*
+ * old code, from ekg/events.c
+ */
+
+static int event_target_check_compare(char *buf) {
+	GString *s = g_string_new(NULL);
+	int ret = 0;
+
+	while (*buf) {
+		if (*buf == '/') {
+			buf++;
+			if (!*buf)
+				break;
+			buf++;
+			if (!*buf)
+				break;
+			continue;
+		}
+
+		if (*buf == '=') {
+			buf++;
+			if (!*buf)
+				break;
+			if (*buf == '=') {
+				buf++;
+				if (!*buf)
+					break;
+				ret = !strcmp(s->str, buf);
+				goto done;
+			}
+			ret = !strcasecmp(s->str, buf);
+			goto done;
+		}
+
+		if (*buf == '!') {
+			buf++;
+			if (!*buf)
+				break;
+			if (*buf == '=') {
+				buf++;
+				if (!*buf)
+					break;
+				if (*buf == '=') {
+					buf++;
+					if (!*buf)
+						break;
+					ret = !!strcmp(s->str, buf);
+					goto done;
+				}
+				ret = !!strcasecmp(s->str, buf);
+				goto done;
+			}
+			if (*buf == '+') {
+				buf++;
+				if (!*buf)
+					break;
+				if (*buf == '+') {
+					buf++;
+					if (!*buf)
+						break;
+					ret = !strstr(buf, s->str);
+					goto done;
+				}
+				ret = !strcasestr(buf, s->str);
+				goto done;
+			}
+			continue;
+		}
+
+		if (*buf == '+') {
+			buf++;
+			if (!*buf)
+				break;
+			if (*buf == '+') {
+				buf++;
+				if (!*buf)
+					break;
+				ret = !!strstr(buf, s->str);
+				goto done;
+			}
+			ret = !!strcasestr(buf, s->str);
+			goto done;
+		}
+
+		g_string_append_c(s, *buf);
+		buf++;
+	}
+done:
+	g_string_free(s, TRUE);
+	return ret;
+}
+
+static int event_target_check(char *buf) {
+	char **params = array_make(buf, "&|", 0, 1, 1);
+	int i = 1;
+	char *separators;
+	char last_returned = 0;
+	int first = 1;
+
+#define s separators[i]
+
+	separators = g_malloc0(strlen(buf) + 2);
+
+	while (*buf) {
+		if (*buf == '&' || *buf == '|') {
+			s = *buf;
+			i++;
+		}
+		buf++;
+	}
+	for (i = 0; params[i]; i++) {
+		int returned_now;
+
+		returned_now = event_target_check_compare(params[i]);
+		if (s && s == '&') {
+			if (returned_now && last_returned)
+				last_returned = 1;
+			else
+				last_returned = 0;
+		} else if (s && s == '|') {
+			if (returned_now || last_returned)
+				last_returned = 1;
+			else
+				last_returned = 0;
+		}
+
+		if (first) {
+			last_returned = returned_now;
+			first = 0;
+		}
+	}
+#undef s
+
+	g_free(separators);
+	g_strfreev(params);
+
+	return last_returned;
+}
+
+static event_t *event_find_all(const char *name, const char *session, const char *uid, const char *target, const char *data) {
+	event_t *ev_max = NULL;
+	int ev_max_prio = 0;
+	char **b, **c;
+	guint n;
+
+	b = array_make(target, "|,;", 0, 1, 0);
+	c = array_make(name, "|,;", 0, 1, 0);
+	for (n = 0; n < events->len; n++) {
+		event_t *ev = events->pdata[n];
+		char **a, **d;
+		int i, j, k, m;
+
+		a = array_make(ev->target, "|,;", 0, 1, 0);
+		d = array_make(ev->name, "|,;", 0, 1, 0);
+		for (i = 0; a[i]; i++) {
+			for (j = 0; b[j]; j++) {
+				for (k = 0; c[k]; k++) {
+					for (m = 0; d[m]; m++) {
+						char *tmp = format_string(a[i], uid, target, data, session);
+						if ((strcasecmp(d[m], c[k]) && strcasecmp(d[m], "*")) ||
+								(!event_target_check(tmp) && strcasecmp(a[i], "*") &&
+								 strcasecmp(a[i], b[j]))) {
+							g_free(tmp);
+							continue;
+						} else if (ev->prio > ev_max_prio) {
+							ev_max = ev;
+							ev_max_prio = ev->prio;
+						}
+						g_free(tmp);
+					}
+				}
+			}
+		}
+		g_strfreev(a);
+		g_strfreev(d);
+	}
+
+	g_strfreev(b);
+	g_strfreev(c);
+
+	return ev_max;
+}
+
+/* returns id of rule, and commands in *cmds */
+static unsigned int check_old(const char *name, const char *session, const char *uid, const char *target, const char *data, GString *cmds) {
+	event_t *ev = event_find_all(name, session, uid, target, data);
+	char **actions;
+	int i;
+
+	if (!ev)
+		return 0;
+
+	actions = array_make(ev->action, ";", 0, 0, 1);
+	for (i = 0; actions[i]; i++) {
+		char *tmp = format_string(strip_spaces(actions[i]), uid, target, data ? data : "", "", session);
+
+		g_string_append(cmds, tmp);
+		g_string_append_c(cmds, '\n');
+		g_free(tmp);
+	}
+	g_strfreev(actions);
+
+	return ev->id;
+}
+
+static unsigned int check_new(event_index_t *idx, const char *name, const char *session, const char *uid, const char *target, const char *data, GString *cmds) {
+	event_rule_t *r = event_index_find(idx, name, session, uid, target, data);
+	guint i;
+
+	if (!r)
+		return 0;
+
+	for (i = 0; i < r->actions_count; i++) {
+		const event_tmpl_t *a = &r->actions[i];
+
+		if (a->dynamic) {
+			char *tmp = format_string(a->text, uid, target, data ? data : "", "", session);
+
+			g_string_append(cmds, tmp);
+			g_free(tmp);
+		} else
+			g_string_append(cmds, a->text);
+		g_string_append_c(cmds, '\n');
+	}
+
+	return r->id;
+}
+
+static const char *names[] = { "event-avail", "event-away", "event-na", "event-online", "event-offline", "event-descr" };
+
+/* mix of what people have in their configs */
+static void rules_generate(int count) {
+	GRand *r = g_rand_new_with_seed(2011);
+	int i;
+
+	for (i = 0; i < count; i++) {
+		event_t *ev = g_new0(event_t, 1);
+		int user = g_rand_int_range(r, 0, 2000);
+
+		ev->id = i + 1;
+		ev->prio = g_rand_int_range(r, 1, 20);
+
+		switch (i % 10) {
+			case 0:		/* match on uid */
+				ev->name = g_strdup(names[g_rand_int_range(r, 0, G_N_ELEMENTS(names))]);
+				ev->target = g_strdup_printf("%%1=xmpp:user%d@example.org", user);
+				ev->action = g_strdup("/beep; /echo %2 changed status");
+				break;
+			case 1:		/* word in description */
+				ev->name = g_strdup("event-descr");
+				ev->target = g_strdup_printf("%%3+word%d&%%2!=nick%d", user % 50, user);
+				ev->action = g_strdup_printf("/play /usr/share/sounds/%d.wav", i);
+				break;
+			case 2:		/* any event of some contacts */
+				ev->name = g_strdup("*");
+				ev->target = g_strdup_printf("nick%d|nick%d", user, (user + 7) % 2000);
+				ev->action = g_strdup("/echo %1 did something");
+				break;
+			default:	/* some events of a contact, by nickname */
+				ev->name = g_strdup_printf("%s|%s", names[g_rand_int_range(r, 0, 3)], names[g_rand_int_range(r, 3, 6)]);
+				ev->target = g_strdup_printf("nick%d", user);
+				ev->action = g_strdup_printf("/beep; /exec notify-send nick%d", user);
+		}
+		g_ptr_array_add(events, ev);
+	}
+	g_rand_free(r);
+}
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+	int nevents = argc > 1 ? atoi(argv[1]) : 10000, nrules = argc > 2 ? atoi(argv[2]) : 500;
+	GRand *r = g_rand_new_with_seed(42);
+	char **ev_name, **ev_uid, **ev_target, **ev_data;
+	unsigned int *id_old, *id_new;
+	GString *cmds_old = g_string_new(NULL), *cmds_new = g_string_new(NULL);
+	event_index_t idx;
+	GPtrArray *rules = g_ptr_array_new();
+	double t0, t_old, t_new, t_compile;
+	int i, fired = 0, differ = 0;
+
+	events = g_ptr_array_new();
+	rules_generate(nrules);
+
+	ev_name = g_new(char *, nevents);
+	ev_uid = g_new(char *, nevents);
+	ev_target = g_new(char *, nevents);
+	ev_data = g_new(char *, nevents);
+	for (i = 0; i < nevents; i++) {
+		int user = g_rand_int_range(r, 0, 2000);
+
+		ev_name[i] = (char *) names[g_rand_int_range(r, 0, G_N_ELEMENTS(names))];
+		ev_uid[i] = g_strdup_printf("xmpp:user%d@example.org", user);
+		ev_target[i] = g_strdup_printf("nick%d", user);
+		ev_data[i] = strcmp(ev_name[i], "event-descr") ? NULL : g_strdup_printf("jestem word%d teraz", g_rand_int_range(r, 0, 60));
+	}
+
+	id_old = g_new(unsigned int, nevents);
+	id_new = g_new(unsigned int, nevents);
+
+	t0 = now();
+	for (i = 0; i < nevents; i++)
+		id_old[i] = check_old(ev_name[i], "xmpp:me@example.org", ev_uid[i], ev_target[i], ev_data[i], cmds_old);
+	t_old = now() - t0;
+
+	t0 = now();
+	event_index_init(&idx);
+	for (i = 0; i < (int) events->len; i++) {
+		event_t *ev = events->pdata[i];
+
+		g_ptr_array_add(rules, event_rule_new(ev->id, ev->prio, ev->name, ev->target, ev->action));
+		event_index_add(&idx, rules->pdata[i]);
+	}
+	t_compile = now() - t0;
+
+	t0 = now();
+	for (i = 0; i < nevents; i++)
+		id_new[i] = check_new(&idx, ev_name[i], "xmpp:me@example.org", ev_uid[i], ev_target[i], ev_data[i], cmds_new);
+	t_new = now() - t0;
+
+	for (i = 0; i < nevents; i++) {
+		if (id_old[i])
+			fired++;
+		if (id_old[i] != id_new[i])
+			differ++;
+	}
+
+	printf("%d events, %d rules, %d fired\n", nevents, nrules, fired);
+	printf("old event_find_all():  %10.2f ms  (%.2f us/event)\n", t_old * 1e3, t_old * 1e6 / nevents);
+	printf("compiled rules:        %10.2f ms  (%.2f us/event)  x%.0f\n", t_new * 1e3, t_new * 1e6 / nevents, t_old / t_new);
+	printf("compiling rules:       %10.2f ms\n", t_compile * 1e3);
+	for (i = 0; i < (int) rules->len; i++) {
+		event_index_remove(&idx, rules->pdata[i]);
+		event_rule_unref(rules->pdata[i]);
+	}
+	event_index_destroy(&idx);
+
+	printf("%s\n", (!differ && !strcmp(cmds_old->str, cmds_new->str)) ? "same rules and commands" : "RESULTS DIFFER");
+
+	return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * recode throughput benchmark
+ *
+ * makes corpus of lines (100 MB by default) like the ones plugins recode:
+ * mostly plain ascii, polish text in iso-8859-2 and cp1250, utf8 (some of
+ * it invalid), and converts every line to utf8 from its charset, and back
+ * (utf8 ones to iso-8859-2), like incoming and outgoing messages. compares
+ * g_convert_with_fallback() for every line (what ekg/recode.c did) with
+ * converter pool from ekg/recode_pool.inc, and checks that results are
+ * the same.
+ *
+ * compile:
+ *	gcc -O2 -o recode_benchmark contrib/recode_benchmark.c -Iekg \
+ *		`pkg-config --cflags --libs glib-2.0`
+ *
+ * usage:
+ *	./recode_benchmark [megabytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "recode_pool.inc"
+
+typedef struct {
+	const char *charset;
+	char *text;
+	gsize len;
+} line_t;
+
+static const char *words_ascii[] = {
+	"PRIVMSG", "#ekg2", ":hello", "world", "ping", "jabber.org", "ok", "lol", "http://ekg2.org/", "NOTICE", "zzz", "1234"
+};
+
+/* utf8, last ones are not in iso-8859-2 */
+static const char *words_pl[] = {
+	"zażółć", "gęślą", "jaźń", "Łódź", "źdźbło", "mówię", "cześć", "dzięki", "świetnie", "żółw", "5€", "日本"
+};
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static line_t *corpus_make(GRand *r, gsize bytes, guint *count) {
+	GArray *lines = g_array_new(FALSE, FALSE, sizeof(line_t));
+	gsize total = 0;
+
+	while (total < bytes) {
+		GString *s = g_string_new(NULL);
+		int kind = g_rand_int_range(r, 0, 10), words = g_rand_int_range(r, 3, 20), i;
+		line_t l;
+
+		for (i = 0; i < words; i++) {
+			if (i)
+				g_string_append_c(s, ' ');
+			if (kind < 6 || g_rand_int_range(r, 0, 3))
+				g_string_append(s, words_ascii[g_rand_int_range(r, 0, G_N_ELEMENTS(words_ascii))]);
+			else
+				g_string_append(s, words_pl[g_rand_int_range(r, 0, G_N_ELEMENTS(words_pl))]);
+		}
+
+		switch (kind) {
+			case 6:	 l.charset = "ISO-8859-2"; break;
+			case 7:	 l.charset = "CP1250"; break;
+			case 8:	 l.charset = "UTF-8"; break;
+			case 9:	 l.charset = "UTF-8";
+				 g_string_append(s, " \xff\xfe broken");
+				 break;
+			default: l.charset = g_rand_boolean(r) ? "UTF-8" : "ISO-8859-2"; break;
+		}
+
+		/* the text is in its charset, what isn't there is '?' */
+		if (kind == 6 || kind == 7) {
+			gsize written;
+			gchar *res = g_convert_with_fallback(s->str, s->len, l.charset, "UTF-8", "?", NULL, &written, NULL);
+
+			g_string_assign(s, res);
+			g_free(res);
+		}
+
+		l.len = s->len;
+		l.text = g_string_free(s, FALSE);
+		total += l.len;
+		g_array_append_val(lines, l);
+	}
+
+	*count = lines->len;
+	return (line_t *) g_array_free(lines, FALSE);
+}
+
+typedef gchar *(*convert_func)(const gchar *str, gssize len, const gchar *from, const gchar *to, gsize *written);
+
+static gchar *convert_old(const gchar *str, gssize len, const gchar *from, const gchar *to, gsize *written) {
+	return g_convert_with_fallback(str, len, to, from, NULL, NULL, written, NULL);
+}
+
+static gchar *convert_pool(const gchar *str, gssize len, const gchar *from, const gchar *to, gsize *written) {
+	return recode_pool_convert(str, len, from, to, written, TRUE);
+}
+
+/* every line to utf8 and back; returns results, for comparing */
+static GPtrArray *run(const char *what, convert_func f, line_t *lines, guint count, gsize bytes) {
+	GPtrArray *res = g_ptr_array_new();
+	double t0 = now(), t;
+	guint i, failed = 0;
+
+	for (i = 0; i < count; i++) {
+		gsize written;
+		gchar *in = f(lines[i].text, lines[i].len, lines[i].charset, "UTF-8", &written);
+		gchar *out;
+
+		if (!in) {
+			failed++;
+			g_ptr_array_add(res, NULL);
+			g_ptr_array_add(res, NULL);
+			continue;
+		}
+		/* answers to utf8 lines go to iso-8859-2 (like irc recode_list), some chars aren't there */
+		out = f(in, written, "UTF-8", strcmp(lines[i].charset, "UTF-8") ? lines[i].charset : "ISO-8859-2", &written);
+		g_ptr_array_add(res, in);
+		g_ptr_array_add(res, out);
+	}
+	t = now() - t0;
+
+	printf("%-28s %8.2f ms  %7.1f MB/s  (%u lines failed)\n", what, t * 1e3, 2 * bytes / t / 1e6, failed);
+	return res;
+}
+
+static void results_free(GPtrArray *res) {
+	guint i;
+
+	for (i = 0; i < res->len; i++)
+		g_free(res->pdata[i]);
+	g_ptr_array_free(res, TRUE);
+}
+
+int main(int argc, char **argv) {
+	gsize bytes = (argc > 1 ? atoi(argv[1]) : 100) * 1000000UL;
+	GRand *r = g_rand_new_with_seed(42);
+	GPtrArray *res_old, *res_new;
+	guint count, i, differ = 0;
+	line_t *lines;
+
+	lines = corpus_make(r, bytes, &count);
+	printf("%u lines, %lu bytes\n", count, (unsigned long) bytes);
+
+	res_old = run("g_convert_with_fallback():", convert_old, lines, count, bytes);
+
+	recode_pool_ref("UTF-8", "ISO-8859-2");		/* like ekg_recode_iso2_inc() */
+	recode_pool_ref("ISO-8859-2", "UTF-8");
+	res_new = run("converter pool:", convert_pool, lines, count, bytes);
+
+	for (i = 0; i < res_old->len; i++) {
+		const gchar *a = res_old->pdata[i], *b = res_new->pdata[i];
+
+		if ((!a != !b || (a && strcmp(a, b))) && differ++ < 10)
+			printf("  line %u differs: %s / %s\n", i / 2, a ? a : "(failed)", b ? b : "(failed)");
+	}
+
+	recode_pool_unref("UTF-8", "ISO-8859-2");
+	recode_pool_unref("ISO-8859-2", "UTF-8");
+	printf("%u converters left open\n", recode_pool ? g_hash_table_size(recode_pool) : 0);
+	recode_pool_destroy();
+
+	printf("%s\n", differ ? "RESULTS DIFFER" : "same results");
+
+	results_free(res_old);
+	results_free(res_new);
+	for (i = 0; i < count; i++)
+		g_free(lines[i].text);
+	g_free(lines);
+	g_rand_free(r);
+	return differ ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * sniff plugin flow table replay benchmark
+ *
+ * reads whole pcap file into memory, and than replays it (loops times)
+ * through the same ethernet/ip/tcp parsing, flow lookup and reassembly
+ * code as plugins/sniff does, with GG-like length-prefixed frame
+ * dissector. prints packets/sec and flow counters.
+ *
+ * compile:
+ *	gcc -O2 -o sniff_flow_benchmark contrib/sniff_flow_benchmark.c -Iplugins/sniff \
+ *		`pkg-config --cflags --libs glib-2.0` -lpcap
+ *
+ * usage:
+ *	./sniff_flow_benchmark dump.pcap [loops]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "sniff_ip.h"
+#include "sniff_flow.h"
+#include "sniff_flow.inc"
+
+typedef struct {
+	struct pcap_pkthdr hdr;
+	u_char *data;
+} packet_t;
+
+static GArray *packets;
+static guint64 frames;
+
+static void store_packet(u_char *user, const struct pcap_pkthdr *h, const u_char *bytes) {
+	packet_t p;
+
+	p.hdr	= *h;
+	p.data	= g_memdup(bytes, h->caplen);
+	g_array_append_val(packets, p);
+}
+
+/* gg_header: type and len, both 32-bit little endian */
+static int frame_dissect(void *priv, const connection_t *hdr, const unsigned char *data, int len) {
+	guint32 flen;
+
+	if (len < 8)
+		return -1;
+
+	flen = data[4] | (data[5] << 8) | (data[6] << 16) | (data[7] << 24);
+	if (flen > 65536)		/* like SNIFF_GG_MAX_LEN */
+		return 0;
+	if (flen > (guint32) len - 8)
+		return -1;
+
+	frames++;
+	return 8 + flen;
+}
+
+static void replay(sniff_flows_t *t, const packet_t *p, int linktype) {
+	const u_char *packet = p->data;
+	int len = p->hdr.caplen;
+	const struct iphdr *ip;
+	const struct tcphdr *tcp;
+	sniff_flow_t *f;
+	guint16 ethtype;
+	int size_ip, size_tcp, size_payload, way;
+
+	if (linktype == DLT_LINUX_SLL) {
+		if (len < SIZE_SLL)
+			return;
+		ethtype = g_ntohs(((const struct sll_header *) packet)->sll_protocol);
+		packet += SIZE_SLL; len -= SIZE_SLL;
+	} else {
+		if (len < SIZE_ETHERNET)
+			return;
+		ethtype = g_ntohs(((const struct ethhdr *) packet)->ether_type);
+		packet += SIZE_ETHERNET; len -= SIZE_ETHERNET;
+	}
+
+	if (ethtype != ETHERTYPE_IP || len < (int) sizeof(struct iphdr))
+		return;
+
+	ip = (const struct iphdr *) packet;
+	size_ip = ip->ip_hl * 4;
+
+	if (size_ip < 20 || ip->ip_p != IPPROTO_TCP || len < size_ip + (int) sizeof(struct tcphdr))
+		return;
+
+	tcp = (const struct tcphdr *) (packet + size_ip);
+	size_tcp = TH_OFF(tcp) * 4;
+	size_payload = g_ntohs(ip->ip_len) - (size_ip + size_tcp);
+
+	if (size_tcp < 20 || size_payload < 0 || len < size_ip + size_tcp + size_payload)
+		return;
+
+	sniff_flows_expire(t, p->hdr.ts.tv_sec);
+	f = sniff_flow_get(t, ip, tcp, p->hdr.ts.tv_sec, &way);
+	sniff_flow_segment(t, f, way, tcp, packet + size_ip + size_tcp, size_payload, frame_dissect, NULL);
+}
+
+int main(int argc, char **argv) {
+	char errbuf[PCAP_ERRBUF_SIZE];
+	struct timespec start, end;
+	sniff_flows_t flows;
+	pcap_t *dev;
+	int linktype, loops, i;
+	guint j;
+	double secs;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s dump.pcap [loops]\n", argv[0]);
+		return 1;
+	}
+	loops = (argc > 2) ? atoi(argv[2]) : 10;
+
+	if (!(dev = pcap_open_offline(argv[1], errbuf))) {
+		fprintf(stderr, "%s\n", errbuf);
+		return 1;
+	}
+
+	packets = g_array_new(FALSE, FALSE, sizeof(packet_t));
+	pcap_loop(dev, -1, store_packet, NULL);
+	linktype = pcap_datalink(dev);
+	pcap_close(dev);
+
+	sniff_flows_init(&flows, 300, 65536);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < packets->len; j++)
+			replay(&flows, &g_array_index(packets, packet_t, j), linktype);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("packets:   %u x %d\n", packets->len, loops);
+	printf("time:      %.3f s\n", secs);
+	printf("rate:      %.0f packets/sec\n", (packets->len * (double) loops) / secs);
+	printf("flows:     %" G_GUINT64_FORMAT " created, %" G_GUINT64_FORMAT " expired, %u active\n",
+			flows.created, flows.expired, g_hash_table_size(flows.flows));
+	printf("frames:    %" G_GUINT64_FORMAT "\n", frames);
+
+	sniff_flows_destroy(&flows);
+
+	for (j = 0; j < packets->len; j++)
+		g_free(g_array_index(packets, packet_t, j).data);
+	g_array_free(packets, TRUE);
+
+	return 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * userlist sorting benchmark
+ *
+ * compares ways of building sorted userlist from N nicknames:
+ *  - old one: list_add_sorted() for every entry, strcoll() on each step,
+ *  - strxfrm() keys, binary search in ordered index, one by one
+ *    (userlist_items_insert()),
+ *  - strxfrm() keys, one sort, one merge (userlist_items_bulk_add()).
+ * and checks that all of them give the same order.
+ * nicknames are read from file (one per line), or generated.
+ *
+ * compile:
+ *	gcc -O2 -o userlist_sort_benchmark contrib/userlist_sort_benchmark.c \
+ *		`pkg-config --cflags --libs glib-2.0`
+ *
+ * usage:
+ *	LC_COLLATE=pl_PL.UTF-8 ./userlist_sort_benchmark [nicknames file | count]
+ */
+
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+typedef struct item {
+	struct item *next;
+	char *nickname;
+	char *collate_key;
+} item_t;
+
+static GPtrArray *nicknames;
+
+static char *collate_key(const char *nickname) {
+	size_t len = strxfrm(NULL, nickname, 0);
+	char *key = g_malloc(len + 1);
+
+	strxfrm(key, nickname, len + 1);
+	return key;
+}
+
+static item_t *items_new(void) {
+	item_t *items = g_new0(item_t, nicknames->len);
+	guint i;
+
+	for (i = 0; i < nicknames->len; i++)
+		items[i].nickname = nicknames->pdata[i];
+	return items;
+}
+
+static void items_free(item_t *items) {
+	guint i;
+
+	for (i = 0; i < nicknames->len; i++)
+		g_free(items[i].collate_key);
+	g_free(items);
+}
+
+/* list_add_sorted() with strcoll() */
+static item_t *build_strcoll(item_t *items) {
+	item_t *head = NULL;
+	guint i;
+
+	for (i = 0; i < nicknames->len; i++) {
+		item_t *u = &items[i], *tmp, *prev = NULL;
+
+		for (tmp = head; tmp && strcoll(u->nickname, tmp->nickname) > 0; tmp = tmp->next)
+			prev = tmp;
+
+		u->next = tmp;
+		if (prev)
+			prev->next = u;
+		else
+			head = u;
+	}
+
+	return head;
+}
+
+/* userlist_items_insert() */
+static item_t *build_index(item_t *items) {
+	GPtrArray *order = g_ptr_array_new();
+	item_t *head = NULL;
+	guint i;
+
+	for (i = 0; i < nicknames->len; i++) {
+		item_t *u = &items[i];
+		guint lo = 0, hi = order->len;
+
+		u->collate_key = collate_key(u->nickname);
+
+		while (lo < hi) {
+			guint mid = lo + (hi - lo) / 2;
+
+			if (strcmp(((item_t *) order->pdata[mid])->collate_key, u->collate_key) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if (lo) {
+			item_t *prev = order->pdata[lo - 1];
+
+			u->next = prev->next;
+			prev->next = u;
+		} else {
+			u->next = head;
+			head = u;
+		}
+
+		g_ptr_array_add(order, NULL);
+		memmove(&order->pdata[lo + 1], &order->pdata[lo], (order->len - 1 - lo) * sizeof(gpointer));
+		order->pdata[lo] = u;
+	}
+
+	g_ptr_array_free(order, TRUE);
+	return head;
+}
+
+static gint key_compare(gconstpointer a, gconstpointer b) {
+	return strcmp((*(item_t **) a)->collate_key, (*(item_t **) b)->collate_key);
+}
+
+/* userlist_items_bulk_add() into empty list */
+static item_t *build_bulk(item_t *items) {
+	GPtrArray *arr = g_ptr_array_sized_new(nicknames->len);
+	item_t *head = NULL, **tail = &head;
+	guint i;
+
+	for (i = 0; i < nicknames->len; i++) {
+		items[i].collate_key = collate_key(items[i].nickname);
+		g_ptr_array_add(arr, &items[i]);
+	}
+	g_ptr_array_sort(arr, key_compare);
+
+	for (i = 0; i < arr->len; i++) {
+		*tail = arr->pdata[i];
+		tail = &(*tail)->next;
+	}
+	*tail = NULL;
+
+	g_ptr_array_free(arr, TRUE);
+	return head;
+}
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* returns time in ms, stores order of nicknames in *out */
+static double bench(item_t *(*build)(item_t *), GPtrArray **out) {
+	item_t *items = items_new(), *u;
+	double t0, t;
+
+	t0 = now();
+	u = build(items);
+	t = (now() - t0) * 1e3;
+
+	*out = g_ptr_array_new();
+	for (; u; u = u->next)
+		g_ptr_array_add(*out, u->nickname);
+
+	items_free(items);
+	return t;
+}
+
+static gboolean same_order(GPtrArray *a, GPtrArray *b) {
+	guint i;
+
+	if (a->len != b->len)
+		return FALSE;
+
+	/* equal nicknames may be swapped, compare by value */
+	for (i = 0; i < a->len; i++) {
+		if (strcmp(a->pdata[i], b->pdata[i]))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static void nicknames_generate(int count) {
+	static const char *first[] = { "Adam", "Łukasz", "Ewa", "Żaneta", "ania", "Zbyszek", "Ćwiek", "Śliwa",
+		"bartek", "Ola", "ola", "Marek", "Ścibor", "Źdźbło", "kasia", "Kasia" };
+	GRand *r = g_rand_new_with_seed(2011);
+	int i;
+
+	for (i = 0; i < count; i++)
+		g_ptr_array_add(nicknames, g_strdup_printf("%s %s%d", first[g_rand_int_range(r, 0, G_N_ELEMENTS(first))],
+					first[g_rand_int_range(r, 0, G_N_ELEMENTS(first))], g_rand_int_range(r, 0, 1000)));
+	g_rand_free(r);
+}
+
+int main(int argc, char **argv) {
+	GPtrArray *o_strcoll, *o_index, *o_bulk;
+	double t_strcoll, t_index, t_bulk;
+
+	setlocale(LC_ALL, "");
+	nicknames = g_ptr_array_new();
+
+	if (argc > 1 && !g_ascii_isdigit(*argv[1])) {
+		gchar *buf, **lines;
+		guint i;
+
+		if (!g_file_get_contents(argv[1], &buf, NULL, NULL)) {
+			fprintf(stderr, "can't read %s\n", argv[1]);
+			return 1;
+		}
+		lines = g_strsplit(buf, "\n", 0);
+		for (i = 0; lines[i]; i++) {
+			if (*lines[i])
+				g_ptr_array_add(nicknames, lines[i]);
+		}
+		g_free(buf);
+	} else
+		nicknames_generate(argc > 1 ? atoi(argv[1]) : 5000);
+
+	t_strcoll = bench(build_strcoll, &o_strcoll);
+	t_index = bench(build_index, &o_index);
+	t_bulk = bench(build_bulk, &o_bulk);
+
+	printf("%u nicknames, LC_COLLATE=%s\n", nicknames->len, setlocale(LC_COLLATE, NULL));
+	printf("list_add_sorted + strcoll: %10.2f ms\n", t_strcoll);
+	printf("strxfrm + binary search:   %10.2f ms  (x%.1f)  %s\n", t_index, t_strcoll / t_index,
+			same_order(o_strcoll, o_index) ? "same order" : "ORDER DIFFERS");
+	printf("strxfrm + sort + merge:    %10.2f ms  (x%.1f)  %s\n", t_bulk, t_strcoll / t_bulk,
+			same_order(o_strcoll, o_bulk) ? "same order" : "ORDER DIFFERS");
+
+	return 0;
+}
+
@@ -0,0 +1,294 @@
+/*
+ * window_find_sa() benchmark
+ *
+ * opens 300 windows across 20 sessions (with 200 users in every userlist)
+ * and looks them up the way the core does: by target in given session
+ * (window_find_s()), by target in any session (window_find()), by nickname
+ * of user whose window has uid as target, and the other way round, and
+ * for targets without window. compares old window_find_sa() (walk all
+ * windows, then for every session walk all windows again) with index
+ * from ekg/windows_index.inc, and checks that both find the same window.
+ * then renames some windows, like /query or nick changes do, and checks
+ * again.
+ *
+ * userlist_find() is a hash lookup here (like it is in ekg/userlist.c),
+ * it costs the same both ways.
+ *
+ * compile:
+ *	gcc -O2 -o windows_benchmark contrib/windows_benchmark.c -Iekg \
+ *		`pkg-config --cflags --libs glib-2.0`
+ *
+ * usage:
+ *	./windows_benchmark [lookups [windows [sessions]]]
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <glib.h>
+
+#define xstrcasecmp strcasecmp
+#define xstrncmp strncmp
+
+typedef struct {
+	char *uid;
+	char *nickname;
+} userlist_t;
+
+typedef struct session {
+	struct session *next;
+	GHashTable *users;		/* lowercased uid and nickname -> userlist_t */
+} session_t;
+
+typedef struct window {
+	struct window *next;		/* sorted by id */
+	unsigned short id;
+	char *target;
+	session_t *session;
+} window_t;
+
+static session_t *sessions;
+static window_t *windows;
+
+#include "windows_index.inc"
+
+static userlist_t *userlist_find(session_t *s, const char *target) {
+	char *key = g_ascii_strdown(target, -1);
+	userlist_t *u = g_hash_table_lookup(s->users, key);
+
+	g_free(key);
+	return u;
+}
+
+/* window_find_sa() before the index, without __current and friends */
+static window_t *find_old(session_t *session, const char *target, int session_null_means_no_session) {
+	userlist_t *u;
+	window_t *w;
+
+	for (w = windows; w; w = w->next) {
+		if (w->target && ((session == w->session) || (!session && !session_null_means_no_session)) && !xstrcasecmp(target, w->target))
+			return w;
+	}
+
+	if (!session && session_null_means_no_session)
+		return NULL;
+
+	if (xstrncmp(target, "__", 2)) {
+		session_t *s;
+		for (s = sessions; s; s = s->next) {
+			if (session != s && session)
+				continue;
+
+			if (!(u = userlist_find(s, target)))
+				continue;
+
+			for (w = windows; w; w = w->next) {
+				if ((!session || session == w->session) && w->target) {
+					if (u->nickname && !xstrcasecmp(u->nickname, w->target))
+						return w;
+					if (!xstrcasecmp(u->uid, w->target))
+						return w;
+				}
+			}
+		}
+	}
+	return NULL;
+}
+
+/* window_find_sa() from ekg/windows.c */
+static window_t *find_new(session_t *session, const char *target, int session_null_means_no_session) {
+	userlist_t *u;
+	window_t *w;
+	session_t *s;
+
+	if ((w = window_index_find(session, target, (!session && !session_null_means_no_session))))
+		return w;
+
+	if (!session && session_null_means_no_session)
+		return NULL;
+
+	if (!xstrncmp(target, "__", 2))
+		return NULL;
+
+	for (s = sessions; s; s = s->next) {
+		window_t *n;
+
+		if (session != s && session)
+			continue;
+
+		if (!(u = userlist_find(s, target)))
+			continue;
+
+		w = window_index_find(session, u->nickname, !session);
+		n = window_index_find(session, u->uid, !session);
+
+		if (n && (!w || n->id < w->id))
+			w = n;
+		if (w)
+			return w;
+	}
+	return NULL;
+}
+
+static void window_target_set(window_t *w, const char *target) {
+	char *tmp = w->target;
+
+	window_index_remove(w);
+	w->target = g_strdup(target);
+	window_index_add(w);
+	g_free(tmp);
+}
+
+typedef struct {
+	session_t *session;
+	char *target;
+	int snmns;
+} lookup_t;
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* random case, targets are compared case-insensitive */
+static char *mangle(GRand *r, const char *s) {
+	char *p, *res = g_strdup(s);
+
+	for (p = res; *p; p++)
+		if (g_rand_boolean(r))
+			*p = toupper((unsigned char) *p);
+	return res;
+}
+
+static void lookups_make(GRand *r, lookup_t *l, int count, session_t **sess, int nsessions, int nusers) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		int s = g_rand_int_range(r, 0, nsessions), u = g_rand_int_range(r, 0, nusers);
+		char *t;
+
+		switch (g_rand_int_range(r, 0, 6)) {
+			case 0:	 t = g_strdup_printf("xmpp:user%d@s%d.org", u, s); break;		/* uid */
+			case 1:	 t = g_strdup_printf("nick%d_%d", u, s); break;			/* nickname */
+			case 2:	 t = g_strdup_printf("irc:#chan%d", u % 10); break;		/* in many sessions */
+			case 3:	 t = g_strdup_printf("xmpp:user%d@s%d.org", u, (s + 1) % nsessions); break;	/* other session */
+			case 4:	 t = g_strdup_printf("unknown%d", u); break;
+			default: t = g_strdup_printf("xmpp:user%d@s%d.org/home", u, s); break;
+		}
+		l[i].target = mangle(r, t);
+		g_free(t);
+
+		switch (g_rand_int_range(r, 0, 4)) {
+			case 0:	 l[i].session = NULL; l[i].snmns = 0; break;			/* window_find() */
+			case 1:	 l[i].session = NULL; l[i].snmns = 1; break;
+			default: l[i].session = sess[s]; l[i].snmns = 1; break;			/* window_find_s() */
+		}
+	}
+}
+
+static int run(const char *what, lookup_t *l, int count) {
+	window_t **res_old = g_new(window_t *, count), **res_new = g_new(window_t *, count);
+	double t0, t_old, t_new;
+	int i, found = 0, differ = 0;
+
+	t0 = now();
+	for (i = 0; i < count; i++)
+		res_old[i] = find_old(l[i].session, l[i].target, l[i].snmns);
+	t_old = now() - t0;
+
+	t0 = now();
+	for (i = 0; i < count; i++)
+		res_new[i] = find_new(l[i].session, l[i].target, l[i].snmns);
+	t_new = now() - t0;
+
+	for (i = 0; i < count; i++) {
+		if (res_old[i])
+			found++;
+		if (res_old[i] != res_new[i] && differ++ < 10)
+			printf("  %s: %s differs: window %d, index %d\n", what, l[i].target,
+				res_old[i] ? res_old[i]->id : -1, res_new[i] ? res_new[i]->id : -1);
+	}
+
+	printf("%s: %d lookups, %d found\n", what, count, found);
+	printf("  old window_find_sa():  %10.2f ms  (%.3f us/lookup)\n", t_old * 1e3, t_old * 1e6 / count);
+	printf("  index:                 %10.2f ms  (%.3f us/lookup)  x%.0f\n", t_new * 1e3, t_new * 1e6 / count, t_old / t_new);
+
+	g_free(res_old);
+	g_free(res_new);
+	return differ;
+}
+
+int main(int argc, char **argv) {
+	int nlookups = argc > 1 ? atoi(argv[1]) : 100000;
+	int nwindows = argc > 2 ? atoi(argv[2]) : 300;
+	int nsessions = argc > 3 ? atoi(argv[3]) : 20;
+	int nusers = 200, i, j, differ = 0;
+	GRand *r = g_rand_new_with_seed(42);
+	session_t **sess = g_new0(session_t *, nsessions);
+	window_t **wins = g_new0(window_t *, nwindows);
+	lookup_t *l = g_new(lookup_t, nlookups);
+
+	for (i = nsessions - 1; i >= 0; i--) {
+		session_t *s = g_new0(session_t, 1);
+
+		s->users = g_hash_table_new(g_str_hash, g_str_equal);
+		for (j = 0; j < nusers; j++) {
+			userlist_t *u = g_new(userlist_t, 1);
+
+			u->uid = g_strdup_printf("xmpp:user%d@s%d.org", j, i);
+			u->nickname = g_strdup_printf("Nick%d_%d", j, i);
+			g_hash_table_insert(s->users, g_ascii_strdown(u->uid, -1), u);
+			g_hash_table_insert(s->users, g_ascii_strdown(u->nickname, -1), u);
+		}
+		s->next = sessions;
+		sessions = sess[i] = s;
+	}
+
+	/* windows 2.., sessions mixed; talks by uid or by nickname, and channels */
+	for (i = nwindows - 1; i >= 0; i--) {
+		window_t *w = g_new0(window_t, 1);
+		int s = g_rand_int_range(r, 0, nsessions), u = g_rand_int_range(r, 0, nusers);
+
+		w->id = i + 2;
+		w->session = sess[s];
+		switch (g_rand_int_range(r, 0, 3)) {
+			case 0:	 w->target = g_strdup_printf("xmpp:user%d@s%d.org", u, s); break;
+			case 1:	 w->target = g_strdup_printf("Nick%d_%d", u, s); break;
+			default: w->target = g_strdup_printf("irc:#chan%d", u % 10); break;
+		}
+		w->next = windows;
+		windows = wins[i] = w;
+		window_index_add(w);
+	}
+
+	printf("%d windows, %d sessions, %d users in every userlist\n", nwindows, nsessions, nusers);
+
+	lookups_make(r, l, nlookups, sess, nsessions, nusers);
+	differ += run("lookups", l, nlookups);
+
+	/* /query in existing window, nick changes */
+	for (i = 0; i < nwindows / 3; i++) {
+		window_t *w = wins[g_rand_int_range(r, 0, nwindows)];
+		char *t = g_strdup_printf("nick%d_%d", g_rand_int_range(r, 0, nusers), g_rand_int_range(r, 0, nsessions));
+
+		window_target_set(w, t);
+		g_free(t);
+	}
+	differ += run("after renames", l, nlookups);
+
+	for (i = 0; i < nwindows; i++) {
+		window_index_remove(wins[i]);
+		g_free(wins[i]->target);
+		g_free(wins[i]);
+	}
+	printf("%s\n", differ ? "RESULTS DIFFER" : "same windows found");
+	printf("index %s\n", windows_index ? "NOT EMPTY" : "empty");
+
+	return differ ? 1 : 0;
+}
@@ -93,17 +93,149 @@ static void list_command_free(void *_data) {
 	xfree(data);
 }
 
+/*
+ * commands are also kept in case-insensitive prefix tree. every node
+ * knows how many commands are below it, so exact lookup, resolving
+ * abbreviations (and checking if they're ambiguous) costs O(length of name),
+ * no matter how many commands there are. session-specific commands
+ * (e.g. "gg:connect") are just the subtree under "gg:".
+ */
+typedef struct command_node {
+	struct command_node *child;	/* first child, siblings sorted by ch */
+	struct command_node *next;	/* next sibling */
+	GSList *cmds;			/* commands with exactly that name, most recently added first */
+	guint count;			/* number of commands in this subtree */
+	unsigned char ch;
+} command_node_t;
+
+static command_node_t commands_trie;
+
+static command_node_t *command_node_child(command_node_t *n, char c, int create) {
+	const unsigned char ch = xtolower(c);
+	command_node_t **p = &n->child;
+	command_node_t *child;
+
+	while (*p && (*p)->ch < ch)
+		p = &(*p)->next;
+
+	if (*p && (*p)->ch == ch)
+		return *p;
+
+	if (!create)
+		return NULL;
+
+	child = xmalloc(sizeof(command_node_t));
+	child->ch = ch;
+	child->next = *p;
+	*p = child;
+
+	return child;
+}
+
+static command_node_t *command_node_find(command_node_t *n, const char *name, size_t len) {
+	size_t i;
+
+	for (i = 0; n && i < len && name[i]; i++)
+		n = command_node_child(n, name[i], 0);
+
+	return n;
+}
+
+static int command_node_remove(command_node_t *n, const char *name, command_t *c) {
+	if (!*name) {
+		if (!g_slist_find(n->cmds, c))
+			return 0;
+		n->cmds = g_slist_remove(n->cmds, c);
+	} else {
+		const unsigned char ch = xtolower(*name);
+		command_node_t **p = &n->child;
+		command_node_t *child;
+
+		while (*p && (*p)->ch < ch)
+			p = &(*p)->next;
+
+		if (!(child = *p) || child->ch != ch || !command_node_remove(child, name + 1, c))
+			return 0;
+
+		if (!child->count) {
+			*p = child->next;
+			xfree(child);
+		}
+	}
+
+	n->count--;
+	return 1;
+}
+
+/* first command (in sorted order) of subtree, the only one if n->count == 1 */
+static command_t *command_node_first(command_node_t *n) {
+	while (n && !n->cmds)
+		n = n->child;
+
+	return n ? n->cmds->data : NULL;
+}
+
+static void command_node_foreach(command_node_t *n, GFunc func, gpointer user_data) {
+	command_node_t *child;
+
+	g_slist_foreach(n->cmds, func, user_data);
+
+	for (child = n->child; child; child = child->next)
+		command_node_foreach(child, func, user_data);
+}
+
+static void command_node_free(command_node_t *n) {
+	command_node_t *child, *next;
+
+	for (child = n->child; child; child = next) {
+		next = child->next;
+		command_node_free(child);
+		xfree(child);
+	}
+
+	g_slist_free(n->cmds);
+}
+
+/**
+ * command_foreach_prefix()
+ *
+ * Calls @a func for every command which name starts with first @a len chars
+ * of @a text (case-insensitive), in the same order as they're on commands list.
+ * @a func must not add or remove commands.
+ */
+void command_foreach_prefix(const char *text, size_t len, GFunc func, gpointer user_data) {
+	command_node_t *n = command_node_find(&commands_trie, text, len);
+
+	if (n)
+		command_node_foreach(n, func, user_data);
+}
+
 static void commands_add(command_t *c) {
+	command_node_t *n = &commands_trie;
+	const char *p;
+
 	commands = g_slist_insert_sorted(commands, c, command_compare);
+
+	n->count++;
+	for (p = c->name; *p; p++) {
+		n = command_node_child(n, *p, 1);
+		n->count++;
+	}
+	n->cmds = g_slist_prepend(n->cmds, c);
 }
 
 void commands_remove(command_t *c) {
 	commands = g_slist_remove(commands, c);
+	command_node_remove(&commands_trie, c->name, c);
 	list_command_free(c);
 }
 
 void commands_destroy() {
 	g_slist_free_full(commands, list_command_free);
+	commands = NULL;
+
+	command_node_free(&commands_trie);
+	memset(&commands_trie, 0, sizeof(commands_trie));
 }
 
 /*
@@ -332,6 +464,7 @@ COMMAND(cmd_add) {
 	if (u) {
 		xfree(u->nickname);
 		u->nickname = xstrdup(params[1]);
+		userlist_replace(session, u);
 	}
 
 	if (u || userlist_add(session, params[0], params[1])) {
@@ -1913,16 +2046,15 @@ static COMMAND(cmd_debug_plugins) {
 static COMMAND(cmd_debug_watches)
 {
 	char buf[256];
-	list_t l;
+	watch_t *w;
 	
 	printq("generic_bold", ("fd	wa   plugin  pers tout	started     rm"));
 	
-	for (l = watches; l; l = l->next) {
+	for (w = watches; w; w = w->next) {
 		char *plugin;
 		char wa[4];
-		watch_t *w = l->data;
 
-		if (!w)
+		if (w->destroyed)
 			continue;
 
 		xstrcpy(wa, "");
@@ -2377,13 +2509,13 @@ next:
 			}
 
 			if (w) {
-				w->target = xstrdup(par0);				/* new target */
+				window_target_set(w, par0);				/* new target */
 				w->session = session;					/* change session */
 				query_emit(NULL, "ui-window-target-changed", &w);	/* notify ui-plugin */
 			}
 		} else if (!(config_make_window & 2) && window_current /* && window_current->id >1 && !window_current->floating */) {
 			w = window_current;
-			xfree(w->target);	w->target = xstrdup(par0);		/* change target */
+			window_target_set(w, par0);				/* change target */
 			w->session = session;						/* change session */
 			query_emit(NULL, "ui-window-target-changed", &w);		/* notify ui-plugin */
 		}
@@ -2439,12 +2571,12 @@ int command_exec(const char *target, session_t *session, const char *xline, int
 	/* TODO: what does the "last" prefix stand for? */
 	command_t *last_command = NULL;
 	command_t *last_command_plugin = NULL; /* unneeded, but someone wrote it as if it would be necessary one day, so we leave it here */
-	int abbrs = 0;	/* 1 if the post-prefix part of command was spelled out fully, e.g. user entered "disconnect" while the command is "gg:disconnect" */
-	int abbrs_plugins = 0;
+	int abbrs = 0;	/* number of commands matching (1 if spelled out fully) */
+	int abbrs_plugins = 0;	/* the same, for commands prefixed with session's prefix, e.g. user entered "disconnect" while the command is "gg:disconnect" */
 
 	int exact = 0;
 
-	GSList *cl;
+	command_node_t *n;
 
 	if (!xline)
 		return 0;
@@ -2453,20 +2585,16 @@ int command_exec(const char *target, session_t *session, const char *xline, int
 	if (target && *xline != '/') {
 		int correct_command = 0;
 	
-		/* detection of commands entered by mistake */
+		/* detection of commands entered by mistake: first word (at least 3 chars) is a command name */
 		if (config_query_commands) {
-			for (cl = commands; cl; cl = cl->next) {
-				command_t *c = cl->data;
-				size_t l = xstrlen(c->name);
+			size_t l;
 
-				if (l < 3 || xstrncasecmp(xline, c->name, l))
-					continue;
-				
-				if (!xline[l] || xisspace(xline[l])) {
+			for (n = &commands_trie, l = 0; xline[l] && (n = command_node_child(n, xline[l], 0)); l++) {
+				if (l + 1 >= 3 && n->cmds && (!xline[l + 1] || xisspace(xline[l + 1]))) {
 					correct_command = 1;
 					break;
 				}
-			}		
+			}
 		}
 
 		if (!correct_command)
@@ -2497,13 +2625,10 @@ int command_exec(const char *target, session_t *session, const char *xline, int
 
 	/* Check if this is a special one-character command. These are special
 	 * because they do not require whitespace to separate them from their arguments. */
-	for (cl = commands; cl; cl = cl->next) {
-		command_t *c = cl->data;
-		if (!isalpha_pl_PL(c->name[0]) && xstrlen(c->name) == 1 && line[0] == c->name[0]) {
-			short_cmd[0] = c->name[0];
-			cmd = short_cmd;
-			p = line + 1;
-		}
+	if (line[0] && !isalpha_pl_PL(line[0]) && (n = command_node_find(&commands_trie, line, 1)) && n->cmds) {
+		short_cmd[0] = line[0];
+		cmd = short_cmd;
+		p = line + 1;
 	}
 	/* Separate command from arguments if not. */
 	if (!cmd) {
@@ -2524,51 +2649,34 @@ int command_exec(const char *target, session_t *session, const char *xline, int
 		session = session_current;
 	if (session && session->uid) {
 		int prefix_len = (int)(xstrchr(session->uid, ':') - session->uid) + 1;
-		
-		for (cl = commands; cl; cl = cl->next) {
-			command_t *c = cl->data;
-			/* Consider commands prefixed with current session's prefix. */
-			if (xstrncasecmp(c->name, session->uid, prefix_len))
-				continue;
-			/* Look for fully spelled out command. */
-			if (!xstrcasecmp(c->name + prefix_len, cmd)) {
-				last_command = c;
+
+		/* Consider commands prefixed with current session's prefix. */
+		if ((n = command_node_find(&commands_trie, session->uid, prefix_len)) && (n = command_node_find(n, cmd, cmdlen))) {
+			if (n->cmds) {
+				/* Fully spelled out command. */
+				last_command = n->cmds->data;
 				abbrs = 1;
 				exact = 1;
-				break;
-			}
-			/* Fall back to the first matching prefix. */
-			if (!xstrncasecmp(c->name + prefix_len, cmd, cmdlen)) {
-				last_command_plugin = c;
-				abbrs_plugins++;
 			} else {
-				/* TODO: document what this does */
-				if (last_command_plugin && abbrs_plugins == 1)
-					break;
-			} 
+				/* Abbreviation, usable only if unambiguous. */
+				last_command_plugin = command_node_first(n);
+				abbrs_plugins = n->count;
+			}
 		}
 	}
 	/* If needed, fall back to non-session-specific commands. */
-	if (!exact) {
-		for (cl = commands; cl; cl = cl->next) {
-			command_t *c = cl->data;
-			if (!xstrcasecmp(c->name, cmd)) {
-				last_command = c;
-				abbrs = 1;
-				exact = 1;
-				/* if this is exact_match we should zero those below, they won't be used */
-				abbrs_plugins = 0; 
-				last_command_plugin = NULL;
-				break;
-			}
-			if (!xstrncasecmp(c->name, cmd, cmdlen)) {
-				last_command = c;
-				abbrs++;
-			} else {
-				if (last_command && abbrs == 1)
-					break;
-			}
-		} 
+	if (!exact && (n = command_node_find(&commands_trie, cmd, cmdlen))) {
+		if (n->cmds) {
+			last_command = n->cmds->data;
+			abbrs = 1;
+			exact = 1;
+			/* if this is exact_match we should zero those below, they won't be used */
+			abbrs_plugins = 0; 
+			last_command_plugin = NULL;
+		} else {
+			last_command = command_node_first(n);
+			abbrs = n->count;
+		}
 	}
 /*	debug("%x %x\n", last_command, last_command_plugin);	*/
 
@@ -2708,7 +2816,10 @@ int command_exec(const char *target, session_t *session, const char *xline, int
 		}
 
 		quiet = quiet & 2;
-		printq("unknown_command", cmd);	/* display warning, if !(quiet & 2) */
+		if (abbrs + abbrs_plugins > 1)
+			printq("ambiguous_command", cmd);	/* display warning, if !(quiet & 2) */
+		else
+			printq("unknown_command", cmd);
 	}
 
 	xfree(line_save);
@@ -3755,7 +3866,7 @@ void command_init()
 	  "-c --clear");
 
 	command_add(NULL, ("script")	    , ("p ?"),	cmd_script, 0, 
-	  "--list --load --unload --varlist --reset"); /* todo	?!!? */
+	  "--list --load --unload --varlist --reset --profile"); /* todo	?!!? */
 
 	command_add(NULL, ("script:autorun"), ("?"),	cmd_script, 0, "");
 	  
@@ -3763,6 +3874,8 @@ void command_init()
 
 	command_add(NULL, ("script:load")   , ("f"),	cmd_script, 0, "");
 
+	command_add(NULL, ("script:profile"), ("?"),	cmd_script, 0, "");
+
 	command_add(NULL, ("script:reset")  , ("?"),	cmd_script, 0, "");
 
 	command_add(NULL, ("script:unload") , ("?"),	cmd_script, 0, "");
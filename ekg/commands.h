@@ -81,6 +81,7 @@ command_t *command_find (const char *name);
 void command_init();
 void commands_remove(command_t *c);
 void commands_destroy();
+void command_foreach_prefix(const char *text, size_t len, GFunc func, gpointer user_data);
 int command_exec(const char *target, session_t *session, const char *line, int quiet);
 int command_exec_params(const char *target, session_t *session, int quiet, const char *command, ...);
 int command_exec_format(const char *target, session_t *session, int quiet, const char *format, ...);
@@ -30,6 +30,9 @@
 
 char **ekg2_completions = NULL;
 static char **completions = NULL;	/* lista dopenie */
+static int completions_count = 0;
+static int completions_size = 0;
+static GHashTable *completions_seen = NULL;	/* completions already on list */
 static char *last_line = NULL;
 static char *last_line_without_complete = NULL;
 static int last_pos = -1;
@@ -38,44 +41,94 @@ int continue_complete_count = 0;
 command_t *actual_completed_command;
 session_t *session_in_line;
 
+/*
+ * completion_add()
+ *
+ * adds string to completions (and takes it over), unless it's already there.
+ * generators can produce thousands of candidates (big irc channels), so
+ * unlike array_add_check() it neither scans whole list for duplicates,
+ * nor counts its length on each call.
+ */
+static void completion_add(char *string)
+{
+	if (!completions) {
+		/* new list, anything remembered refers to the old one */
+		completions_count = 0;
+		completions_size = 0;
+		if (completions_seen)
+			g_hash_table_remove_all(completions_seen);
+		else
+			completions_seen = g_hash_table_new(g_str_hash, g_str_equal);
+	}
+
+	if (g_hash_table_lookup(completions_seen, string)) {
+		xfree(string);
+		return;
+	}
+
+	if (completions_count + 1 >= completions_size) {
+		completions_size = completions_size ? completions_size * 2 : 16;
+		completions = xrealloc(completions, completions_size * sizeof(char *));
+	}
+
+	completions[completions_count++] = string;
+	completions[completions_count] = NULL;
+	g_hash_table_insert(completions_seen, string, string);
+}
+
+struct command_generator_data {
+	const char *slash, *dash;
+	const char *text;	/* what user typed */
+	int len;
+	int plen;		/* length of session's prefix, stripped from names */
+};
+
+static void command_generator_add(gpointer data, gpointer user_data)
+{
+	command_t *c = data;
+	struct command_generator_data *d = user_data;
+
+	/* session-specific command already completed with full name */
+	if (d->plen && !xstrncasecmp(d->text, c->name, d->len))
+		return;
+
+	completion_add(saprintf(("%s%s%s"), d->slash, d->dash, c->name + d->plen));
+}
+
 static void command_generator(const char *text, int len)
 {
-	const char *slash = (""), *dash = ("");
-	GSList *cl;
+	struct command_generator_data d;
 	session_t *session = session_current;
+
+	d.slash = ("");
+	d.dash = ("");
 	if (*text == ('/')) {
-		slash = ("/");
+		d.slash = ("/");
 		text++;
 		len--;
 	}
 
 	if (*text == ('^')) {
-		dash = ("^");
+		d.dash = ("^");
 		text++;
 		len--;
 	}
 
 	if (window_current->target)
-		slash = ("/");
-
-	for (cl = commands; cl; cl = cl->next) {
-		command_t *c = cl->data;
-		char *without_sess_id = NULL;
-		int plen = 0;
-		if (session && session->uid)
-			plen = (int)(xstrchr(session->uid, ':') - session->uid) + 1;
-
-		if (session && !xstrncasecmp(c->name, session->uid, plen))
-			without_sess_id = xstrchr(c->name, ':');
-
-		if (!xstrncasecmp(text, c->name, len) && !array_item_contains(completions, c->name, 1))
-			array_add_check(&completions, 
-					saprintf(("%s%s%s"), slash, dash, c->name),
-					1);
-		else if (without_sess_id && !array_item_contains(completions, without_sess_id + 1, 1) && !xstrncasecmp(text, without_sess_id + 1, len))
-			array_add_check(&completions, 
-					saprintf(("%s%s%s"), slash, dash, without_sess_id + 1),
-					1);
+		d.slash = ("/");
+
+	d.text = text;
+	d.len = len;
+	d.plen = 0;
+
+	command_foreach_prefix(text, len, command_generator_add, &d);
+
+	/* commands of current session, without "xxx:" prefix */
+	if (session && session->uid && (d.plen = (int)(xstrchr(session->uid, ':') - session->uid) + 1) > 0) {
+		char *prefix = saprintf("%.*s%.*s", d.plen, session->uid, len, text);
+
+		command_foreach_prefix(prefix, xstrlen(prefix), command_generator_add, &d);
+		xfree(prefix);
 	}
 }
 
@@ -84,7 +137,7 @@ static void events_generator(const char *text, int len)
 	int i;
 	for (i = 0; events_all && events_all[i]; i++)
 		if (!xstrncasecmp(text, events_all[i], len))
-			array_add_check(&completions, xstrdup(events_all[i]), 1);
+			completion_add(xstrdup(events_all[i]));
 }
 
 static void ignorelevels_generator(const char *text, int len)
@@ -107,7 +160,7 @@ static void ignorelevels_generator(const char *text, int len)
 
 	for (i = 0; ignore_labels[i].name; i++)
 		if (!xstrncasecmp(tmp, ignore_labels[i].name, len))
-			array_add_check(&completions, ((tmp == text) ? xstrdup(ignore_labels[i].name) : saprintf("%s%s", pre, ignore_labels[i].name)), 1);
+			completion_add(((tmp == text) ? xstrdup(ignore_labels[i].name) : saprintf("%s%s", pre, ignore_labels[i].name)));
 	xfree(pre);
 }
 
@@ -117,15 +170,30 @@ static void unknown_uin_generator(const char *text, int len)
 	
 	for (i = 0; i < send_nicks_count; i++) {
 		if (send_nicks[i] && xstrchr(send_nicks[i], ':') && xisdigit(xstrchr(send_nicks[i], ':')[1]) && !xstrncasecmp(text, send_nicks[i], len)) {
-			array_add_check(&completions, xstrdup(send_nicks[i]), 1);
+			completion_add(xstrdup(send_nicks[i]));
 		}
 	}
 }
 
+struct known_uin_data {
+	const char *session_name;	/* if set, complete as "session_name/name" */
+	int found;
+};
+
+static void known_uin_add(userlist_t *u, const char *name, void *data)
+{
+	struct known_uin_data *d = data;
+
+	if (d->session_name)
+		completion_add(saprintf(("%s/%s"), d->session_name, name));
+	else
+		completion_add(xstrdup(name));
+	d->found = 1;
+}
+
 static void known_uin_generator(const char *text, int len)
 {
-	int done = 0;
-	userlist_t *ul;
+	struct known_uin_data plain = { NULL, 0 }, prefixed = { NULL, 0 };
 	session_t *s;
 	char *tmp = NULL, *session_name = NULL;
 	int tmp_len = 0;
@@ -144,47 +212,26 @@ static void known_uin_generator(const char *text, int len)
 		if (session_find(session_name))
 			s = session_find(session_name);
 	}
+	prefixed.session_name = session_name;
 
-	for (ul = s->userlist; ul; ul = ul->next) {
-		userlist_t *u = ul;
-		if (u->nickname && !xstrncasecmp(text, u->nickname, len)) {
-			array_add_check(&completions, xstrdup(u->nickname), 1);
-			done = 1;
-		}
-		
-		if (u->nickname && tmp && !xstrncasecmp(tmp, u->nickname, tmp_len)) { 
-			array_add_check(&completions, saprintf(("%s/%s"), session_name, u->nickname), 1);
-			done = 1;
-		}
-	}
-
-	for (ul = s->userlist; ul; ul = ul->next) {
-		userlist_t *u = ul;
+	/* nicknames first, uids only if no nickname matches */
+	userlist_index_foreach(&s->userlist, text, len, USERLIST_INDEX_NICKNAME, known_uin_add, &plain);
+	if (tmp)
+		userlist_index_foreach(&s->userlist, tmp, tmp_len, USERLIST_INDEX_NICKNAME, known_uin_add, &prefixed);
 
-		if (!done && !xstrncasecmp(text, u->uid, len)) {
-			array_add_check(&completions, xstrdup(u->uid), 1);
-		}
-		if (!done && tmp && !xstrncasecmp(tmp, u->uid, tmp_len)) 
-		       array_add_check(&completions, saprintf(("%s/%s"), session_name, u->uid), 1);
+	if (!plain.found && !prefixed.found) {
+		userlist_index_foreach(&s->userlist, text, len, USERLIST_INDEX_UID, known_uin_add, &plain);
+		if (tmp)
+			userlist_index_foreach(&s->userlist, tmp, tmp_len, USERLIST_INDEX_UID, known_uin_add, &prefixed);
 	}
 
 	if (!window_current) 
 		goto end;
 
-	if ((c = newconference_find(window_current->session, window_current->target)))	ul = c->participants;
-	else										ul = window_current->userlist;
-
-	for (; ul; ul = ul->next) {
-		userlist_t *u = ul;
-
-		if (u->uid && !xstrncasecmp(text, u->uid, len)) {
-			array_add_check(&completions, xstrdup(u->uid), 1);
-		}
-
-		if (u->nickname && !xstrncasecmp(text, u->nickname, len)) {
-			array_add_check(&completions, xstrdup(u->nickname), 1);
-		}
-	} 
+	if ((c = newconference_find(window_current->session, window_current->target)))
+		userlist_index_foreach(&c->participants, text, len, USERLIST_INDEX_UID | USERLIST_INDEX_NICKNAME, known_uin_add, &plain);
+	else
+		userlist_index_foreach(&window_current->userlist, text, len, USERLIST_INDEX_UID | USERLIST_INDEX_NICKNAME, known_uin_add, &plain);
 
 end:
 	if (session_name)
@@ -197,7 +244,7 @@ static void conference_generator(const char *text, int len)
 
 	for (c = newconferences; c; c = c->next) {
 		if (!xstrncasecmp(text, c->name, len))
-			array_add_check(&completions, xstrdup(c->name), 1);
+			completion_add(xstrdup(c->name));
 	}
 }
 
@@ -208,11 +255,11 @@ static void plugin_generator(const char *text, int len)
 	for (pl = plugins; pl; pl = pl->next) {
 		const plugin_t *p = pl->data;
 		if (!xstrncasecmp(text, p->name, len)) {
-			array_add_check(&completions, xstrdup(p->name), 1);
+			completion_add(xstrdup(p->name));
 		}
 		if ((text[0] == '+' || text[0] == '-') && !xstrncasecmp(text + 1, p->name, len - 1)) {
 			char *tmp = saprintf(("%c%s"), text[0], p->name);
-			array_add_check(&completions, tmp, 1);
+			completion_add(tmp);
 		}
 	}
 }
@@ -227,12 +274,10 @@ static void variable_generator(const char *text, int len)
 			continue;
 		if (*text == '-') {
 			if (!xstrncasecmp(text + 1, v->name, len - 1))
-				array_add_check(&completions, 
-				saprintf("-%s", v->name),
-				1);
+				completion_add(saprintf("-%s", v->name));
 		} else {
 			if (!xstrncasecmp(text, v->name, len)) {
-				array_add_check(&completions, xstrdup(v->name), 1);
+				completion_add(xstrdup(v->name));
 			}
 		}
 	}
@@ -256,10 +301,10 @@ static void ignored_uin_generator(const char *text, int len)
 
 		if (!u->nickname) {
 			if (!xstrncasecmp(text, u->uid, len))
-				array_add_check(&completions, xstrdup(u->uid), 1);
+				completion_add(xstrdup(u->uid));
 		} else {
 			if (u->nickname && !xstrncasecmp(text, u->nickname, len))
-				array_add_check(&completions, xstrdup(u->nickname), 1);
+				completion_add(xstrdup(u->nickname));
 		}
 	}
 }
@@ -282,10 +327,10 @@ static void blocked_uin_generator(const char *text, int len)
 
 		if (!u->nickname) {
 			if (!xstrncasecmp(text, u->uid, len))
-				array_add_check(&completions, xstrdup(u->uid), 1);
+				completion_add(xstrdup(u->uid));
 		} else {
 			if (u->nickname && !xstrncasecmp(text, u->nickname, len))
-				array_add_check(&completions, xstrdup(u->nickname), 1);
+				completion_add(xstrdup(u->nickname));
 		}
 	}
 }
@@ -372,7 +417,7 @@ static void dir_generator(const char *text, int len)
 
 		if (!strncmp(name, fname, xstrlen(fname))) {
 			name = saprintf("%s%s%s", (dname) ? dname : "", name, "/");
-			array_add_check(&completions, name, 1);
+			completion_add(name);
 		}
 
 		xfree(namelist[i]);
@@ -458,7 +503,7 @@ again:
 
 		if (!strncmp(name, fname, xstrlen(fname))) {
 			name = saprintf("%s%s%s", (dname) ? dname : "", name, (isdir) ? "/" : "");
-			array_add_check(&completions, name, 1);
+			completion_add(name);
 		}
 
 		xfree(namelist[i]);
@@ -523,7 +568,7 @@ static void theme_generator_adding(const char *text, int len, const char *dname,
 		tmp2 = xstrndup(name, xstrlen(name) - xstrlen(xstrstr(name, ".theme")));
 		
 		if (!xstrncmp(text, name, len) || (!xstrncmp(text, tmp2, len) && !themes_only) )
-			array_add_check(&completions, tmp2, 1);
+			completion_add(tmp2);
 		else	xfree(tmp2);
 
 		xfree(namelist[i]);
@@ -551,7 +596,7 @@ static void possibilities_generator(const char *text, int len)
 
 	for (i = 0; c && c->possibilities && c->possibilities[i]; i++)
 		if (!xstrncmp(text, c->possibilities[i], len)) {
-			array_add_check(&completions, xstrdup(c->possibilities[i]), 1);
+			completion_add(xstrdup(c->possibilities[i]));
 		}
 }
 
@@ -563,7 +608,7 @@ static void window_generator(const char *text, int len)
 		if (!w->target || xstrncmp(text, w->target, len))
 			continue;
 
-		array_add_check(&completions, xstrdup(w->target), 0);
+		completion_add(xstrdup(w->target));
 	}
 }
 
@@ -574,14 +619,14 @@ static void sessions_generator(const char *text, int len)
 	for (v = sessions; v; v = v->next) {
 		if (*text == '-') {
 			if (!xstrncasecmp(text + 1, v->uid, len - 1))
-				array_add_check(&completions, saprintf("-%s", v->uid), 1);
+				completion_add(saprintf("-%s", v->uid));
 			if (!xstrncasecmp(text + 1, v->alias, len - 1))
-				array_add_check(&completions, saprintf("-%s", v->alias), 1);
+				completion_add(saprintf("-%s", v->alias));
 		} else {
 			if (!xstrncasecmp(text, v->uid, len))
-				array_add_check(&completions, xstrdup(v->uid), 1);
+				completion_add(xstrdup(v->uid));
 			if (!xstrncasecmp(text, v->alias, len))
-				array_add_check(&completions, xstrdup(v->alias), 1);
+				completion_add(xstrdup(v->alias));
 		}
 	}
 }
@@ -592,7 +637,7 @@ static void metacontacts_generator(const char *text, int len)
 
 	for (m = metacontacts; m; m = m->next) {
 		if (!xstrncasecmp(text, m->name, len)) 
-			array_add_check(&completions, xstrdup(m->name), 1);
+			completion_add(xstrdup(m->name));
 	}
 }
 
@@ -615,10 +660,10 @@ static void sessions_var_generator(const char *text, int len)
 	for (i = 0; (p->params[i].key /* && p->params[i].id != -1 */); i++) {
 		if(*text == '-') {
 			if (!xstrncasecmp(text + 1, p->params[i].key, len - 1))
-				array_add_check(&completions, saprintf(("-%s"), p->params[i].key), 1);
+				completion_add(saprintf(("-%s"), p->params[i].key));
 		} else {
 			if (!xstrncasecmp(text, p->params[i].key, len)) {
-				array_add_check(&completions, xstrdup(p->params[i].key), 1);
+				completion_add(xstrdup(p->params[i].key));
 			}
 		}
 	}
@@ -629,7 +674,7 @@ static void reason_generator(const char *text, int len)
 	char *descr = session_current ? session_current->descr : NULL;
 	if (descr && !xstrncasecmp(text, descr, len)) {
 		/* not to good solution to avoid descr changing by complete */
-		array_add_check(&completions, saprintf(("\001%s"), session_current->descr), 1);
+		completion_add(saprintf(("\001%s"), session_current->descr));
 	}
 }
 
@@ -893,6 +938,7 @@ int ekg2_complete(int *line_start, int *line_index, char *line, int line_maxlen)
 		*line_index = xstrlen(line);
 
 		g_strfreev(completions);
+		completions = NULL;
 		g_strfreev(words);
 		xfree(start);
 		xfree(separators);
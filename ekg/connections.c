@@ -50,6 +50,11 @@ struct ekg_connection {
 
 	GString *wr_buffer;
 
+	gboolean flush_pending;		/* in pending_flushes, waiting for ekg_connections_flush() */
+	guint writes;			/* ekg_connection_write_buf() calls */
+	guint flushes;			/* flush_handler calls */
+	guint sock_writes;		/* flushes of socket stream (async writes) */
+
 #if NEED_SLAVERY
 	struct ekg_connection *master;
 	struct ekg_connection *slave;
@@ -58,7 +63,23 @@ struct ekg_connection {
 
 static GSList *connections = NULL;
 
+/*
+ * writes are coalesced: ekg_connection_write_buf() only puts data into
+ * buffered stream and marks connection as pending. all pending connections
+ * are flushed once, when main loop becomes idle, or at most after
+ * config_connection_flush_delay ms, if it doesn't.
+ */
+static GSList *pending_flushes = NULL;
+static guint pending_idle_id = 0;
+static guint pending_timeout_id = 0;
+
+#define EKG_CONNECTION_QUARK ekg_connection_quark()
+static G_GNUC_CONST GQuark ekg_connection_quark() {
+	return g_quark_from_static_string("ekg-connection");
+}
+
 static void setup_async_read(struct ekg_connection *c);
+static void ekg_connection_flush(struct ekg_connection *c);
 static gboolean setup_async_connect(GSocketClient *sock, struct ekg_connection_starter *cs);
 
 #ifdef HAVE_LIBGNUTLS
@@ -84,7 +105,14 @@ static void ekg_connection_remove(struct ekg_connection *c) {
 #endif
 
 	connections = g_slist_remove(connections, c);
+		/* don't lose what was written just before disconnect */
+	if (c->flush_pending)
+		ekg_connection_flush(c);
 
+	debug_function("ekg_connection_remove(%x) %u writes, %u flushes, %u socket writes\n",
+			c, c->writes, c->flushes, c->sock_writes);
+
+	g_object_set_qdata(G_OBJECT(c->outstream), EKG_CONNECTION_QUARK, NULL);
 	g_string_free(c->wr_buffer, TRUE);
 	g_object_unref(c->cancellable);
 	g_object_unref(c->instream);
@@ -93,16 +121,7 @@ static void ekg_connection_remove(struct ekg_connection *c) {
 }
 
 static struct ekg_connection *get_connection_by_outstream(GDataOutputStream *s) {
-	GSList *el;
-
-	gint conn_find_outstream(gconstpointer list_elem, gconstpointer comp_elem) {
-		const struct ekg_connection *c = list_elem;
-
-		return c->outstream == comp_elem ? 0 : -1;
-	}
-
-	el = g_slist_find_custom(connections, s, conn_find_outstream);
-	return el ? el->data : NULL;
+	return g_object_get_qdata(G_OBJECT(s), EKG_CONNECTION_QUARK);
 }
 
 #if NEED_SLAVERY
@@ -181,6 +200,13 @@ static void done_async_write(GObject *obj, GAsyncResult *res, gpointer user_data
 
 	ret = g_output_stream_flush_finish(of, res, &err);
 
+		/* connection was removed while flush was in progress */
+	if (get_connection_by_outstream(G_DATA_OUTPUT_STREAM(of)) != c) {
+		if (!ret)
+			g_error_free(err);
+		return;
+	}
+
 	if (!ret) {
 		debug_error("done_async_write(), write failed: %s\n", err ? err->message : NULL);
 		/* XXX */
@@ -204,6 +230,7 @@ static void done_async_write(GObject *obj, GAsyncResult *res, gpointer user_data
 }
 
 static void setup_async_write(struct ekg_connection *c) {
+	c->sock_writes++;
 	g_output_stream_flush_async(
 			G_OUTPUT_STREAM(c->outstream),
 			G_PRIORITY_DEFAULT,
@@ -259,6 +286,10 @@ GDataOutputStream *ekg_connection_add(
 		/* disallow any blocking writes */
 	g_buffered_output_stream_set_auto_grow(G_BUFFERED_OUTPUT_STREAM(bout), TRUE);
 
+	c->flush_pending = FALSE;
+	c->writes = c->flushes = c->sock_writes = 0;
+	g_object_set_qdata(G_OBJECT(c->outstream), EKG_CONNECTION_QUARK, c);
+
 	connections = g_slist_prepend(connections, c);
 #if NEED_SLAVERY
 	if (G_LIKELY(!c->master))
@@ -281,6 +312,57 @@ void ekg_disconnect_by_outstream(GDataOutputStream *f) {
 	ekg_connection_remove(c);
 }
 
+static void ekg_connection_flush(struct ekg_connection *c) {
+	if (c->flush_pending) {
+		pending_flushes = g_slist_remove(pending_flushes, c);
+		c->flush_pending = FALSE;
+	}
+
+		/* flush in progress will be followed by another one
+		 * from done_async_write(), if needed */
+	if (g_output_stream_has_pending(G_OUTPUT_STREAM(c->outstream)))
+		return;
+
+	c->flushes++;
+	c->flush_handler(c);
+}
+
+static gboolean ekg_connections_flush(gpointer data) {
+	if (pending_idle_id) {
+		g_source_remove(pending_idle_id);
+		pending_idle_id = 0;
+	}
+	if (pending_timeout_id) {
+		g_source_remove(pending_timeout_id);
+		pending_timeout_id = 0;
+	}
+
+		/* flushing tls connection writes to its master,
+		 * so it may be appended to the list meanwhile */
+	while (pending_flushes)
+		ekg_connection_flush(pending_flushes->data);
+
+	return FALSE;
+}
+
+static void ekg_connection_schedule_flush(struct ekg_connection *c) {
+	if (config_connection_flush_delay <= 0) {
+		ekg_connection_flush(c);
+		return;
+	}
+
+	if (c->flush_pending)
+		return;
+
+	c->flush_pending = TRUE;
+	pending_flushes = g_slist_prepend(pending_flushes, c);
+
+	if (!pending_idle_id)
+		pending_idle_id = g_idle_add(ekg_connections_flush, NULL);
+	if (!pending_timeout_id)
+		pending_timeout_id = g_timeout_add(config_connection_flush_delay, ekg_connections_flush, NULL);
+}
+
 void ekg_connection_write_buf(GDataOutputStream *f, gconstpointer buf, gsize len) {
 	struct ekg_connection *c = get_connection_by_outstream(f);
 	GError *err = NULL;
@@ -306,7 +388,8 @@ void ekg_connection_write_buf(GDataOutputStream *f, gconstpointer buf, gsize len
 
 	debug_function("ekg_connection_write_buf(), wrote %d bytes\n", out);
 
-	c->flush_handler(c);
+	c->writes++;
+	ekg_connection_schedule_flush(c);
 }
 
 void ekg_connection_write(GDataOutputStream *f, const gchar *format, ...) {
@@ -324,7 +407,7 @@ void ekg_connection_write(GDataOutputStream *f, const gchar *format, ...) {
 		ekg_connection_write_buf(f, buf->str, buf->len);
 	} else {
 		struct ekg_connection *c = get_connection_by_outstream(f);
-		c->flush_handler(c);
+		ekg_connection_flush(c);
 	}
 }
 
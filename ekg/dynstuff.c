@@ -372,6 +372,156 @@ void *list_unlink3(list_t *list, list_t elem) {
 	return ret;
 }
 
+/*
+ * dlist_*()
+ *
+ * doubly linked *3() lists, see struct dlist in dynstuff.h.
+ * unlink/remove don't check if element is on given list (that's
+ * what makes them O(1)), only if it's on any list at all.
+ */
+
+void *dlist_add_beginning(dlist_t *list, dlist_t new_) {
+	if (!list) {
+		errno = EFAULT;
+		return NULL;
+	}
+
+	if ((new_->next = *list)) {
+		new_->prev = (*list)->prev;
+		(*list)->prev = new_;
+	} else
+		new_->prev = new_;
+	*list = new_;
+
+	return new_;
+}
+
+void *dlist_add(dlist_t *list, dlist_t new_) {
+	if (!list) {
+		errno = EFAULT;
+		return NULL;
+	}
+
+	if (!*list)
+		return dlist_add_beginning(list, new_);
+
+	new_->next = NULL;
+	new_->prev = (*list)->prev;
+	(*list)->prev->next = new_;
+	(*list)->prev = new_;
+
+	return new_;
+}
+
+/* like list_add_sorted3(): new element goes before equal ones */
+void *dlist_add_sorted(dlist_t *list, dlist_t new_, int (*comparision)(void *, void *)) {
+	dlist_t tmp;
+
+	if (!list) {
+		errno = EFAULT;
+		return NULL;
+	}
+
+		/* common case: lists sorted by id, uid... grow at the end */
+	if (!comparision || !*list || comparision(new_, (*list)->prev) > 0)
+		return dlist_add(list, new_);
+
+	for (tmp = *list; comparision(new_, tmp) > 0; tmp = tmp->next)
+		;
+
+	if (tmp == *list)
+		return dlist_add_beginning(list, new_);
+
+	new_->next = tmp;
+	new_->prev = tmp->prev;
+	tmp->prev->next = new_;
+	tmp->prev = new_;
+
+	return new_;
+}
+
+/* returns next element */
+void *dlist_unlink(dlist_t *list, dlist_t elem) {
+	dlist_t next;
+
+	if (!list || !elem) {
+		errno = EFAULT;
+		return NULL;
+	}
+
+	if (!elem->prev) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	next = elem->next;
+
+	if (elem == *list) {
+		if ((*list = next))
+			next->prev = elem->prev;
+	} else {
+		elem->prev->next = next;
+		if (next)
+			next->prev = elem->prev;
+		else
+			(*list)->prev = elem->prev;
+	}
+
+	elem->next = elem->prev = NULL;
+	return next;
+}
+
+void *dlist_remove(dlist_t *list, dlist_t elem, void (*func)(dlist_t data)) {
+	void *ret;
+
+	if (!elem || !elem->prev) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	ret = dlist_unlink(list, elem);
+
+	if (func)
+		func(elem);
+	xfree(elem);
+
+	return ret;
+}
+
+/* like list_remove3i(): returns element, whose ->next is the one after removed */
+void *dlist_remove_iter(dlist_t *list, dlist_t elem, void (*func)(dlist_t data)) {
+	void *ret;
+
+	if (!list || !elem || !elem->prev) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	ret = (elem == *list) ? (void *) list : (void *) elem->prev;
+	dlist_unlink(list, elem);
+
+	if (func)
+		func(elem);
+	xfree(elem);
+
+	return ret;
+}
+
+void dlist_resort(dlist_t *list, int (*comparision)(void *, void *)) {
+	dlist_t tmplist = NULL;
+	dlist_t l = *list;
+
+	while (l) {
+		dlist_t cur = l;
+
+		l = l->next;
+
+		dlist_add_sorted(&tmplist, cur, comparision);
+	}
+
+	*list = tmplist;
+}
+
 /**
  * list_remove()
  *
@@ -78,6 +78,27 @@ struct list {
 
 typedef struct list *list_t;
 
+/*
+ * Doubly linked *3() lists (dlist)
+ *
+ * Same idea, but struct begins with both 'next' and 'prev' fields.
+ * List is still pointed by its first element and ends with NULL 'next',
+ * so it can be iterated (and passed to list_count(), list_get_nth3(),
+ * list_destroy3()) like any other *3() list. 'prev' of first element
+ * points to the last one, that's how we find tail without walking.
+ * It makes add, unlink and remove O(1), instead of looking for tail
+ * or predecessor of removed element.
+ *
+ * 'prev' of element which is not on any list is NULL.
+ */
+
+struct dlist {
+	struct dlist *next;		/* keep it first, like in struct list */
+	struct dlist *prev;
+};
+
+typedef struct dlist *dlist_t;
+
 #ifndef EKG2_WIN32_NOFUNCTION
 #define LIST_ADD_COMPARE(x, type)			int x(const type data1, const type data2)
 #define LIST_ADD_SORTED(list, data, comp)		list_add_sorted(list, data, (void *) comp)
@@ -98,6 +119,12 @@ typedef struct list *list_t;
 #define LIST_DESTROY(list, func)			list_destroy2(list, (void *) func)
 #define LIST_DESTROY2(list, func)			list_destroy3((list_t) list, (void *) func)
 
+#define DLIST_ADD2(list, data)				dlist_add((dlist_t *) (void *) list, (dlist_t) data)
+#define DLIST_ADD_SORTED2(list, data, comp)		dlist_add_sorted((dlist_t *) (void *) list, (dlist_t) data, (void *) comp)
+#define DLIST_UNLINK2(list, elem)			dlist_unlink((dlist_t *) (void *) list, (dlist_t) elem)
+#define DLIST_REMOVE2(list, elem, func)			dlist_remove((dlist_t *) (void *) list, (dlist_t) elem, (void *) func)
+#define DLIST_RESORT2(list, comp)			dlist_resort((dlist_t *) (void *) list, (void *) comp)
+
 void *list_add(list_t *list, void *data);
 void *list_add_beginning(list_t *list, void *data);
 void *list_add_sorted(list_t *list, void *data, int (*comparision)(void *, void *));
@@ -125,6 +152,14 @@ int list_destroy3(list_t list, void (*func)(void *));
 
 void list_cleanup(list_t *list);
 int list_remove_safe(list_t *list, void *data, int free_data);
+
+void *dlist_add(dlist_t *list, dlist_t new_);
+void *dlist_add_beginning(dlist_t *list, dlist_t new_);
+void *dlist_add_sorted(dlist_t *list, dlist_t new_, int (*comparision)(void *, void *));
+void *dlist_unlink(dlist_t *list, dlist_t elem);
+void *dlist_remove(dlist_t *list, dlist_t elem, void (*func)(dlist_t));
+void *dlist_remove_iter(dlist_t *list, dlist_t elem, void (*func)(dlist_t));
+void dlist_resort(dlist_t *list, int (*comparision)(void *, void *));
 #endif
 
 /*
@@ -384,6 +384,51 @@ extern "C" {
 
 #endif
 
+/* doubly linked lists (struct dlist in dynstuff.h), typ has to begin with 'next' and 'prev' */
+
+#define __DYNSTUFF_DLIST_ADD(lista, typ, __notused)		\
+	void lista##_add(typ *new_) { dlist_add((dlist_t *) (void *) &lista, (dlist_t) new_); }
+
+#define __DYNSTUFF_DLIST_ADD_BEGINNING(lista, typ, __notused)	\
+	void lista##_add(typ *new_) { dlist_add_beginning((dlist_t *) (void *) &lista, (dlist_t) new_); }
+
+#define __DYNSTUFF_DLIST_ADD_SORTED(lista, typ, comparision)	\
+	void lista##_add(typ *new_) { dlist_add_sorted((dlist_t *) (void *) &lista, (dlist_t) new_, (void *) comparision); }
+
+#define __DYNSTUFF_DLIST_REMOVE_SAFE(lista, typ, free_func)	\
+	void lista##_remove(typ *elem) { dlist_remove((dlist_t *) (void *) &lista, (dlist_t) elem, (void *) free_func); }
+
+#define __DYNSTUFF_DLIST_REMOVE_ITER(lista, typ, free_func)	\
+	typ *lista##_removei(typ *elem) { return dlist_remove_iter((dlist_t *) (void *) &lista, (dlist_t) elem, (void *) free_func); }
+
+#define __DYNSTUFF_DLIST_UNLINK(lista, typ)			\
+	void lista##_unlink(typ *elem) { dlist_unlink((dlist_t *) (void *) &lista, (dlist_t) elem); }
+
+#define __DYNSTUFF_DADD(prefix, typ, __notused)		\
+	void prefix##_add(typ **lista, typ *new_) { dlist_add((dlist_t *) lista, (dlist_t) new_); }
+
+#define __DYNSTUFF_DADD_BEGINNING(prefix, typ, __notused) \
+	void prefix##_add(typ **lista, typ *new_) { dlist_add_beginning((dlist_t *) lista, (dlist_t) new_); }
+
+#define __DYNSTUFF_DADD_SORTED(prefix, typ, comparision) \
+	void prefix##_add(typ **lista, typ *new_) { dlist_add_sorted((dlist_t *) lista, (dlist_t) new_, (void *) comparision); }
+
+#define __DYNSTUFF_DREMOVE_SAFE(prefix, typ, free_func)					\
+	void prefix##_remove(typ **lista, typ *elem) {					\
+		dlist_remove((dlist_t *) lista, (dlist_t) elem, (void *) free_func);	\
+	}
+
+#define __DYNSTUFF_DREMOVE_ITER(prefix, typ, free_func)						\
+	typ *prefix##_removei(typ **lista, typ *elem) {						\
+		return dlist_remove_iter((dlist_t *) lista, (dlist_t) elem, (void *) free_func);	\
+	}
+
+#define __DYNSTUFF_DUNLINK(prefix, typ)				\
+	void prefix##_unlink(typ **lista, typ *elem) { dlist_unlink((dlist_t *) lista, (dlist_t) elem); }
+
+	/* __DYNSTUFF_LIST_DESTROY, __DYNSTUFF_DESTROY, _COUNT and _GET_NTH work with dlists too */
+
+#define __DYNSTUFF_NOADD(lista, typ, __notused)
 #define __DYNSTUFF_NOREMOVE(lista, typ, free_func)
 #define __DYNSTUFF_NOUNLINK(lista, typ)
 #define __DYNSTUFF_NOCOUNT(lista, typ)
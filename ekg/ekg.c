@@ -844,12 +844,11 @@ void ekg_exit()
 	send_nicks_count = 0;
 
 	{
-		list_t l;
+		watch_t *w;
 
-		for (l = watches; l; l = l->next) {
-			watch_t *w = l->data;
-
-			watch_free(w);
+		for (w = watches; w; w = w->next) {
+			if (!w->destroyed)
+				watch_free(w);
 		}
 	}
 
@@ -869,7 +868,7 @@ void ekg_exit()
 //			if (p->dl) ekg2_dlclose(p->dl);
 		}
 	}
-	list_destroy(watches, 0); watches = NULL;
+	watches_destroy();
 
 	if (config_changed && !config_speech_app && config_save_quit == 1) {
 		char line[80];
@@ -955,6 +954,7 @@ void ekg_exit()
 	buffer_free(&buffer_debug);	buffer_free(&buffer_speech);
 	event_free();
 	ekg_tls_deinit();
+	ekg_recode_destroy();
 
 	/* free internal read_file() buffer */
 	read_file(NULL, -1);
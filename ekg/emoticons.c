@@ -25,6 +25,9 @@
 
 #include <sys/types.h>
 #include <stdio.h>
+#include <string.h>
+
+#include "emoticons_ac.inc"
 
 typedef struct emoticon {
 	struct emoticon *next;
@@ -40,10 +43,35 @@ static LIST_FREE_ITEM(list_emoticon_free, emoticon_t *) { xfree(data->name); xfr
 DYNSTUFF_LIST_DECLARE(emoticons, emoticon_t, list_emoticon_free,
 	static __DYNSTUFF_LIST_ADD,		/* emoticons_add() */
 	__DYNSTUFF_NOREMOVE,
-	__DYNSTUFF_LIST_DESTROY)		/* emoticons_destroy() */
+	__DYNSTUFF_NODESTROY)
 
 int config_emoticons = 1;
 
+/* automat zbudowany z listy emoticons, NULL jeli trzeba go zbudowa od nowa */
+static emoticons_ac_t *emoticons_ac = NULL;
+
+/*
+ * emoticons_changed()
+ *
+ * wyrzuca automat po kadej zmianie listy, emoticon_expand()
+ * zbuduje go ponownie przy nastpnym wywoaniu.
+ */
+static void emoticons_changed() {
+	emoticons_ac_free(emoticons_ac);
+	emoticons_ac = NULL;
+}
+
+/*
+ * emoticons_destroy()
+ *
+ * zwalnia list emotikon i automat.
+ */
+void emoticons_destroy() {
+	emoticons_changed();
+	LIST_DESTROY2(emoticons, list_emoticon_free);
+	emoticons = NULL;
+}
+
 /*
  * emoticon_add()
  *
@@ -65,6 +93,7 @@ static int emoticon_add(const char *name, const char *value) {
 		if (!xstrcasecmp(name, e->name)) {
 			xfree(e->value);
 			e->value = xstrdup(value);
+			emoticons_changed();
 			return 0;
 		}
 	}
@@ -73,6 +102,7 @@ static int emoticon_add(const char *name, const char *value) {
 	e->value = xstrdup(value);
 
 	emoticons_add(e);
+	emoticons_changed();
 
 	return 0;
 }
@@ -114,68 +144,28 @@ int emoticon_read() {
 /*
  * emoticon_expand()
  *
- * rozwija definicje makr (najczciej bd to emoticony)
+ * rozwija definicje makr (najczciej bd to emoticony). tekst jest
+ * przegldany raz, automatem Aho-Corasick (patrz emoticons_ac.inc);
+ * jeli w danym miejscu pasuje kilka makr, wygrywa najdusze.
  *
  *  - s - string z makrami.
  *
  * zwraca zaalokowany, rozwinity string.
  */
 char *emoticon_expand(const char *s) {
-	emoticon_t *el = NULL;
-	const char *ss;
-	char *ms;
-	size_t n = 0;
-
 	if (!s)
 		return NULL;
 
-	for (ss = s; *ss; ss++) {
-		emoticon_t *e = NULL;
-		size_t ns = xstrlen(ss);
-		int ret = 1;
-
-		for (el = emoticons; el && ret; el = (ret ? el->next : el)) {
-			size_t nn;
-
-			e = el;
-			nn = xstrlen(e->name);
-			if (ns >= nn)
-				ret = xstrncmp(ss, e->name, nn);
-		}
-
-		if (el) {
-			e = el;
-			n += xstrlen(e->value);
-			ss += xstrlen(e->name) - 1;
-		} else
-			n++;
-	}
-
-	ms = xcalloc(1, n + 1);
-
-	for (ss = s; *ss; ss++) {
-		emoticon_t *e = NULL;
-		size_t ns = xstrlen(ss);
-		int ret = 1;
-
-		for (el = emoticons; el && ret; el = (ret ? el->next : el)) {
-			size_t n;
-
-			e = el;
-			n = xstrlen(e->name);
-			if (ns >= n)
-				ret = xstrncmp(ss, e->name, n);
-		}
+	if (!emoticons_ac) {
+		emoticon_t *e;
 
-		if (el) {
-			e = el;
-			xstrcat(ms, e->value);
-			ss += xstrlen(e->name) - 1;
-		} else
-			ms[xstrlen(ms)] = *ss;
+		emoticons_ac = emoticons_ac_new();
+		for (e = emoticons; e; e = e->next)
+			emoticons_ac_add(emoticons_ac, e->name, e->value);
+		emoticons_ac_compile(emoticons_ac);
 	}
 
-	return ms;
+	return emoticons_ac_expand(emoticons_ac, s);
 }
 
 /*
@@ -197,6 +187,7 @@ static int emoticon_remove(const char *name)
 
 		if (!xstrcasecmp(f->name, name)) {
 			emoticons_remove(f);
+			emoticons_changed();
 			return 0;
 		}
 	}
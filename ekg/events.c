@@ -24,11 +24,19 @@
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <ctype.h>
+
+#include "events_rules.inc"
 
 event_t *events = NULL;
+static event_index_t events_index;
 
 static LIST_ADD_COMPARE(event_add_compare, event_t *) { return data1->id - data2->id; }
-static LIST_FREE_ITEM(list_event_free, struct event *) { xfree(data->name); xfree(data->action); xfree(data->target); }
+static LIST_FREE_ITEM(list_event_free, struct event *) {
+	event_index_remove(&events_index, data->rule);
+	event_rule_unref(data->rule);
+	xfree(data->name); xfree(data->action); xfree(data->target);
+}
 
 DYNSTUFF_LIST_DECLARE_SORTED(events, event_t, event_add_compare, list_event_free, 
 	static __DYNSTUFF_LIST_ADD_SORTED,	/* events_add() */
@@ -54,7 +62,6 @@ static event_t *event_find_id(unsigned int id);
 static int event_remove(unsigned int id, int quiet);
 static int events_list(int id, int quiet);
 
-static int event_target_check(char *buf);
 static int event_check(const char *session, const char *name, const char *uid, const char *data);
 
 /* 
@@ -151,8 +158,13 @@ int event_add(const char *name, int prio, const char *target, const char *action
 	ev->prio	= prio;
 	ev->target	= xstrdup(target);
 	ev->action	= xstrdup(action);
+	ev->rule	= event_rule_new(id, prio, name, target, action);
 	events_add(ev);
 
+	if (!events_index.named)
+		event_index_init(&events_index);
+	event_index_add(&events_index, ev->rule);
+
 	tmp = xstrdup(name);
 	query_emit(NULL, "event-added", &tmp);
 	xfree(tmp);
@@ -218,6 +230,8 @@ void event_free() {
 	events_all = NULL;
 
 	events_destroy();
+	if (events_index.named)
+		event_index_destroy(&events_index);
 }
 
 /* 
@@ -288,56 +302,6 @@ event_t *event_find(const char *name, const char *target) {
 	return (ev_max) ? ev_max : NULL;
 }
 
-/*
- * event_find_all ()
- *
- * it finds the event including possibility of * and return (if found) 
- * descriptor to event
- *
- */
-static event_t *event_find_all(const char *name, const char *session, const char *uid, const char *target, const char *data) {
-	event_t *ev, *ev_max = NULL;
-	int ev_max_prio = 0;
-	char **b, **c;
-
-//	debug("// event_find_all (session %s) (name (%s), target (%s)\n", session, name, target);
-	b = array_make(target, ("|,;"), 0, 1, 0);
-	c = array_make(name, ("|,;"), 0, 1, 0);
-	for (ev = events; ev; ev = ev->next) {
-		char **a, **d;
-		int i, j, k, m;
-
-		a = array_make(ev->target, ("|,;"), 0, 1, 0);
-		d = array_make(ev->name, ("|,;"), 0, 1, 0);
-		for (i = 0; a[i]; i++) {
-			for (j = 0; b[j]; j++) {
-				for (k = 0; c[k]; k++) {
-					for (m = 0; d[m]; m++) {
-						char *tmp = format_string(a[i], uid, target, data, session);
-						if ((xstrcasecmp(d[m], c[k]) && xstrcasecmp(d[m], ("*"))) || 
-								(!event_target_check(tmp) && xstrcasecmp(a[i], ("*")) && 
-								 xstrcasecmp(a[i], b[j]))) {
-							xfree(tmp);
-							continue;
-						} else if (ev->prio > ev_max_prio){
-							ev_max = ev;
-							ev_max_prio = ev->prio;
-						}
-						xfree(tmp);
-					}
-				}
-			}
-		}
-		g_strfreev(a);
-		g_strfreev(d);
-	}
-
-	g_strfreev(b);
-	g_strfreev(c);
-
-	return (ev_max) ? ev_max : NULL;
-}
-
 /*
  * event_find ()
  *
@@ -531,11 +495,10 @@ static QUERY(event_misc) {
 static int event_check(const char *session, const char *name, const char *uid, const char *data) {
 	session_t *__session;
 	userlist_t *userlist;
-	event_t *ev;
+	event_rule_t *rule;
 	const char *target;
-	char *action, **actions;
 	char *edata = NULL;
-	int i;
+	guint i;
 
 	if (!events)
 		return 1;
@@ -550,15 +513,10 @@ static int event_check(const char *session, const char *name, const char *uid, c
 	userlist = userlist_find(__session, uid);
 	target = (userlist && userlist->nickname) ? userlist->nickname : uid;
 
-	if (!(ev = event_find_all(name, session, uid, target, data)))
-		return -1;
-
-	action = ev->action;
-
-	if (!action)
+	if (!(rule = event_index_find(&events_index, name, session, uid, target, data)))
 		return -1;
 
-	if (data) {
+	if (data && rule->dynamic_actions) {
 		int size = 1;
 		const char *p;
 		char *q;
@@ -591,191 +549,27 @@ static int event_check(const char *session, const char *name, const char *uid, c
 		*q = 0;
 	}
 
-	actions = array_make(action, (";"), 0, 0, 1);
+		/* action may remove the rule */
+	rule->refs++;
 
-	for (i = 0; actions && actions[i]; i++) {
-		char *tmp = format_string(strip_spaces(actions[i]), (uid) ? uid : target, target, ((data) ? data : ""), ((edata) ? edata : ""), session_uid_get(__session));
+	for (i = 0; i < rule->actions_count; i++) {
+		const event_tmpl_t *a = &rule->actions[i];
+		char *tmp = NULL;
 
-		debug("// event_check() calling \"%s\"\n", tmp);
-		command_exec(NULL, NULL, tmp, 0); /* BUG? CHECK: hm, we've got specified session, not current one... target too.. so is it correct ? */
+		if (a->dynamic)
+			tmp = format_string(a->text, (uid) ? uid : target, target, ((data) ? data : ""), ((edata) ? edata : ""), session_uid_get(__session));
+
+		debug("// event_check() calling \"%s\"\n", tmp ? tmp : a->text);
+		command_exec(NULL, NULL, tmp ? tmp : a->text, 0); /* BUG? CHECK: hm, we've got specified session, not current one... target too.. so is it correct ? */
 		xfree(tmp);
 	}
 
-	g_strfreev(actions);
+	event_rule_unref(rule);
 	xfree(edata);
 
 	return 0;
 }
 
-/*
- * event_target_check_compare()
- *
- * it only compares given as an argument values
- *
- * returns logical value
- */
-static int event_target_check_compare(char *buf) {
-	string_t s;
-
-	s = string_init(NULL);
-
-	while(*buf) {
-		if (*buf == '/') {
-			buf++;
-			if (!*buf)
-				break;
-			buf++;
-			if (!*buf)
-				break;
-			continue;
-		}
-
-		if (*buf == '=') {
-			buf++;
-
-			if (!*buf)
-				break;
-
-			if (*buf == '=') /* '==' */ {
-				buf++;
-				if (!*buf)
-					break;
-
-				return (!xstrcmp(s->str, buf) && !string_free(s, 1)) ? 1 : 0;
-			}
-
-			/* '=' */
-			return (!xstrcasecmp(s->str, buf) && !string_free(s, 1)) ? 1 : 0;
-		}
-
-		if (*buf == '!') {
-			buf++;
-
-			if (!*buf)
-				break;
-
-			if (*buf == '=') {
-				buf++;
-
-				if (!*buf)
-					break;
-
-				if (*buf == '=') { /* '!==' */
-					buf++;
-					if (!*buf)
-						break;
-
-					return (xstrcmp(s->str, buf) && !string_free(s, 1)) ? 1 : 0;
-				}
-
-				/* '!=' */
-				return (xstrcasecmp(s->str, buf) && !string_free(s, 1)) ? 1 : 0;
-			}
-
-			if (*buf == '+') {
-				buf++;
-
-				if (!*buf)
-					break;
-
-				if (*buf == '+') { /* '!++' */
-					buf++;
-					if (!*buf)
-						break;
-
-					return (!xstrstr(buf, s->str) && !string_free(s, 1)) ? 1 : 0;
-				}
-
-				/* '!+' */
-				return (!xstrcasestr(buf, s->str) && !string_free(s, 1)) ? 1 : 0;
-			}
-
-			continue;
-		}
-
-		if (*buf == '+') {
-			buf++;
-
-			if (!*buf)
-				break;
-
-			if (*buf == '+') { /* '++' */
-				buf++;
-
-				if (!*buf)
-					break;
-
-				return (xstrstr(buf, s->str) && !string_free(s, 1)) ? 1 : 0;
-			}
-
-			/* '+' */
-			return (xstrcasestr(buf, s->str) && !string_free(s, 1)) ? 1 : 0;
-		}
-
-		string_append_c(s, *buf);
-		buf++;
-	}
-
-	string_free(s, 1);
-	return 0;
-}
-
-/* 
- * event_target_check()
- *
- * it has to get as an argument parametr to check
- *
- * returns logical value of given expression
- */
-
-static int event_target_check(char *buf) {
-	char **params = array_make(buf, ("&|"), 0, 1, 1);
-	int i = 1;
-	char *separators;
-	char last_returned = 0;
-	int first = 1;
-	
-#define s separators[i]
-
-	separators = xmalloc(g_strv_length(params) * sizeof(char) + 1);
-	
-	while (*buf) {
-		if (*buf == '&' || *buf == '|') {
-			s = *buf;
-			i++;	
-		}
-		buf++;
-	}
-	for (i = 0; params[i]; i++) {
-		int returned_now;
-
-		returned_now = event_target_check_compare(params[i]);
-		if (s && s == '&') {
-			if (returned_now && last_returned)
-				last_returned = 1;
-			else
-				last_returned = 0;	
-		} else if (s && s == '|') {
-			if (returned_now || last_returned)
-				last_returned = 1;
-			else
-				last_returned = 0;
-		}
-
-		if (first) {
-			last_returned = returned_now;
-			first = 0;
-		}
-
-	}
-#undef s
-
-	xfree(separators);
-	g_strfreev(params);
-
-	return last_returned;
-}
-
 
 /*
  * Local Variables:
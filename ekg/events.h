@@ -36,6 +36,8 @@ typedef struct event {
 	char *target;	/* uid(s), alias(es), group(s) */
 	char *action;	/* action to do */
 	int prio;	/* priority of this event */
+
+	struct event_rule *rule;	/* compiled, see events_rules.inc */
 } event_t;
 
 extern event_t *events;
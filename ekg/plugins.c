@@ -49,7 +49,7 @@ void plugins_unlink(plugin_t *pl) {
 	plugins = g_slist_remove(plugins, pl);
 }
 
-list_t watches = NULL;
+watch_t *watches = NULL;
 
 query_t* queries[QUERIES_BUCKETS];
 
@@ -61,8 +61,8 @@ LIST_FREE_ITEM(query_free_data, query_t *) {
 }
 
 DYNSTUFF_LIST_DECLARE(queries_list, query_t, query_free_data,
-	static __DYNSTUFF_ADD,
-	static __DYNSTUFF_REMOVE_SAFE,
+	static __DYNSTUFF_DADD,
+	static __DYNSTUFF_DREMOVE_SAFE,
 	__DYNSTUFF_DESTROY)
 
 void ekg2_dlinit(const gchar *argv0) {
@@ -490,16 +490,14 @@ int plugin_unregister(plugin_t *p)
 	session_t *s;
 	query_t **kk;
 	GSList *vl, *cl;
-	list_t l;
+	watch_t *w;
 
 	g_assert(p);
 
 /* XXX think about sequence of unloading....: currently: watches, timers, sessions, queries, variables, commands */
 
-	for (l = watches; l; l = l->next) {
-		watch_t *w = l->data;
-
-		if (w && w->plugin == p)
+	for (w = watches; w; w = w->next) {
+		if (!w->destroyed && w->plugin == p)
 			watch_free(w);
 	}
 
@@ -743,6 +741,51 @@ int query_emit(plugin_t *plugin, const char* name, ...) {
 	return result;
 }
 
+/**
+ * query_emit_unbatched()
+ *
+ * Emits query @a name like query_emit(NULL, ...) does, but only to plugin handlers
+ * which don't have handler (the same plugin and data) connected to @a batch.<br>
+ * Used after batch query was emitted, to give single events to those who don't
+ * handle batch. Core handlers are skipped, core applies batch by itself.
+ *
+ * @param batch	- name of batch query
+ * @param name	- name of query to emit
+ *
+ * @return like query_emit()
+ */
+int query_emit_unbatched(const char *batch, const char *name, ...) {
+	const int batch_hash	= ekg_hash(batch);
+	const int name_hash	= ekg_hash(name);
+	int result = -2;
+	va_list ap;
+	query_t *g;
+
+	va_start(ap, name);
+
+	for (g = queries[name_hash & (QUERIES_BUCKETS - 1)]; g; g = g->next) {
+		query_t *b;
+
+		if (name_hash != g->name_hash || !g->plugin || xstrcmp(name, g->name))
+			continue;
+
+		for (b = queries[batch_hash & (QUERIES_BUCKETS - 1)]; b; b = b->next) {
+			if (batch_hash == b->name_hash && b->plugin == g->plugin && b->data == g->data && !xstrcmp(batch, b->name))
+				break;
+		}
+
+		if (b)
+			continue;
+
+		if ((result = query_emit_inner(g, ap)) == -1)
+			break;
+	}
+
+	va_end(ap);
+
+	return result;
+}
+
 static LIST_ADD_COMPARE(query_compare, query_t *) {
 	/*				any other suggestions: vvv ? */
 	const int ap = (data1->plugin ? data1->plugin->prio : -666);
@@ -760,7 +803,7 @@ static LIST_ADD_COMPARE(query_compare, query_t *) {
 void queries_reconnect() {
 	size_t i;
 	for (i = 0; i < QUERIES_BUCKETS; ++i) {
-		LIST_RESORT2(&(queries[i]), query_compare);
+		DLIST_RESORT2(&(queries[i]), query_compare);
 	}
 }
 
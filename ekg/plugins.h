@@ -139,6 +139,7 @@ typedef QUERY(query_handler_func_t);
 
 typedef struct query_node {
         struct query_node* next;
+        struct query_node* prev;
         char *name;
         int name_hash;
         plugin_t *plugin;
@@ -150,6 +151,7 @@ typedef struct query_node {
 int query_register(const char *name, ...);
 query_t *query_connect(plugin_t *plugin, const char *name, query_handler_func_t *handler, void *data);
 int query_emit(plugin_t *, const char *, ...);
+int query_emit_unbatched(const char *batch, const char *name, ...);
 int query_free(query_t* g);
 
 void queries_reconnect();
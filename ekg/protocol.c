@@ -47,6 +47,32 @@ static QUERY(protocol_message);
 static QUERY(protocol_xstate);
 static QUERY(protocol_userlist_changed);
 
+static const session_t *protocol_emit_session;	/* session protocol_*_emit() emits query for */
+
+/*
+ * protocol_session_find()
+ *
+ * session given by uid to core handler of protocol-* query. if it came from
+ * protocol_*_emit(), it's the session it was emitted for, no need to look it
+ * up (it's looked up, if some handler (i.e. script) changed the uid).
+ */
+static session_t *protocol_session_find(const char *session) {
+	if (protocol_emit_session && !xstrcmp(session, protocol_emit_session->uid))
+		return (session_t *) protocol_emit_session;
+
+	return session_find(session);
+}
+
+/*
+ * protocol_userlist_changed_emit()
+ *
+ * emits userlist-changed-session, and userlist-changed to those who don't handle it.
+ */
+static void protocol_userlist_changed_emit(session_t *s, char **session, char **uid) {
+	query_emit(NULL, "userlist-changed-session", &s, uid);
+	query_emit_unbatched("userlist-changed-session", "userlist-changed", session, uid);
+}
+
 /**
  * protocol_init()
  *
@@ -98,8 +124,7 @@ static QUERY(protocol_userlist_changed) {
 		if (!w->target || xstrcasecmp(w->target, *p1))
 			continue;
 
-		xfree(w->target);
-		w->target = xstrdup(*p2);
+		window_target_set(w, *p2);
 
 		query_emit(NULL, "ui-window-target-changed", &w);
 	}
@@ -301,34 +326,30 @@ int protocol_connected_emit(const session_t *s) {
 }
 
 /*
- * protocol_status()
+ * protocol_status_real()
  *
- * obsuga zapytania "protocol-status" wysyanego przez pluginy protokow.
+ * waciwa obsuga zmiany stanu uytkownika @a uid (@a u, jeli ju go
+ * znaleziono). jeli @a batch, nie wysya "userlist-changed", zrobi to
+ * protocol_status_batch_emit() raz dla caej paczki.
+ *
+ * zwraca 1, jeli wpis na licie kontaktw si zmieni.
  */
-static QUERY(protocol_status)
+static int protocol_status_real(session_t *s, userlist_t *u, const char *uid, int status, const char *descr, time_t when, int sess_notify, int batch)
 {
-	char **__session	= va_arg(ap, char**), *session = *__session;
-	char **__uid		= va_arg(ap, char**), *uid = *__uid;
-	int status		= *(va_arg(ap, int*));
-	char **__descr		= va_arg(ap, char**), *descr = *__descr;
-	time_t when		= *(va_arg(ap, time_t*));
+	char *session		= s->uid;
+	char **__session	= &session;
+	char *uid_rw		= (char *) uid, **__uid = &uid_rw;
+	char *descr_rw		= (char *) descr, **__descr = &descr_rw;
 	ekg_resource_t *r	= NULL;
-	userlist_t *u;
-	session_t *s;
 
 	int st;				/* status	u->status || r->status */
 	char *de;			/* descr	u->descr  || r->descr  */
 
 	int ignore_level;
 	int ignore_status, ignore_status_descr, ignore_events, ignore_notify;
-	int sess_notify;
 
-	if (!(s = session_find(session)))
-		return 0;
-	
-	sess_notify = session_int_get(s, "display_notify");
 	/* we are checking who user we know */
-	if (!(u = userlist_find(s, uid))) {
+	if (!u) {
 		if (config_auto_user_add && xstrncmp(uid, session, xstrlen(session)) ) {
 			char *tmp = xstrdup(uid);
 			char *p = xstrchr(tmp, '/');
@@ -346,7 +367,7 @@ static QUERY(protocol_status)
 			return 0;
 		}
 	}
-	ignore_level = ignored_check(s, uid);
+	ignore_level = ignored_check_u(u);
 
 	ignore_status = ignore_level & IGNORE_STATUS;
 	ignore_status_descr = ignore_level & IGNORE_STATUS_DESCR;
@@ -471,7 +492,8 @@ notify_plugins:
 			u->status_time = when ? when : time(NULL);
 	}
 	
-	query_emit(NULL, "userlist-changed", __session, __uid);
+	if (!batch)
+		protocol_userlist_changed_emit(s, __session, __uid);
 
 	/* Currently it behaves like event means grouped statuses,
 	 * i.e. EVENT_AVAIL is for avail&ffc
@@ -486,14 +508,40 @@ notify_plugins:
 			query_emit(NULL, "event-na", __session, __uid);
 	}
 
+	return 1;
+}
+
+/*
+ * protocol_status()
+ *
+ * obsuga zapytania "protocol-status" wysyanego przez pluginy protokow.
+ */
+static QUERY(protocol_status)
+{
+	char *session	= *(va_arg(ap, char**));
+	char *uid	= *(va_arg(ap, char**));
+	int status	= *(va_arg(ap, int*));
+	char *descr	= *(va_arg(ap, char**));
+	time_t when	= *(va_arg(ap, time_t*));
+	session_t *s;
+
+	if (!(s = protocol_session_find(session)))
+		return 0;
+
+	protocol_status_real(s, userlist_find(s, uid), uid, status, descr, when, session_int_get(s, "display_notify"), 0);
 	return 0;
 }
 
 int protocol_status_emit(const session_t *s, const char *uid, int status, char *descr, time_t when) {
+	const session_t *prev = protocol_emit_session;
 	char *session  = xstrdup(s->uid);
 	char *uid_ro   = xstrdup(uid);
 	char *descr_ro = xstrdup(descr);
-	int result     = query_emit(NULL, "protocol-status", &session, &uid_ro, &status, &descr_ro, &when);
+	int result;
+
+	protocol_emit_session = s;
+	result = query_emit(NULL, "protocol-status", &session, &uid_ro, &status, &descr_ro, &when);
+	protocol_emit_session = prev;
 
 	xfree(session);
 	xfree(uid_ro);
@@ -501,20 +549,108 @@ int protocol_status_emit(const session_t *s, const char *uid, int status, char *
 	return result;
 }
 
-/*
- * message_print()
+/**
+ * protocol_status_batch_emit()
  *
- * wywietla wiadomo w odpowiednim oknie i w odpowiedniej postaci.
+ * Handles many status changes from session @a s at once, i.e. notify reply
+ * after connecting, when servers send statuses of whole roster.<br>
+ * Only the last entry for each uid is taken, and it's applied to userlist
+ * directly, without <i>PROTOCOL_STATUS</i> round-trip. Changes which were applied
+ * are passed to <i>PROTOCOL_STATUS_BATCH</i>, followed by one <i>USERLIST_REFRESH</i>
+ * instead of <i>USERLIST_CHANGED</i> for every changed user.<br>
+ * Handlers of <i>PROTOCOL_STATUS</i> which aren't connected to <i>PROTOCOL_STATUS_BATCH</i>
+ * get every applied change afterwards, see query_emit_unbatched().
  *
- * zwraca target
+ * @param s		- session
+ * @param entries	- status changes
+ * @param count		- number of @a entries
+ *
+ * @return number of changed userlist entries.
  */
-char *message_print(const char *session, const char *sender, const char **rcpts, const char *__text, const guint32 *format, time_t sent, int mclass, const char *seq, int dobeep, int secure)
+int protocol_status_batch_emit(const session_t *s, const protocol_status_t *entries, int count) {
+	session_t *sess = (session_t *) s;
+	GHashTable *last = NULL;
+	GArray *changes;
+	int sess_notify;
+	int changed;
+	int i;
+
+	if (!s || !entries || count <= 0)
+		return 0;
+
+	if (count > 1) {
+		last = g_hash_table_new(g_str_hash, g_str_equal);
+
+		for (i = 0; i < count; i++) {
+			if (entries[i].uid)
+				g_hash_table_insert(last, (gpointer) entries[i].uid, GINT_TO_POINTER(i));
+		}
+	}
+
+	sess_notify = session_int_get(sess, "display_notify");
+	changes = g_array_sized_new(FALSE, FALSE, sizeof(protocol_status_change_t), count);
+
+	for (i = 0; i < count; i++) {
+		const protocol_status_t *e = &entries[i];
+		protocol_status_change_t c;
+		userlist_t *u;
+
+		if (!e->uid)
+			continue;
+
+		/* superseded by later entry in this batch */
+		if (last && GPOINTER_TO_INT(g_hash_table_lookup(last, e->uid)) != i)
+			continue;
+
+		u = userlist_find(sess, e->uid);
+
+		c.uid		= e->uid;
+		c.old_status	= u ? u->status : EKG_STATUS_NA;
+		c.status	= e->status;
+		c.descr		= e->descr;
+		c.when		= e->when;
+
+		if (protocol_status_real(sess, u, e->uid, e->status, e->descr, e->when, sess_notify, 1))
+			g_array_append_val(changes, c);
+	}
+
+	if (last)
+		g_hash_table_destroy(last);
+
+	if ((changed = changes->len)) {
+		protocol_status_change_t *list = (protocol_status_change_t *) changes->data;
+		char *session = xstrdup(s->uid);
+
+		query_emit(NULL, "protocol-status-batch", &session, &changed, &list);
+
+		for (i = 0; i < changed; i++) {
+			char *uid	= xstrdup(list[i].uid);
+			char *descr	= xstrdup(list[i].descr);
+
+			query_emit_unbatched("protocol-status-batch", "protocol-status", &session, &uid, &list[i].status, &descr, &list[i].when);
+			xfree(uid);
+			xfree(descr);
+		}
+
+		query_emit(NULL, "userlist-refresh");
+		xfree(session);
+	}
+
+	g_array_free(changes, TRUE);
+	return changed;
+}
+
+/*
+ * message_print_real()
+ *
+ * message_print() for session @a s, which caller already has.
+ */
+static char *message_print_real(session_t *s, const char *sender, const char **rcpts, const char *__text, const guint32 *format, time_t sent, int mclass, const char *seq, int dobeep, int secure)
 {
 	char *class_str, timestamp[100], *text = xstrdup(__text);
 	char *securestr = NULL;
 	const char *target = sender, *user;
 	time_t now;
-	session_t *s = session_find(session);
 	struct conference *c = NULL;
 	int empty_theme = 0, is_me = 0, to_me = 1, activity = 0, separate = 0;
 
@@ -737,6 +873,18 @@ char *message_print(const char *session, const char *sender, const char **rcpts,
 	return xstrdup(target);
 }
 
+/*
+ * message_print()
+ *
+ * wywietla wiadomo w odpowiednim oknie i w odpowiedniej postaci.
+ *
+ * zwraca target
+ */
+char *message_print(const char *session, const char *sender, const char **rcpts, const char *text, const guint32 *format, time_t sent, int mclass, const char *seq, int dobeep, int secure)
+{
+	return message_print_real(session_find(session), sender, rcpts, text, format, sent, mclass, seq, dobeep, secure);
+}
+
 /*
  * protocol_message()
  */
@@ -753,7 +901,7 @@ static QUERY(protocol_message)
 	int dobeep	= *(va_arg(ap, int*));
 	int secure	= *(va_arg(ap, int*));
 
-	session_t *session_class = session_find(session);
+	session_t *session_class = protocol_session_find(session);
 	userlist_t *userlist = userlist_find(session_class, uid);
 	char *target = NULL;
 	int empty_theme = 0;
@@ -782,7 +930,7 @@ static QUERY(protocol_message)
 		}
 
 		if (oldstate != userlist->blink)
-			query_emit(NULL, "userlist-changed", &session, &uid);
+			protocol_userlist_changed_emit(session_class, &session, &uid);
 	}
 	
 	if (mclass & EKG_NO_THEMEBIT) {
@@ -816,12 +964,14 @@ static QUERY(protocol_message)
 	else		query_emit(NULL, "protocol-message-received", &session, &uid, &rcpts, ptext, &format, &sent, &mclass, &seq, &secure);
 
 	query_emit(NULL, "protocol-message-post", &session, &uid, &rcpts, ptext, &format, &sent, &mclass, &seq, &secure);
+	if (session_class)	/* the same, with session_t * instead of uid, for loggers */
+		query_emit(NULL, "protocol-message-post-session", &session_class, &uid, &rcpts, ptext, &format, &sent, &mclass, &seq, &secure);
 
 	/* show it ! */
 	if (!(our_msg && !config_display_sent)) {
 		if (empty_theme)
 			mclass |= EKG_NO_THEMEBIT;
-		if (!(target = message_print(session, uid, (const char**) rcpts, *ptext, format, sent, mclass, seq, dobeep, secure)))
+		if (!(target = message_print_real(session_class, uid, (const char**) rcpts, *ptext, format, sent, mclass, seq, dobeep, secure)))
 			return -1;
 	}
 
@@ -859,12 +1009,17 @@ static QUERY(protocol_message)
 }
 
 int protocol_message_emit(const session_t *s, const char *uid, char **rcpts, const char *text, const guint32 *format, time_t sent, int mclass, const char *seq, int dobeep, int secure) {
-	char *session = xstrdup(s->uid);
+	const session_t *prev = protocol_emit_session;
+	char *session = xstrdup(s->uid);	/* scripts may replace it */
 	char *uid_ro  = xstrdup(uid);
 	char *text_ro = xstrdup(text);
 	char *seq_ro  = xstrdup(seq);
+	int result;
+
 	/* XXX, rcpts_ro, format_ro */
-	int result    = query_emit(NULL, "protocol-message", &session, &uid_ro, &rcpts, &text_ro, &format, &sent, &mclass, &seq_ro, &dobeep, &secure);
+	protocol_emit_session = s;
+	result = query_emit(NULL, "protocol-message", &session, &uid_ro, &rcpts, &text_ro, &format, &sent, &mclass, &seq_ro, &dobeep, &secure);
+	protocol_emit_session = prev;
 
 	xfree(session);
 	xfree(uid_ro);
@@ -85,6 +85,21 @@ typedef enum {
 	EKG_MSGCLASS_PRIV_STATUS= 64	/* used by logs */
 } msgclass_t;
 
+typedef struct {
+	const char	*uid;		/* user uid */
+	int		status;		/* new status */
+	const char	*descr;		/* new description */
+	time_t		when;		/* time of change */
+} protocol_status_t;
+
+typedef struct {
+	const char	*uid;		/* user uid */
+	int		old_status;	/* status before change */
+	int		status;		/* new status */
+	const char	*descr;		/* new description */
+	time_t		when;		/* time of change */
+} protocol_status_change_t;
+
 #ifndef EKG2_WIN32_NOFUNCTION
 void protocol_init();
 
@@ -96,6 +111,7 @@ int protocol_disconnected_emit(const session_t *s, const char *reason, int type)
 int protocol_message_ack_emit(const session_t *s, const char *rcpt, const char *seq, int status);
 int protocol_message_emit(const session_t *s, const char *uid, char **rcpts, const char *text, const guint32 *format, time_t sent, int mclass, const char *seq, int dobeep, int secure);
 int protocol_status_emit(const session_t *s, const char *uid, int status, char *descr, time_t when);
+int protocol_status_batch_emit(const session_t *s, const protocol_status_t *entries, int count);
 int protocol_xstate_emit(const session_t *s, const char *uid, int state, int offstate);
 
 char *protocol_uid(const char *proto, const char *target);	/* XXX ? */
@@ -96,6 +96,18 @@ static const query_def_t core_query_list[] = {
 		QUERY_ARG_INT,			/* secure */
 		QUERY_ARG_END } },
 
+	{ NULL, "protocol-message-post-session", 0, {
+		QUERY_ARG_SESSION,		/* session */
+		QUERY_ARG_CHARP,		/* uid */
+		QUERY_ARG_CHARPP,		/* rcpts */
+		QUERY_ARG_CHARP,		/* text */
+		QUERY_ARG_UINT,	/* guint32 */	/* format */
+		QUERY_ARG_UINT, /* time_t */	/* sent */
+		QUERY_ARG_INT,			/* mclass */
+		QUERY_ARG_CHARP,		/* seq */
+		QUERY_ARG_INT,			/* secure */
+		QUERY_ARG_END } },
+
 	{ NULL, "event-away", 0, {
 		QUERY_ARG_CHARP,		/* session uid */
 		QUERY_ARG_CHARP,		/* uid */
@@ -136,6 +148,11 @@ static const query_def_t core_query_list[] = {
 		QUERY_ARG_CHARP,		/* uid */
 		QUERY_ARG_END } },
 
+	{ NULL, "userlist-changed-session", 0, {
+		QUERY_ARG_SESSION,		/* session */
+		QUERY_ARG_CHARP,		/* uid */
+		QUERY_ARG_END } },
+
 	{ NULL, "userlist-removed", 0, {
 		/* XXX, we need here a session->uid too (?) */
 
@@ -228,6 +245,12 @@ static const query_def_t core_query_list[] = {
 		QUERY_ARG_UINT, /* time_t */	/* when */
 		QUERY_ARG_END } },
 
+	{ NULL, "protocol-status-batch", 0, {
+		QUERY_ARG_CHARP,		/* session uid */
+		QUERY_ARG_INT,			/* number of changed users */
+						/* protocol_status_change_t *changes, not passed to scripts */
+		QUERY_ARG_END } },
+
 	{ NULL, "protocol-validate-uid", 0, {
 		QUERY_ARG_CHARP,		/* uid */
 		QUERY_ARG_INT,			/* valid */
@@ -38,6 +38,8 @@
 #include <errno.h>
 #include <string.h>
 
+#include "recode_pool.inc"
+
 struct ekg_encoding_pair {
 	gchar *from;
 	gchar *to;
@@ -64,12 +66,14 @@ void *ekg_convert_string_init(const char *from, const char *to, void **rev) {
 		enc = g_new(struct ekg_encoding_pair, 1);
 		enc->from = g_strdup(to);
 		enc->to = g_strdup(from);
+		recode_pool_ref(enc->from ? enc->from : "utf8", enc->to ? enc->to : "utf8");
 		*rev = enc;
 	}
 
 	enc = g_new(struct ekg_encoding_pair, 1);
 	enc->from = g_strdup(from);
 	enc->to = g_strdup(to);
+	recode_pool_ref(enc->from ? enc->from : "utf8", enc->to ? enc->to : "utf8");
 	return enc;
 }
 
@@ -89,6 +93,8 @@ void *ekg_convert_string_init(const char *from, const char *to, void **rev) {
 
 void ekg_convert_string_destroy(void *ptr) {
 	struct ekg_encoding_pair *e = ptr;
+
+	recode_pool_unref(e->from ? e->from : "utf8", e->to ? e->to : "utf8");
 	g_free(e->from);
 	g_free(e->to);
 	g_free(ptr);
@@ -142,7 +148,7 @@ char *ekg_convert_string(const char *ps, const char *from, const char *to) {
 	if (!to)
 		to = "utf8";
 
-	res = g_convert_with_fallback(ps, -1, to, from, NULL, NULL, &written, NULL);
+	res = recode_pool_convert(ps, -1, from, to, &written, TRUE);
 
 	if (!res) {
 		res = g_strdup(ps);
@@ -167,7 +173,7 @@ string_t ekg_convert_string_t(string_t s, const char *from, const char *to) {
 	if (!to)
 		to = "utf8";
 
-	res = g_convert_with_fallback(s->str, s->len, to, from, NULL, NULL, &written, NULL);
+	res = recode_pool_convert(s->str, s->len, from, to, &written, TRUE);
 	ret = string_init(NULL);
 
 	if (!res)
@@ -178,10 +184,31 @@ string_t ekg_convert_string_t(string_t s, const char *from, const char *to) {
 	return ret;
 }
 
+/**
+ * ekg_recode_inc_ref()
+ *
+ * Keep converters between @a enc and ekg2 internal encoding (utf8) open,
+ * until ekg_recode_dec_ref() is called as many times.
+ *
+ * @param enc - encoding (e.g. "iso-8859-2").
+ */
 void ekg_recode_inc_ref(const gchar *enc) {
+	recode_pool_ref(enc, "utf8");
+	recode_pool_ref("utf8", enc);
 }
 
 void ekg_recode_dec_ref(const gchar *enc) {
+	recode_pool_unref(enc, "utf8");
+	recode_pool_unref("utf8", enc);
+}
+
+/**
+ * ekg_recode_destroy()
+ *
+ * Close all converters, at exit.
+ */
+void ekg_recode_destroy(void) {
+	recode_pool_destroy();
 }
 
 char *ekg_recode_from_core(const gchar *enc, gchar *buf) {
@@ -299,11 +326,14 @@ static gboolean gstring_recode_helper(GString *s, const gchar *from, const gchar
 	char *res;
 	gsize written;
 
-	res = g_convert_with_fallback(s->str, s->len, to, from, NULL, NULL, &written, NULL);
+	res = recode_pool_convert(s->str, s->len, from, to, &written, FALSE);
 
 	if (G_LIKELY(res)) {
-		g_string_truncate(s, 0);
-		g_string_append_len(s, res, written);
+		if (res != s->str) {
+			g_string_truncate(s, 0);
+			g_string_append_len(s, res, written);
+			g_free(res);
+		}
 	} else if (G_LIKELY(fixutf))
 		ekg_fix_utf8(s->str);
 
@@ -458,12 +488,12 @@ fstring_t *ekg_recode_fstr_to_locale(const fstring_t *fstr) {
 			char *ls;
 			gsize ob;
 
-			ls = g_convert_with_fallback(s, len, console_charset, "utf8",
-					NULL, NULL, &ob, NULL);
+			ls = recode_pool_convert(s, len, "utf8", console_charset, &ob, FALSE);
 
 			if (ls) {
 				g_string_append_len(outs, ls, ob);
-				g_free(ls);
+				if (ls != s)
+					g_free(ls);
 			} else {
 				/* XXX: is that really a good idea? */
 				g_string_append_len(outs, s, len);
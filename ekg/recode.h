@@ -23,6 +23,7 @@ int ekg_converters_display(int quiet);
 
 void ekg_recode_inc_ref(const gchar *enc);
 void ekg_recode_dec_ref(const gchar *enc);
+void ekg_recode_destroy(void);
 
 char *ekg_recode_from_core(const gchar *enc, gchar *buf);
 gchar *ekg_recode_to_core(const gchar *enc, char *buf);
@@ -12,6 +12,8 @@
 
 #include "scripts.h"
 
+#include "script_events.inc"
+
 /* TODO && BUGS 
  * - cleanup.
  * - multiple handler for commands && var_changed. 
@@ -48,6 +50,8 @@ static int script_plugin_theme_init( /* plugin_t *p */ );
 
 static int scripts_autoload(scriptlang_t *scr);
 static char *script_find_path(const char *name);
+static void script_query_events_drop(script_query_t *squery);
+static void script_events_unload(script_t *scr);
 /****************************************************************************************************/
 
 scriptlang_t *scriptlang_from_ext(char *name)
@@ -210,6 +214,90 @@ int script_var_list(script_t *scr)
 	return i;
 }
 
+static gint64 script_time() {
+#if GLIB_CHECK_VERSION(2, 28, 0)
+	return g_get_monotonic_time();
+#else
+	GTimeVal tv;
+
+	g_get_current_time(&tv);
+	return (gint64) tv.tv_sec * G_USEC_PER_SEC + tv.tv_usec;
+#endif
+}
+
+/*
+ * script_profile_add()
+ *
+ * accounts one call of script handler, warns (once per handler) if it took
+ * longer than script_time_budget milliseconds.
+ */
+static void script_profile_add(script_profile_t *prof, script_t *scr, const char *what, const char *name, gint64 elapsed) {
+	prof->calls++;
+	prof->total += elapsed;
+	if (elapsed > prof->max)
+		prof->max = elapsed;
+
+	if (config_script_time_budget > 0 && elapsed > (gint64) config_script_time_budget * 1000) {
+		debug_error("[script] %s %s %s took %ld ms\n", scr ? scr->name : "?", what, name, (long) (elapsed / 1000));
+
+		if (!prof->overruns++)
+			print("script_overrun", scr ? scr->name : "?", what, name, ekg_itoa((long) (elapsed / 1000)), ekg_itoa(config_script_time_budget));
+	}
+}
+
+static void script_profile_print(script_t *scr, const char *what, const char *name, script_profile_t *prof) {
+	char *total = saprintf("%.3f", prof->total / 1000.0);
+	char *max = saprintf("%.3f", prof->max / 1000.0);
+
+	print("script_profile", scr ? scr->name : "?", what, name, ekg_itoa(prof->calls), total, max, ekg_itoa(prof->overruns));
+
+	xfree(total);
+	xfree(max);
+}
+
+int script_profile(script_t *scr)
+{
+	list_t l;
+	int i = 0;
+
+	for (l = script_queries; l; l = l->next) {
+		script_query_t *q = l->data;
+
+		if (scr && q->scr != scr)
+			continue;
+		if (!i++)
+			print("script_profile_header");
+		script_profile_print(q->scr, q->observer ? "observer" : "query", q->self->name, &q->prof);
+	}
+
+	for (l = script_commands; l; l = l->next) {
+		script_command_t *c = l->data;
+
+		if (scr && c->scr != scr)
+			continue;
+		if (!i++)
+			print("script_profile_header");
+		script_profile_print(c->scr, "command", c->self->name, &c->prof);
+	}
+
+	for (l = script_timers; l; l = l->next) {
+		script_timer_t *t = l->data;
+		char *name;
+
+		if (scr && t->scr != scr)
+			continue;
+		if (!i++)
+			print("script_profile_header");
+		name = saprintf("scr_%p", t);
+		script_profile_print(t->scr, "timer", name, &t->prof);
+		xfree(name);
+	}
+
+	if (!i)
+		print("script_profile_empty");
+	return i;
+}
+
 /***********************************************************************************/
 
 static char *script_find_path(const char *name) {
@@ -276,6 +364,7 @@ int script_unload(script_t *scr)
 
 	for (l = script_queries; l;)  { t = l->data; l = l->next; if (!t) continue;
 		if (s(t)->scr == scr) { script_query_unbind(t, 1); } }
+	script_events_unload(scr);
 
 	for (l = script_watches; l;)  { t = l->data; l = l->next; if (!t) continue;
 		if (s(t)->scr == scr) { script_watch_unbind(t, 1); } }
@@ -509,6 +598,7 @@ int script_command_unbind(script_command_t *temp, int free)
 
 int script_query_unbind(script_query_t *temp, int free)
 {
+	script_query_events_drop(temp);
 	SCRIPT_UNBIND_HANDLER(SCRIPT_QUERYTYPE, temp->priv_data);
 	query_free(temp->self);	
 	return list_remove(&script_queries, temp, 1);
@@ -657,6 +747,11 @@ script_query_t *script_query_bind(scriptlang_t *s, script_t *scr, char *qname, v
 
 #define NEXT_ARG(y) temp->argv_type[temp->argc] = y; temp->argc++;
 
+	if (!xstrncmp(qname, "observe:", sizeof("observe:")-1)) {
+		temp->observer = 1;
+		qname += sizeof("observe:")-1;
+	}
+
 /* hacki */
 	if (!xstrcmp(qname, "protocol-disconnected"))		temp->hack = 1;
 	else if (!xstrcmp(qname, "protocol-status"))		temp->hack = 2;
@@ -691,6 +786,25 @@ script_query_t *script_query_bind(scriptlang_t *s, script_t *scr, char *qname, v
 	}
 #undef NEXT_ARG
 	temp->real_argc = temp->argc;
+
+	if (temp->observer && !temp->hack) {
+		int i;
+
+		/* we can copy only strings and numbers, windows/sessions/... can be gone before handler is called */
+		for (i = 0; i < temp->argc; i++) {
+			switch (temp->argv_type[i] & QUERY_ARG_TYPES) {
+				case QUERY_ARG_CHARP:
+				case QUERY_ARG_CHARPP:
+				case QUERY_ARG_INT:
+				case QUERY_ARG_UINT:
+					continue;
+				default:
+					debug_error("[script] %s can't be observed (arg %d), binding it synchronously\n", qname, i);
+					temp->observer = 0;
+			}
+			break;
+		}
+	}
 	temp->self = query_connect(s->plugin, qname, script_query_handlers, temp);
 	SCRIPT_BIND_FOOTER(script_queries);
 }
@@ -706,6 +820,123 @@ static void script_var_changed(const char *var) {
 	return;
 }
 
+/*
+ * observers
+ *
+ * handler bound as "observe:<query>" can't change arguments nor stop the
+ * query, so instead of calling it from query_emit() we copy the arguments
+ * and deliver them in batches from idle source. single slow script won't
+ * stall the query (e.g. protocol-message) for everyone else. scripts with
+ * events queued share script_time_budget of every batch, one which used
+ * up its share waits, while others go on (script_events.inc).
+ */
+
+typedef struct {
+	script_query_t	*squery;
+	int		argc;
+	int		argv_type[MAX_ARGS];
+	union {
+		char	*str;
+		char	**strv;
+		int	num;
+	} val[MAX_ARGS];
+	void		*args[MAX_ARGS];
+} script_event_t;
+
+static script_events_t script_events;
+static guint script_events_source;
+
+static void script_event_free(script_event_t *ev) {
+	int i;
+
+	for (i = 0; i < ev->argc; i++) {
+		switch (ev->argv_type[i] & QUERY_ARG_TYPES) {
+			case QUERY_ARG_CHARP:	xfree(ev->val[i].str);		break;
+			case QUERY_ARG_CHARPP:	g_strfreev(ev->val[i].strv);	break;
+		}
+	}
+	xfree(ev);
+}
+
+static gboolean script_event_match(gpointer ev, gpointer squery) {
+	return ((script_event_t *) ev)->squery == squery;
+}
+
+static void script_query_events_drop(script_query_t *squery) {
+	if (script_events.owners)
+		script_events_drop(&script_events, squery->scr, script_event_match, squery, (GDestroyNotify) script_event_free);
+}
+
+static void script_events_unload(script_t *scr) {
+	if (script_events.owners)
+		script_events_forget(&script_events, scr, (GDestroyNotify) script_event_free);
+}
+
+static void script_event_deliver(script_event_t *ev) {
+	script_query_t	*temp = ev->squery;
+	int		argc = temp->argc;
+	int		argv_type[MAX_ARGS];
+	gint64		start;
+
+	SCRIPT_HANDLER_HEADER(script_handler_query_t);
+
+	/* the same view of arguments, as script had when query was emitted */
+	memcpy(argv_type, temp->argv_type, sizeof(argv_type));
+	temp->argc = ev->argc;
+	memcpy(temp->argv_type, ev->argv_type, sizeof(argv_type));
+
+	start = script_time();
+	SCRIPT_HANDLER_FOOTER(script_handler_query, (void **) &ev->args);
+
+	temp->argc = argc;
+	memcpy(temp->argv_type, argv_type, sizeof(argv_type));
+
+	script_profile_add(&temp->prof, temp->scr, "observer", temp->self->name, script_time() - start);
+}
+
+static void script_event_run(gpointer ev, gpointer data) {
+	script_event_deliver(ev);
+	script_event_free(ev);
+}
+
+static gboolean script_events_dispatch(gpointer data) {
+	if (script_events_run(&script_events, (gint64) config_script_time_budget * 1000, script_time, script_event_run, NULL))
+		return TRUE;
+
+	script_events_source = 0;
+	return FALSE;
+}
+
+static void script_event_queue(script_query_t *temp, void **args) {
+	script_event_t *ev = xmalloc(sizeof(script_event_t));
+	int i;
+
+	ev->squery	= temp;
+	ev->argc	= temp->argc;
+	memcpy(ev->argv_type, temp->argv_type, sizeof(ev->argv_type));
+
+	for (i = 0; i < ev->argc; i++) {
+		switch (ev->argv_type[i] & QUERY_ARG_TYPES) {
+			case QUERY_ARG_CHARP:
+				ev->val[i].str = xstrdup(*(char **) args[i]);
+				break;
+			case QUERY_ARG_CHARPP:
+				ev->val[i].strv = g_strdupv(*(char ***) args[i]);
+				break;
+			default:	/* QUERY_ARG_INT, QUERY_ARG_UINT */
+				ev->val[i].num = *(int *) args[i];
+		}
+		ev->args[i] = &ev->val[i];
+	}
+
+	if (!script_events.owners)
+		script_events_init(&script_events);
+	script_events_push(&script_events, temp->scr, ev);
+
+	if (!script_events_source)
+		script_events_source = g_idle_add(script_events_dispatch, NULL);
+}
+
 static WATCHER(script_handle_watch)
 {
 	script_watch_t *temp = data;
@@ -724,11 +955,14 @@ static WATCHER(script_handle_watch)
 static COMMAND(script_command_handlers)
 {
 	script_command_t *temp = script_command_find(name);
+	gint64 start = script_time();
 
 	SCRIPT_HANDLER_HEADER(script_handler_command_t);
 	SCRIPT_HANDLER_MULTI_FOOTER(script_handler_command, (char **) params) {
 		script_command_unbind(temp, 1);
+		return ret;
 	}
+	script_profile_add(&temp->prof, temp->scr, "command", name, script_time() - start);
 	return ret;
 }
 
@@ -740,12 +974,19 @@ static int script_plugin_theme_init( /* plugin_t *p */ )
 
 static TIMER(script_timer_handlers) {
 	script_timer_t *temp = data;
+	gint64 start = script_time();
 	SCRIPT_HANDLER_HEADER(script_handler_timer_t);
 	SCRIPT_HANDLER_FOOTER(script_handler_timer, type) {
 		if (!type) {
 			return -1; /* timer_free(temp->self); */
 		}
 	}
+	if (!type) {
+		char *name = saprintf("scr_%p", temp);
+
+		script_profile_add(&temp->prof, temp->scr, "timer", name, script_time() - start);
+		xfree(name);
+	}
 	if (type)
 		script_timer_unbind(temp, 0);
 	return 0;
@@ -760,6 +1001,7 @@ static QUERY(script_query_handlers)
 	script_query_t saved;
 	char *status = NULL;			/* for temp->hack == 2 */
 	int ign_level = 0;
+	gint64 start = 0;
 
 	SCRIPT_HANDLER_HEADER(script_handler_query_t);
 
@@ -831,7 +1073,13 @@ static QUERY(script_query_handlers)
 			break;
 	}
 
-	SCRIPT_HANDLER_FOOTER(script_handler_query, (void **) &args);
+	if (temp->observer) {
+		script_event_queue(temp, args);
+		ret = 0;
+	} else {
+		start = script_time();
+		SCRIPT_HANDLER_FOOTER(script_handler_query, (void **) &args);
+	}
 
 	if (temp->hack) {
 		memcpy(temp, &saved, sizeof(script_query_t));
@@ -849,6 +1097,9 @@ static QUERY(script_query_handlers)
 		}
 	}
 
+	if (!temp->observer)
+		script_profile_add(&temp->prof, temp->scr, "query", temp->self->name, script_time() - start);
+
 	return ret;
 }
 
@@ -923,6 +1174,8 @@ COMMAND(cmd_script)
 			return script_list(s);
 		else if (!xstrcmp(tmp, "varlist"))
 			return script_var_list(NULL /*s*/);
+		else if (!xstrcmp(tmp, "profile"))
+			return script_profile(param0 ? script_find(NULL, param0) : NULL);
 		else if (!xstrcmp(tmp, "reset"))
 			return script_reset(s);
 		else if (!xstrcmp(tmp, "autorun"))
@@ -26,6 +26,14 @@ typedef enum {
 	SCRIPT_PLUGINTYPE, 
 } script_type_t;
 
+/* time spent in script handler, for /script:profile */
+typedef struct {
+	unsigned int	calls;
+	unsigned int	overruns;	/* calls longer than script_time_budget */
+	gint64		total;		/* in microseconds */
+	gint64		max;
+} script_profile_t;
+
 typedef struct script {
 	struct script	*next;
 
@@ -42,6 +50,7 @@ typedef struct {
 	ekg_timer_t	self;
 	int		removed;
 	void		*priv_data;
+	script_profile_t prof;
 } script_timer_t; 
 
 typedef struct {
@@ -68,12 +77,15 @@ typedef struct {
 	int		real_argc;
 	void		*priv_data;
 	int		hack;
+	int		observer;	/* bound as "observe:<query>", called later from idle source with copy of args */
+	script_profile_t prof;
 } script_query_t; 
 
 typedef struct {
 	script_t	*scr;
 	command_t	*self;
 	void		*priv_data; 
+	script_profile_t prof;
 } script_command_t;
 
 typedef struct {
@@ -182,6 +194,7 @@ extern scriptlang_t *scriptlang;
 int script_unload_lang(scriptlang_t *s);
 
 int script_list(scriptlang_t *s);
+int script_profile(script_t *scr);
 int script_unload_name(scriptlang_t *s, char *name);
 int script_load(scriptlang_t *s, char *name);
 
@@ -25,6 +25,7 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/file.h>
@@ -37,7 +38,7 @@ session_t *sessions = NULL;
 
 static LIST_ADD_COMPARE(session_compare, session_t *) { return xstrcasecmp(data1->uid, data2->uid); }
 
-static __DYNSTUFF_LIST_ADD_SORTED(sessions, session_t, session_compare);	/* sessions_add() */
+static __DYNSTUFF_DLIST_ADD_SORTED(sessions, session_t, session_compare);	/* sessions_add() */
 static __DYNSTUFF_LIST_COUNT(sessions, session_t);				/* sessions_count() */
 
 static LIST_FREE_ITEM(session_param_free_item, session_param_t *) { xfree(data->key); xfree(data->value);  }
@@ -47,6 +48,83 @@ static __DYNSTUFF_DESTROY(session_vars, session_param_t, session_param_free_item
 
 session_t *session_current = NULL;
 
+/*
+ * indexes of sessions: by uid, by alias (both case insensitive, like
+ * xstrcasecmp() in session_find() was) and by pointer. keys are owned by
+ * sessions, so they're updated in session_add(), session_remove(),
+ * session_alias_set() and sessions_free().
+ */
+static GHashTable *sessions_by_uid	= NULL;
+static GHashTable *sessions_by_alias	= NULL;
+static GHashTable *sessions_by_ptr	= NULL;
+
+static guint session_name_hash(gconstpointer key) {
+	const unsigned char *p = key;
+	guint h = 5381;
+
+	for (; *p; p++)
+		h = (h << 5) + h + tolower(*p);
+	return h;
+}
+
+static gboolean session_name_equal(gconstpointer a, gconstpointer b) {
+	return !xstrcasecmp(a, b);
+}
+
+static void sessions_index_alias(session_t *s) {
+	if (s->alias && !g_hash_table_lookup(sessions_by_alias, s->alias))
+		g_hash_table_insert(sessions_by_alias, s->alias, s);
+}
+
+static void sessions_unindex_alias(session_t *s) {
+	session_t *sl;
+
+	if (!s->alias || g_hash_table_lookup(sessions_by_alias, s->alias) != s)
+		return;
+
+	g_hash_table_remove(sessions_by_alias, s->alias);
+
+	/* other session with the same alias? */
+	for (sl = sessions; sl; sl = sl->next) {
+		if (sl != s && sl->alias && !xstrcasecmp(sl->alias, s->alias)) {
+			g_hash_table_insert(sessions_by_alias, sl->alias, sl);
+			break;
+		}
+	}
+}
+
+static void sessions_index_add(session_t *s) {
+	if (!sessions_by_uid) {
+		sessions_by_uid		= g_hash_table_new(session_name_hash, session_name_equal);
+		sessions_by_alias	= g_hash_table_new(session_name_hash, session_name_equal);
+		sessions_by_ptr		= g_hash_table_new(g_direct_hash, g_direct_equal);
+	}
+
+	g_hash_table_insert(sessions_by_uid, s->uid, s);
+	g_hash_table_insert(sessions_by_ptr, s, s);
+	sessions_index_alias(s);
+}
+
+static void sessions_index_remove(session_t *s) {
+	if (!sessions_by_uid)
+		return;
+
+	if (g_hash_table_lookup(sessions_by_uid, s->uid) == s)
+		g_hash_table_remove(sessions_by_uid, s->uid);
+	g_hash_table_remove(sessions_by_ptr, s);
+	sessions_unindex_alias(s);
+}
+
+static void sessions_index_destroy(void) {
+	if (!sessions_by_uid)
+		return;
+
+	g_hash_table_destroy(sessions_by_uid);
+	g_hash_table_destroy(sessions_by_alias);
+	g_hash_table_destroy(sessions_by_ptr);
+	sessions_by_uid = sessions_by_alias = sessions_by_ptr = NULL;
+}
+
 /**
  * session_find_ptr()
  *
@@ -55,7 +133,7 @@ session_t *session_current = NULL;
  * session (in private watch data struct) before it gone.
  *
  * @note It's possible to find another session with the same address as old one.. it's rather not possible.. however.
- *	It's better if you use @a session_find() function.. Yeah, i know it's slower.
+ *	It's better if you use @a session_find() function.
  *
  * @param s - session to look for.
  *
@@ -63,14 +141,10 @@ session_t *session_current = NULL;
  */
 
 session_t *session_find_ptr(session_t *s) {
-	session_t *sl;
-
-	for (sl = sessions; sl; sl = sl->next) {
-		if (sl == s)
-			return s;
+	if (!s || !sessions_by_ptr)
+		return NULL;
 
-	}
-	return NULL;
+	return g_hash_table_lookup(sessions_by_ptr, s);
 }
 
 /**
@@ -89,15 +163,13 @@ session_t *session_find(const char *uid)
 {
 	session_t *s;
 
-	if (!uid)
+	if (!uid || !sessions_by_uid)
 		return NULL;
 
-	for (s = sessions; s; s = s->next) {
-		if (!xstrcasecmp(s->uid, uid) || (s->alias && !xstrcasecmp(s->alias, uid)))
-			return s;
-	}
+	if ((s = g_hash_table_lookup(sessions_by_uid, uid)))
+		return s;
 
-	return NULL;
+	return g_hash_table_lookup(sessions_by_alias, uid);
 }
 
 /**
@@ -141,6 +213,7 @@ session_t *session_add(const char *uid) {
 #endif
 
 	sessions_add(s);
+	sessions_index_add(s);
 
 	/* XXX, wywalic sprawdzanie czy juz jest sesja? w koncu jak dodajemy sesje.. to moze chcemy sie od razu na nia przelaczyc? */
 	if (!window_current->session && (window_current == window_debug || window_current == window_status))
@@ -208,7 +281,7 @@ static LIST_FREE_ITEM(session_free_item, session_t *) {
 	userlist_free(data);
 }
 
-static __DYNSTUFF_LIST_REMOVE_SAFE(sessions, session_t, session_free_item);	/* sessions_remove() */
+static __DYNSTUFF_DLIST_REMOVE_SAFE(sessions, session_t, session_free_item);	/* sessions_remove() */
 static __DYNSTUFF_LIST_DESTROY(sessions, session_t, session_free_item);	/* sessions_destroy() */
 
 /**
@@ -246,7 +319,7 @@ int session_remove(const char *uid)
 	window_t *w;
 	char *tmp;
 	int count;
-	list_t l;
+	watch_t *wt;
 
 	if (!(s = session_find(uid)))
 		return -1;
@@ -274,11 +347,9 @@ int session_remove(const char *uid)
 #endif
 
 /* remove session watches */
-	for (l = watches; l; l = l->next) {
-		watch_t *w = l->data;
-
-		if (w && w->is_session && w->data == s)
-			watch_free(w);
+	for (wt = watches; wt; wt = wt->next) {
+		if (!wt->destroyed && wt->is_session && wt->data == s)
+			watch_free(wt);
 
 	}
 
@@ -289,6 +360,7 @@ int session_remove(const char *uid)
 	query_emit(NULL, "session-removed", &tmp);
 	xfree(tmp);
 
+	sessions_index_remove(s);
 	sessions_remove(s);
 	return 0;
 }
@@ -479,7 +551,24 @@ int session_descr_set(session_t *s, const char *descr)
 	return 0;
 }
 
-PROPERTY_STRING(session, alias)
+PROPERTY_STRING_GET(session, alias)
+
+int session_alias_set(session_t *s, const char *alias)
+{
+	if (!s)
+		return -1;
+
+	if (sessions_by_alias)
+		sessions_unindex_alias(s);
+
+	xfree(s->alias);
+	s->alias = xstrdup(alias);
+
+	if (sessions_by_alias && session_find_ptr(s))
+		sessions_index_alias(s);
+
+	return 0;
+}
 PROPERTY_PRIVATE(session)
 PROPERTY_INT_GET(session, connected, int)
 
@@ -1471,16 +1560,14 @@ void sessions_free() {
 	session_t *s;
 
 	window_t *wl;
-	list_t l;
+	watch_t *w;
 
 	if (!sessions)
 		return;
 
 /* remove _ALL_ session watches */
-	for (l = watches; l; l = l->next) {
-		watch_t *w = l->data;
-
-		if (w && w->is_session)
+	for (w = watches; w; w = w->next) {
+		if (!w->destroyed && w->is_session)
 			watch_free(w);
 	}
 
@@ -1501,6 +1588,7 @@ void sessions_free() {
 	for (wl = windows; wl; wl = wl->next)
 		wl->session = NULL;
 
+	sessions_index_destroy();
 	sessions_destroy();
 	session_current = NULL;
 	window_current->session = NULL;
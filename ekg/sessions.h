@@ -126,6 +126,7 @@ typedef struct session_param {
  */
 typedef struct ekg_session {
 	struct ekg_session	*next;
+	struct ekg_session	*prev;		/**< dlist, see dynstuff.h */
 
 /* public: */
 	void		*plugin;		/**< protocol plugin owing session */
@@ -29,12 +29,27 @@
 /* WEXITSTATUS for FreeBSD */
 #include <sys/wait.h>
 
+#include <ctype.h>
+
+#include "timer_wheel.inc"
+
 /*
  * Common API
  */
 
-static GSList *children = NULL;
-static GSList *timers = NULL;
+	/* GQueue, so every source can keep its link, and unlink itself in O(1) */
+static GQueue children = G_QUEUE_INIT;
+static GQueue timers = G_QUEUE_INIT;
+
+	/* timers are also indexed by plugin and by private data (session for
+	 * timer_add_session()), both with and without name, see timer_index_add() */
+typedef enum {
+	TIMER_BY_PLUGIN = 0,
+	TIMER_BY_PLUGIN_NAME,
+	TIMER_BY_DATA,
+	TIMER_BY_DATA_NAME,
+	TIMER_INDEXES
+} timer_index_t;
 
 struct ekg_source {
 	guint id;
@@ -51,6 +66,7 @@ struct ekg_source {
 
 	gpointer priv_data;
 	GDestroyNotify destr;
+	GList *link;		/* in children or timers */
 
 	union {
 		struct {
@@ -65,10 +81,22 @@ struct ekg_source {
 			 * however, /at uses it, and so does xmsg plugin
 			 * the former needs fixing, the latter will probably be removed */
 			gboolean persist;
+
+			timer_wheel_entry_t entry;	/* entry.link.data is this source */
+			struct timer_bucket *buckets[TIMER_INDEXES];
+			GList links[TIMER_INDEXES];	/* in buckets[i]->timers */
+			guint old_api : 1;		/* timer_add(), uses as_old_timer */
+			guint in_call : 1;		/* handler is running */
+			guint removed : 1;		/* will be freed, as soon as handler returns */
 		} as_timer;
 	} details;
 };
 
+static void timer_remove_source(struct ekg_source *t);
+static gboolean timers_remove_by_handler(gpointer handler, const gchar *name);
+static gboolean timers_remove_indexed(timer_index_t index, gconstpointer owner, const gchar *name, const gchar *exact);
+static void timers_destroy(void);
+
 static ekg_source_t source_new(plugin_t *plugin, const gchar *name_format, gpointer data, GDestroyNotify destr, va_list args) {
 	struct ekg_source *s = g_slice_new(struct ekg_source);
 
@@ -102,7 +130,10 @@ static void source_free(struct ekg_source *s) {
  * @param s - the source identifier.
  */
 void ekg_source_remove(ekg_source_t s) {
-	g_source_remove(s->id);
+	if (s->source)
+		g_source_remove(s->id);
+	else	/* timers don't have GSource of their own */
+		timer_remove_source(s);
 }
 
 /**
@@ -127,11 +158,6 @@ struct source_remove_data {
 	gboolean *ret;
 };
 
-struct source_find_data {
-	gpointer data;
-	const gchar *name;
-};
-
 static void source_remove_by_h(gpointer data, gpointer user_data) {
 	struct ekg_source *s = data;
 	struct source_remove_data *args = user_data;
@@ -148,9 +174,9 @@ gboolean ekg_source_remove_by_handler(gpointer handler, const gchar *name) {
 	gboolean ret = FALSE;
 	struct source_remove_data args = { handler, name, &ret };
 
-	g_slist_foreach(timers, source_remove_by_h, &args);
-	if (G_UNLIKELY(!ret))
-		g_slist_foreach(children, source_remove_by_h, &args);
+	if (timers_remove_by_handler(handler, name))
+		return TRUE;
+	g_queue_foreach(&children, source_remove_by_h, &args);
 	return ret;
 }
 
@@ -186,8 +212,9 @@ gboolean ekg_source_remove_by_data(gpointer priv_data, const gchar *name) {
 	gboolean ret = FALSE;
 	struct source_remove_data args = { priv_data, name, &ret };
 
-	g_slist_foreach(children, source_remove_by_d, &args);
-	g_slist_foreach(timers, source_remove_by_d, &args);
+	g_queue_foreach(&children, source_remove_by_d, &args);
+	if (timers_remove_indexed(name ? TIMER_BY_DATA_NAME : TIMER_BY_DATA, priv_data, name, NULL))
+		ret = TRUE;
 	return ret;
 }
 
@@ -219,8 +246,9 @@ gboolean ekg_source_remove_by_plugin(plugin_t *plugin, const gchar *name) {
 	gboolean ret = FALSE;
 	struct source_remove_data args = { plugin, name, &ret };
 
-	g_slist_foreach(children, source_remove_by_p, &args);
-	g_slist_foreach(timers, source_remove_by_p, &args);
+	g_queue_foreach(&children, source_remove_by_p, &args);
+	if (timers_remove_indexed(name ? TIMER_BY_PLUGIN_NAME : TIMER_BY_PLUGIN, plugin, name, NULL))
+		ret = TRUE;
 	return ret;
 }
 
@@ -230,8 +258,8 @@ static void source_remove(gpointer data, gpointer user_data) {
 }
 
 void sources_destroy(void) {
-	g_slist_foreach(children, source_remove, NULL);
-	g_slist_foreach(timers, source_remove, NULL);
+	g_queue_foreach(&children, source_remove, NULL);
+	timers_destroy();
 }
 
 /*
@@ -240,7 +268,7 @@ void sources_destroy(void) {
 
 static void child_destroy_notify(gpointer data) {
 	struct ekg_source *c = data;
-	children = g_slist_remove(children, data);
+	g_queue_delete_link(&children, c->link);
 
 	if (!c->details.as_child.terminated)
 #ifndef NO_POSIX_SYSTEM
@@ -298,7 +326,8 @@ ekg_child_t ekg_child_add(plugin_t *plugin, const gchar *name_format, GPid pid,
 	c->handler.as_child = handler;
 	c->details.as_child.pid = pid;
 	c->details.as_child.terminated = FALSE;
-	children = g_slist_prepend(children, c);
+	g_queue_push_head(&children, c);
+	c->link = children.head;
 	source_set_id(c, g_child_watch_add_full(G_PRIORITY_DEFAULT, pid, child_wrapper, c, child_destroy_notify));
 
 	return c;
@@ -306,34 +335,313 @@ ekg_child_t ekg_child_add(plugin_t *plugin, const gchar *name_format, GPid pid,
 
 /*
  * Timers
+ *
+ * all timers are kept in one timer wheel (timer_wheel.inc), turned by
+ * a single GSource, which sleeps until the first timer is due. timers with
+ * close due times are called together, see timer_schedule().
  */
 
-static void timer_wrapper_destroy_notify(gpointer data) {
-	struct ekg_source *t = data;
+typedef struct timer_bucket {
+	timer_index_t index;
+	gconstpointer owner;	/* plugin or private data */
+	gchar *name;		/* NULL for TIMER_BY_PLUGIN and TIMER_BY_DATA */
+	GQueue timers;		/* newest first, like timers */
+} timer_bucket_t;
+
+static timer_wheel_t timers_wheel;
+static GSource *timers_source;
+static GHashTable *timers_index;	/* timer_bucket_t -> itself */
+static guint timers_last_id;
+
+static guint64 timers_now(void) {
+#if GLIB_CHECK_VERSION(2, 28, 0)
+	return g_get_monotonic_time() / 1000;
+#else
+	GTimeVal tv;
+
+	g_get_current_time(&tv);
+	return (guint64) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#endif
+}
+
+static guint timer_bucket_hash(gconstpointer key) {
+	const timer_bucket_t *b = key;
+	guint h = g_direct_hash(b->owner) * TIMER_INDEXES + b->index;
+	const gchar *p;
+
+	/* names are compared with strcasecmp() */
+	for (p = b->name; p && *p; p++)
+		h = h * 33 + tolower((unsigned char) *p);
+	return h;
+}
+
+static gboolean timer_bucket_equal(gconstpointer a, gconstpointer b) {
+	const timer_bucket_t *x = a, *y = b;
+
+	if (x->index != y->index || x->owner != y->owner)
+		return FALSE;
+	return (!x->name || !strcasecmp(x->name, y->name));
+}
 
-	t->handler.as_old_timer(1, t->priv_data);
+static void timer_bucket_free(gpointer data) {
+	timer_bucket_t *b = data;
+
+	g_free(b->name);
+	g_slice_free(timer_bucket_t, b);
+}
+
+static timer_bucket_t *timer_bucket_find(timer_index_t index, gconstpointer owner, const gchar *name) {
+	timer_bucket_t key = { index, owner, (gchar *) name, G_QUEUE_INIT };
+
+	return (timers_index ? g_hash_table_lookup(timers_index, &key) : NULL);
+}
+
+static void timer_index_add(struct ekg_source *t) {
+	timer_index_t i;
+
+	for (i = 0; i < TIMER_INDEXES; i++) {
+		gconstpointer owner = (i == TIMER_BY_PLUGIN || i == TIMER_BY_PLUGIN_NAME) ? (gconstpointer) t->plugin : t->priv_data;
+		const gchar *name = (i == TIMER_BY_PLUGIN_NAME || i == TIMER_BY_DATA_NAME) ? t->name : NULL;
+		timer_bucket_t *b = timer_bucket_find(i, owner, name);
+
+		if (!b) {
+			b = g_slice_new(timer_bucket_t);
+			b->index = i;
+			b->owner = owner;
+			b->name = g_strdup(name);
+			g_queue_init(&b->timers);
+			g_hash_table_insert(timers_index, b, b);
+		}
+
+		t->details.as_timer.links[i].data = t;
+		t->details.as_timer.links[i].next = t->details.as_timer.links[i].prev = NULL;
+		g_queue_push_head_link(&b->timers, &t->details.as_timer.links[i]);
+		t->details.as_timer.buckets[i] = b;
+	}
+}
+
+static void timer_index_remove(struct ekg_source *t) {
+	timer_index_t i;
+
+	for (i = 0; i < TIMER_INDEXES; i++) {
+		timer_bucket_t *b = t->details.as_timer.buckets[i];
+
+		g_queue_unlink(&b->timers, &t->details.as_timer.links[i]);
+		if (g_queue_is_empty(&b->timers))
+			g_hash_table_remove(timers_index, b);
+	}
+}
+
+/*
+ * timer_schedule()
+ *
+ * puts timer in the wheel, @a interval ms from @a now. it may be called up
+ * to timer_slack ms late (but not more than a quarter of interval, so short
+ * timers stay accurate), so that timers due at about the same time are
+ * called together, and main loop wakes up once for all of them.
+ */
+static void timer_schedule(struct ekg_source *t, guint64 now) {
+	guint64 interval = t->details.as_timer.interval;
+	guint64 slack = (config_timer_slack > 0) ? MIN((guint64) config_timer_slack, interval / 4) : 0;
+
+	timer_wheel_add(&timers_wheel, &t->details.as_timer.entry, timer_wheel_slack(now + interval, slack));
+}
+
+static void timer_free(struct ekg_source *t) {
+	timer_wheel_remove(&timers_wheel, &t->details.as_timer.entry);
+	timer_index_remove(t);
+	g_queue_delete_link(&timers, t->link);
+
+	if (t->details.as_timer.old_api)
+		t->handler.as_old_timer(1, t->priv_data);
+	else if (G_UNLIKELY(t->destr))
+		t->destr(t->priv_data);
 
-	timers = g_slist_remove(timers, data);
 	source_free(t);
 }
 
-static gboolean timer_wrapper_old(gpointer data) {
-	struct ekg_source *t = data;
+static void timer_call(struct ekg_source *t, guint64 now) {
+	gboolean keep;
+
+	g_get_current_time(&(t->details.as_timer.lasttime));
+
+	t->details.as_timer.in_call = TRUE;
+	if (t->details.as_timer.old_api)
+		keep = !(t->handler.as_old_timer(0, t->priv_data) == -1 || !t->details.as_timer.persist);
+	else
+		keep = t->handler.as_timer(t->priv_data);
+	t->details.as_timer.in_call = FALSE;
+
+	if (!keep)
+		t->details.as_timer.removed = TRUE;
+
+	if (t->details.as_timer.removed)
+		timer_free(t);
+	else
+		timer_schedule(t, now);
+}
+
+static gboolean timers_source_prepare(GSource *source, gint *timeout) {
+	guint64 next = timer_wheel_next(&timers_wheel);
+	guint64 now;
+
+	if (next == G_MAXUINT64) {
+		*timeout = -1;
+		return FALSE;
+	}
+
+	now = timers_now();
+	if (next <= now) {
+		*timeout = 0;
+		return TRUE;
+	}
+
+	*timeout = MIN(next - now, G_MAXINT);
+	return FALSE;
+}
+
+static gboolean timers_source_check(GSource *source) {
+	return (timer_wheel_next(&timers_wheel) <= timers_now());
+}
+
+static gboolean timers_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+	guint64 now = timers_now();
+	timer_wheel_entry_t *e;
+
+	timer_wheel_advance(&timers_wheel, now);
+	while ((e = timer_wheel_pop(&timers_wheel)))
+		timer_call(e->link.data, now);
+
+	return TRUE;
+}
+
+static GSourceFuncs timers_source_funcs = {
+	timers_source_prepare,
+	timers_source_check,
+	timers_source_dispatch,
+	NULL
+};
+
+static void timer_start(struct ekg_source *t, guint64 interval, gboolean persist, gboolean old_api) {
+	if (G_UNLIKELY(!timers_source)) {
+		timer_wheel_init(&timers_wheel, timers_now());
+		timers_index = g_hash_table_new_full(timer_bucket_hash, timer_bucket_equal, NULL, timer_bucket_free);
+		timers_source = g_source_new(&timers_source_funcs, sizeof(GSource));
+		g_source_attach(timers_source, NULL);
+	}
+
+	t->id = ++timers_last_id;
+	t->source = NULL;
+	if (!t->name)
+		t->name = g_strdup_printf("_%d", t->id);
+
+	t->details.as_timer.interval = interval;
+	t->details.as_timer.persist = persist;
+	t->details.as_timer.old_api = old_api;
+	t->details.as_timer.in_call = FALSE;
+	t->details.as_timer.removed = FALSE;
+	timer_wheel_entry_init(&t->details.as_timer.entry, t);
+
+	g_queue_push_head(&timers, t);
+	t->link = timers.head;
+	timer_index_add(t);
+
+	g_get_current_time(&(t->details.as_timer.lasttime));
+	timer_schedule(t, timers_now());
+}
+
+/*
+ * removing: if handler of timer is running, timer is freed when it returns.
+ * timers are marked first, and freed then, so destructors may remove other
+ * timers, also ones being removed (that does nothing).
+ */
+
+static void timer_remove_source(struct ekg_source *t) {
+	if (t->details.as_timer.removed)
+		return;
 
-	g_source_get_current_time(t->source, &(t->details.as_timer.lasttime));
-	return !(t->handler.as_old_timer(0, t->priv_data) == -1 || !t->details.as_timer.persist);
+	t->details.as_timer.removed = TRUE;
+	if (!t->details.as_timer.in_call)
+		timer_free(t);
+}
+
+static void timer_mark(GPtrArray *found, struct ekg_source *t) {
+	if (t->details.as_timer.removed)
+		return;
+
+	t->details.as_timer.removed = TRUE;
+	g_ptr_array_add(found, t);
+}
+
+static gboolean timers_remove_marked(GPtrArray *found) {
+	gboolean ret = (found->len > 0);
+	guint i;
+
+	for (i = 0; i < found->len; i++) {
+		struct ekg_source *t = found->pdata[i];
+
+		if (!t->details.as_timer.in_call)
+			timer_free(t);
+	}
+
+	g_ptr_array_free(found, TRUE);
+	return ret;
+}
+
+/* removes timers from bucket, either all of them, or only the ones named
+ * exactly @a exact (bucket names are case-insensitive) */
+static gboolean timers_remove_indexed(timer_index_t index, gconstpointer owner, const gchar *name, const gchar *exact) {
+	timer_bucket_t *b = timer_bucket_find(index, owner, name);
+	GPtrArray *found = g_ptr_array_new();
+	GList *l;
+
+	for (l = (b ? b->timers.head : NULL); l; l = l->next) {
+		struct ekg_source *t = l->data;
+
+		if (!exact || !xstrcmp(t->name, exact))
+			timer_mark(found, t);
+	}
+
+	return timers_remove_marked(found);
+}
+
+static gboolean timers_remove_by_handler(gpointer handler, const gchar *name) {
+	GPtrArray *found = g_ptr_array_new();
+	GList *l;
+
+	for (l = timers.head; l; l = l->next) {
+		struct ekg_source *t = l->data;
+
+		if (t->handler.as_void == handler && (!name || G_UNLIKELY(!strcasecmp(t->name, name))))
+			timer_mark(found, t);
+	}
+
+	return timers_remove_marked(found);
+}
+
+static void timers_destroy(void) {
+	GPtrArray *found = g_ptr_array_new();
+	GList *l;
+
+	for (l = timers.head; l; l = l->next)
+		timer_mark(found, l->data);
+	timers_remove_marked(found);
+
+	/* unless we're called from a handler */
+	if (timers_source && g_queue_is_empty(&timers)) {
+		g_source_destroy(timers_source);
+		g_source_unref(timers_source);
+		timers_source = NULL;
+		g_hash_table_destroy(timers_index);
+		timers_index = NULL;
+	}
 }
 
 ekg_timer_t timer_add_ms(plugin_t *plugin, const gchar *name, guint period, gboolean persist, gint (*function)(gint, gpointer), gpointer data) {
 	struct ekg_source *t = source_new(plugin, name, data, NULL, NULL);
 
 	t->handler.as_old_timer = function;
-	t->details.as_timer.interval = period;
-	t->details.as_timer.persist = persist;
-	timers = g_slist_prepend(timers, t);
-
-	source_set_id(t, g_timeout_add_full(G_PRIORITY_DEFAULT, period, timer_wrapper_old, t, timer_wrapper_destroy_notify));
-	g_source_get_current_time(t->source, &(t->details.as_timer.lasttime));
+	timer_start(t, period, persist, TRUE);
 
 	return t;
 }
@@ -364,22 +672,6 @@ ekg_timer_t timer_add_session(session_t *session, const gchar *name, guint perio
 	return timer_add(session->plugin, name, period, persist, (void *) function, session);
 }
 
-static void timer_destroy_notify(gpointer data) {
-	struct ekg_source *t = data;
-	timers = g_slist_remove(timers, data);
-
-	if (G_UNLIKELY(t->destr))
-		t->destr(t->priv_data);
-
-	source_free(t);
-}
-
-static gboolean timer_wrapper(gpointer data) {
-	struct ekg_source *t = data;
-
-	return t->handler.as_timer(t->priv_data);
-}
-
 /**
  * ekg_timer_add()
  *
@@ -389,9 +681,9 @@ static gboolean timer_wrapper(gpointer data) {
  * @param name_format - format string for timer name. Can be NULL, or
  *	simple string if the name is guaranteed not to contain '%'.
  * @param interval - the interval between successive timer calls,
- *	in milliseconds. If it is a multiple of 1000, the timer will use
- *	glib second timeouts (more efficient); otherwise, the millisecond
- *	timeout will be used.
+ *	in milliseconds. The handler may be called up to timer_slack ms
+ *	(but not more than a quarter of interval) late, so that timers due
+ *	at about the same time are called together.
  * @param handler - the handler func. It will be passed the private
  *	data, and should either return TRUE or FALSE, depending on whether
  *	the timer should persist or be removed.
@@ -405,7 +697,6 @@ static gboolean timer_wrapper(gpointer data) {
 ekg_timer_t ekg_timer_add(plugin_t *plugin, const gchar *name_format, guint64 interval, GSourceFunc handler, gpointer data, GDestroyNotify destr, ...) {
 	va_list args;
 	struct ekg_source *t;
-	guint id;
 	
 	va_start(args, destr);
 	t = source_new(plugin, name_format, data, destr, args);
@@ -413,17 +704,7 @@ ekg_timer_t ekg_timer_add(plugin_t *plugin, const gchar *name_format, guint64 in
 
 	g_assert(handler);
 	t->handler.as_timer = handler;
-	t->details.as_timer.interval = interval;
-	t->details.as_timer.persist = TRUE;
-
-	timers = g_slist_prepend(timers, t);
-	if (interval % 1000 == 0)
-		id = g_timeout_add_seconds_full(G_PRIORITY_DEFAULT, interval / 1000, timer_wrapper, t, timer_destroy_notify);
-	else
-		id = g_timeout_add_full(G_PRIORITY_DEFAULT, interval, timer_wrapper, t, timer_destroy_notify);
-
-	source_set_id(t, id);
-	g_source_get_current_time(t->source, &(t->details.as_timer.lasttime));
+	timer_start(t, interval, TRUE, FALSE);
 
 	return t;
 }
@@ -444,42 +725,30 @@ gint timer_remove(plugin_t *plugin, const gchar *name) {
 	return (ekg_source_remove_by_plugin(plugin, name) ? 0 : -1);
 }
 
-gint timer_find_session_cmp(gconstpointer li, gconstpointer ui) {
-	const struct ekg_source *t = li;
-	const struct source_find_data *args = ui;
-
-	return !(t->priv_data == args->data && !xstrcmp(args->name, t->name));
-}
-
 ekg_timer_t timer_find_session(session_t *session, const gchar *name) {
-	struct source_find_data args = { session, name };
+	timer_bucket_t *b;
+	GList *l;
 
-	if (!session)
+	if (!session || !name || !(b = timer_bucket_find(TIMER_BY_DATA_NAME, session, name)))
 		return NULL;
 
-	return (ekg_timer_t) g_slist_find_custom(timers, &args, timer_find_session_cmp);
-}
+	for (l = b->timers.head; l; l = l->next) {
+		struct ekg_source *t = l->data;
 
-static void timer_remove_session_iter(gpointer data, gpointer user_data) {
-	struct ekg_source *t = data;
-	struct source_remove_data *args = user_data;
-
-	if (t->priv_data == args->data && !xstrcmp(args->name, t->name)) {
-		ekg_source_remove(t);
-		*args->ret = TRUE;
+		if (!t->details.as_timer.removed && !xstrcmp(name, t->name))
+			return t;
 	}
+	return NULL;
 }
 
 gint timer_remove_session(session_t *session, const gchar *name) {
-	gboolean removed = FALSE;
-	struct source_remove_data args = { session, name, &removed };
-
 	if (!session)
 		return -1;
 	g_assert(session->plugin);
 
-	g_slist_foreach(timers, timer_remove_session_iter, &args);
-	return ((removed) ? 0 : -1);
+	if (!name)
+		return -1;
+	return (timers_remove_indexed(TIMER_BY_DATA_NAME, session, name, name) ? 0 : -1);
 }
 
 /*
@@ -507,7 +776,7 @@ static gchar *timer_next_call(struct ekg_source *t) {
 		ends.tv_sec++;
 	}
 
-	g_source_get_current_time(t->source, &tv);
+	g_get_current_time(&tv);
 
 	if (tv.tv_sec - ends.tv_sec > 2)
 		return g_strdup("?");
@@ -566,9 +835,9 @@ static void child_print(gpointer data, gpointer user_data) {
 }
 
 gint ekg_children_print(gint quiet) {
-	g_slist_foreach(children, child_print, &quiet);
+	g_queue_foreach(&children, child_print, &quiet);
 
-	if (!children) {
+	if (g_queue_is_empty(&children)) {
 		printq("no_processes");
 		return -1;
 	}
@@ -599,7 +868,7 @@ COMMAND(cmd_debug_timers) {
 /* XXX, */
 	printq("generic_bold", ("plugin      name               pers peri     handler  next"));
 
-	g_slist_foreach(timers, timer_debug_print, &quiet);
+	g_queue_foreach(&timers, timer_debug_print, &quiet);
 	return 0;
 }
 
@@ -636,7 +905,7 @@ static void timer_print(gpointer data, gpointer user_data) {
 
 	(*args->count)++;
 
-	g_source_get_current_time(t->source, &tv);
+	g_get_current_time(&tv);
 
 	ends.tv_sec = t->details.as_timer.lasttime.tv_sec + (t->details.as_timer.interval / 1000);
 	ends.tv_usec = t->details.as_timer.lasttime.tv_usec + ((t->details.as_timer.interval % 1000) * 1000);
@@ -709,7 +978,7 @@ COMMAND(cmd_at)
 				return -1;
 			}
 
-			if (g_slist_find_custom(timers, a_name, timer_match_name)) {
+			if (g_queue_find_custom(&timers, a_name, timer_match_name)) {
 				printq("at_exist", a_name);
 				return -1;
 			}
@@ -921,7 +1190,7 @@ COMMAND(cmd_at)
 
 		{
 			struct timer_print_args args = { a_name, &count, quiet };
-			g_slist_foreach(timers, timer_print, &args);
+			g_queue_foreach(&timers, timer_print, &args);
 		}
 
 		if (!count) {
@@ -991,7 +1260,7 @@ COMMAND(cmd_timer)
 				return -1;
 			}
 
-			if (g_slist_find_custom(timers, t_name, timer_match_name)) {
+			if (g_queue_find_custom(&timers, t_name, timer_match_name)) {
 				printq("timer_exist", t_name);
 				return -1;
 			}
@@ -1104,7 +1373,7 @@ COMMAND(cmd_timer)
 
 		{
 			struct timer_print_args args = { t_name, &count, quiet };
-			g_slist_foreach(timers, timer_print_list, &args);
+			g_queue_foreach(&timers, timer_print_list, &args);
 		}
 
 		if (!count) {
@@ -1163,7 +1432,7 @@ void timers_write(GOutputStream *f) {
 		}
 	}
 
-	g_slist_foreach(timers, timer_write, f);
+	g_queue_foreach(&timers, timer_write, f);
 }
 
 /*
@@ -1176,13 +1445,11 @@ void timers_write(GOutputStream *f) {
  * zwraca obiekt watch_t o podanych parametrach.
  */
 watch_t *watch_find(plugin_t *plugin, int fd, watch_type_t type) {
-	list_t l;
+	watch_t *w;
 	
-	for (l = watches; l; l = l->next) {
-		watch_t *w = l->data;
-
+	for (w = watches; w; w = w->next) {
 			/* XXX: added simple plugin ignoring, make something nicer? */
-		if (w && ((plugin == (void*) -1) || w->plugin == plugin) && w->fd == fd && (w->type & type))
+		if (!w->destroyed && ((plugin == (void*) -1) || w->plugin == plugin) && w->fd == fd && (w->type & type))
 			return w;
 	}
 
@@ -1205,6 +1472,9 @@ static LIST_FREE_ITEM(watch_free_data, watch_t *) {
 	g_io_channel_unref(data->f);
 }
 
+#define WATCH_LINE_READ_MIN	1024		/* first, and the smallest read() of WATCH_READ_LINE */
+#define WATCH_LINE_READ_MAX	65536		/* the largest one, when data comes in bursts */
+
 /*
  * watch_handle_line()
  *
@@ -1212,51 +1482,58 @@ static LIST_FREE_ITEM(watch_free_data, watch_t *) {
  */
 static int watch_handle_line(watch_t *w)
 {
-	char buf[1024], *tmp;
 	int ret, res = 0;
 	int (*handler)(int, int, const char *, void *) = w->handler;
+	gsize start = 0, len;
+	char *tmp;
 
 	g_assert(w);
 
+	if (!w->read_size)
+		w->read_size = WATCH_LINE_READ_MIN;
+
+	/* read straight into buffer, after data left from previous call */
+	len = w->buf->len;
+	g_string_set_size(w->buf, len + w->read_size);
+
 #ifndef NO_POSIX_SYSTEM
-	ret = read(w->fd, buf, sizeof(buf) - 1);
+	ret = read(w->fd, w->buf->str + len, w->read_size);
 #else
-	ret = recv(w->fd, buf, sizeof(buf) - 1, 0);
+	ret = recv(w->fd, w->buf->str + len, w->read_size, 0);
 	if (ret == -1 && WSAGetLastError() == WSAENOTSOCK) {
 		printf("recv() failed Error: %d, using ReadFile()", WSAGetLastError());
-		res = ReadFile(w->fd, &buf, sizeof(buf)-1, &ret, NULL);
+		res = ReadFile(w->fd, w->buf->str + len, w->read_size, &ret, NULL);
 		printf(" res=%d ret=%d\n", res, ret);
 	}
 	res = 0;
 #endif
 
-	if (ret > 0) {
-		buf[ret] = 0;
-		string_append(w->buf, buf);
-#ifdef NO_POSIX_SYSTEM
-		printf("RECV: %s\n", buf);
-#endif
-	}
+	g_string_truncate(w->buf, len + (ret > 0 ? ret : 0));
+
+	/* if whole buffer was filled, there's probably more waiting */
+	if (ret == w->read_size && w->read_size < WATCH_LINE_READ_MAX)
+		w->read_size *= 2;
+	else if (ret > 0 && ret < w->read_size / 4 && w->read_size > WATCH_LINE_READ_MIN)
+		w->read_size /= 2;
 
 	if (ret == 0 || (ret == -1 && errno != EAGAIN))
 		string_append_c(w->buf, '\n');
 
-	while ((tmp = xstrchr(w->buf->str, '\n'))) {
-		size_t strlen = tmp - w->buf->str;		/* get len of str from begining to \n char */
-		char *line = xstrndup(w->buf->str, strlen);	/* strndup() str with len == strlen */
-
-		/* we strndup() str with len == strlen, so we don't need to call xstrlen() */
-		if (strlen > 1 && line[strlen - 1] == '\r')
-			line[strlen - 1] = 0;
+	/* lines are terminated in place, and handler gets pointer into buffer.
+	 * searching starts where it stopped last time, and buffer is compacted
+	 * once, after all complete lines were handled. */
+	while ((tmp = memchr(w->buf->str + w->buf_scan, '\n', w->buf->len - w->buf_scan))) {
+		char *line = w->buf->str + start;
+		gsize linelen = tmp - line;
 
-		if ((res = handler(0, w->fd, line, w->data)) == -1) {
-			xfree(line);
-			break;
-		}
+		*tmp = '\0';
+		if (linelen > 1 && line[linelen - 1] == '\r')
+			line[linelen - 1] = '\0';
 
-		string_remove(w->buf, strlen + 1);
+		start = w->buf_scan = (tmp - w->buf->str) + 1;
 
-		xfree(line);
+		if ((res = handler(0, w->fd, line, w->data)) == -1)
+			break;
 	}
 
 	/* je¶li koniec strumienia, lub nie jest to ci±głe przegl±danie,
@@ -1264,6 +1541,10 @@ static int watch_handle_line(watch_t *w)
 	if (res == -1 || ret == 0 || (ret == -1 && errno != EAGAIN))
 		return -1; /* XXX: close(fd) was here, seemed unsafe */
 
+	if (start)
+		g_string_erase(w->buf, 0, start);
+	w->buf_scan = w->buf->len;
+
 	return res;
 }
 
@@ -1447,6 +1728,36 @@ static gboolean watch_old_wrapper(GIOChannel *f, GIOCondition cond, gpointer dat
 	return TRUE;
 }
 
+static GSList *watches_destroyed;	/* destroyed, but still on watches list */
+static guint watches_cleanup_id;
+
+static gboolean watches_cleanup(gpointer data) {
+	while (watches_destroyed) {
+		watch_t *w = watches_destroyed->data;
+
+		watches_destroyed = g_slist_delete_link(watches_destroyed, watches_destroyed);
+		DLIST_UNLINK2(&watches, w);
+		xfree(w);
+	}
+
+	watches_cleanup_id = 0;
+	return FALSE;
+}
+
+/*
+ * watches_destroy()
+ *
+ * frees destroyed watches and forgets about the rest, at exit.
+ */
+void watches_destroy(void) {
+	if (watches_cleanup_id) {
+		g_source_remove(watches_cleanup_id);
+		watches_cleanup(NULL);
+	}
+
+	watches = NULL;
+}
+
 static void watch_old_destroy_notify(gpointer data) {
 	watch_t *w = data;
 
@@ -1458,7 +1769,13 @@ static void watch_old_destroy_notify(gpointer data) {
 #endif
 
 	watch_free_data(w);
-	list_remove_safe(&watches, w, 1);
+	w->destroyed = 1;
+
+		/* someone may be walking watches right now (ekg_close() -> watch_free() -> here),
+		 * so we can't unlink it yet */
+	watches_destroyed = g_slist_prepend(watches_destroyed, w);
+	if (!watches_cleanup_id)
+		watches_cleanup_id = g_idle_add_full(G_PRIORITY_HIGH, watches_cleanup, NULL, NULL);
 
 	debug("watch_old_destroy_notify() REMOVED WATCH, oldwatch: 0x%x\n", w);
 }
@@ -1530,7 +1847,7 @@ watch_t *watch_add(plugin_t *plugin, int fd, watch_type_t type, watcher_handler_
 	else
 		w->id = -1; /* backwards compat magic ;f */
 
-	list_add_beginning(&watches, w);
+	dlist_add_beginning((dlist_t *) (void *) &watches, (dlist_t) w);
 	return w;
 }
 
@@ -56,8 +56,6 @@ gint timer_remove_session(session_t *session, const gchar *name);
 
 /* Watches */
 
-extern list_t watches;
-
 typedef enum {
 	WATCH_NONE = 0,
 	WATCH_WRITE = 1,
@@ -76,6 +74,9 @@ typedef WATCHER(watcher_handler_func_t);
 typedef WATCHER_SESSION(watcher_session_handler_func_t);
 
 typedef struct watch {
+	struct watch *next;
+	struct watch *prev;	/* dlist, see dynstuff.h */
+
 	int fd;			/* obserwowany deskryptor */
 	watch_type_t type;	/* co sprawdzamy */
 	plugin_t *plugin;	/* wtyczka obsługuj±ca deskryptor */
@@ -97,8 +98,15 @@ typedef struct watch {
 
 	guint id;
 	GIOChannel *f;
+
+	gsize buf_scan;		/* WATCH_READ_LINE: buf up to this offset has no '\n' */
+	int read_size;		/* WATCH_READ_LINE: how much to read() next time */
+
+	int destroyed;		/* already freed, stays on list until next main loop iteration, skip it */
 } watch_t;
 
+extern watch_t *watches;
+
 #ifndef EKG2_WIN32_NOFUNCTION
 
 #ifdef __GNU__
@@ -121,6 +129,7 @@ watch_t *watch_add_session(session_t *session, int fd, watch_type_t type, watche
 #define watch_add_session_line(s, fd, type, handler) watch_add_session(s, fd, type, (watcher_session_handler_func_t *) (handler))
 
 int watch_remove(plugin_t *plugin, int fd, watch_type_t type);
+void watches_destroy(void);
 
 #endif
 
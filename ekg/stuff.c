@@ -94,6 +94,7 @@ char *config_sound_app = NULL;
 int config_changed = 0;
 int config_display_ack = 12;
 int config_completion_notify = 1;
+int config_connection_flush_delay = 20;
 char *config_completion_char = NULL;
 time_t ekg_started = 0;
 int config_display_notify = 1;
@@ -112,6 +113,7 @@ int config_make_window = 6;
 char *config_tab_command = NULL;
 int config_save_password = 1;
 int config_save_quit = 1;
+int config_script_time_budget = 20;
 char *config_timestamp = NULL;
 int config_timestamp_show = 1;
 int config_display_sent = 1;
@@ -120,6 +122,7 @@ int config_sort_windows = 1;
 int config_keep_reason = 1;
 char *config_speech_app = NULL;
 int config_time_deviation = 300;
+int config_timer_slack = 250;
 int config_mesg = MESG_DEFAULT;
 int config_display_welcome = 1;
 char *config_display_color_map = NULL;
@@ -640,8 +643,8 @@ const char *compile_time() {
 static LIST_FREE_ITEM(newconference_free_item, newconference_t *) { xfree(data->name); xfree(data->session); userlists_destroy(&(data->participants)); }
 
 DYNSTUFF_LIST_DECLARE(newconferences, newconference_t, newconference_free_item,
-	static __DYNSTUFF_LIST_ADD,		/* newconferences_add() */
-	static __DYNSTUFF_LIST_REMOVE_SAFE,	/* newconferences_remove() */
+	static __DYNSTUFF_DLIST_ADD,		/* newconferences_add() */
+	static __DYNSTUFF_DLIST_REMOVE_SAFE,	/* newconferences_remove() */
 	__DYNSTUFF_LIST_DESTROY)		/* newconferences_destroy() */
 
 userlist_t *newconference_member_find(newconference_t *conf, const char *uid) {
@@ -715,8 +718,8 @@ void newconference_destroy(newconference_t *conf, int kill_wnd) {
 static LIST_FREE_ITEM(conference_free_item, struct conference *) { xfree(data->name); list_destroy(data->recipients, 1); }
 
 DYNSTUFF_LIST_DECLARE(conferences, struct conference, conference_free_item,
-	static __DYNSTUFF_LIST_ADD,		/* conferences_add() */
-	static __DYNSTUFF_LIST_REMOVE_ITER,	/* conferences_removei() */
+	static __DYNSTUFF_DLIST_ADD,		/* conferences_add() */
+	static __DYNSTUFF_DLIST_REMOVE_ITER,	/* conferences_removei() */
 	__DYNSTUFF_LIST_DESTROY)		/* conferences_destroy() */
 
 /*
@@ -2426,16 +2429,14 @@ inline void ekg_yield_cpu()
 
 int ekg_write(int fd, const char *buf, int len) {
 	watch_t *wl = NULL;
-	list_t l;
+	watch_t *w;
 
 	if (fd == -1)
 		return -1;
 
 	/* first check if we have watch for this fd */
-	for (l = watches; l; l = l->next) {
-		watch_t *w = l->data;
-
-		if (w && w->fd == fd && w->type == WATCH_WRITE && w->buf) {
+	for (w = watches; w; w = w->next) {
+		if (!w->destroyed && w->fd == fd && w->type == WATCH_WRITE && w->buf) {
 			wl = w;
 			break;
 		}
@@ -2488,15 +2489,14 @@ int ekg_writef(int fd, const char *format, ...) {
  */
 
 int ekg_close(int fd) {
-	list_t l;
+	watch_t *w;
 
 	if (fd == -1)
 		return -1;
 
-	for (l = watches; l; l = l->next) {
-		watch_t *w = l->data;
-
-		if (w && w->fd == fd) {
+		/* watch_free() doesn't unlink watch, so it's safe */
+	for (w = watches; w; w = w->next) {
+		if (!w->destroyed && w->fd == fd) {
 			debug("ekg_close(%d) w->plugin: %s w->session: %s w->type: %d w->buf: %d\n", 
 				fd, w->plugin ? w->plugin->name : "-",
 				w->is_session ? ((session_t *) w->data)->uid : "-",
@@ -75,6 +75,7 @@ enum mesg_t {
 
 struct conference {
 	struct conference	*next;
+	struct conference	*prev;
 
 	char		*name;
 	ignore_t	ignore;
@@ -83,6 +84,7 @@ struct conference {
 
 typedef struct newconference {
 	struct newconference	*next;
+	struct newconference	*prev;
 
 	char		*session;
 	char		*name;
@@ -138,6 +140,7 @@ extern int config_beep_msg;
 extern int config_beep_chat;
 extern int config_beep_notify;
 extern int config_completion_notify;
+extern int config_connection_flush_delay;
 extern char *config_completion_char;
 extern int config_debug;
 extern int config_default_status_window;
@@ -164,6 +167,7 @@ extern int config_slash_messages;
 extern char *config_quit_reason;
 extern int config_save_password;
 extern int config_save_quit;
+extern int config_script_time_budget;
 extern char *config_session_default;
 extern int config_sessions_save;
 extern int config_send_white_lines;
@@ -180,6 +184,7 @@ extern char *config_subject_reply_prefix;
 extern char *config_tab_command;
 extern char *config_theme;
 extern int config_time_deviation;
+extern int config_timer_slack;
 extern char *config_timestamp;
 extern int config_timestamp_show;
 extern int config_window_session_allow;
@@ -34,17 +34,24 @@ static const char *timestamp_cache = NULL;
 
 static int no_prompt_cache = 0;
 static int no_prompt_cache_hash = 0x139dcbd6;	/* hash value of "no_prompt_cache" */
+static int dont_resolve = 0;
+
+struct format_prog;
 
 struct format {
 	struct format *next;
 	char *name;
 	int name_hash;
 	char *value;
+	struct format_prog *prog;	/* compiled value, see format_compile() */
 };
 
 static struct format* formats[0x100];
 
+static void format_prog_free(struct format_prog *prog);
+
 static LIST_FREE_ITEM(list_format_free, struct format *) {
+	format_prog_free(data->prog);
 	xfree(data->value);
 	xfree(data->name);
 }
@@ -73,40 +80,38 @@ static int gim_hash(const char *name) {
 }
 
 /*
- * format_find()
+ * format_find_entry()
  *
- * odnajduje warto danego formatu. jeli nie znajdzie, zwraca pusty cig,
- * eby nie musie uwaa na adne null-references.
- *
- *  - name.
+ * odnajduje formatk o danej nazwie (z uwzgldnieniem wariantw ,speech
+ * i motywu). zwraca NULL, jeli nie ma takiej.
  */
-const char *format_find(const char *name)
+static struct format *format_find_entry(const char *name)
 {
 	struct format *fl;
 	const char *tmp;
 	int hash;
 
 	if (!name)
-		return "";
+		return NULL;
 
 	if (config_speech_app && !xstrchr(name, ',')) {
 		char *name2	= saprintf("%s,speech", name);
-		const char *tmp = format_find(name2);
+		struct format *f = format_find_entry(name2);
 
 		xfree(name2);
 
-		if (format_ok(tmp))
-			return tmp;
+		if (f && format_ok(f->value))
+			return f;
 	}
 
 	if (config_theme && (tmp = xstrchr(config_theme, ',')) && !xstrchr(name, ',')) {
 		char *name2	= saprintf("%s,%s", name, tmp + 1);
-		const char *tmp = format_find(name2);
+		struct format *f = format_find_entry(name2);
 
 		xfree(name2);
 
-		if (format_ok(tmp))
-			return tmp;
+		if (f && format_ok(f->value))
+			return f;
 	}
 
 	hash = gim_hash(name);
@@ -115,9 +120,24 @@ const char *format_find(const char *name)
 		struct format *f = fl;
 
 		if (hash == f->name_hash && !xstrcmp(f->name, name))
-			return f->value;
+			return f;
 	}
-	return "";
+	return NULL;
+}
+
+/*
+ * format_find()
+ *
+ * odnajduje warto danego formatu. jeli nie znajdzie, zwraca pusty cig,
+ * eby nie musie uwaa na adne null-references.
+ *
+ *  - name.
+ */
+const char *format_find(const char *name)
+{
+	struct format *f = format_find_entry(name);
+
+	return f ? f->value : "";
 }
 
 /*
@@ -194,6 +214,97 @@ static const char *format_ansi(char ch) {
 	return ("");
 }
 
+#define NPAR 16			/* ECMA-48 CSI have got max 16 params (NPAR) defined in <linux/console_struct.h> */
+
+struct fstring_csi {
+	unsigned short	par[NPAR];
+	unsigned short	parlen[NPAR];	/* some old code must know sequence length... stupid */
+	int		npar;
+};
+
+/* "\033[00m" - %| in formats, end of the prompt repeated in following lines */
+#define fstring_csi_is_prompt(csi) (!(csi)->npar && (csi)->parlen[0] == 2 && !(csi)->par[0])
+
+/*
+ * fstring_csi_parse()
+ *
+ * parses parameters of ECMA-48 CSI, @a str points right after "\033[".
+ * returns pointer to the final character of sequence.
+ */
+static const char *fstring_csi_parse(const char *str, struct fstring_csi *csi) {
+	memset(csi, 0, sizeof(struct fstring_csi));
+
+	while (1) {	/* idea based from kernel sources */
+		char c = *str;
+
+		if (c == ';' && csi->npar < NPAR -1) {		/* next param */
+			csi->npar++;
+		} else if (c >= '0' && c <= '9') {		/* code */
+			csi->par[csi->npar] *= 10;		/* multiply current */
+			csi->par[csi->npar] += c - '0';		/* add current */
+			csi->parlen[csi->npar]++;
+		} else					/* params done */
+			break;
+		str++;
+	}
+	return str;
+}
+
+/*
+ * fstring_csi_apply()
+ *
+ * applies "\033[...m" sequence to attribute @a attr. @a j is the current
+ * position in @a res, where prompt and margin markers are stored.
+ */
+static void fstring_csi_apply(const struct fstring_csi *csi, fstr_attr_t *attr, int *isbold, fstring_t *res, int j) {
+	int k;
+
+	for (k=0; k <= csi->npar; k++) {
+		unsigned short cur = csi->par[k];
+		switch (cur) {
+			case 0:				/* RESET */
+				*attr = FSTR_NORMAL;
+				*isbold = 0;
+
+				if (csi->parlen[k] == 4)	/* /| set margin */
+					res->margin_left = j;
+				else {
+					if (csi->parlen[k] >= 2)
+						res->prompt_len = j;
+
+					if (csi->parlen[k] == 3)
+						res->prompt_empty = 1;
+				}
+				break;
+			case 1:				/* BOLD */
+				if (k == csi->npar && !*isbold)		/* if (*p == ('m') && !isbold) */
+					*attr ^= FSTR_BOLD;
+				else {					/* if (*p == (';')) */
+					*attr |= FSTR_BOLD;
+					*isbold = 1;
+				}
+				break;
+			case 2:
+				*attr &= (FSTR_BACKMASK);
+				*isbold = 0;
+				break;
+			case 4:	*attr ^= FSTR_UNDERLINE;	break;	/* UNDERLINE */
+			case 5: *attr ^= FSTR_BLINK;	break;	/* BLINK */
+			case 7: *attr ^= FSTR_REVERSE;	break;	/* REVERSE */
+		}
+
+		if (cur >= 30 && cur <= 37) {
+			*attr &= ~(FSTR_NORMAL+FSTR_FOREMASK);
+			*attr |= (cur - 30);
+		}
+
+		if (cur >= 40 && cur <= 47) {
+			*attr &= ~(FSTR_NORMAL+FSTR_BACKMASK);
+			*attr |= (cur - 40) << 3;
+		}
+	}
+}
+
 /**
  * fstring_iter()
  *
@@ -325,9 +436,29 @@ static char *fstring2str(fstring_t *f) {
  *  - format - warto, nie nazwa formatu,
  *  - ap - argumenty.
  */
+static void theme_cache_update(void) {
+	if (dont_resolve)
+		return;
+
+	dont_resolve = 1;
+	if (no_prompt_cache) {
+		/* zawsze czytaj */
+		timestamp_cache	= format_find("timestamp");
+		prompt_cache	= format_string(format_find("prompt"));
+		prompt2_cache	= format_string(format_find("prompt2"));
+		error_cache	= format_string(format_find("error"));
+	} else {
+		/* tylko jeli nie s keszowanie */
+		if (!timestamp_cache)	timestamp_cache = format_find("timestamp");
+		if (!prompt_cache)	prompt_cache	= format_string(format_find("prompt"));
+		if (!prompt2_cache)	prompt2_cache	= format_string(format_find("prompt2"));
+		if (!error_cache)	error_cache	= format_string(format_find("error"));
+	}
+	dont_resolve = 0;
+}
+
 static char *va_format_string(const char *format, va_list ap) {
 	string_t buf = string_init(NULL);
-	static int dont_resolve = 0;
 	const char *p;
 	char *args[9] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
 	int i, argc = 0;
@@ -382,23 +513,7 @@ static char *va_format_string(const char *format, va_list ap) {
 	for (i = 0; i < argc; i++)
 		args[i] = va_arg(ap, char *);
 
-	if (!dont_resolve) {
-		dont_resolve = 1;
-		if (no_prompt_cache) {
-			/* zawsze czytaj */
-			timestamp_cache	= format_find("timestamp");
-			prompt_cache	= format_string(format_find("prompt"));
-			prompt2_cache	= format_string(format_find("prompt2"));
-			error_cache	= format_string(format_find("error"));
-		} else {
-			/* tylko jeli nie s keszowanie */
-			if (!timestamp_cache)	timestamp_cache = format_find("timestamp");
-			if (!prompt_cache)	prompt_cache	= format_string(format_find("prompt"));
-			if (!prompt2_cache)	prompt2_cache	= format_string(format_find("prompt2"));
-			if (!error_cache)	error_cache	= format_string(format_find("error"));
-		}
-		dont_resolve = 0;
-	}
+	theme_cache_update();
 
 	p = format;
 
@@ -634,7 +749,6 @@ fstring_t *fstring_dup(const fstring_t *str) {
  */
 
 fstring_t *fstring_new(const char *str) {
-#define NPAR 16			/* ECMA-48 CSI have got max 16 params (NPAR) defined in <linux/console_struct.h> */
 	fstring_t *res;
 	char *tmpstr;
 	fstr_attr_t attr = FSTR_NORMAL;
@@ -686,80 +800,18 @@ fstring_t *fstring_new(const char *str) {
 				continue;
 			}
 		} else if (str[i] == 27) {		/* ESC- */
-			unsigned short par[NPAR]	= { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; 
-			unsigned short parlen[NPAR]	= { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; 
-
-			int npar	= 0; 
+			struct fstring_csi csi;
+			const char *end;
 
 			if (str[i + 1] != ('['))
 				continue;
-			i += 2;
 
 			/* parse ECMA-48 CSI here & build data */
-			while (1) {	/* idea based from kernel sources */
-				char c = str[i++];
-
-				if (c == ';' && npar < NPAR -1) {	/* next param */
-					npar++;
-					continue;
-				} else if (c >= '0' && c <= '9') {	/* code */
-					par[npar] *= 10;			/* multiply current */
-					par[npar] += c - '0';		/* add current */
-					parlen[npar]++;			/* some old code must know sequence length... stupid */
-					continue;
-				} else {				/* params done */
-					break;
-				}
-			}
-			i--;
+			end = fstring_csi_parse(&str[i + 2], &csi);
+			i = end - str;
 
-			if (str[i] == 'm') {	/* parse sequence to internal attr we only parse seq like \033[...m */
-				int k;
-				for (k=0; k <= npar; k++) {
-					unsigned short cur = par[k];
-					switch (cur) {
-						case 0:				/* RESET */
-							attr = FSTR_NORMAL;
-							isbold = 0;
-
-							if (parlen[k] == 4)	/* /| set margin */
-								res->margin_left = j;
-							else {
-								if (parlen[k] >= 2)
-									res->prompt_len = j;
-
-								if (parlen[k] == 3)
-									res->prompt_empty = 1;
-							}
-							break;
-						case 1:				/* BOLD */
-							if (k == npar && !isbold)		/* if (*p == ('m') && !isbold) */
-								attr ^= FSTR_BOLD;
-							else {					/* if (*p == (';')) */
-								attr |= FSTR_BOLD;
-								isbold = 1;
-							}
-							break;
-						case 2:
-							attr &= (FSTR_BACKMASK);
-							isbold = 0;
-							break;
-						case 4:	attr ^= FSTR_UNDERLINE;	break;	/* UNDERLINE */
-						case 5: attr ^= FSTR_BLINK;	break;	/* BLINK */
-						case 7: attr ^= FSTR_REVERSE;	break;	/* REVERSE */
-					}
-
-					if (cur >= 30 && cur <= 37) {
-						attr &= ~(FSTR_NORMAL+FSTR_FOREMASK);
-						attr |= (cur - 30);
-					}
-
-					if (cur >= 40 && cur <= 47) {
-						attr &= ~(FSTR_NORMAL+FSTR_BACKMASK);
-						attr |= (cur - 40) << 3;
-					}
-				}
-			}
+			if (*end == 'm')	/* parse sequence to internal attr we only parse seq like \033[...m */
+				fstring_csi_apply(&csi, &attr, &isbold, res, j);
 //			else debug("Invalid/unsupported by ekg2 ECMA-48 CSI seq? (npar: %d)\n", npar);	/* sequence not ended with m */
 			continue;
 		}
@@ -851,6 +903,827 @@ char *format_string(const char *format, ...)
 	return tmp;
 }
 
+/*
+ * compiled formats
+ *
+ * print_window() used to expand format into ansi string with va_format_string(),
+ * split it into lines, and parse every line again with fstring_new(). Now every
+ * format is compiled (when it's used first time) into list of instructions:
+ * literal text, attribute changes (already parsed), arguments with padding, etc.
+ * and printing builds fstring_t's directly. Compiled form is dropped when the
+ * value of format changes (format_add(), theme_free()).
+ */
+
+enum {
+	FORMAT_OP_NONE = 0,
+	FORMAT_OP_TEXT,		/* literal text (offset, len) */
+	FORMAT_OP_CSI,		/* attribute change (%|, %], /|) */
+	FORMAT_OP_COLOR,	/* attribute change, only with config_display_color */
+	FORMAT_OP_CHARSET,	/* alternate charset on (len == 1) or off, only with config_display_color */
+	FORMAT_OP_PROMPT,	/* %> */
+	FORMAT_OP_PROMPT2,	/* %) */
+	FORMAT_OP_ERROR,	/* %! */
+	FORMAT_OP_TIMESTAMP,	/* %# */
+	FORMAT_OP_ARG,		/* %1 .. %9, with %[..] or %(..) padding */
+	FORMAT_OP_GENDER,	/* %@N */
+	FORMAT_OP_COND,		/* %{N...}X, followed by len ops, one for each letter */
+};
+
+struct format_op {
+	int type;
+	int arg;			/* argument number (from 0) */
+	int offset;			/* position of text in format_prog->text */
+	int len;
+
+	int fill_length;
+	char fill_char;
+	unsigned int fill_soft	 : 1;
+	unsigned int fill_before : 1;
+	unsigned int fill_after	 : 1;
+	unsigned int center	 : 1;
+
+	struct fstring_csi csi;
+};
+
+struct format_prog {
+	int argc;
+	int count;
+	struct format_op *ops;
+	char *text;			/* literals */
+};
+
+static void format_prog_free(struct format_prog *prog) {
+	if (!prog)
+		return;
+
+	xfree(prog->ops);
+	xfree(prog->text);
+	xfree(prog);
+}
+
+static struct format_op *format_prog_op(struct format_prog *prog, int type) {
+	struct format_op *op;
+
+	prog->ops = xrealloc(prog->ops, (prog->count + 1) * sizeof(struct format_op));
+	op = &prog->ops[prog->count++];
+	memset(op, 0, sizeof(struct format_op));
+	op->type = type;
+
+	return op;
+}
+
+static void format_prog_text(struct format_prog *prog, GString *text, const char *str, int len, int merge) {
+	struct format_op *op = prog->count ? &prog->ops[prog->count - 1] : NULL;
+
+	if (!merge || !op || op->type != FORMAT_OP_TEXT || op->offset + op->len != text->len) {
+		op = format_prog_op(prog, FORMAT_OP_TEXT);
+		op->offset = text->len;
+	}
+
+	g_string_append_len(text, str, len);
+	op->len += len;
+}
+
+static void format_prog_arg(struct format_prog *prog, struct format_op *op, char n) {
+	op->arg = (n >= '1' && n <= '9') ? n - '1' : -1;
+
+	if (op->arg >= prog->argc)
+		prog->argc = op->arg + 1;
+}
+
+/*
+ * format_compile_char()
+ *
+ * compiles single-letter formatee (%c), adds at most one instruction.
+ */
+static void format_compile_char(struct format_prog *prog, GString *text, char c, int merge) {
+	const char *ansi;
+
+	switch (c) {
+		case '%':
+			format_prog_text(prog, text, "%", 1, merge);
+			return;
+		case '>':
+			format_prog_op(prog, FORMAT_OP_PROMPT);
+			return;
+		case ')':
+			format_prog_op(prog, FORMAT_OP_PROMPT2);
+			return;
+		case '!':
+			format_prog_op(prog, FORMAT_OP_ERROR);
+			return;
+		case '#':
+			format_prog_op(prog, FORMAT_OP_TIMESTAMP);
+			return;
+		case '|':
+			fstring_csi_parse("00m", &format_prog_op(prog, FORMAT_OP_CSI)->csi);
+			return;
+		case ']':
+			fstring_csi_parse("000m", &format_prog_op(prog, FORMAT_OP_CSI)->csi);
+			return;
+	}
+
+	ansi = format_ansi(c);
+
+	if (ansi[0] == 27 && ansi[1] == '[')
+		fstring_csi_parse(ansi + 2, &format_prog_op(prog, FORMAT_OP_COLOR)->csi);
+	else if (ansi[0] == 27 && ansi[1] == '(')
+		format_prog_op(prog, FORMAT_OP_CHARSET)->len = (ansi[2] == '0');
+}
+
+/*
+ * format_compile()
+ *
+ * compiles format value, it has to stay in sync with va_format_string().
+ */
+static struct format_prog *format_compile(const char *format) {
+	struct format_prog *prog = xmalloc(sizeof(struct format_prog));
+	GString *text = g_string_new(NULL);
+	const char *p = format;
+
+	while (*p) {
+		struct format_op *op;
+		int fill_before = 0;
+		int fill_after	= 0;
+		int fill_soft	= 1;
+		int fill_length = 0;
+		char fill_char	= ' ';
+		int center	= 0;
+
+		if (*p == '\\' && (p[1] == '%' || p[1] == '\\')) {
+			format_prog_text(prog, text, p + 1, 1, 1);
+			p += 2;
+			continue;
+		}
+
+		if (*p == '/' && p[1] == '|') {		/* /| 'set margin' */
+			if ((p == format) || (p[-1] != '/'))
+				fstring_csi_parse("0000m", &format_prog_op(prog, FORMAT_OP_CSI)->csi);
+			else
+				format_prog_text(prog, text, "|", 1, 1);
+			p += 2;
+			continue;
+		}
+
+		if (*p != '%') {
+			format_prog_text(prog, text, p, 1, 1);
+			p++;
+			continue;
+		}
+
+		p++;
+		if (!*p)
+			break;
+
+		if (*p == '{') {		/* %{NcdefSTUV}X, see va_format_string() */
+			const char *end;
+			int hm = 0, i;
+
+			p++;
+
+			if (*p == '}' || !(*p >= '0' && *p <= '9')) {
+				if (*p == '}' && p[1])
+					p++;
+				if (*p)
+					p++;
+				continue;
+			}
+
+			op = format_prog_op(prog, FORMAT_OP_COND);
+			format_prog_arg(prog, op, *p);
+			p++;
+
+			for (end = p; *end && *end != '}'; end++)
+				hm++;
+			hm >>= 1;
+
+			op->offset	= text->len;
+			op->len		= hm;
+			g_string_append_len(text, p, hm);
+
+			/* op may move, while adding new ones */
+			for (i = 0; i < hm; i++) {
+				int count = prog->count;
+
+				if (p[hm + i] >= '1' && p[hm + i] <= '9')
+					format_prog_arg(prog, format_prog_op(prog, FORMAT_OP_ARG), p[hm + i]);
+				else
+					format_compile_char(prog, text, p[hm + i], 0);
+				if (count == prog->count)
+					format_prog_op(prog, FORMAT_OP_NONE);
+			}
+
+			p += 2 * hm;
+			if (*p)
+				p++;
+			if (*p)
+				p++;
+			continue;
+		}
+
+		format_compile_char(prog, text, *p, 1);
+
+		if (*p == '@') {
+			format_prog_arg(prog, format_prog_op(prog, FORMAT_OP_GENDER), p[1]);
+			p += p[1] ? 2 : 1;
+			continue;
+		}
+
+		if (*p == '[' || *p == '(') {
+			char *q;
+
+			fill_soft = (*p == '(');
+			p++;
+
+			if (*p == '^') {
+				center = 1;
+				p++;
+			}
+
+			if (*p == '.') {
+				fill_char = '0';
+				p++;
+			} else if (*p == ',') {
+				fill_char = '.';
+				p++;
+			} else if (*p == '_') {
+				fill_char = '_';
+				p++;
+			}
+
+			fill_length = strtol(p, &q, 0);
+			p = q;
+			if (fill_length > 0)
+				fill_after = 1;
+			else {
+				fill_length = -fill_length;
+				fill_before = 1;
+			}
+			if (*p)
+				p++;
+		}
+
+		if (*p >= '1' && *p <= '9') {
+			op = format_prog_op(prog, FORMAT_OP_ARG);
+			format_prog_arg(prog, op, *p);
+
+			op->fill_length	= fill_length;
+			op->fill_char	= fill_char;
+			op->fill_soft	= fill_soft;
+			op->fill_before	= fill_before;
+			op->fill_after	= fill_after;
+			op->center	= center;
+		}
+
+		if (*p)
+			p++;
+	}
+
+	prog->text = g_string_free(text, FALSE);
+
+	return prog;
+}
+
+enum {
+	FORMAT_CHUNK_TEXT = 0,	/* str, len (may contain ansi sequences) */
+	FORMAT_CHUNK_FILL,	/* len times fill */
+	FORMAT_CHUNK_CSI,	/* csi */
+	FORMAT_CHUNK_CHARSET,	/* alternate charset on (len == 1) or off */
+};
+
+struct format_chunk {
+	int type;
+	const char *str;
+	int len;
+	int limit;		/* at most that many chars of str, -1 - no limit */
+	char fill;
+	const struct fstring_csi *csi;
+};
+
+struct format_exec {
+	char *args[9];
+	GArray *chunks;
+	char *stamp;		/* %#, done once */
+};
+
+static void format_exec_chunk(struct format_exec *ex, int type, const char *str, int len) {
+	struct format_chunk c;
+
+	memset(&c, 0, sizeof(c));
+	c.type	= type;
+	c.str	= str;
+	c.len	= len;
+	c.limit	= -1;
+
+	g_array_append_val(ex->chunks, c);
+}
+
+static void format_exec_fill(struct format_exec *ex, char fill, int count) {
+	struct format_chunk c;
+
+	if (count <= 0)
+		return;
+
+	memset(&c, 0, sizeof(c));
+	c.type	= FORMAT_CHUNK_FILL;
+	c.fill	= fill;
+	c.len	= count;
+
+	g_array_append_val(ex->chunks, c);
+}
+
+/*
+ * format_width()
+ *
+ * number of characters fstring_new(str) would have.
+ */
+static int format_width(const char *str) {
+	int i, j = 0, width = 0;
+
+	for (i = 0; str[i]; i++) {
+		if (str[i] == 27) {
+			if (str[i + 1] == '(' && (str[i + 2] == '0' || str[i + 2] == 'B')) {
+				i += 2;
+				continue;
+			}
+			if (str[i + 1] == '[') {
+				struct fstring_csi csi;
+
+				i = fstring_csi_parse(&str[i + 2], &csi) - str;
+				if (!str[i])
+					break;
+			}
+			continue;
+		}
+
+		if (str[i] == 13)
+			continue;
+
+		if (str[i] == 9) {
+			width += 8 - (j % 8);
+			j += 8 - (j % 8);
+			continue;
+		}
+
+		if ((str[i] & 0xc0) != 0x80)
+			width++;
+		j++;
+	}
+
+	return width;
+}
+
+static const char *format_exec_argv(struct format_exec *ex, int n) {
+	return (n >= 0 && n < 9) ? ex->args[n] : NULL;
+}
+
+static void format_exec_op(struct format_exec *ex, const struct format_prog *prog, const struct format_op *op) {
+	const char *str;
+
+	switch (op->type) {
+		case FORMAT_OP_TEXT:
+			format_exec_chunk(ex, FORMAT_CHUNK_TEXT, prog->text + op->offset, op->len);
+			break;
+
+		case FORMAT_OP_COLOR:
+			if (!config_display_color)
+				break;
+		case FORMAT_OP_CSI:
+			format_exec_chunk(ex, FORMAT_CHUNK_CSI, NULL, 0);
+			g_array_index(ex->chunks, struct format_chunk, ex->chunks->len - 1).csi = &op->csi;
+			break;
+
+		case FORMAT_OP_CHARSET:
+			if (config_display_color)
+				format_exec_chunk(ex, FORMAT_CHUNK_CHARSET, NULL, op->len);
+			break;
+
+		case FORMAT_OP_PROMPT:
+		case FORMAT_OP_PROMPT2:
+		case FORMAT_OP_ERROR:
+			str = (op->type == FORMAT_OP_PROMPT) ? prompt_cache : (op->type == FORMAT_OP_PROMPT2) ? prompt2_cache : error_cache;
+			if (str)
+				format_exec_chunk(ex, FORMAT_CHUNK_TEXT, str, xstrlen(str));
+			break;
+
+		case FORMAT_OP_TIMESTAMP:
+			if (!ex->stamp)
+				ex->stamp = xstrdup(timestamp(timestamp_cache));
+			format_exec_chunk(ex, FORMAT_CHUNK_TEXT, ex->stamp, xstrlen(ex->stamp));
+			break;
+
+		case FORMAT_OP_GENDER:
+		{
+			const char *suffix = "y";	/* display_notify&4, I think male form would be fine for UIDs */
+
+			if ((str = format_exec_argv(ex, op->arg)) && *str) {
+				const char *q = str + xstrlen(str) - 1;
+
+				while (q >= str && (isspace(*q) || ispunct(*q)))
+					q--;
+
+				if (q >= str && *q == 'a')
+					suffix = "a";
+			}
+			format_exec_chunk(ex, FORMAT_CHUNK_TEXT, suffix, 1);
+			break;
+		}
+
+		case FORMAT_OP_ARG:
+		{
+			int fill_length = op->fill_length;
+			int fill_before = op->fill_before;
+			int fill_after	= op->fill_after;
+			int center	= 0;
+			int limit	= -1;
+
+			if (!(str = format_exec_argv(ex, op->arg)))
+				str = "";
+
+			if (fill_length) {
+				/* XXX: width */
+				int len = format_width(str);
+
+				if (len >= fill_length) {
+					if (!op->fill_soft)
+						limit = fill_length;	/* XXX: how about double width chars? */
+					fill_length = 0;
+				} else
+					fill_length -= len;
+			}
+
+			if (op->center) {
+				fill_before = fill_after = 1;
+				center = fill_length & 1;
+				fill_length /= 2;
+			}
+
+			if (fill_before)
+				format_exec_fill(ex, op->fill_char, fill_length + center);
+
+			format_exec_chunk(ex, FORMAT_CHUNK_TEXT, str, xstrlen(str));
+			g_array_index(ex->chunks, struct format_chunk, ex->chunks->len - 1).limit = limit;
+
+			if (fill_after)
+				format_exec_fill(ex, op->fill_char, fill_length);
+			break;
+		}
+	}
+}
+
+static void format_exec(struct format_exec *ex, const struct format_prog *prog) {
+	int i;
+
+	for (i = 0; i < prog->count; i++) {
+		const struct format_op *op = &prog->ops[i];
+
+		if (op->type == FORMAT_OP_COND) {
+			const char *letters = prog->text + op->offset;
+			const char *str = format_exec_argv(ex, op->arg);
+			int k;
+
+			for (k = 0; str && k < op->len; k++) {
+				if (letters[k] == *str) {
+					format_exec_op(ex, prog, &prog->ops[i + 1 + k]);
+					break;
+				}
+			}
+			i += op->len;
+			continue;
+		}
+
+		format_exec_op(ex, prog, op);
+	}
+}
+
+/*
+ * fstring_builder
+ *
+ * fstring_t being built, char by char.
+ */
+struct fstring_builder {
+	gchar *str;
+	fstr_attr_t *attr;
+	int len, size;
+	fstr_attr_t cur;
+	int isbold;
+	fstring_t meta;		/* margin_left, prompt_len, prompt_empty */
+};
+
+static void fstring_builder_init(struct fstring_builder *b) {
+	memset(b, 0, sizeof(struct fstring_builder));
+	b->cur	= FSTR_NORMAL;
+	b->meta.margin_left = -1;
+}
+
+static void fstring_builder_reserve(struct fstring_builder *b, int count) {
+	if (b->len + count < b->size)
+		return;
+
+	b->size = MAX(2 * b->size, b->len + count + 64);
+	b->str	= xrealloc(b->str, b->size * sizeof(gchar));
+	b->attr	= xrealloc(b->attr, b->size * sizeof(fstr_attr_t));
+}
+
+static void fstring_builder_append(struct fstring_builder *b, const char *str, int count) {
+	int i;
+
+	fstring_builder_reserve(b, count);
+	memcpy(b->str + b->len, str, count);
+	for (i = 0; i < count; i++)
+		b->attr[b->len++] = b->cur;
+}
+
+static void fstring_builder_fill(struct fstring_builder *b, char c, int count) {
+	int i;
+
+	fstring_builder_reserve(b, count);
+	for (i = 0; i < count; i++) {
+		b->str[b->len] = c;
+		b->attr[b->len++] = b->cur;
+	}
+}
+
+static void fstring_builder_copy(struct fstring_builder *b, const struct fstring_builder *from) {
+	b->len = 0;
+
+	if (from) {
+		fstring_builder_reserve(b, from->len);
+		memcpy(b->str, from->str, from->len * sizeof(gchar));
+		memcpy(b->attr, from->attr, from->len * sizeof(fstr_attr_t));
+		b->len		= from->len;
+		b->cur		= from->cur;
+		b->isbold	= from->isbold;
+		b->meta		= from->meta;
+	} else {
+		b->cur		= FSTR_NORMAL;
+		b->isbold	= 0;
+		memset(&b->meta, 0, sizeof(fstring_t));
+		b->meta.margin_left = -1;
+	}
+}
+
+static fstring_t *fstring_builder_finish(struct fstring_builder *b) {
+	fstring_t *res = g_memdup(&b->meta, sizeof(fstring_t));
+
+	res->str	= xmalloc((b->len + 1) * sizeof(gchar));
+	res->attr	= xmalloc((b->len + 1) * sizeof(fstr_attr_t));
+	if (b->len) {
+		memcpy(res->str, b->str, b->len * sizeof(gchar));
+		memcpy(res->attr, b->attr, b->len * sizeof(fstr_attr_t));
+	}
+
+	return res;
+}
+
+static void fstring_builder_free(struct fstring_builder *b) {
+	xfree(b->str);
+	xfree(b->attr);
+}
+
+/*
+ * format_reader
+ *
+ * splits chunks into lines, like print_window_c() did with split_line():
+ * if line contains %| everything before it is remembered as prompt,
+ * and prepended to the following lines, unless they have got their own %|.
+ */
+struct format_reader {
+	const struct format_chunk *chunks;
+	int count;
+
+	int i, off, shown;		/* current position */
+	int li, loff, lshown;		/* beginning of current line */
+	int raw;			/* how much of current line was read */
+
+	unsigned int have_prompt : 1;
+	unsigned int prompted	 : 1;	/* current line starts with prompt */
+	unsigned int marked	 : 1;	/* current line has got %| */
+
+	struct fstring_builder line;
+	struct fstring_builder prompt;
+	GSList *lines;
+};
+
+/* %| found, returns 1 if line has to be read again */
+static int format_reader_marker(struct format_reader *r) {
+	if (r->marked)
+		return 0;
+
+	if (r->prompted) {
+		/* line has got its own prompt, forget about the previous one */
+		fstring_builder_copy(&r->line, NULL);
+		r->prompted	= 0;
+		r->raw		= 0;
+		r->i		= r->li;
+		r->off		= r->loff;
+		r->shown	= r->lshown;
+		return 1;
+	}
+
+	r->marked = 1;
+	r->have_prompt = !!r->raw;
+	if (r->raw)
+		fstring_builder_copy(&r->prompt, &r->line);
+	return 0;
+}
+
+static void format_reader_newline(struct format_reader *r) {
+	r->lines = g_slist_prepend(r->lines, fstring_builder_finish(&r->line));
+
+	fstring_builder_copy(&r->line, r->have_prompt ? &r->prompt : NULL);
+	r->prompted	= r->have_prompt;
+	r->marked	= 0;
+	r->raw		= 0;
+	r->li		= r->i;
+	r->loff		= r->off;
+	r->lshown	= r->shown;
+}
+
+static void format_reader_next(struct format_reader *r) {
+	r->i++;
+	r->off = 0;
+	r->shown = 0;
+}
+
+static GSList *format_read(const struct format_chunk *chunks, int count) {
+	struct format_reader r;
+	int k;
+
+	memset(&r, 0, sizeof(r));
+	r.chunks = chunks;
+	r.count = count;
+	fstring_builder_init(&r.line);
+	fstring_builder_init(&r.prompt);
+
+	while (r.i < r.count) {
+		const struct format_chunk *c = &r.chunks[r.i];
+		const char *s;
+
+		if (c->type == FORMAT_CHUNK_CSI) {
+			if (fstring_csi_is_prompt(c->csi) && format_reader_marker(&r))
+				continue;
+			fstring_csi_apply(c->csi, &r.line.cur, &r.line.isbold, &r.line.meta, r.line.len);
+			r.raw++;
+			format_reader_next(&r);
+			continue;
+		}
+
+		if (c->type == FORMAT_CHUNK_CHARSET) {
+			if (c->len)
+				r.line.cur |= FSTR_ALTCHARSET;
+			else
+				r.line.cur &= ~FSTR_ALTCHARSET;
+			r.raw++;
+			format_reader_next(&r);
+			continue;
+		}
+
+		if (c->type == FORMAT_CHUNK_FILL) {
+			fstring_builder_fill(&r.line, c->fill, c->len);
+			r.raw += c->len;
+			format_reader_next(&r);
+			continue;
+		}
+
+		if (r.off >= c->len) {
+			format_reader_next(&r);
+			continue;
+		}
+
+		s = c->str + r.off;
+
+		if (c->limit == -1) {
+			/* copy plain text at once */
+			for (k = 0; r.off + k < c->len; k++) {
+				if (s[k] == 27 || s[k] == '\n' || s[k] == 9 || s[k] == 13)
+					break;
+			}
+
+			if (k) {
+				fstring_builder_append(&r.line, s, k);
+				r.off += k;
+				r.raw += k;
+				continue;
+			}
+		}
+
+		if (*s == 27 && s[1] == '(' && (s[2] == '0' || s[2] == 'B')) {
+			if (s[2] == '0')
+				r.line.cur |= FSTR_ALTCHARSET;
+			else
+				r.line.cur &= ~FSTR_ALTCHARSET;
+			r.off += 3;
+			r.raw += 3;
+			continue;
+		}
+
+		if (*s == 27) {
+			struct fstring_csi csi;
+			const char *end;
+
+			if (s[1] != '[') {
+				r.off++;
+				r.raw++;
+				continue;
+			}
+
+			end = fstring_csi_parse(s + 2, &csi);
+
+			if (*end == 'm') {
+				if (c->limit != -1) {
+					/* truncated argument, only colors are left in it */
+					fstring_t dummy;
+
+					fstring_csi_apply(&csi, &r.line.cur, &r.line.isbold, &dummy, 0);
+				} else {
+					if (fstring_csi_is_prompt(&csi) && format_reader_marker(&r))
+						continue;
+					fstring_csi_apply(&csi, &r.line.cur, &r.line.isbold, &r.line.meta, r.line.len);
+				}
+				end++;
+			}
+
+			r.raw += end - s;
+			r.off += end - s;
+			continue;
+		}
+
+		if (c->limit != -1 && (*s & 0xc0) != 0x80 && r.shown >= c->limit) {
+			format_reader_next(&r);
+			continue;
+		}
+
+		if (*s == '\n') {
+			r.off++;
+			r.shown++;
+			format_reader_newline(&r);
+			continue;
+		}
+
+		r.off++;
+		r.raw++;
+
+		if (*s == 13)
+			continue;
+
+		if (*s == 9) {
+			/* truncated argument has got tabs expanded on its own */
+			int l = 8 - ((c->limit != -1 ? r.shown : r.line.len) % 8);
+
+			fstring_builder_fill(&r.line, ' ', l);
+			r.shown += l;
+			continue;
+		}
+
+		if ((*s & 0xc0) != 0x80)
+			r.shown++;
+		fstring_builder_append(&r.line, s, 1);
+	}
+
+	if (r.raw)
+		r.lines = g_slist_prepend(r.lines, fstring_builder_finish(&r.line));
+
+	fstring_builder_free(&r.line);
+	fstring_builder_free(&r.prompt);
+
+	return g_slist_reverse(r.lines);
+}
+
+/*
+ * format_print()
+ *
+ * formats @a f with arguments from @a ap, and returns list of fstring_t's,
+ * one for each line.
+ */
+static GSList *format_print(struct format *f, va_list ap) {
+	struct format_exec ex;
+	GSList *lines;
+	int i;
+
+	if (!f->prog)
+		f->prog = format_compile(f->value);
+
+	memset(&ex, 0, sizeof(ex));
+	for (i = 0; i < f->prog->argc; i++)
+		ex.args[i] = va_arg(ap, char *);
+
+	theme_cache_update();
+
+	ex.chunks = g_array_sized_new(FALSE, FALSE, sizeof(struct format_chunk), f->prog->count + 4);
+	format_exec(&ex, f->prog);
+
+	lines = format_read((struct format_chunk *) ex.chunks->data, ex.chunks->len);
+
+	g_array_free(ex.chunks, TRUE);
+	xfree(ex.stamp);
+
+	if (!dont_resolve && no_prompt_cache)
+		theme_cache_reset();
+
+	return lines;
+}
+
 /**
  * print_window_c()
  *
@@ -863,7 +1736,8 @@ char *format_string(const char *format, ...)
  */
 
 static void print_window_c(window_t *w, int activity, const char *theme, va_list ap) {
-	char *stmp;
+	struct format *f;
+	GSList *lines, *l;
 
 	/* w here shouldn't here be NULL. In case. */
 	if (!w) {
@@ -880,37 +1754,16 @@ static void print_window_c(window_t *w, int activity, const char *theme, va_list
 		}
 	}
 
-	stmp = va_format_string(format_find(theme), ap);
-	{
-		char *prompt = NULL;
-		char *line;
-
-		char *tmp = stmp;
-		while ((line = split_line(&tmp))) {
-			char *p;
-			fstring_t *l;
+	if (!(f = format_find_entry(theme)))
+		return;
 
-			if ((p = xstrstr(line, "\033[00m"))) {
-				xfree(prompt);
-				if (p != line)
-					prompt = xstrndup(line, (int) (p - line));
-				else
-					prompt = NULL;
-				line = p;
-			}
+	lines = format_print(f, ap);
 
-			if (prompt) {
-				gchar *tmp = g_strdup_printf("%s%s", prompt, line);
-				l = fstring_new(tmp);
-				g_free(tmp);
-			} else
-				l = fstring_new(line);
-			window_print(w, l);
-			fstring_free(l);
-		}
-		xfree(prompt);
+	for (l = lines; l; l = l->next) {
+		window_print(w, l->data);
+		fstring_free(l->data);
 	}
-	xfree(stmp);
+	g_slist_free(lines);
 }
 
 /**
@@ -993,7 +1846,7 @@ static window_t *print_window_find(const char *target, session_t *session, int s
 			if (!wa->target && wa->id > 1) {
 				w = wa;
 
-				w->target = xstrdup(target);
+				window_target_set(w, target);
 				w->session = session;
 
 				query_emit(NULL, "ui-window-target-changed", &w);	/* XXX */
@@ -1108,7 +1961,7 @@ void print_window_w(window_t *w, int activity, const char *theme, ...) {
  * theme_cache_reset()
  *
  * Remove cached: @a prompt_cache, @a prompt2_cache, @a error_cache and @a timestamp_cache<br>
- * These values are used by va_format_string() to don't call format_find() on:<br>
+ * These values are used by va_format_string() and format_print() to don't call format_find() on:<br>
  *	["prompt" "%>", "prompt2" "%)", "errror" "%!", "timestamp" "%#"]
  *
  */
@@ -1157,6 +2010,8 @@ void format_add(const char *name, const char *value, int replace) {
 			if (replace) {
 				xfree(f->value);
 				f->value = xstrdup(value);
+				format_prog_free(f->prog);
+				f->prog = NULL;
 			}
 			return;
 		}
@@ -1502,6 +2357,7 @@ void theme_init()
 	format_add("user_not_found", _("%! User %T%1%n not found\n"), 1);
 	format_add("not_implemented", _("%! This function isn't ready yet\n"), 1);
 	format_add("unknown_command", _("%! Unknown command: %T%1%n\n"), 1);
+	format_add("ambiguous_command", _("%! Ambiguous command: %T%1%n\n"), 1);
 	format_add("welcome", _("%> %Tekg2-%1%n (%ge%Gk%gg %Gr%ge%Gl%go%Ga%gd%Ge%gd%n)\n%> Software licensed on GPL v2 terms\n\n"), 1);
 	format_add("welcome,speech", _("welcome in e k g 2."), 1);
 	format_add("ekg_version", _("%) %Tekg2-%1%n (compiled %2)\n"), 1);
@@ -2208,6 +3064,10 @@ void theme_init()
 	format_add("script_generic", "%> [script,%2] (%1) %3\n", 1);
 	format_add("script_varlist", _("%> %1 = %2 (%3)\n"), 1);
 	format_add("script_varlist_empty", _("%! No script vars!\n"), 1);
+	format_add("script_profile_header", _("%> %Tscript, handler: calls, total time, max time, budget overruns%n\n"), 1);
+	format_add("script_profile", _("%> %1, %2 %T%3%n: %4 calls, %5 ms, max %6 ms, %7 overruns\n"), 1);
+	format_add("script_profile_empty", _("%! No script handlers\n"), 1);
+	format_add("script_overrun", _("%! Script %W%1%n %2 %T%3%n took %R%4 ms%n (script_time_budget is %5 ms)\n"), 1);
 
 	format_add("directory_cant_create",	_("%! Can't create directory: %1 (%2)"), 1);
 
@@ -29,6 +29,7 @@
 #include <arpa/inet.h>
 #endif
 
+#include <ctype.h>
 #include <errno.h>
 #include <limits.h>
 #include <stdarg.h>
@@ -52,6 +53,45 @@ struct ignore_label ignore_labels[IGNORE_LABELS_MAX] = {
 };
 
 /* groups: */
+
+/*
+ * group names are interned: each name (case insensitive, like xstrcasecmp())
+ * gets its number, and userlist_t keeps bitset of numbers of its groups and
+ * cached ignore level, so membership and ignore checks don't compare strings.
+ * ekg_groups_changed() keeps them up to date after every change of u->groups.
+ */
+static GHashTable *group_ids = NULL;		/* name -> id + 1 */
+static int group_ids_count = 0;
+
+#define GROUP_BITS ((int) (sizeof(unsigned int) * 8))
+
+static guint group_name_hash(gconstpointer key) {
+	const unsigned char *p = key;
+	guint h = 5381;
+
+	for (; *p; p++)
+		h = (h << 5) + h + tolower(*p);
+	return h;
+}
+
+static gboolean group_name_equal(gconstpointer a, gconstpointer b) {
+	return !xstrcasecmp(a, b);
+}
+
+static int group_id_get(const char *name) {
+	int id;
+
+	if ((id = ekg_group_id(name)) != -1)
+		return id;
+
+	if (!group_ids)
+		group_ids = g_hash_table_new_full(group_name_hash, group_name_equal, xfree, NULL);
+
+	id = group_ids_count++;
+	g_hash_table_insert(group_ids, xstrdup(name), GINT_TO_POINTER(id + 1));
+	return id;
+}
+
 static LIST_ADD_COMPARE(group_compare, struct ekg_group *) { return xstrcasecmp(data1->name, data2->name); }
 static LIST_FREE_ITEM(group_item_free, struct ekg_group *) { xfree(data->name); }
 DYNSTUFF_LIST_DECLARE_SORTED(ekg_groups, struct ekg_group, group_compare, group_item_free,
@@ -73,33 +113,439 @@ DYNSTUFF_LIST_DECLARE_SORTED(ekg_resources, ekg_resource_t, userlist_resource_co
 	static __DYNSTUFF_DESTROY)		/* ekg_resources_destroy() */
 
 /* userlist: */
-static LIST_ADD_COMPARE(userlist_compare, userlist_t *) { return xstrcoll(data1->nickname, data2->nickname); }
 static LIST_FREE_ITEM(userlist_free_item, userlist_t *) {
 	userlist_private_free(data);
 	private_items_destroy(&data->priv_list);
 	xfree((void *) data->uid); xfree(data->nickname); xfree(data->descr); xfree(data->foreign); xfree(data->last_descr);
 	xfree(data->descr1line);
+	xfree(data->group_bits);
+	xfree(data->collate_key);
 	ekg_groups_destroy(&(data->groups));
 	ekg_resources_destroy(&(data->resources));
 }
-DYNSTUFF_LIST_DECLARE_SORTED(userlists, userlist_t, userlist_compare, userlist_free_item,
-	static __DYNSTUFF_ADD_SORTED,					/* userlists_add() */
-	__DYNSTUFF_REMOVE_SAFE,						/* userlists_remove() */
-	__DYNSTUFF_DESTROY)						/* userlists_destroy() */
+DYNSTUFF_LIST_DECLARE_SORTED(userlist_items, userlist_t, NULL, userlist_free_item,
+	__DYNSTUFF_NOADD,						/* see userlist_items_insert() */
+	__DYNSTUFF_NOREMOVE,						/* see userlist_items_unlink() */
+	static __DYNSTUFF_DESTROY)					/* userlist_items_destroy() */
 
 /*
- * userlist_add_entry()
+ * userlist_collate_key()
  *
- * dodaje do listy kontaktw pojedyncz lini z pliku lub z serwera.
+ * klucz sortowania nicka: strxfrm(), wic strcmp() kluczy daje to samo
+ * co strcoll() nickw, a kosztuje tyle co zwyke porwnanie napisw.
  */
-void userlist_add_entry(session_t *session, const char *line) {
+static char *userlist_collate_key(const char *nickname) {
+	size_t len;
+	char *key;
+
+	if (!nickname)
+		return NULL;
+
+	len = strxfrm(NULL, nickname, 0);
+	key = xmalloc(len + 1);
+	strxfrm(key, nickname, len + 1);
+
+	return key;
+}
+
+static gint userlist_collate_compare(gconstpointer a, gconstpointer b) {
+	const userlist_t *u1 = *(userlist_t **) a;
+	const userlist_t *u2 = *(userlist_t **) b;
+
+	return xstrcmp(u1->collate_key, u2->collate_key);
+}
+
+/*
+ * ordered index of userlist: the same entries as in list, in the same
+ * order (by u->collate_key), so place for new entry, and predecessor of
+ * removed one, are found with binary search instead of walking the list.
+ * it's built from list by first userlist_items_insert() or _unlink(),
+ * and dropped by userlists_destroy() and userlist_items_bulk_add().
+ */
+static GHashTable *userlist_orders;	/* address of list head (userlist_t **) -> GPtrArray of userlist_t */
+
+static void userlist_order_free(gpointer data) {
+	g_ptr_array_free(data, TRUE);
+}
+
+static GPtrArray *userlist_order_get(userlist_t **userlist) {
+	GPtrArray *order;
+	userlist_t *u;
+
+	if (!userlist_orders)
+		userlist_orders = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, userlist_order_free);
+
+	if (!(order = g_hash_table_lookup(userlist_orders, userlist))) {
+		order = g_ptr_array_new();
+		for (u = *userlist; u; u = u->next)
+			g_ptr_array_add(order, u);
+		g_hash_table_insert(userlist_orders, userlist, order);
+	}
+
+	return order;
+}
+
+/* position of first entry with key >= given one */
+static guint userlist_order_bound(GPtrArray *order, const char *key) {
+	guint lo = 0, hi = order->len;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		userlist_t *u = g_ptr_array_index(order, mid);
+
+		if (xstrcmp(u->collate_key, key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * userlist_items_insert()
+ *
+ * puts @a u into sorted @a userlist, before entries with equal nickname
+ * (like list_add_sorted3() did). collation key is computed here, so after
+ * nickname change entry has to be unlinked and inserted again.
+ */
+static void userlist_items_insert(userlist_t **userlist, userlist_t *u) {
+	GPtrArray *order = userlist_order_get(userlist);
+	guint pos;
+
+	xfree(u->collate_key);
+	u->collate_key = userlist_collate_key(u->nickname);
+
+	pos = userlist_order_bound(order, u->collate_key);
+	if (pos) {
+		userlist_t *prev = g_ptr_array_index(order, pos - 1);
+
+		u->next = prev->next;
+		prev->next = u;
+	} else {
+		u->next = *userlist;
+		*userlist = u;
+	}
+
+		/* g_ptr_array_insert() is glib >= 2.40 */
+	g_ptr_array_add(order, NULL);
+	memmove(&order->pdata[pos + 1], &order->pdata[pos], (order->len - 1 - pos) * sizeof(gpointer));
+	order->pdata[pos] = u;
+}
+
+/*
+ * userlist_items_unlink()
+ *
+ * unlinks @a u from @a userlist, doesn't free it.
+ *
+ * 0/-1 if it's not on list
+ */
+static int userlist_items_unlink(userlist_t **userlist, userlist_t *u) {
+	GPtrArray *order = userlist_order_get(userlist);
+	guint i;
+
+	for (i = userlist_order_bound(order, u->collate_key); i < order->len; i++) {
+		userlist_t *e = g_ptr_array_index(order, i);
+
+		if (e != u) {
+			if (xstrcmp(e->collate_key, u->collate_key))
+				break;
+			continue;
+		}
+
+		if (i)
+			((userlist_t *) g_ptr_array_index(order, i - 1))->next = u->next;
+		else
+			*userlist = u->next;
+		u->next = NULL;
+
+		g_ptr_array_remove_index(order, i);
+		return 0;
+	}
+
+	return -1;
+}
+
+/*
+ * prefix index of userlist: casefolded nicknames and uids kept sorted, so tab
+ * completion asks for a range, instead of walking whole list (think of irc
+ * channel with thousands of people). it's built by first
+ * userlist_index_foreach() on given list, and then kept up to date by
+ * userlist_add_u(), userlist_remove_u(), userlist_replace() and userlists_destroy().
+ * userlist_items_bulk_add() drops it, it's cheaper to build it again.
+ */
+typedef struct {
+	char *key;			/* casefolded name */
+	char *name;			/* name, as it was when indexed */
+	userlist_t *u;
+	userlist_index_type_t type;
+} userlist_index_entry_t;
+
+typedef struct {
+	GPtrArray *entries;		/* userlist_index_entry_t, sorted by key */
+	GHashTable *nicknames;		/* userlist_t -> its nickname entry, u->nickname may be already changed when we remove it */
+} userlist_index_t;
+
+static GHashTable *userlist_indexes;	/* address of list head (userlist_t **) -> userlist_index_t */
+
+/* the same folding as strncasecmp_pl() does */
+static char *userlist_index_fold(const char *name, gssize len) {
+	return g_utf8_casefold(name, len);
+}
+
+/* position of first entry with key >= given one */
+static guint userlist_index_bound(GPtrArray *entries, const char *key) {
+	guint lo = 0, hi = entries->len;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		userlist_index_entry_t *e = g_ptr_array_index(entries, mid);
+
+		if (strcmp(e->key, key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static gint userlist_index_compare(gconstpointer a, gconstpointer b) {
+	const userlist_index_entry_t *e1 = *(userlist_index_entry_t **) a;
+	const userlist_index_entry_t *e2 = *(userlist_index_entry_t **) b;
+
+	return strcmp(e1->key, e2->key);
+}
+
+static userlist_index_entry_t *userlist_index_entry_new(userlist_t *u, const char *name, userlist_index_type_t type) {
+	userlist_index_entry_t *e = xmalloc(sizeof(userlist_index_entry_t));
+
+	e->key	= userlist_index_fold(name, -1);
+	e->name	= xstrdup(name);
+	e->u	= u;
+	e->type	= type;
+
+	return e;
+}
+
+static void userlist_index_entry_free(gpointer data) {
+	userlist_index_entry_t *e = data;
+
+	g_free(e->key);
+	xfree(e->name);
+	xfree(e);
+}
+
+static void userlist_index_free(gpointer data) {
+	userlist_index_t *idx = data;
+
+	g_hash_table_destroy(idx->nicknames);
+	g_ptr_array_free(idx->entries, TRUE);
+	xfree(idx);
+}
+
+/* g_ptr_array_insert() is glib >= 2.40 */
+static void userlist_index_put(GPtrArray *entries, userlist_index_entry_t *e) {
+	guint pos = userlist_index_bound(entries, e->key);
+
+	g_ptr_array_add(entries, NULL);
+	memmove(&entries->pdata[pos + 1], &entries->pdata[pos], (entries->len - 1 - pos) * sizeof(gpointer));
+	entries->pdata[pos] = e;
+}
+
+static void userlist_index_insert(userlist_index_t *idx, userlist_t *u) {
+	userlist_index_entry_t *e;
+
+	if (u->uid)
+		userlist_index_put(idx->entries, userlist_index_entry_new(u, u->uid, USERLIST_INDEX_UID));
+
+	if (u->nickname) {
+		e = userlist_index_entry_new(u, u->nickname, USERLIST_INDEX_NICKNAME);
+		userlist_index_put(idx->entries, e);
+		g_hash_table_insert(idx->nicknames, u, e);
+	}
+}
+
+static void userlist_index_delete(userlist_index_t *idx, const char *key, userlist_t *u, userlist_index_type_t type) {
+	guint i;
+
+	for (i = userlist_index_bound(idx->entries, key); i < idx->entries->len; i++) {
+		userlist_index_entry_t *e = g_ptr_array_index(idx->entries, i);
+
+		if (strcmp(e->key, key))
+			break;
+
+		if (e->u == u && e->type == type) {
+			g_ptr_array_remove_index(idx->entries, i);	/* frees e */
+			return;
+		}
+	}
+}
+
+static void userlist_index_add(userlist_t **userlist, userlist_t *u) {
+	userlist_index_t *idx;
+
+	if (userlist_indexes && (idx = g_hash_table_lookup(userlist_indexes, userlist)))
+		userlist_index_insert(idx, u);
+}
+
+static void userlist_index_remove(userlist_t **userlist, userlist_t *u) {
+	userlist_index_entry_t *e;
+	userlist_index_t *idx;
+
+	if (!userlist_indexes || !(idx = g_hash_table_lookup(userlist_indexes, userlist)))
+		return;
+
+	if ((e = g_hash_table_lookup(idx->nicknames, u))) {
+		g_hash_table_remove(idx->nicknames, u);
+		userlist_index_delete(idx, e->key, u, USERLIST_INDEX_NICKNAME);
+	}
+
+	if (u->uid) {
+		char *key = userlist_index_fold(u->uid, -1);
+
+		userlist_index_delete(idx, key, u, USERLIST_INDEX_UID);
+		g_free(key);
+	}
+}
+
+/**
+ * userlist_index_foreach()
+ *
+ * Calls @a func for every nickname and/or uid from @a userlist starting
+ * with first @a len chars of @a text (case-insensitive), in alphabetical order.
+ *
+ * @param userlist	- address of list head (&session->userlist, &window->userlist, &conference->participants)
+ * @param types		- USERLIST_INDEX_NICKNAME, USERLIST_INDEX_UID or both
+ *
+ * @note @a func must not modify @a userlist
+ */
+void userlist_index_foreach(userlist_t **userlist, const char *text, size_t len, int types, userlist_index_func_t func, void *data) {
+	userlist_index_t *idx;
+	char *key;
+	guint i;
+
+	if (!userlist)
+		return;
+
+	if (!userlist_indexes)
+		userlist_indexes = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, userlist_index_free);
+
+	if (!(idx = g_hash_table_lookup(userlist_indexes, userlist))) {
+		userlist_t *u;
+
+		idx = xmalloc(sizeof(userlist_index_t));
+		idx->entries	= g_ptr_array_new_with_free_func(userlist_index_entry_free);
+		idx->nicknames	= g_hash_table_new(g_direct_hash, g_direct_equal);
+
+		for (u = *userlist; u; u = u->next) {
+			if (u->uid)
+				g_ptr_array_add(idx->entries, userlist_index_entry_new(u, u->uid, USERLIST_INDEX_UID));
+			if (u->nickname) {
+				userlist_index_entry_t *e = userlist_index_entry_new(u, u->nickname, USERLIST_INDEX_NICKNAME);
+
+				g_ptr_array_add(idx->entries, e);
+				g_hash_table_insert(idx->nicknames, u, e);
+			}
+		}
+		g_ptr_array_sort(idx->entries, userlist_index_compare);
+
+		g_hash_table_insert(userlist_indexes, userlist, idx);
+	}
+
+	key = userlist_index_fold(text, len);
+	len = xstrlen(key);
+
+	for (i = userlist_index_bound(idx->entries, key); i < idx->entries->len; i++) {
+		userlist_index_entry_t *e = g_ptr_array_index(idx->entries, i);
+
+		if (strncmp(e->key, key, len))
+			break;
+
+		if (e->type & types)
+			func(e->u, e->name, data);
+	}
+
+	g_free(key);
+}
+
+/*
+ * userlist_items_bulk_add()
+ *
+ * adds all @a items at once: sorts them and merges with list, instead
+ * of inserting one by one. indexes of the list are dropped, they'll be
+ * rebuilt when needed.
+ */
+static void userlist_items_bulk_add(userlist_t **userlist, GPtrArray *items) {
+	userlist_t *head = NULL, **tail = &head;
+	userlist_t *l = *userlist;
+	guint i;
+
+	if (!items->len)
+		return;
+
+	for (i = 0; i < items->len; i++) {
+		userlist_t *u = g_ptr_array_index(items, i);
+
+		xfree(u->collate_key);
+		u->collate_key = userlist_collate_key(u->nickname);
+	}
+	g_ptr_array_sort(items, userlist_collate_compare);
+
+	i = 0;
+	while (l || i < items->len) {
+		userlist_t *u;
+
+			/* new ones go before equal, as in userlist_items_insert() */
+		if (i < items->len && (!l || xstrcmp(((userlist_t *) g_ptr_array_index(items, i))->collate_key, l->collate_key) <= 0))
+			u = g_ptr_array_index(items, i++);
+		else {
+			u = l;
+			l = l->next;
+		}
+
+		*tail = u;
+		tail = &u->next;
+	}
+	*tail = NULL;
+	*userlist = head;
+
+	if (userlist_orders)
+		g_hash_table_remove(userlist_orders, userlist);
+	if (userlist_indexes)
+		g_hash_table_remove(userlist_indexes, userlist);
+}
+
+/*
+ * userlists_destroy()
+ *
+ * frees whole list (and its indexes)
+ */
+void userlists_destroy(userlist_t **userlist) {
+	if (userlist_indexes)
+		g_hash_table_remove(userlist_indexes, userlist);
+	if (userlist_orders)
+		g_hash_table_remove(userlist_orders, userlist);
+
+	userlist_items_destroy(userlist);
+}
+
+/*
+ * userlist_entry_parse()
+ *
+ * tworzy wpis z pojedynczej linii z pliku lub z serwera, nie dodaje go
+ * do listy.
+ *
+ * NULL jeli linia jest bdna
+ */
+static userlist_t *userlist_entry_parse(session_t *session, const char *line) {
 	char **entry = array_make(line, ";", 8, 0, 0);
 	userlist_t *u;
 	int count, i;
 
 	if ((count = g_strv_length(entry)) < 7) {
 		g_strfreev(entry);
-		return;
+		return NULL;
 	}
 
 	u = xmalloc(sizeof(userlist_t)); /* we'd need this here */
@@ -116,7 +562,7 @@ void userlist_add_entry(session_t *session, const char *line) {
 		array_free_count(entry, count);
 		xfree((void *) u->uid);
 		xfree(u);
-		return;
+		return NULL;
 	}
 
 	u->status = EKG_STATUS_NA;
@@ -129,6 +575,7 @@ void userlist_add_entry(session_t *session, const char *line) {
 	}
 			
 	u->groups	= group_init(entry[5]);
+	ekg_groups_changed(u);
 
 	if (entry[3]) {
 		u->nickname	= !valid_nick(entry[3]) ? 
@@ -141,7 +588,41 @@ void userlist_add_entry(session_t *session, const char *line) {
 		NULL;
 	
 	array_free_count(entry, count);
-	userlists_add(&(session->userlist), u);
+	return u;
+}
+
+/*
+ * userlist_add_entry()
+ *
+ * dodaje do listy kontaktw pojedyncz lini z pliku lub z serwera.
+ */
+void userlist_add_entry(session_t *session, const char *line) {
+	userlist_t *u;
+
+	if (!(u = userlist_entry_parse(session, line)))
+		return;
+
+	userlist_items_insert(&(session->userlist), u);
+	userlist_index_add(&(session->userlist), u);
+}
+
+/*
+ * userlist_add_entries()
+ *
+ * dodaje do listy kontaktw wiele linii naraz (np. ca list z serwera),
+ * sortujc je raz, zamiast wstawia kad osobno.
+ */
+void userlist_add_entries(session_t *session, char **lines) {
+	GPtrArray *items = g_ptr_array_new();
+	userlist_t *u;
+
+	for (; lines && *lines; lines++) {
+		if ((u = userlist_entry_parse(session, *lines)))
+			g_ptr_array_add(items, u);
+	}
+
+	userlist_items_bulk_add(&(session->userlist), items);
+	g_ptr_array_free(items, TRUE);
 }
 
 /**
@@ -156,17 +637,24 @@ void userlist_add_entry(session_t *session, const char *line) {
 int userlist_read(session_t *session) {
 	char *buf;
 	GDataInputStream *f;
+	GPtrArray *items;
+	userlist_t *u;
 
 	if (!(f = G_DATA_INPUT_STREAM(config_open("%s-userlist", "r", session->uid))))
 		return -1;
-			
+
+	items = g_ptr_array_new();
 	while ((buf = read_line(f))) {
 		if (buf[0] == '#' || (buf[0] == '/' && buf[1] == '/'))
 			continue;
 		
-		userlist_add_entry(session, buf);
+		if ((u = userlist_entry_parse(session, buf)))
+			g_ptr_array_add(items, u);
 	}
 
+	userlist_items_bulk_add(&(session->userlist), items);
+	g_ptr_array_free(items, TRUE);
+
 	query_emit(NULL, "userlist-refresh");	/* XXX, wywolywac tylko kiedy dodalismy przynajmniej 1 */
 
 	g_object_unref(f);
@@ -394,7 +882,8 @@ userlist_t *userlist_add_u(userlist_t **userlist, const char *uid, const char *n
 	u->nickname = xstrdup(nickname);
 	u->status = EKG_STATUS_NA;
 
-	userlists_add(userlist, u);
+	userlist_items_insert(userlist, u);
+	userlist_index_add(userlist, u);
 	return u;
 }
 
@@ -420,7 +909,11 @@ int userlist_remove_u(userlist_t **userlist, userlist_t *u) {
 	if (!u)
 		return -1;
 
-	userlists_remove(userlist, u);
+	userlist_index_remove(userlist, u);
+	if (!userlist_items_unlink(userlist, u)) {
+		userlist_free_item(u);
+		xfree(u);
+	}
 
 	return 0;
 }
@@ -440,9 +933,11 @@ int userlist_remove_u(userlist_t **userlist, userlist_t *u) {
 int userlist_replace(session_t *session, userlist_t *u) {
 	if (!u)
 		return -1;
-	if (!LIST_UNLINK2(&(session->userlist), u) && (errno == ENOENT))
+	if (userlist_items_unlink(&(session->userlist), u) == -1)
 		return -1;
-	userlists_add(&(session->userlist), u);
+	userlist_index_remove(&(session->userlist), u);
+	userlist_items_insert(&(session->userlist), u);
+	userlist_index_add(&(session->userlist), u);
 
 	return 0;
 }
@@ -748,6 +1243,7 @@ int ignored_remove(session_t *session, const char *uid) {
 
 		gl = ekg_groups_removei(&u->groups, g);
 	}
+	ekg_groups_changed(u);
 
 	if (!u->nickname && !u->groups) {
 		userlist_remove(session, u);
@@ -817,23 +1313,18 @@ int ignored_add(session_t *session, const char *uid, ignore_t level) {
  *
  */
 int ignored_check(session_t *session, const char *uid) {
-	userlist_t *u = userlist_find(session, uid);
-	struct ekg_group *gl;
-
-	if (!u)
-		return 0;
-
-	for (gl = u->groups; gl; gl = gl->next) {
-		struct ekg_group *g = gl;
-
-		if (!xstrcasecmp(g->name, "__ignored"))
-			return IGNORE_ALL;
-
-		if (!xstrncasecmp(g->name, "__ignored_", 10))
-			return atoi(g->name + 10);
-	}
+	return ignored_check_u(userlist_find(session, uid));
+}
 
-	return 0;
+/**
+ * ignored_check_u()
+ *
+ * like ignored_check(), but for already found user @a u.
+ *
+ * @param u - user, can be NULL
+ */
+int ignored_check_u(userlist_t *u) {
+	return (u ? u->ignore_level : 0);
 }
 
 /**
@@ -932,8 +1423,10 @@ int ekg_group_add(userlist_t *u, const char *group) {
 	}
 	g = xmalloc(sizeof(struct ekg_group));
 	g->name = xstrdup(group);
+	g->id	= group_id_get(group);
 
 	ekg_groups_add(&u->groups, g);
+	ekg_groups_changed(u);
 
 	return 0;
 }
@@ -959,7 +1452,8 @@ int ekg_group_remove(userlist_t *u, const char *group) {
 
 		if (!xstrcasecmp(g->name, group)) {
 			(void) ekg_groups_removei(&u->groups, g);
-			
+			ekg_groups_changed(u);
+
 			return 0;
 		}
 	}
@@ -978,19 +1472,88 @@ int ekg_group_remove(userlist_t *u, const char *group) {
  * @return 1 jeli tak, 0 jeli nie.
  */
 int ekg_group_member(userlist_t *u, const char *group) {
-	struct ekg_group *gl;
-
 	if (!u || !group)
 		return 0;
 
-	for (gl = u->groups; gl; gl = gl->next) {
-		struct ekg_group *g = gl;
+	return ekg_group_member_id(u, ekg_group_id(group));
+}
 
-		if (!xstrcasecmp(g->name, group))
-			return 1;
+/**
+ * ekg_group_member_id()
+ *
+ * like ekg_group_member(), but takes number of group from ekg_group_id(),
+ * useful when checking many users against the same group.
+ *
+ * @return 1 jeli tak, 0 jeli nie.
+ */
+int ekg_group_member_id(userlist_t *u, int id) {
+	if (!u || id < 0 || id / GROUP_BITS >= u->group_bits_len)
+		return 0;
+
+	return !!(u->group_bits[id / GROUP_BITS] & (1U << (id % GROUP_BITS)));
+}
+
+/**
+ * ekg_group_id()
+ *
+ * zwraca numer grupy o nazwie @a name.
+ *
+ * @return numer grupy lub -1, jeli nikt nigdy nie nalea do takiej grupy.
+ */
+int ekg_group_id(const char *name) {
+	gpointer id;
+
+	if (!name || !group_ids || !(id = g_hash_table_lookup(group_ids, name)))
+		return -1;
+
+	return GPOINTER_TO_INT(id) - 1;
+}
+
+/**
+ * ekg_groups_changed()
+ *
+ * rebuilds bitset of groups and ignore level of @a u from u->groups.
+ * has to be called after every change of u->groups, ekg_group_add()
+ * and ekg_group_remove() do it themselves.
+ *
+ * @param u - wpis usera.
+ */
+void ekg_groups_changed(userlist_t *u) {
+	struct ekg_group *g;
+	int level = 0, found = 0;
+	int max = -1;
+
+	if (!u)
+		return;
+
+	for (g = u->groups; g; g = g->next) {
+		if (g->id > max)
+			max = g->id;
+
+		/* like it was in ignored_check(): first matching group decides */
+		if (found)
+			continue;
+
+		if (!xstrcasecmp(g->name, "__ignored")) {
+			level = IGNORE_ALL;
+			found = 1;
+		} else if (!xstrncasecmp(g->name, "__ignored_", 10)) {
+			level = atoi(g->name + 10);
+			found = 1;
+		}
 	}
 
-	return 0;
+	u->ignore_level = level;
+
+	if (max / GROUP_BITS >= u->group_bits_len) {
+		u->group_bits_len = max / GROUP_BITS + 1;
+		u->group_bits = xrealloc(u->group_bits, u->group_bits_len * sizeof(unsigned int));
+	}
+	if (u->group_bits_len)
+		memset(u->group_bits, 0, u->group_bits_len * sizeof(unsigned int));
+
+	for (g = u->groups; g; g = g->next)
+		u->group_bits[g->id / GROUP_BITS] |= (1U << (g->id % GROUP_BITS));
 }
 
 /**
@@ -1017,6 +1580,7 @@ struct ekg_group *group_init(const char *names) {
 		struct ekg_group *g = xmalloc(sizeof(struct ekg_group));
 
 		g->name = groups[i];
+		g->id	= group_id_get(g->name);
 		ekg_groups_add(&gl, g);
 	}
 	/* NOTE: we don't call here g_strfreev() cause we use items of this
@@ -79,6 +79,11 @@ typedef struct userlist {
 	time_t		status_time;	/**< From when we have this status, description */
 	void		*priv_data;	/**< Alternate private data, used by ncurses plugin */
 	private_data_t	*priv_list;	/* New user private data */
+
+	int		ignore_level;	/**< Ignore level from __ignored groups, kept by ekg_groups_changed() */
+	unsigned int	*group_bits;	/**< Bitset of ekg_group_id() of groups, kept by ekg_groups_changed() */
+	int		group_bits_len;	/**< Number of elements in group_bits */
+	char		*collate_key;	/**< strxfrm() of nickname, as it was when entry was put in list; list is sorted by it */
 } userlist_t;
 
 typedef enum {
@@ -129,6 +134,7 @@ struct ekg_group {
 	struct ekg_group *next;
 
 	char *name;		/**< name of group */
+	int id;			/**< number of group, see ekg_group_id() */
 };
 
 typedef enum {
@@ -149,6 +155,13 @@ struct ignore_label {
 	char		*name;
 };
 
+typedef enum {
+	USERLIST_INDEX_NICKNAME	= 0x01,
+	USERLIST_INDEX_UID	= 0x02
+} userlist_index_type_t;
+
+typedef void (*userlist_index_func_t)(userlist_t *u, const char *name, void *data);
+
 #define	IGNORE_LABELS_MAX 9
 extern struct ignore_label ignore_labels[IGNORE_LABELS_MAX];
 
@@ -160,6 +173,7 @@ void userlist_clear_status(session_t *session, const char *uid);
 userlist_t *userlist_add(session_t *session, const char *uid, const char *nickname);
 userlist_t *userlist_add_u(userlist_t **userlist, const char *uid, const char *nickname);
 void userlist_add_entry(session_t *session,const char *line);
+void userlist_add_entries(session_t *session, char **lines);
 int userlist_remove(session_t *session, userlist_t *u);
 int userlist_remove_u(userlist_t **userlist, userlist_t *u);
 int userlist_replace(session_t *session, userlist_t *u);
@@ -168,6 +182,7 @@ userlist_t *userlist_find_u(userlist_t **userlist, const char *uid);
 #define userlist_find_n(a, b) userlist_find(session_find(a), b)
 void userlist_free(session_t *session);
 void userlists_destroy(userlist_t **userlist);
+void userlist_index_foreach(userlist_t **userlist, const char *text, size_t len, int types, userlist_index_func_t func, void *data);
 
 void *userlist_private_get(plugin_t *plugin, userlist_t *u);
 
@@ -179,12 +194,16 @@ void userlist_resource_remove(userlist_t *u, ekg_resource_t *r);
 int ignored_add(session_t *session, const char *uid, ignore_t level);
 int ignored_remove(session_t *session, const char *uid);
 int ignored_check(session_t *session, const char *uid);
+int ignored_check_u(userlist_t *u);
 int ignore_flags(const char *str);
 const char *ignore_format(int level);
 
 int ekg_group_add(userlist_t *u, const char *group);
 int ekg_group_remove(userlist_t *u, const char *group);
 int ekg_group_member(userlist_t *u, const char *group);
+int ekg_group_member_id(userlist_t *u, int id);
+int ekg_group_id(const char *name);
+void ekg_groups_changed(userlist_t *u);
 char *group_to_string(struct ekg_group *l, int meta, int sep);
 struct ekg_group *group_init(const char *groups);
 
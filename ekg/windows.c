@@ -27,17 +27,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <ctype.h>
+
+#include "windows_index.inc"
 
 int window_last_id = -1;		/* ostatnio wywietlone okno */
 
 window_t *windows = NULL;		/* lista okien */
 
 static LIST_ADD_COMPARE(window_new_compare, window_t *) { return data1->id - data2->id; }
-static LIST_FREE_ITEM(list_window_free, window_t *) { xfree(data->target); xfree(data->alias); userlists_destroy(&(data->userlist)); }
+static LIST_FREE_ITEM(list_window_free, window_t *) { window_index_remove(data); xfree(data->target); xfree(data->alias); userlists_destroy(&(data->userlist)); }
 
-static __DYNSTUFF_LIST_ADD_SORTED(windows, window_t, window_new_compare);			/* windows_add() */
-static __DYNSTUFF_LIST_UNLINK(windows, window_t);						/* windows_unlink() */
-static __DYNSTUFF_LIST_REMOVE_SAFE(windows, window_t, list_window_free);			/* windows_remove() */
+static __DYNSTUFF_DLIST_ADD_SORTED(windows, window_t, window_new_compare);			/* windows_add() */
+static __DYNSTUFF_DLIST_UNLINK(windows, window_t);						/* windows_unlink() */
+static __DYNSTUFF_DLIST_REMOVE_SAFE(windows, window_t, list_window_free);			/* windows_remove() */
 __DYNSTUFF_LIST_DESTROY(windows, window_t, list_window_free);					/* windows_destroy() */
 
 int config_display_crap = 1;		/* czy wywietla mieci? */
@@ -94,6 +97,7 @@ window_t *window_find_ptr(window_t *w) {
 window_t *window_find_sa(session_t *session, const char *target, int session_null_means_no_session) {
 	userlist_t *u;
 	window_t *w;
+	session_t *s;
 
 	if (!target || !xstrcasecmp(target, "__current"))
 		return window_current->id ? window_current : window_status;
@@ -104,43 +108,37 @@ window_t *window_find_sa(session_t *session, const char *target, int session_nul
 	if (!xstrcasecmp(target, "__debug"))
 		return window_debug;
 
-	for (w = windows; w; w = w->next) {
-		/* if targets match, and (sessions match or [no session was specified, and it doesn't matter to which session window belongs to]) */
-		if (w->target && ((session == w->session) || (!session && !session_null_means_no_session)) && !xstrcasecmp(target, w->target))
-			return w;
-	}
+	/* if targets match, and (sessions match or [no session was specified, and it doesn't matter to which session window belongs to]) */
+	if ((w = window_index_find(session, target, (!session && !session_null_means_no_session))))
+		return w;
 
 	/* if we don't want session window, code below is useless */
 	if (!session && session_null_means_no_session)
 		return NULL;
 
-	if (xstrncmp(target, "__", 2)) {
-		session_t *s;
-		for (s = sessions; s; s = s->next) {
+	if (!xstrncmp(target, "__", 2))
+		return NULL;
+
+	for (s = sessions; s; s = s->next) {
+		window_t *n;
+
 		/* if sessions mishmash, and it wasn't NULL session, skip this session */
-			if (session != s && session)
-				continue;
+		if (session != s && session)
+			continue;
 
 		/* get_uid() was bad here. Because if even it's uid of user but we don't have it in userlist it'll do nothing. */
-			if (!(u = userlist_find(s, target))) 
-				continue;
+		if (!(u = userlist_find(s, target)))
+			continue;
 
-			for (w = windows; w; w = w->next) {
-				/* if there's target, and sessions match [no session specified, or sessions equal, check if entry (from userlist) match */
-				if ((!session || session == w->session) && w->target) {
-					if (u->nickname && !xstrcasecmp(u->nickname, w->target))
-						return w;
-
-					/* XXX, userlist_find() search only for u->nickname or u->uid.. so code below is useless? we can always return w; ?
-					 *	However userlist_find() also strip resources if preset.. here we don't have it. 
-					 *	maybe it's better, maybe not. Must think about it.
-					 *	For now leave this code.
-					 */
-					if (!xstrcasecmp(u->uid, w->target))
-						return w;
-				}
-			}
-		}
+		/* window with nickname or uid of that user [no session specified, or sessions equal],
+		 * XXX, userlist_find() also strips resources, windows of other resources aren't found. */
+		w = window_index_find(session, u->nickname, !session);
+		n = window_index_find(session, u->uid, !session);
+
+		if (n && (!w || n->id < w->id))
+			w = n;
+		if (w)
+			return w;
 	}
 	return NULL;
 }
@@ -310,6 +308,7 @@ window_t *window_new(const char *target, session_t *session, int new_id) {
 /*	w->userlist = NULL; */		/* xmalloc memset() to 0 memory */
 
 	windows_add(w);
+	window_index_add(w);
 	query_emit(NULL, "ui-window-new", &w);	/* XXX */
 
 	return w;
@@ -562,6 +561,25 @@ char *window_target(window_t *window) {
 	else				return "";
 }
 
+/**
+ * window_target_set()
+ *
+ * Change target of window @a w to @a target [can be NULL], keeping index of window_find_sa() up to date.<br>
+ * Use it instead of setting w->target by hand. It doesn't emit UI_WINDOW_TARGET_CHANGED, do it yourself.
+ *
+ * @param w	 - window
+ * @param target - new target, it's duplicated [it can be w->target or part of it]
+ */
+
+void window_target_set(window_t *w, const char *target) {
+	char *tmp = w->target;
+
+	window_index_remove(w);
+	w->target = xstrdup(target);
+	window_index_add(w);
+	xfree(tmp);
+}
+
 /*
  *
  * komenda ekg obsugujca okna
@@ -874,15 +892,10 @@ again:
 		return -1;
 	}
 
-	if ((nickname = get_nickname(new_session, uid))) {		/* if we've got nickname for old uid, than use it as w->target */
-		char *tmp = w->target;
-		w->target = xstrdup(nickname);
-		xfree(tmp);
-	} else if (w->target != uid) {					/* if not, than change w->target (possibility nickname) with uid value [XXX, untested behavior] */
-		char *tmp = w->target;
-		w->target = xstrdup(uid);
-		xfree(tmp);
-	}
+	if ((nickname = get_nickname(new_session, uid)))		/* if we've got nickname for old uid, than use it as w->target */
+		window_target_set(w, nickname);
+	else if (w->target != uid)					/* if not, than change w->target (possibility nickname) with uid value [XXX, untested behavior] */
+		window_target_set(w, uid);
 
 	window_session_set(w, new_session);
 	return 0;
@@ -66,9 +66,10 @@ typedef enum {
 
 typedef struct window {
 	struct window *next;
+	struct window *prev;		/* dlist, see dynstuff.h */
 
 	unsigned short id;		/* numer okna */
-	char *target;			/* nick query albo inna nazwa albo NULL */
+	char *target;			/* nick query albo inna nazwa albo NULL, change with window_target_set() */
 	char *alias;			/* name for display */
 	session_t *session;		/* ktrej sesji dotyczy okno */
 
@@ -116,6 +117,7 @@ window_t *window_exist(int id);
 void window_print(window_t *w, fstring_t *line);
 void print_window_w(window_t *w, int activity, const char *theme, ...);	/* themes.c */
 char *window_target(window_t *window);
+void window_target_set(window_t *w, const char *target);
 
 void window_session_set(window_t *w, session_t *newsession);
 int window_session_cycle(window_t *w);
@@ -6,8 +6,14 @@
 
 #include <stdio.h>
 
+void add_lastlog_tests(void);
+void add_nntp_tests(void);
 void add_recode_tests(void);
+void add_script_events_tests(void);
 void add_static_aborts_tests(void);
+void add_statusbar_tests(void);
+void add_themes_tests(void);
+void add_timer_wheel_tests(void);
 
 PLUGIN_DEFINE(check, PLUGIN_UI, NULL);
 
@@ -25,8 +31,14 @@ EXPORT int check_plugin_init(int prio) {
 
 	g_test_init(&argc, &argv, NULL);
 
+	add_lastlog_tests();
+	add_nntp_tests();
 	add_recode_tests();
+	add_script_events_tests();
 	add_static_aborts_tests();
+	add_statusbar_tests();
+	add_themes_tests();
+	add_timer_wheel_tests();
 
 	g_test_run();
 	ekg_exit();
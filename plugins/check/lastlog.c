@@ -0,0 +1,188 @@
+#include "ekg2.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include "plugins/ncurses/lastlog_index.inc"
+
+/* runs incremental lastlog on randomized backlogs, the way lastlog.c does
+ * on redraw, and compares lines it finds with full scan of backlog (what
+ * lastlog.c did before). backlog gets new lines (old ones fall out when it's
+ * full), is cleared, shrinks when backlog_size is changed; expression is
+ * changed (substrings and regexes, some with literal parts which trigram
+ * index is used for), and so is case. */
+
+/* like ncurses_window_t */
+static fstring_t **backlog;
+static int backlog_size, backlog_max;
+static guint backlog_seq;
+
+static const char *words[] = {
+	"ala", "Ala", "ma", "kota", "KOTA", "kot", "psa", "ekg2", "Ekg2", "jabber", "irc", "lastlog",
+	"abcabc", "abc", "bca", "x", "zzz", "[ok]", "a.b", "aba", "\xb1\xea\xbf", "\xa1\xca\xaf"
+};
+
+static const char *expressions[] = {
+	"kot", "kota", "KoTa", "ala ma", "abc", "bcab", "a.b", "ekg2", "zz", "", "x", "[ok]", "\xb1\xea",
+	"nothing"
+};
+
+static const char *regexes[] = {
+	"kota", "ala ma", "ko?ta", "k.ta", "^ala", "abc$", "(abc)+x", "[]abc]bca", "[[:alpha:]]psa", "ekg2|irc",
+	"a{2}la", "ma k", "z*", "bc\\[", "(?i)KOTA", "l(as)tlog", "abc+a",
+	"abc?a", "kota?", "kot{0,2}a", "x{100}", "bca{1,}b"
+};
+
+typedef struct {
+	const char *expression;
+	int isregex;
+	int casense;
+	GRegex *reg;
+} query_t;
+
+static gboolean query_match(const char *str, gpointer data) {
+	query_t *q = data;
+
+	if (q->isregex)
+		return g_regex_match(q->reg, str, 0, NULL);
+	if (q->casense)
+		return !!strstr(str, q->expression);
+	else
+		return !!xstrcasestr(str, q->expression);
+}
+
+static void backlog_add(GRand *r) {
+	GString *s = g_string_new(NULL);
+	int i, n = g_rand_int_range(r, 1, 12);
+	fstring_t *line = g_new0(fstring_t, 1);
+
+	for (i = 0; i < n; i++) {
+		if (i)
+			g_string_append_c(s, g_rand_int_range(r, 0, 4) ? ' ' : '.');
+		g_string_append(s, words[g_rand_int_range(r, 0, G_N_ELEMENTS(words))]);
+	}
+	line->str = g_string_free(s, FALSE);
+
+	/* like ncurses_backlog_add_real() */
+	if (backlog_size == backlog_max) {
+		g_free(backlog[backlog_size - 1]->str);
+		g_free(backlog[backlog_size - 1]);
+		backlog_size--;
+	}
+	memmove(&backlog[1], &backlog[0], backlog_size * sizeof(fstring_t *));
+	backlog[0] = line;
+	backlog_size++;
+	backlog_seq++;
+}
+
+static void backlog_truncate(int size) {
+	while (backlog_size > size) {
+		backlog_size--;
+		g_free(backlog[backlog_size]->str);
+		g_free(backlog[backlog_size]);
+	}
+}
+
+static void query_set(GRand *r, query_t *q) {
+	if (q->reg)
+		g_regex_unref(q->reg);
+	q->reg = NULL;
+
+	q->isregex = !g_rand_int_range(r, 0, 3);
+	q->casense = g_rand_boolean(r);
+	if (q->isregex) {
+		q->expression = regexes[g_rand_int_range(r, 0, G_N_ELEMENTS(regexes))];
+		q->reg = g_regex_new(q->expression, G_REGEX_RAW | G_REGEX_NO_AUTO_CAPTURE | (q->casense ? 0 : G_REGEX_CASELESS), 0, NULL);
+		g_assert(q->reg);
+	} else
+		q->expression = expressions[g_rand_int_range(r, 0, G_N_ELEMENTS(expressions))];
+}
+
+/* lastlog_matchcase toggled, like lastlog_regex_case() */
+static void query_flip_case(query_t *q) {
+	q->casense = !q->casense;
+	if (q->isregex) {
+		GRegex *reg = g_regex_new(g_regex_get_pattern(q->reg), g_regex_get_compile_flags(q->reg) ^ G_REGEX_CASELESS, 0, NULL);
+
+		g_regex_unref(q->reg);
+		q->reg = reg;
+	}
+}
+
+static void compare(lastlog_matches_t *m, lastlog_index_t *idx, query_t *q) {
+	char *literal = q->isregex ? lastlog_regex_literal(q->expression) : NULL;
+	guint k = 0;
+	int i;
+
+	lastlog_matches_update(m, idx, q->expression, q->isregex, q->casense, q->isregex ? literal : q->expression,
+			query_match, q, backlog, backlog_size, backlog_seq);
+
+	/* full scan, the oldest first */
+	for (i = backlog_size - 1; i >= 0; i--) {
+		if (!query_match(backlog[i]->str, q))
+			continue;
+
+		g_assert_cmpuint(k, <, m->matches->len);
+		g_assert(backlog[backlog_seq - 1 - g_array_index(m->matches, guint, k)] == backlog[i]);
+		k++;
+	}
+	g_assert_cmpuint(k, ==, m->matches->len);
+	g_free(literal);
+}
+
+static void check_lastlog_random(void) {
+	GRand *r = g_rand_new_with_seed(2011);
+	lastlog_index_t idx = { NULL, 0, 0 };
+	lastlog_matches_t m[2] = { { NULL, 0, 0, 0, NULL }, { NULL, 0, 0, 0, NULL } };
+	query_t q[2] = { { NULL, 0, 0, NULL }, { NULL, 0, 0, NULL } };
+	guint step;
+
+	backlog_size = 0;
+	backlog_seq = 0;
+	backlog_max = 200;
+	backlog = g_new(fstring_t *, 1000);
+	query_set(r, &q[0]);
+	query_set(r, &q[1]);
+
+	for (step = 0; step < 20000; step++) {
+		int op = g_rand_int_range(r, 0, 100), i;
+
+		if (op < 70) {
+			/* new messages, a few at once sometimes */
+			for (i = g_rand_int_range(r, 1, 4); i; i--)
+				backlog_add(r);
+		} else if (op < 72) {
+			/* /clear: ncurses_clear() forgets everything */
+			backlog_truncate(0);
+			lastlog_index_clear(&idx);
+			lastlog_matches_clear(&m[0]);
+			lastlog_matches_clear(&m[1]);
+		} else if (op < 74) {
+			/* /set backlog_size */
+			backlog_max = g_rand_int_range(r, 20, 1000);
+			backlog_truncate(backlog_max);
+		} else if (op < 84)
+			query_set(r, &q[g_rand_int_range(r, 0, 2)]);
+		else if (op < 90)
+			query_flip_case(&q[g_rand_int_range(r, 0, 2)]);
+
+		/* redraw, both lastlogs search this window */
+		compare(&m[0], &idx, &q[0]);
+		compare(&m[1], &idx, &q[1]);
+	}
+
+	backlog_truncate(0);
+	lastlog_index_clear(&idx);
+	lastlog_matches_clear(&m[0]);
+	lastlog_matches_clear(&m[1]);
+	g_free(backlog);
+	if (q[0].reg)
+		g_regex_unref(q[0].reg);
+	if (q[1].reg)
+		g_regex_unref(q[1].reg);
+	g_rand_free(r);
+}
+
+void add_lastlog_tests(void) {
+	g_test_add_func("/lastlog/incremental matches and full scan", check_lastlog_random);
+}
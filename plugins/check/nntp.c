@@ -0,0 +1,535 @@
+#include "ekg2.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "plugins/nntp/nntp_pipeline.inc"
+
+#define WINDOW 8
+
+/* fake server, in child process: group of articles 1..articles */
+
+typedef struct {
+	int fd;
+	int articles;
+	GString *in;
+	FILE *log;			/* commands it got, and "batch n" before each batch */
+} fake_server_t;
+
+static void fake_send(fake_server_t *srv, const char *fmt, ...) {
+	GString *out = g_string_new(NULL);
+	va_list ap;
+
+	va_start(ap, fmt);
+	g_string_append_vprintf(out, fmt, ap);
+	va_end(ap);
+
+	g_string_append(out, "\r\n");
+	if (write(srv->fd, out->str, out->len) != (ssize_t) out->len)
+		_exit(2);
+	g_string_free(out, TRUE);
+}
+
+/* reads what's there, waits @a timeout ms for it; returns 0 at EOF, -1 if nothing came */
+static int fake_read(fake_server_t *srv, int timeout) {
+	struct pollfd pfd = { srv->fd, POLLIN, 0 };
+	char buf[4096];
+	ssize_t len;
+
+	if (poll(&pfd, 1, timeout) <= 0)
+		return -1;
+	if ((len = read(srv->fd, buf, sizeof(buf))) <= 0)
+		return 0;
+	g_string_append_len(srv->in, buf, len);
+	return 1;
+}
+
+/* answers @a cmd, returns 0 after QUIT */
+static int fake_answer(fake_server_t *srv, const char *cmd) {
+	int a, b, i;
+
+	if (!strncmp(cmd, "GROUP ", 6))
+		fake_send(srv, "211 %d 1 %d %s", srv->articles, srv->articles, cmd + 6);
+
+	else if (sscanf(cmd, "XOVER %d-%d", &a, &b) == 2) {
+		if (a > srv->articles) {
+			fake_send(srv, "420 No articles in range");
+			return 1;
+		}
+		fake_send(srv, "224 Overview information follows");
+		for (i = a; i <= b && i <= srv->articles; i++)
+			fake_send(srv, "%d\tSubject %d\tauthor@example.org\t13 Mar 2011 12:00:00 +0100\t<%d@fake>\t\t100\t10", i, i, i);
+		fake_send(srv, ".");
+
+	} else if (sscanf(cmd, "HEAD %d", &a) == 1) {
+		if (a < 1 || a > srv->articles) {
+			fake_send(srv, "423 No article with that number");
+			return 1;
+		}
+		fake_send(srv, "221 %d <%d@fake>", a, a);
+		fake_send(srv, "Subject: Subject %d", a);
+		fake_send(srv, "From: author@example.org");
+		fake_send(srv, ".");
+
+	} else if (sscanf(cmd, "BODY %d", &a) == 1) {
+		fake_send(srv, "222 %d <%d@fake>", a, a);
+		fake_send(srv, "body of %d", a);
+		fake_send(srv, "");
+		fake_send(srv, "..starts with dot");
+		fake_send(srv, ".");
+
+	} else if (!strncmp(cmd, "AUTHINFO USER ", 14))
+		fake_send(srv, "381 Password required");
+	else if (!strncmp(cmd, "AUTHINFO PASS ", 14))
+		fake_send(srv, "281 Authentication accepted");
+
+	else if (!strcmp(cmd, "QUIT")) {
+		fake_send(srv, "205 Bye");
+		return 0;
+	} else
+		fake_send(srv, "500 What?");
+	return 1;
+}
+
+/*
+ * answers in batches: it waits for commands which client sent at once,
+ * and answers all of them, so we know how many were outstanding.
+ */
+static void fake_server(int fd, int articles, FILE *log) {
+	fake_server_t srv = { fd, articles, g_string_new(NULL), log };
+
+	fake_send(&srv, "200 fake news server ready");
+
+	for (;;) {
+		GPtrArray *batch = g_ptr_array_new();
+		char *nl;
+		guint i;
+
+		while (!strchr(srv.in->str, '\n')) {
+			if (!fake_read(&srv, -1))
+				_exit(0);
+		}
+		while (fake_read(&srv, 50) > 0)
+			;
+
+		while ((nl = strstr(srv.in->str, "\r\n"))) {
+			g_ptr_array_add(batch, g_strndup(srv.in->str, nl - srv.in->str));
+			g_string_erase(srv.in, 0, nl - srv.in->str + 2);
+		}
+
+		fprintf(log, "batch %u\n", batch->len);
+		for (i = 0; i < batch->len; i++)
+			fprintf(log, "%s\n", (char *) batch->pdata[i]);
+		fflush(log);
+
+		for (i = 0; i < batch->len; i++) {
+			if (!fake_answer(&srv, batch->pdata[i]))
+				_exit(0);
+		}
+		g_ptr_array_free(batch, TRUE);
+	}
+}
+
+/* client, what nntp.c does with nntp_pipeline.inc */
+
+typedef struct {
+	int fd;
+	GString *in;
+	nntp_pipeline_t pipeline;
+	nntp_reader_t reader;
+	nntp_articles_t articles;
+	int fart, lart;
+	pid_t server;
+	char *log;			/* file fake server writes to */
+} client_t;
+
+static void client_write(const char *line, void *data) {
+	client_t *c = data;
+	char *out = g_strconcat(line, "\r\n", NULL);
+
+	g_assert_cmpint(write(c->fd, out, strlen(out)), ==, strlen(out));
+	g_free(out);
+}
+
+/* one line, without \n (\r is left, like watch does) */
+static char *client_read_line(client_t *c) {
+	char *nl, *line;
+
+	while (!(nl = strchr(c->in->str, '\n'))) {
+		char buf[4096];
+		ssize_t len = read(c->fd, buf, sizeof(buf));
+
+		g_assert_cmpint(len, >, 0);
+		g_string_append_len(c->in, buf, len);
+	}
+	line = g_strndup(c->in->str, nl - c->in->str);
+	g_string_erase(c->in, 0, nl - c->in->str + 1);
+	return line;
+}
+
+/* reads one response, checks it's for the request it should be, and handles it */
+static void client_response(client_t *c) {
+	nntp_request_t *req;
+	char **lines = NULL;
+	int code, i;
+
+	for (;;) {
+		char *line = client_read_line(c);
+		nntp_response_state_t res = nntp_reader_line(&c->reader, line);
+
+		g_assert_cmpint(res, !=, NNTP_RESPONSE_INVALID);
+		g_free(line);
+		if (res == NNTP_RESPONSE_DONE)
+			break;
+	}
+
+	req = nntp_pipeline_current(&c->pipeline);
+	g_assert(req);
+	code = c->reader.code;
+
+	if (nntp_code_is_multi(code))
+		lines = g_strsplit(c->reader.buf->str, "\n", -1);
+
+	switch (req->type) {
+		case NNTP_REQ_GREETING:
+			g_assert_cmpint(code, ==, 200);
+			break;
+		case NNTP_REQ_COMMAND:
+			g_assert(code == 381 || code == 281 || code == 205);
+			break;
+		case NNTP_REQ_GROUP:
+			g_assert_cmpint(code, ==, 211);
+			g_assert_cmpint(sscanf(c->reader.buf->str, "%*d %d %d", &c->fart, &c->lart), ==, 2);
+			break;
+		case NNTP_REQ_OVERVIEW:
+			if (code == 420)
+				break;
+			g_assert_cmpint(code, ==, 224);
+			for (i = 1; lines[i] && *lines[i]; i++) {
+				nntp_article_t *a = nntp_overview_add(&c->articles, lines[i]);
+
+				g_assert(a);
+				g_assert_cmpint(a->artid, >=, req->first);
+				g_assert_cmpint(a->artid, <=, req->last);
+			}
+			break;
+		case NNTP_REQ_ARTICLE:
+		{
+			nntp_article_t *a;
+			char *msgid = g_strdup_printf("<%d@fake>", req->first);
+
+			g_assert(code == 221 || code == 222);
+			g_assert_cmpint(atoi(lines[0]), ==, req->first);
+
+			a = nntp_article_get(&c->articles, req->first, strchr(lines[0], ' ') + 1);
+			g_assert_cmpstr(a->msgid, ==, msgid);
+			g_assert(nntp_article_by_msgid(&c->articles, msgid) == a);
+
+			if (code == 221) {
+				g_string_assign(a->header, strchr(c->reader.buf->str, '\n') + 1);
+				g_assert(g_str_has_prefix(a->header->str, "Subject: Subject "));
+			} else {
+				g_string_assign(a->body, strchr(c->reader.buf->str, '\n') + 1);
+				g_assert(g_str_has_suffix(a->body->str, "\n\n.starts with dot\n"));
+			}
+			g_free(msgid);
+			break;
+		}
+	}
+
+	g_strfreev(lines);
+	nntp_pipeline_done(&c->pipeline);
+	nntp_pipeline_send(&c->pipeline, client_write, c);
+}
+
+static void client_send(client_t *c, nntp_request_type_t type, int first, int last, char *line) {
+	nntp_pipeline_add(&c->pipeline, type, first, last, line);
+	nntp_pipeline_send(&c->pipeline, client_write, c);
+}
+
+static void client_wait(client_t *c) {
+	while (nntp_pipeline_busy(&c->pipeline))
+		client_response(c);
+}
+
+static void client_connect(client_t *c, int articles) {
+	FILE *log;
+	int fds[2];
+	int fd;
+
+	fd = g_file_open_tmp("ekg2-nntp-log-XXXXXX", &c->log, NULL);
+	g_assert(fd != -1);
+	close(fd);
+
+	g_assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+	c->server = fork();
+	g_assert(c->server != -1);
+
+	if (!c->server) {
+		close(fds[0]);
+		if (!(log = fopen(c->log, "w")))
+			_exit(2);
+		fake_server(fds[1], articles, log);
+	}
+	close(fds[1]);
+
+	c->fd = fds[0];
+	c->in = g_string_new(NULL);
+	nntp_pipeline_init(&c->pipeline, WINDOW);
+	nntp_reader_init(&c->reader);
+
+	client_send(c, NNTP_REQ_GREETING, 0, 0, NULL);
+}
+
+/* quits, and returns what server got */
+static char *client_disconnect(client_t *c) {
+	char *log;
+	int status;
+
+	client_send(c, NNTP_REQ_COMMAND, 0, 0, g_strdup("QUIT"));
+	client_wait(c);
+
+	g_assert(waitpid(c->server, &status, 0) == c->server);
+	g_assert(WIFEXITED(status) && !WEXITSTATUS(status));
+	close(c->fd);
+
+	g_assert(g_file_get_contents(c->log, &log, NULL, NULL));
+	unlink(c->log);
+	g_free(c->log);
+
+	g_string_free(c->in, TRUE);
+	nntp_pipeline_free(&c->pipeline);
+	nntp_reader_free(&c->reader);
+	return log;
+}
+
+/* like nntp_command_check(): GROUP, and then overview and headers above high-water mark */
+static void client_check(client_t *c, const char *group) {
+	int i, from;
+
+	client_send(c, NNTP_REQ_GROUP, 0, 0, g_strdup_printf("GROUP %s", group));
+	client_wait(c);
+
+	from = MAX(c->articles.hwm, c->fart - 1) + 1;
+	for (i = from; i <= c->lart; i += 20)
+		client_send(c, NNTP_REQ_OVERVIEW, i, MIN(i + 19, c->lart), g_strdup_printf("XOVER %d-%d", i, MIN(i + 19, c->lart)));
+	for (i = from; i <= c->lart; i++)
+		client_send(c, NNTP_REQ_ARTICLE, i, i, g_strdup_printf("HEAD %d", i));
+	client_wait(c);
+
+	c->articles.hwm = c->lart;
+}
+
+/* commands server got, and the largest batch of them */
+static char **log_commands(const char *log, guint *max_batch) {
+	char **lines = g_strsplit(log, "\n", -1);
+	GPtrArray *cmds = g_ptr_array_new();
+	int i;
+
+	*max_batch = 0;
+	for (i = 0; lines[i] && *lines[i]; i++) {
+		if (!strncmp(lines[i], "batch ", 6))
+			*max_batch = MAX(*max_batch, (guint) atoi(lines[i] + 6));
+		else
+			g_ptr_array_add(cmds, g_strdup(lines[i]));
+	}
+	g_ptr_array_add(cmds, NULL);
+	g_strfreev(lines);
+	return (char **) g_ptr_array_free(cmds, FALSE);
+}
+
+static void check_nntp_reader(void) {
+	nntp_reader_t r;
+
+	nntp_reader_init(&r);
+
+	g_assert_cmpint(nntp_reader_line(&r, "211 3 1 3 pl.test\r"), ==, NNTP_RESPONSE_DONE);
+	g_assert_cmpint(r.code, ==, 211);
+	g_assert_cmpstr(r.buf->str, ==, "3 1 3 pl.test");
+
+	g_assert_cmpint(nntp_reader_line(&r, "222 1 <1@fake>\r"), ==, NNTP_RESPONSE_PARTIAL);
+	g_assert_cmpint(nntp_reader_line(&r, "text\r"), ==, NNTP_RESPONSE_PARTIAL);
+	g_assert_cmpint(nntp_reader_line(&r, "\r"), ==, NNTP_RESPONSE_PARTIAL);
+	g_assert_cmpint(nntp_reader_line(&r, "..\r"), ==, NNTP_RESPONSE_PARTIAL);
+	g_assert_cmpint(nntp_reader_line(&r, "...dots"), ==, NNTP_RESPONSE_PARTIAL);
+	g_assert_cmpint(nntp_reader_line(&r, "211 not a status here"), ==, NNTP_RESPONSE_PARTIAL);
+	g_assert_cmpint(nntp_reader_line(&r, ".\r"), ==, NNTP_RESPONSE_DONE);
+	g_assert_cmpint(r.code, ==, 222);
+	g_assert_cmpstr(r.buf->str, ==, "1 <1@fake>\ntext\n\n.\n..dots\n211 not a status here\n");
+
+	g_assert_cmpint(nntp_reader_line(&r, "hello"), ==, NNTP_RESPONSE_INVALID);
+	g_assert_cmpint(nntp_reader_line(&r, "2000 too long"), ==, NNTP_RESPONSE_INVALID);
+	g_assert_cmpint(nntp_reader_line(&r, "205"), ==, NNTP_RESPONSE_DONE);
+	g_assert_cmpint(r.code, ==, 205);
+	g_assert_cmpstr(r.buf->str, ==, "");
+
+	nntp_reader_free(&r);
+}
+
+static void record_write(const char *line, void *data) {
+	g_ptr_array_add(data, g_strdup(line));
+}
+
+static void check_nntp_pipeline(void) {
+	GPtrArray *sent = g_ptr_array_new();
+	nntp_pipeline_t p;
+	int i;
+
+	nntp_pipeline_init(&p, 4);
+
+	/* nothing is sent before greeting */
+	nntp_pipeline_add(&p, NNTP_REQ_GREETING, 0, 0, NULL);
+	nntp_pipeline_send(&p, record_write, sent);
+	for (i = 1; i <= 6; i++)
+		nntp_pipeline_add(&p, NNTP_REQ_ARTICLE, i, i, g_strdup_printf("HEAD %d", i));
+	nntp_pipeline_send(&p, record_write, sent);
+	g_assert_cmpint(sent->len, ==, 0);
+
+	/* AUTHINFO goes first, alone */
+	nntp_pipeline_add(&p, NNTP_REQ_COMMAND, 0, 0, g_strdup("AUTHINFO USER ekg"));
+	nntp_pipeline_done(&p);
+	nntp_pipeline_send(&p, record_write, sent);
+	g_assert_cmpint(sent->len, ==, 1);
+	g_assert_cmpstr(sent->pdata[0], ==, "AUTHINFO USER ekg");
+	g_assert_cmpint(nntp_pipeline_current(&p)->type, ==, NNTP_REQ_COMMAND);
+
+	/* and so does the next step, before HEADs */
+	nntp_pipeline_add(&p, NNTP_REQ_COMMAND, 0, 0, g_strdup("AUTHINFO PASS ekg"));
+	nntp_pipeline_done(&p);
+	nntp_pipeline_send(&p, record_write, sent);
+	g_assert_cmpint(sent->len, ==, 2);
+	g_assert_cmpstr(sent->pdata[1], ==, "AUTHINFO PASS ekg");
+
+	/* then window of HEADs */
+	nntp_pipeline_done(&p);
+	nntp_pipeline_send(&p, record_write, sent);
+	g_assert_cmpint(sent->len, ==, 6);
+	g_assert_cmpstr(sent->pdata[5], ==, "HEAD 4");
+	g_assert_cmpint(nntp_pipeline_current(&p)->first, ==, 1);
+
+	nntp_pipeline_done(&p);
+	nntp_pipeline_send(&p, record_write, sent);
+	g_assert_cmpint(sent->len, ==, 7);
+	g_assert_cmpint(nntp_pipeline_current(&p)->first, ==, 2);
+	g_assert_cmpint(nntp_pipeline_busy(&p), ==, 5);
+
+	nntp_pipeline_clear(&p);
+	g_assert(!nntp_pipeline_current(&p));
+	g_assert_cmpint(nntp_pipeline_busy(&p), ==, 0);
+
+	nntp_pipeline_free(&p);
+	for (i = 0; i < (int) sent->len; i++)
+		g_free(sent->pdata[i]);
+	g_ptr_array_free(sent, TRUE);
+}
+
+static void check_nntp_session(void) {
+	client_t c = { 0 };
+	char *cache, *log, **cmds;
+	guint max_batch;
+	int fd, i;
+
+	fd = g_file_open_tmp("ekg2-nntp-overview-XXXXXX", &cache, NULL);
+	g_assert(fd != -1);
+	close(fd);
+
+	/* the first time: nothing in cache, everything is fetched */
+	nntp_articles_init(&c.articles);
+	g_assert_cmpint(nntp_overview_load(&c.articles, cache), ==, 0);
+
+	client_connect(&c, 50);
+	client_send(&c, NNTP_REQ_COMMAND, 0, 0, g_strdup("AUTHINFO USER ekg"));
+	client_wait(&c);
+	client_send(&c, NNTP_REQ_COMMAND, 0, 0, g_strdup("AUTHINFO PASS ekg"));
+	client_check(&c, "pl.test");
+	client_send(&c, NNTP_REQ_ARTICLE, 7, 7, g_strdup("BODY 7"));
+	client_wait(&c);
+	log = client_disconnect(&c);
+
+	cmds = log_commands(log, &max_batch);
+	g_assert_cmpint(max_batch, ==, WINDOW);
+	g_assert_cmpstr(cmds[0], ==, "AUTHINFO USER ekg");
+	g_assert_cmpstr(cmds[1], ==, "AUTHINFO PASS ekg");
+	g_assert_cmpstr(cmds[2], ==, "GROUP pl.test");
+	g_assert_cmpstr(cmds[3], ==, "XOVER 1-20");
+	g_assert_cmpstr(cmds[5], ==, "XOVER 41-50");
+	g_assert_cmpstr(cmds[6], ==, "HEAD 1");
+	g_assert_cmpstr(cmds[55], ==, "HEAD 50");
+	g_assert_cmpstr(cmds[56], ==, "BODY 7");
+	g_assert_cmpstr(cmds[57], ==, "QUIT");
+	g_strfreev(cmds);
+	g_free(log);
+
+	g_assert_cmpint(g_hash_table_size(c.articles.by_artid), ==, 50);
+	g_assert_cmpint(g_hash_table_size(c.articles.by_msgid), ==, 50);
+	for (i = 1; i <= 50; i++) {
+		char *msgid = g_strdup_printf("<%d@fake>", i);
+		nntp_article_t *a = nntp_article_by_msgid(&c.articles, msgid);
+
+		g_assert(a && a->artid == i && a->new && a->over);
+		g_assert(a == nntp_article_get(&c.articles, i, NULL));
+		g_free(msgid);
+	}
+	g_assert_cmpstr(nntp_article_get(&c.articles, 7, NULL)->body->str, ==, "body of 7\n\n.starts with dot\n");
+
+	g_assert_cmpint(nntp_overview_save(&c.articles, cache, 40), ==, 0);
+	nntp_articles_free(&c.articles);
+
+	/* reconnect, 10 new articles: only they are fetched */
+	nntp_articles_init(&c.articles);
+	g_assert_cmpint(nntp_overview_load(&c.articles, cache), ==, 50);
+	g_assert_cmpint(g_hash_table_size(c.articles.by_artid), ==, 40);	/* the newest 40 */
+	g_assert(!nntp_article_by_msgid(&c.articles, "<10@fake>"));
+	g_assert(!nntp_article_by_msgid(&c.articles, "<11@fake>")->new);
+
+	client_connect(&c, 60);
+	client_check(&c, "pl.test");
+	log = client_disconnect(&c);
+
+	cmds = log_commands(log, &max_batch);
+	g_assert_cmpstr(cmds[0], ==, "GROUP pl.test");
+	g_assert_cmpstr(cmds[1], ==, "XOVER 51-60");
+	g_assert_cmpstr(cmds[2], ==, "HEAD 51");
+	g_assert_cmpstr(cmds[11], ==, "HEAD 60");
+	g_assert_cmpstr(cmds[12], ==, "QUIT");
+	g_assert(!cmds[13]);
+	g_strfreev(cmds);
+	g_free(log);
+
+	g_assert_cmpint(g_hash_table_size(c.articles.by_artid), ==, 50);
+	g_assert(nntp_article_by_msgid(&c.articles, "<60@fake>")->new);
+	g_assert_cmpint(c.articles.hwm, ==, 60);
+
+	/* nothing new */
+	g_assert_cmpint(nntp_overview_save(&c.articles, cache, 1000), ==, 0);
+	nntp_articles_free(&c.articles);
+	nntp_articles_init(&c.articles);
+	g_assert_cmpint(nntp_overview_load(&c.articles, cache), ==, 60);
+
+	client_connect(&c, 60);
+	client_check(&c, "pl.test");
+	log = client_disconnect(&c);
+
+	cmds = log_commands(log, &max_batch);
+	g_assert_cmpstr(cmds[0], ==, "GROUP pl.test");
+	g_assert_cmpstr(cmds[1], ==, "QUIT");
+	g_strfreev(cmds);
+	g_free(log);
+
+	nntp_articles_free(&c.articles);
+	unlink(cache);
+	g_free(cache);
+}
+
+void add_nntp_tests(void) {
+	g_test_add_func("/nntp/response reader", check_nntp_reader);
+	g_test_add_func("/nntp/pipeline", check_nntp_pipeline);
+	g_test_add_func("/nntp/fake server, overview cache", check_nntp_session);
+}
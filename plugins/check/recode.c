@@ -49,7 +49,59 @@ static void check_recode_charp(void) {
 	g_free(iso);
 }
 
+static void check_recode_same(void) {
+	gchar *res;
+	GString *s;
+
+	/* same charset, different spelling: no conversion, but invalid utf8 is fixed */
+	ekg_recode_utf8_inc();
+	res = ekg_convert_string("za\xc5\xbc\xc3\xb3\xc5\x82\xc4\x87", "utf-8", "UTF8");
+	g_assert_cmpstr(res, ==, "za\xc5\xbc\xc3\xb3\xc5\x82\xc4\x87");
+	g_free(res);
+
+	res = ekg_recode_from("UTF-8", input_iso);
+	g_assert(g_utf8_validate(res, -1, NULL));
+	g_free(res);
+	ekg_recode_utf8_dec();
+
+	res = ekg_convert_string(input_iso, "iso-8859-2", "ISO_8859-2");
+	g_assert_cmpstr(res, ==, input_iso);
+	g_free(res);
+
+	/* ascii is the same in both, string is left as it is */
+	s = g_string_new("Litwo! Ojczyzno moja!");
+	g_assert(ekg_recode_gstring_to("iso-8859-2", s));
+	g_assert_cmpstr(s->str, ==, "Litwo! Ojczyzno moja!");
+	g_string_free(s, TRUE);
+}
+
+static void check_recode_fallback(void) {
+	gchar *res;
+	void *conv, *rev;
+
+	/* euro sign isn't in iso-8859-2, but the rest is converted */
+	conv = ekg_convert_string_init(NULL, "iso-8859-2", &rev);
+	res = ekg_convert_string_p("\xc5\xbc \xe2\x82\xac", conv);
+	g_assert(res[0] == '\xbf' && res[1] == ' ');
+	g_assert(strlen(res) > 2);
+	g_free(res);
+
+	/* and converter is still good after that */
+	res = ekg_convert_string_p("\xc5\xbc", conv);
+	g_assert_cmpstr(res, ==, "\xbf");
+	g_free(res);
+
+	res = ekg_convert_string_p("\xbf", rev);
+	g_assert_cmpstr(res, ==, "\xc5\xbc");
+	g_free(res);
+
+	ekg_convert_string_destroy(conv);
+	ekg_convert_string_destroy(rev);
+}
+
 void add_recode_tests(void) {
 	g_test_add_func("/recode/ekg_fix_utf8()", check_fix_utf8);
 	g_test_add_func("/recode/ekg_recode_from() & ekg_recode_to()", check_recode_charp);
+	g_test_add_func("/recode/same charset and ascii", check_recode_same);
+	g_test_add_func("/recode/unconvertible characters", check_recode_fallback);
 }
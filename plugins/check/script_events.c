@@ -0,0 +1,164 @@
+#include "ekg2.h"
+
+#include <string.h>
+
+#include "ekg/script_events.inc"
+
+/* runs observer event batches of scripts.c against mocked clock: every
+ * delivered event moves the clock by its cost, like a handler taking that
+ * long would. */
+
+#define BUDGET		20000	/* script_time_budget, in microseconds */
+
+typedef struct {
+	guint script;
+	guint seq;
+	gint64 cost;
+} test_event_t;
+
+typedef struct {
+	guint queued;
+	guint delivered;	/* events delivered, in order of seq */
+	guint batch_done;	/* batch in which the last event got delivered */
+} test_script_t;
+
+static gint64 clock_now;
+static guint batch;
+static test_script_t scripts[3];
+
+static gint64 mock_now(void) {
+	return clock_now;
+}
+
+static void mock_deliver(gpointer data, gpointer user_data) {
+	test_event_t *ev = data;
+	test_script_t *scr = &scripts[ev->script];
+
+	g_assert_cmpuint(ev->seq, ==, scr->delivered);
+	scr->delivered++;
+	scr->batch_done = batch;
+	clock_now += ev->cost;
+	g_free(ev);
+}
+
+static void queue_events(script_events_t *se, guint script, guint count, gint64 cost) {
+	guint i;
+
+	for (i = 0; i < count; i++) {
+		test_event_t *ev = g_new(test_event_t, 1);
+
+		ev->script = script;
+		ev->seq = scripts[script].queued++;
+		ev->cost = cost;
+		script_events_push(se, &scripts[script], ev);
+	}
+}
+
+/* script 0 takes 3 budgets for every event, 1 and 2 are fast. slow one
+ * gets its event, and then waits, while fast ones get all of theirs. */
+static void check_script_events_slow_observer(void) {
+	script_events_t se;
+	gint64 start;
+	guint i;
+
+	memset(scripts, 0, sizeof(scripts));
+	clock_now = 1000000;
+	batch = 0;
+	script_events_init(&se);
+
+	for (i = 0; i < 10; i++) {
+		queue_events(&se, 0, 1, 3 * BUDGET);
+		queue_events(&se, 1, 10, 500);
+		queue_events(&se, 2, 10, 500);
+	}
+
+	do {
+		guint slow = scripts[0].delivered;
+
+		batch++;
+		start = clock_now;
+		if (!script_events_run(&se, BUDGET, mock_now, mock_deliver, NULL))
+			break;
+
+		/* batch without slow script keeps to budget (+ the last event) */
+		if (scripts[0].delivered == slow)
+			g_assert_cmpint(clock_now - start, <=, BUDGET + 500);
+	} while (batch < 1000);
+
+	g_assert_cmpuint(scripts[0].delivered, ==, 10);
+	g_assert_cmpuint(scripts[1].delivered, ==, 100);
+	g_assert_cmpuint(scripts[2].delivered, ==, 100);
+
+	/* fast ones are done (first event of slow one took a batch, and then
+	 * 100 events * 500 us in halves of budget), before second event of slow one */
+	g_assert_cmpuint(scripts[1].batch_done, <=, 6);
+	g_assert_cmpuint(scripts[2].batch_done, <=, 6);
+	g_assert_cmpuint(scripts[0].batch_done, >, scripts[1].batch_done);
+
+	/* slow one still owes for its last event */
+	g_assert_cmpuint(g_hash_table_size(se.owners), ==, 1);
+	script_events_forget(&se, &scripts[0], g_free);
+	g_hash_table_destroy(se.owners);
+}
+
+/* only fast scripts: share of budget each, and whole queue at no budget */
+static void check_script_events_share(void) {
+	script_events_t se;
+	gint64 start;
+
+	memset(scripts, 0, sizeof(scripts));
+	clock_now = 1000000;
+	batch = 0;
+	script_events_init(&se);
+
+	queue_events(&se, 1, 100, 1000);
+	queue_events(&se, 2, 100, 1000);
+
+	/* 2 scripts, 10 ms each */
+	batch++;
+	start = clock_now;
+	g_assert(script_events_run(&se, BUDGET, mock_now, mock_deliver, NULL));
+	g_assert_cmpint(clock_now - start, ==, BUDGET);
+	g_assert_cmpuint(scripts[1].delivered, ==, 10);
+	g_assert_cmpuint(scripts[2].delivered, ==, 10);
+
+	/* script_time_budget 0: everything */
+	batch++;
+	g_assert(!script_events_run(&se, 0, mock_now, mock_deliver, NULL));
+	g_assert_cmpuint(scripts[1].delivered, ==, 100);
+	g_assert_cmpuint(scripts[2].delivered, ==, 100);
+
+	/* nobody owes anything, nothing left */
+	g_assert_cmpuint(g_hash_table_size(se.owners), ==, 0);
+	g_hash_table_destroy(se.owners);
+}
+
+/* script unloaded: its events and debt are gone, others are kept */
+static void check_script_events_forget(void) {
+	script_events_t se;
+
+	memset(scripts, 0, sizeof(scripts));
+	clock_now = 1000000;
+	batch = 1;
+	script_events_init(&se);
+
+	queue_events(&se, 0, 5, 3 * BUDGET);
+	queue_events(&se, 1, 5, 100);
+
+	g_assert(script_events_run(&se, BUDGET, mock_now, mock_deliver, NULL));
+	script_events_forget(&se, &scripts[0], g_free);
+
+	while (script_events_run(&se, BUDGET, mock_now, mock_deliver, NULL))
+		;
+
+	g_assert_cmpuint(scripts[0].delivered, <=, 1);
+	g_assert_cmpuint(scripts[1].delivered, ==, 5);
+	g_assert_cmpuint(g_hash_table_size(se.owners), ==, 0);
+	g_hash_table_destroy(se.owners);
+}
+
+void add_script_events_tests(void) {
+	g_test_add_func("/script_events/slow observer defers only itself", check_script_events_slow_observer);
+	g_test_add_func("/script_events/batch budget is shared", check_script_events_share);
+	g_test_add_func("/script_events/forget unloaded script", check_script_events_forget);
+}
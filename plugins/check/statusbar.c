@@ -0,0 +1,183 @@
+#include "ekg2.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "plugins/ncurses/statusbar_fields.inc"
+
+/* drives tracked statusbar fields the way statusbar.c does on every tick
+ * of ncurses:clock: fields are set from (fake) session, window activity
+ * and time, and statusbar is drawn (here: formats are expanded to bytes)
+ * only when something has changed. when nothing happens it shouldn't be
+ * drawn, no matter how many ticks, time should cause one redraw every
+ * minute (every second only if it's shown), and change of field which
+ * isn't shown is drawn, but not sent to terminal. */
+
+enum { F_TIME = 0, F_AWAY, F_AVAIL, F_ACTIVITY, F_TYPING, F_COUNT };
+
+static statusbar_field_t fields[F_COUNT] = {
+	{ "time", 1 },
+	{ "away", 0 },
+	{ "avail", 0 },
+	{ "activity", 1 },
+	{ "typing", 0 },
+};
+
+static statusbar_line_t line;
+static statusbar_clock_t clock_;
+
+/* what statusbar.c takes from session, windows, theme */
+static time_t now;
+static int away;
+static const char *activity;
+static int typing;
+static const char *timestamp_format;
+static const char *statusbar_format;
+
+static guint renders;			/* draw() calls */
+
+static void update(void) {
+	if (statusbar_clock_due(&clock_, timestamp_format, now)) {
+		char buf[100];
+
+		strftime(buf, sizeof(buf), timestamp_format, gmtime(&now));
+		statusbar_field_set(&fields[F_TIME], 1, buf);
+	}
+
+	statusbar_field_set(&fields[F_AWAY], away, "");
+	statusbar_field_set(&fields[F_AVAIL], !away, "");
+	statusbar_field_set(&fields[F_ACTIVITY], 1, activity);
+	statusbar_field_set(&fields[F_TYPING], 1, typing ? "" : NULL);
+	statusbar_line_format(&line, statusbar_format);
+}
+
+/* %{name} and %{?name text}, enough for this test */
+static int draw(void) {
+	GByteArray *drawn = g_byte_array_new();
+	const char *p;
+	int changed, i;
+
+	renders++;
+
+	for (p = line.text; *p; p++) {
+		int cond = 0;
+		gsize len;
+
+		if (p[0] != '%' || p[1] != '{') {
+			g_byte_array_append(drawn, (guint8 *) p, 1);
+			continue;
+		}
+		p += 2;
+		if (*p == '?') {
+			cond = 1;
+			p++;
+		}
+		len = strcspn(p, cond ? " " : "}");
+
+		for (i = 0; i < F_COUNT; i++) {
+			if (strlen(fields[i].name) != len || strncmp(fields[i].name, p, len) || !fields[i].set)
+				continue;
+			if (!cond && fields[i].text)
+				g_byte_array_append(drawn, (guint8 *) fields[i].text, strlen(fields[i].text));
+			if (cond && fields[i].text) {
+				const char *end = strchr(p + len + 1, '}');
+
+				g_byte_array_append(drawn, (guint8 *) p + len + 1, end - (p + len + 1));
+			}
+		}
+		p = strchr(p, '}');
+	}
+
+	changed = statusbar_line_drawn(&line, drawn);
+	g_byte_array_free(drawn, TRUE);
+	return changed;
+}
+
+/* refreshes statusbar, checks if it was drawn, and sent to terminal */
+static void refresh_once(guint drew, int committed) {
+	guint r = renders;
+
+	g_assert_cmpint(statusbar_refresh_with(update, draw, 0), ==, committed);
+	g_assert_cmpuint(renders - r, ==, drew);
+}
+
+static void check_statusbar_clock_interval(void) {
+	g_assert_cmpint(statusbar_clock_interval("%H:%M"), ==, 60);
+	g_assert_cmpint(statusbar_clock_interval("%-H:%M %d.%m.%Y"), ==, 60);
+	g_assert_cmpint(statusbar_clock_interval("%R %%S"), ==, 60);
+	g_assert_cmpint(statusbar_clock_interval("%H:%M:%S"), ==, 1);
+	g_assert_cmpint(statusbar_clock_interval("%T"), ==, 1);
+	g_assert_cmpint(statusbar_clock_interval("%OS"), ==, 1);
+	g_assert_cmpint(statusbar_clock_interval("%c"), ==, 1);
+	g_assert_cmpint(statusbar_clock_interval("%02M"), ==, 60);
+}
+
+static void check_statusbar_refresh(void) {
+	char *activity_copy, *format_copy;
+	guint i;
+
+	now = 1300000000 - 1300000000 % 60;	/* full minute */
+	activity = NULL;
+	timestamp_format = "%H:%M";
+	statusbar_format = " [%{time}] %{?away (away)}%{?avail (avail)} %{?activity [act: %{activity}]}";
+
+	refresh_once(1, 1);
+	refresh_once(0, 0);
+
+	/* idle: statusbar changes only when minute does, ticks of ncurses:clock */
+	for (i = 0; i < 100000; i++) {
+		int minute = ((now + 1) % 60 == 0);
+
+		now++;
+		refresh_once(minute, minute);
+	}
+
+	/* seconds shown: every tick */
+	timestamp_format = "%H:%M:%S";
+	refresh_once(1, 1);
+	for (i = 0; i < 100; i++) {
+		now++;
+		refresh_once(1, 1);
+	}
+	timestamp_format = "%H:%M";
+	refresh_once(1, 1);
+
+	/* fields */
+	away = 1;
+	refresh_once(1, 1);
+	refresh_once(0, 0);
+	activity = "2,3";
+	refresh_once(1, 1);
+	activity = activity_copy = g_strdup("2,3");	/* the same text, other pointer */
+	refresh_once(0, 0);
+	typing = 1;
+	refresh_once(1, 0);				/* not shown */
+	statusbar_format = " [%{time}] %{?typing (typing)} %{activity}";
+	refresh_once(1, 1);
+	statusbar_format = format_copy = g_strdup(statusbar_format);
+	refresh_once(0, 0);
+
+	/* when fields are forgotten, they're made again */
+	statusbar_fields_clear(fields, F_COUNT);
+	statusbar_clock_clear(&clock_);
+	refresh_once(1, 0);
+
+	/* and idle again */
+	for (i = 0; i < 1000; i++) {
+		int minute = ((now + 1) % 60 == 0);
+
+		now++;
+		refresh_once(minute, minute);
+	}
+
+	statusbar_fields_clear(fields, F_COUNT);
+	statusbar_lines_clear(&line, 1);
+	statusbar_clock_clear(&clock_);
+	g_free(activity_copy);
+	g_free(format_copy);
+}
+
+void add_statusbar_tests(void) {
+	g_test_add_func("/statusbar/clock interval", check_statusbar_clock_interval);
+	g_test_add_func("/statusbar/drawn only when changed", check_statusbar_refresh);
+}
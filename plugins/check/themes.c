@@ -0,0 +1,168 @@
+#include "ekg2.h"
+
+#include <string.h>
+
+/* print_window() builds lines from compiled formats (format_compile() in
+ * themes.c). they have to be the same as from the old path: format expanded
+ * by format_string(), split into lines, prompt (text before %|) repeated on
+ * next lines, and every line parsed by fstring_new(). */
+
+extern plugin_t check_plugin;
+
+static const char *themes_args[][9] = {
+	{ NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
+	{ "a", "ala", "kot", "1", "22", "333", "4444", "55555", "666666" },
+	{ "żółć", "gęślą jaźń", "źdźbło dłuższe niż dopełnienie", "ą", "ę", "ó", "ł", "ń", "ść" },
+	{ "bardzo długi argument, dłuższy niż jakiekolwiek dopełnienie", "linia 1\nlinia 2\r\nlinia 3", "100% \033[01;31mczerwony\033[0m",
+		"\ttab", "x\ry", "b", "/|", "%|", " " },
+};
+
+/* formats using %[-N] padding and %| prompt in ways default theme may not */
+static const char *themes_extra[][2] = {
+	{ "check_themes_padding",	"%[10]1|%[-10]2|%[^11]3|%(6)4|%[.4]5|%[,-7]6|%[_8]7|%[3]8|%(-3)9" },
+	{ "check_themes_cut",		"%g%[-5]1%n %c%[5]2%n %[^4]3 %[-2]9%[2]8" },
+	{ "check_themes_prompt",	"%> %1%|%2\n%3 %|%4\n%5\n%|%6" },
+	{ "check_themes_margin",	"%T%1%n/|%2\n%3 //| %4" },
+	{ "check_themes_cond",		"%{1abGY}X %@2 %{7bxRB}X%3%7%n" },
+	{ "check_themes_empty",		"" },
+	{ "check_themes_newlines",	"%1\n\n%2\n" },
+};
+
+static GPtrArray *themes_printed;	/* what print_window() gave to window_print() */
+
+static QUERY(check_themes_print) {
+	window_t *w	= *(va_arg(ap, window_t **));
+	fstring_t *line	= *(va_arg(ap, fstring_t **));
+
+	if (themes_printed && w == window_status)
+		g_ptr_array_add(themes_printed, fstring_dup(line));
+	return 0;
+}
+
+static void themes_lines_free(GPtrArray *lines) {
+	g_ptr_array_foreach(lines, (GFunc) fstring_free, NULL);
+	g_ptr_array_free(lines, TRUE);
+}
+
+/* old print_window_c() */
+static GPtrArray *themes_print_old(const char *value, const char **a) {
+	GPtrArray *lines = g_ptr_array_new();
+	gchar *format = g_strdup(value);	/* %{..} is patched in place */
+	char *str = format_string(format, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]);
+	char *tmp = str, *line, *prompt = NULL;
+
+	while ((line = split_line(&tmp))) {
+		char *p;
+
+		if ((p = xstrstr(line, "\033[00m"))) {
+			xfree(prompt);
+			prompt = (p != line) ? xstrndup(line, (int) (p - line)) : NULL;
+			line = p;
+		}
+
+		if (prompt) {
+			gchar *full = g_strdup_printf("%s%s", prompt, line);
+
+			g_ptr_array_add(lines, fstring_new(full));
+			g_free(full);
+		} else
+			g_ptr_array_add(lines, fstring_new(line));
+	}
+
+	xfree(prompt);
+	xfree(str);
+	g_free(format);
+	return lines;
+}
+
+static GPtrArray *themes_print_new(const char *name, const char **a) {
+	GPtrArray *lines = g_ptr_array_new();
+
+	themes_printed = lines;
+	print_window_w(window_status, EKG_WINACT_NONE, name, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]);
+	themes_printed = NULL;
+	return lines;
+}
+
+static gboolean themes_lines_same(GPtrArray *old, GPtrArray *new) {
+	guint i;
+
+	if (old->len != new->len)
+		return FALSE;
+
+	for (i = 0; i < old->len; i++) {
+		const fstring_t *o = g_ptr_array_index(old, i);
+		const fstring_t *n = g_ptr_array_index(new, i);
+		gsize len = strlen(o->str);
+
+		if (strcmp(o->str, n->str) || memcmp(o->attr, n->attr, len * sizeof(fstr_attr_t)))
+			return FALSE;
+		if (o->prompt_len != n->prompt_len || o->prompt_empty != n->prompt_empty || o->margin_left != n->margin_left)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * old path crashed on NULL given to padded argument or %{N..}, and with
+ * g_string_append(NULL) elsewhere it appended nothing, so it gets "" where
+ * compiled one gets NULL. %@N looks at the byte before "" (NULL is "y" too),
+ * so there is a space.
+ */
+static const char themes_empty[] = " ";
+
+static void themes_compare(const char *name, const char *value) {
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(themes_args); i++) {
+		const char *a[9], *old_a[9];
+		GPtrArray *old, *new;
+		gboolean same;
+		int retry, k;
+
+		memcpy(a, themes_args[i], sizeof(a));
+		for (k = 0; k < 9; k++)
+			old_a[k] = a[k] ? a[k] : themes_empty + 1;
+
+		/* %# may see another second */
+		for (retry = 0; retry < 2; retry++) {
+			old = themes_print_old(value, old_a);
+			new = themes_print_new(name, a);
+			same = themes_lines_same(old, new);
+
+			themes_lines_free(old);
+			themes_lines_free(new);
+
+			if (same || !strstr(value, "%#"))
+				break;
+		}
+
+		if (!same)
+			g_error("format %s (%s), arguments #%u, display_color %d: compiled output differs", name, value, i, config_display_color);
+	}
+}
+
+static int themes_compare_enum(const char *name, const char *value) {
+	if (xstrcmp(name, "no_prompt_cache"))
+		themes_compare(name, value);
+	return 1;
+}
+
+static void check_themes_compiled(void) {
+	const int color = config_display_color;
+	query_t *q = query_connect(&check_plugin, "ui-window-print", check_themes_print, NULL);
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(themes_extra); i++)
+		format_add(themes_extra[i][0], themes_extra[i][1], 1);
+
+	for (config_display_color = 0; config_display_color <= 1; config_display_color++)
+		theme_enumerate(themes_compare_enum);
+
+	config_display_color = color;
+	query_free(q);
+}
+
+void add_themes_tests(void) {
+	g_test_add_func("/themes/compiled formats print like format_string", check_themes_compiled);
+}
@@ -0,0 +1,196 @@
+#include "ekg2.h"
+
+#include <string.h>
+
+#include "ekg/timer_wheel.inc"
+
+/* runs timer wheel against mocked monotonic clock, the way sources.c does
+ * from its GSource: sleep until timer_wheel_next(), turn the wheel, pop
+ * what's due. main loop is sometimes late, and sometimes wakes up too early. */
+
+typedef struct {
+	timer_wheel_entry_t entry;
+	guint64 added;
+	guint64 nominal;	/* when it was asked for */
+	guint64 slack;
+	guint fired;
+	gboolean removed;
+	gboolean persist;
+} test_timer_t;
+
+static guint64 clock_now;		/* mocked monotonic clock, in ms */
+
+static guint64 random_delay(GRand *r) {
+	switch (g_rand_int_range(r, 0, 10)) {
+		case 0:	 return 0;
+		case 1:  return g_rand_int_range(r, 0, 64);
+		case 2:
+		case 3:	 return g_rand_int_range(r, 0, 5000);
+		case 4:
+		case 5:	 return 1000 * g_rand_int_range(r, 1, 300);		/* keepalives */
+		case 6:	 return g_rand_int_range(r, 0, 3600000);
+		case 7:	 return (guint64) g_rand_int_range(r, 0, 86400) * 1000 * 31;
+		case 8:	 return TIMER_WHEEL_RANGE - 2 + g_rand_int_range(r, 0, 4);
+		default: return TIMER_WHEEL_RANGE + (guint64) g_rand_int(r) * 1000;
+	}
+}
+
+static void timer_schedule(timer_wheel_t *w, test_timer_t *t, GRand *r) {
+	t->added = clock_now;
+	t->nominal = clock_now + random_delay(r);
+	t->slack = g_rand_boolean(r) ? g_rand_int_range(r, 0, 1000) : 0;
+	timer_wheel_add(w, &t->entry, timer_wheel_slack(t->nominal, t->slack));
+
+	/* tick given by timer_wheel_slack() is within slack */
+	g_assert_cmpuint(t->entry.expires, >=, t->nominal);
+	g_assert_cmpuint(t->entry.expires, <=, t->nominal + t->slack);
+}
+
+/* timers due from 0 ms up to years (past the range of wheel), some of them
+ * rescheduled when they fire, like persistent timers, and some removed
+ * (also while others are firing). every one has to fire exactly once,
+ * in order, not before its tick and not later than the first turn past it. */
+static void check_timer_wheel_random(void) {
+	const guint count = 20000;
+	GRand *r = g_rand_new_with_seed(2011);
+	timer_wheel_t *w = g_new(timer_wheel_t, 1);
+	test_timer_t *timers = g_new0(test_timer_t, count);
+	guint64 last_dispatch;
+	guint i, wakeups = 0, left = count;
+
+	clock_now = G_GUINT64_CONSTANT(1) << 40;	/* like g_get_monotonic_time() / 1000 */
+	timer_wheel_init(w, clock_now);
+	last_dispatch = clock_now - 1;
+
+	for (i = 0; i < count; i++) {
+		timer_wheel_entry_init(&timers[i].entry, &timers[i]);
+		timers[i].persist = !g_rand_int_range(r, 0, 8);
+		timer_schedule(w, &timers[i], r);
+	}
+
+	while (left) {
+		guint64 next = timer_wheel_next(w);
+		timer_wheel_entry_t *e;
+		guint64 prev = 0;
+
+		/* wheel can't be empty with timers left */
+		g_assert_cmpuint(next, !=, G_MAXUINT64);
+
+		/* poll() timeout: wake up then, or a bit later, or early for something else */
+		switch (g_rand_int_range(r, 0, 8)) {
+			case 0:	 clock_now += g_rand_int_range(r, 0, 2000); break;
+			case 1:  if (next > clock_now) clock_now += g_rand_int_range(r, 0, MIN(next - clock_now, G_MAXINT32)); break;
+			default: clock_now = MAX(clock_now, next);
+		}
+
+		/* nothing may be due before next (it's slow, check sometimes) */
+		for (i = 0; i < count && next > clock_now && !(wakeups % 16); i++) {
+			test_timer_t *t = &timers[i];
+
+			if (t->entry.slot != TIMER_WHEEL_NONE)
+				g_assert_cmpuint(MAX(t->entry.expires, t->added + 1), >=, next);
+		}
+
+		timer_wheel_advance(w, clock_now);
+		wakeups++;
+
+		while ((e = timer_wheel_pop(w))) {
+			test_timer_t *t = e->link.data;
+			/* ones added while previous ones were firing, with tick which
+			 * was already looked at, are due on the next turn */
+			guint64 due = MAX(e->expires, t->added + 1);
+
+			g_assert(!t->removed);
+			g_assert_cmpuint(e->expires, <=, clock_now);
+			g_assert_cmpuint(due, >, last_dispatch);
+			g_assert_cmpuint(due, >=, prev);
+			prev = due;
+			t->fired++;
+
+			/* persistent ones go on, others are done */
+			if (t->persist && t->fired < 3)
+				timer_schedule(w, t, r);
+			else
+				left--;
+
+			/* handler removes some other timer, maybe one which is due too */
+			if (!g_rand_int_range(r, 0, 16)) {
+				test_timer_t *o = &timers[g_rand_int_range(r, 0, count)];
+
+				if (o->entry.slot != TIMER_WHEEL_NONE) {
+					timer_wheel_remove(w, &o->entry);
+					o->removed = TRUE;
+					left--;
+				}
+			}
+		}
+		last_dispatch = clock_now;
+	}
+
+	for (i = 0; i < count; i++) {
+		test_timer_t *t = &timers[i];
+
+		if (t->removed)
+			g_assert_cmpint(t->entry.slot, ==, TIMER_WHEEL_NONE);
+		else
+			g_assert_cmpuint(t->fired, ==, (t->persist ? 3 : 1));
+	}
+
+	g_free(timers);
+	g_free(w);
+	g_rand_free(r);
+}
+
+/* many keepalives, one per session, started at random times */
+static guint timer_wheel_coalesce(guint count, guint64 slack) {
+	GRand *r = g_rand_new_with_seed(2011);
+	timer_wheel_t *w = g_new(timer_wheel_t, 1);
+	test_timer_t *timers = g_new0(test_timer_t, count);
+	guint64 end;
+	guint i, wakeups = 0;
+
+	clock_now = 1000000;
+	timer_wheel_init(w, clock_now);
+	end = clock_now + 600000;
+
+	for (i = 0; i < count; i++) {
+		timers[i].nominal = clock_now + g_rand_int_range(r, 0, 60000);
+		timer_wheel_entry_init(&timers[i].entry, &timers[i]);
+		timer_wheel_add(w, &timers[i].entry, timer_wheel_slack(timers[i].nominal, slack));
+	}
+
+	while ((clock_now = timer_wheel_next(w)) < end) {
+		timer_wheel_entry_t *e;
+		gboolean any = FALSE;
+
+		timer_wheel_advance(w, clock_now);
+		while ((e = timer_wheel_pop(w))) {
+			test_timer_t *t = e->link.data;
+
+			g_assert_cmpuint(clock_now, >=, t->nominal);
+			g_assert_cmpuint(clock_now, <=, t->nominal + slack);
+
+			t->nominal = clock_now + 60000;
+			timer_wheel_add(w, e, timer_wheel_slack(t->nominal, slack));
+			any = TRUE;
+		}
+		wakeups += any;
+	}
+
+	g_free(timers);
+	g_free(w);
+	g_rand_free(r);
+	return wakeups;
+}
+
+static void check_timer_wheel_slack(void) {
+	guint exact = timer_wheel_coalesce(500, 0);
+	guint slacked = timer_wheel_coalesce(500, 250);
+
+	g_assert_cmpuint(slacked, <, exact);
+}
+
+void add_timer_wheel_tests(void) {
+	g_test_add_func("/timer_wheel/random timers", check_timer_wheel_random);
+	g_test_add_func("/timer_wheel/slack coalesces wake-ups", check_timer_wheel_slack);
+}
@@ -748,7 +748,7 @@ static void gg_session_handler_disconnect(session_t *s) {
  *
  * obsuga zmiany stanu przez uytkownika.
  */
-static void gg_session_handler_status(session_t *s, uin_t uin, int status, const char *descr, guint32 ip, guint16 port, int protocol) {
+static void gg_session_handler_status(session_t *s, uin_t uin, int status, const char *descr, guint32 ip, guint16 port, int protocol, GArray *batch) {
 	char *__uid	= saprintf(("gg:%d"), uin);
 	char *__descr	= gg_to_core(s, xstrdup(descr));
 	int i, j, dlen, state = 0, m = 0;
@@ -799,12 +799,43 @@ static void gg_session_handler_status(session_t *s, uin_t uin, int status, const
 
 	}
 
+	if (batch) {
+		protocol_status_t st;
+
+		/* uid and descr are freed by gg_session_handler_status_flush() */
+		st.uid		= __uid;
+		st.status	= gg_status_to_text(status);
+		st.descr	= __descr;
+		st.when		= time(NULL);
+		g_array_append_val(batch, st);
+		return;
+	}
+
 	protocol_status_emit(s, __uid, gg_status_to_text(status), __descr, time(NULL));
 
 	xfree(__descr);
 	xfree(__uid);
 }
 
+/*
+ * gg_session_handler_status_flush()
+ *
+ * passes statuses from notify reply to core at once.
+ */
+static void gg_session_handler_status_flush(session_t *s, GArray *batch) {
+	guint i;
+
+	protocol_status_batch_emit(s, (protocol_status_t *) batch->data, batch->len);
+
+	for (i = 0; i < batch->len; i++) {
+		protocol_status_t *st = &g_array_index(batch, protocol_status_t, i);
+
+		xfree((char *) st->uid);
+		xfree((char *) st->descr);
+	}
+	g_array_free(batch, TRUE);
+}
+
 /*
  * gg_session_handler_msg()
  *
@@ -1235,35 +1266,40 @@ WATCHER_SESSION(gg_session_handler) {		/* tymczasowe */
 		case GG_EVENT_NOTIFY_DESCR:
 			{
 				struct gg_notify_reply *n;
+				GArray *batch = g_array_new(FALSE, FALSE, sizeof(protocol_status_t));
 
 				n = (e->type == GG_EVENT_NOTIFY) ? e->event.notify : e->event.notify_descr.notify;
 
 				for (; n->uin; n++) {
 					char *descr = (e->type == GG_EVENT_NOTIFY_DESCR) ? e->event.notify_descr.descr : NULL;
 
-					gg_session_handler_status(s, n->uin, n->status, descr, n->remote_ip, n->remote_port, n->version);
+					gg_session_handler_status(s, n->uin, n->status, descr, n->remote_ip, n->remote_port, n->version, batch);
 				}
 
+				gg_session_handler_status_flush(s, batch);
 				break;
 			}
 
 		case GG_EVENT_STATUS:
-			gg_session_handler_status(s, e->event.status.uin, e->event.status.status, e->event.status.descr, 0, 0, 0);
+			gg_session_handler_status(s, e->event.status.uin, e->event.status.status, e->event.status.descr, 0, 0, 0, NULL);
 			break;
 
 #ifdef GG_STATUS60
 		case GG_EVENT_STATUS60:
-			gg_session_handler_status(s, e->event.status60.uin, e->event.status60.status, e->event.status60.descr, e->event.status60.remote_ip, e->event.status60.remote_port, e->event.status60.version);
+			gg_session_handler_status(s, e->event.status60.uin, e->event.status60.status, e->event.status60.descr, e->event.status60.remote_ip, e->event.status60.remote_port, e->event.status60.version, NULL);
 			break;
 #endif
 
 #ifdef GG_NOTIFY_REPLY60
 		case GG_EVENT_NOTIFY60:
 			{
+				GArray *batch = g_array_new(FALSE, FALSE, sizeof(protocol_status_t));
 				int i;
 
 				for (i = 0; e->event.notify60[i].uin; i++)
-					gg_session_handler_status(s, e->event.notify60[i].uin, e->event.notify60[i].status, e->event.notify60[i].descr, e->event.notify60[i].remote_ip, e->event.notify60[i].remote_port, e->event.notify60[i].version);
+					gg_session_handler_status(s, e->event.notify60[i].uin, e->event.notify60[i].status, e->event.notify60[i].descr, e->event.notify60[i].remote_ip, e->event.notify60[i].remote_port, e->event.notify60[i].version, batch);
+
+				gg_session_handler_status_flush(s, batch);
 				break;
 			}
 #endif
@@ -512,7 +512,6 @@ COMMAND(gg_command_remind)
 int gg_userlist_set(session_t *session, const char *contacts)
 {
 	char **entries;
-	int i;
 
 	if (!session)
 		return -1;
@@ -521,8 +520,7 @@ int gg_userlist_set(session_t *session, const char *contacts)
 
 	userlist_free(session);
 
-	for (i = 0; entries[i]; i++)
-		userlist_add_entry(session, entries[i]);
+	userlist_add_entries(session, entries);
 
 	g_strfreev(entries);
 
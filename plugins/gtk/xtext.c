@@ -38,6 +38,10 @@
 #define MARGIN 2		/* dont touch. */
 #define REFRESH_TIMEOUT 20
 #define WORDWRAP_LIMIT 24
+#define REFLOW_CHUNK 200		/* entries rewrapped per idle call */
+
+#define XTEXT_REFLOW_INDENT 1		/* reflow_widths: redo ent->indent */
+#define XTEXT_REFLOW_STR_WIDTH 2	/* reflow_widths: redo ent->str_width */
 
 #include "ekg2.h"
 #define USE_XLIB
@@ -93,6 +97,8 @@ struct textentry {
 	gint16 indent;
 	gint16 left_len;
 	gint16 lines_taken;
+	guint16 reflow_gen;	/* == buf->reflow_gen when lines_taken is valid */
+	int index_pos;		/* slot in buf->index_ents */
 #define RECORD_WRAPS 4
 	guint16 wrap_offset[RECORD_WRAPS];
 	guchar mb;		/* boolean: is multibyte? */
@@ -3326,28 +3332,17 @@ static void gtk_xtext_fix_indent(xtext_buffer * buf)
 	dontscroll(buf);	/* force scrolling off */
 }
 
+static void gtk_xtext_reflow_start(xtext_buffer * buf, int fire_signal);
+
 static void gtk_xtext_recalc_widths(xtext_buffer * buf, int do_str_width)
 {
-	textentry *ent;
+	/* since we have a new font, we have to recalc the text widths,
+	 * it's done together with rewrapping, see gtk_xtext_reflow_ent() */
+	buf->reflow_widths |= XTEXT_REFLOW_INDENT;
+	if (do_str_width)
+		buf->reflow_widths |= XTEXT_REFLOW_STR_WIDTH;
 
-	/* since we have a new font, we have to recalc the text widths */
-	for (ent = buf->text_first; ent; ent = ent->next) {
-		if (do_str_width) {
-			ent->str_width = gtk_xtext_text_width(buf->xtext, ent->str,
-							      ent->str_len, NULL);
-		}
-		if (ent->left_len != -1) {
-			ent->indent =
-				(buf->indent -
-				 gtk_xtext_text_width(buf->xtext, ent->str,
-						      ent->left_len,
-						      NULL)) - buf->xtext->space_width;
-			if (ent->indent < MARGIN)
-				ent->indent = MARGIN;
-		}
-	}
-
-	gtk_xtext_calc_lines(buf, FALSE);
+	gtk_xtext_reflow_start(buf, FALSE);
 }
 
 int gtk_xtext_set_font(GtkXText * xtext, char *name)
@@ -3475,81 +3470,276 @@ static int gtk_xtext_lines_taken(xtext_buffer * buf, textentry * ent)
 	return taken;
 }
 
-/* Calculate number of actual lines (with wraps), to set adj->lower. *
- * This should only be called when the window resizes.		     */
+/* line index:
+ *	buf->index_ents[] keeps entries in order they were appended, index_tree[] is fenwick tree
+ *	over their lines_taken, so both "which line is ent at" and "which ent is at line n"
+ *	are O(log n), no matter how big scrollback is.
+ *	Entries are removed only from top (gtk_xtext_remove_top()), their slots are just
+ *	cleared, and reclaimed when index gets full.
+ */
 
-static void gtk_xtext_calc_lines(xtext_buffer * buf, int fire_signal)
+static void gtk_xtext_index_add(xtext_buffer * buf, int pos, int delta)
 {
-	textentry *ent;
-	int width;
-	int height;
-	int lines;
+	for (pos++; pos <= buf->index_size; pos += pos & -pos)
+		buf->index_tree[pos] += delta;
+}
 
-	gdk_drawable_get_size(GTK_WIDGET(buf->xtext)->window, &width, &height);
-	width -= MARGIN;
+/* number of lines before slot 'pos' */
 
-	if (width < 30 || height < buf->xtext->fontsize || width < buf->indent + 30)
-		return;
+static int gtk_xtext_index_sum(xtext_buffer * buf, int pos)
+{
+	int sum = 0;
+
+	for (; pos > 0; pos -= pos & -pos)
+		sum += buf->index_tree[pos];
+
+	return sum;
+}
+
+static void gtk_xtext_index_rebuild(xtext_buffer * buf)
+{
+	int live = buf->index_last - buf->index_first;
+	int size = buf->index_size ? buf->index_size : 256;
+	int i;
 
-	lines = 0;
+	/* keep at least half of it free, so rebuilding is amortized O(1) per append */
+	while (size < 2 * (live + 1))
+		size *= 2;
 
-	for (ent = buf->text_first; ent; ent = ent->next) {
-		ent->lines_taken = gtk_xtext_lines_taken(buf, ent);
-		lines += ent->lines_taken;
+	if (size != buf->index_size) {
+		buf->index_ents = xrealloc(buf->index_ents, size * sizeof(textentry *));
+		buf->index_tree = xrealloc(buf->index_tree, (size + 1) * sizeof(int));
+		buf->index_size = size;
 	}
 
-	buf->pagetop_ent = NULL;
-	buf->num_lines = lines;
-	gtk_xtext_adjustment_set(buf, fire_signal);
+	if (buf->index_first)
+		memmove(buf->index_ents, buf->index_ents + buf->index_first, live * sizeof(textentry *));
+	buf->index_first = 0;
+	buf->index_last = live;
+
+	/* O(n) fenwick build */
+	memset(buf->index_tree, 0, (size + 1) * sizeof(int));
+	for (i = 1; i <= size; i++) {
+		int up = i + (i & -i);
+
+		if (i <= live) {
+			buf->index_ents[i - 1]->index_pos = i - 1;
+			buf->index_tree[i] += buf->index_ents[i - 1]->lines_taken;
+		}
+		if (up <= size)
+			buf->index_tree[up] += buf->index_tree[i];
+	}
 }
 
-/* find the n-th line in the linked list, this includes wrap calculations */
+static void gtk_xtext_index_append(xtext_buffer * buf, textentry * ent)
+{
+	if (buf->index_last == buf->index_size)
+		gtk_xtext_index_rebuild(buf);
 
-static textentry *gtk_xtext_nth(GtkXText * xtext, int line, int *subline)
+	ent->index_pos = buf->index_last++;
+	buf->index_ents[ent->index_pos] = ent;
+	gtk_xtext_index_add(buf, ent->index_pos, ent->lines_taken);
+}
+
+/* only for buf->text_first */
+
+static void gtk_xtext_index_remove(xtext_buffer * buf, textentry * ent)
 {
-	int lines = 0;
-	textentry *ent;
+	gtk_xtext_index_add(buf, ent->index_pos, -ent->lines_taken);
+	buf->index_ents[ent->index_pos] = NULL;
+	buf->index_first = ent->index_pos + 1;
+}
 
-	ent = xtext->buffer->text_first;
+static void gtk_xtext_index_free(xtext_buffer * buf)
+{
+	xfree(buf->index_ents);
+	xfree(buf->index_tree);
+	buf->index_ents = NULL;
+	buf->index_tree = NULL;
+	buf->index_size = buf->index_first = buf->index_last = 0;
+}
+
+/* find entry with line 'line' in it */
 
-	/* -- optimization -- try to make a short-cut using the pagetop ent */
-	if (xtext->buffer->pagetop_ent) {
-		if (line == xtext->buffer->pagetop_line) {
-			*subline = xtext->buffer->pagetop_subline;
-			return xtext->buffer->pagetop_ent;
+static textentry *gtk_xtext_index_find(xtext_buffer * buf, int line, int *subline)
+{
+	int pos = 0;
+	int step;
+
+	if (line < 0 || line >= buf->num_lines)
+		return NULL;
+
+	/* index_size is always power of two */
+	for (step = buf->index_size; step; step >>= 1) {
+		if (pos + step <= buf->index_size && buf->index_tree[pos + step] <= line) {
+			pos += step;
+			line -= buf->index_tree[pos];
 		}
-		if (line > xtext->buffer->pagetop_line) {
-			/* lets start from the pagetop instead of the absolute beginning */
-			ent = xtext->buffer->pagetop_ent;
-			lines = xtext->buffer->pagetop_line - xtext->buffer->pagetop_subline;
-		} else if (line > xtext->buffer->pagetop_line - line) {
-			/* move backwards from pagetop */
-			ent = xtext->buffer->pagetop_ent;
-			lines = xtext->buffer->pagetop_line - xtext->buffer->pagetop_subline;
-			while (1) {
-				if (lines <= line) {
-					*subline = line - lines;
-					return ent;
-				}
-				ent = ent->prev;
-				if (!ent)
-					break;
-				lines -= ent->lines_taken;
-			}
-			return NULL;
+	}
+
+	if (pos >= buf->index_last)
+		return NULL;
+
+	*subline = line;
+	return buf->index_ents[pos];
+}
+
+static void gtk_xtext_set_lines_taken(xtext_buffer * buf, textentry * ent, int lines)
+{
+	if (lines == ent->lines_taken)
+		return;
+
+	buf->num_lines += lines - ent->lines_taken;
+	gtk_xtext_index_add(buf, ent->index_pos, lines - ent->lines_taken);
+	ent->lines_taken = lines;
+}
+
+/* rewrap 'ent' (and recalc widths if needed), if it wasn't done since last change */
+
+static void gtk_xtext_reflow_ent(xtext_buffer * buf, textentry * ent)
+{
+	if (ent->reflow_gen == buf->reflow_gen)
+		return;
+	ent->reflow_gen = buf->reflow_gen;
+
+	if (buf->reflow_widths & XTEXT_REFLOW_STR_WIDTH)
+		ent->str_width = gtk_xtext_text_width(buf->xtext, ent->str, ent->str_len, NULL);
+
+	if ((buf->reflow_widths & XTEXT_REFLOW_INDENT) && ent->left_len != -1) {
+		ent->indent =
+			(buf->indent -
+			 gtk_xtext_text_width(buf->xtext, ent->str,
+					      ent->left_len, NULL)) - buf->xtext->space_width;
+		if (ent->indent < MARGIN)
+			ent->indent = MARGIN;
+	}
+
+	gtk_xtext_set_lines_taken(buf, ent, gtk_xtext_lines_taken(buf, ent));
+}
+
+/* rewrap entries which take 'lines' lines starting from 'ent' (or ending with it, if 'backward') */
+
+static void gtk_xtext_reflow_range(xtext_buffer * buf, textentry * ent, int lines, int backward)
+{
+	while (ent && lines > 0) {
+		gtk_xtext_reflow_ent(buf, ent);
+		lines -= ent->lines_taken;
+		ent = backward ? ent->prev : ent->next;
+	}
+}
+
+/* entries above pagetop_ent might have changed their size, keep pagetop_ent where it was on screen */
+
+static void gtk_xtext_reflow_anchor(xtext_buffer * buf)
+{
+	textentry *ent = buf->pagetop_ent;
+	int subline, line, delta;
+
+	if (!ent || buf->scrollbar_down)
+		return;
+
+	subline = buf->pagetop_subline;
+	if (subline >= ent->lines_taken)
+		subline = ent->lines_taken - 1;
+
+	line = gtk_xtext_index_sum(buf, ent->index_pos) + subline;
+	delta = line - buf->pagetop_line;
+
+	buf->pagetop_line = line;
+	buf->pagetop_subline = subline;
+
+	if (!delta)
+		return;
+
+	buf->last_pixel_pos += delta * buf->xtext->fontsize;
+	buf->old_value += delta;
+	if (buf->xtext->buffer == buf) {	/* is it the current buffer? */
+		buf->xtext->adj->value += delta;
+		buf->xtext->select_start_adj += delta;
+	}
+}
+
+static gboolean gtk_xtext_reflow_idle(xtext_buffer * buf)
+{
+	GtkXText *xtext = buf->xtext;
+	int done = 0;
+
+	while (buf->reflow_ent && done < REFLOW_CHUNK) {
+		if (buf->reflow_ent->reflow_gen != buf->reflow_gen) {
+			gtk_xtext_reflow_ent(buf, buf->reflow_ent);
+			done++;
 		}
+		buf->reflow_ent = buf->reflow_ent->next;
 	}
-	/* -- end of optimization -- */
 
-	while (ent) {
-		lines += ent->lines_taken;
-		if (lines > line) {
-			*subline = ent->lines_taken - (lines - line);
-			return ent;
+	gtk_xtext_reflow_anchor(buf);
+
+	if (xtext->buffer == buf) {
+		gtk_xtext_adjustment_set(buf, TRUE);
+		if (buf->scrollbar_down) {
+			g_signal_handler_block(xtext->adj, xtext->vc_signal_tag);
+			gtk_adjustment_set_value(xtext->adj, xtext->adj->upper - xtext->adj->page_size);
+			g_signal_handler_unblock(xtext->adj, xtext->vc_signal_tag);
+			buf->old_value = xtext->adj->value;
 		}
-		ent = ent->next;
 	}
-	return NULL;
+
+	if (buf->reflow_ent)
+		return TRUE;
+
+	buf->reflow_tag = 0;
+	buf->reflow_widths = 0;
+
+	if (xtext->buffer == buf && GTK_WIDGET_REALIZED(GTK_WIDGET(xtext)))
+		gtk_xtext_render_page(xtext);
+	return FALSE;
+}
+
+/* Mark all entries as needing rewrap. Those on screen are rewrapped now,
+ * the rest from idle, REFLOW_CHUNK at time, so resizing window with huge
+ * scrollback doesn't block. */
+
+static void gtk_xtext_reflow_start(xtext_buffer * buf, int fire_signal)
+{
+	int lines = buf->xtext->fontsize ? buf->window_height / buf->xtext->fontsize + 1 : 1;
+
+	buf->reflow_gen++;
+	buf->reflow_ent = buf->text_first;
+
+	if (buf->scrollbar_down || !buf->pagetop_ent)
+		gtk_xtext_reflow_range(buf, buf->text_last, lines, TRUE);
+	else
+		gtk_xtext_reflow_range(buf, buf->pagetop_ent, lines, FALSE);
+
+	gtk_xtext_reflow_anchor(buf);
+	gtk_xtext_adjustment_set(buf, fire_signal);
+
+	if (buf->reflow_ent && !buf->reflow_tag)
+		buf->reflow_tag = g_idle_add((GSourceFunc) gtk_xtext_reflow_idle, buf);
+}
+
+/* Calculate number of actual lines (with wraps), to set adj->lower. *
+ * This should only be called when the window resizes.		     */
+
+static void gtk_xtext_calc_lines(xtext_buffer * buf, int fire_signal)
+{
+	int width;
+	int height;
+
+	gdk_drawable_get_size(GTK_WIDGET(buf->xtext)->window, &width, &height);
+	width -= MARGIN;
+
+	if (width < 30 || height < buf->xtext->fontsize || width < buf->indent + 30)
+		return;
+
+	gtk_xtext_reflow_start(buf, fire_signal);
+}
+
+/* find the n-th line in the linked list, this includes wrap calculations */
+
+static textentry *gtk_xtext_nth(GtkXText * xtext, int line, int *subline)
+{
+	return gtk_xtext_index_find(xtext->buffer, line, subline);
 }
 
 /* render enta (or an inclusive range enta->entb) */
@@ -3657,6 +3847,13 @@ static void gtk_xtext_render_page(GtkXText * xtext)
 	if (startline > 0)
 		ent = gtk_xtext_nth(xtext, startline, &subline);
 
+	/* still rewrapping from idle? make sure what we show is up to date */
+	if (xtext->buffer->reflow_ent && ent) {
+		gtk_xtext_reflow_range(xtext->buffer, ent, height / xtext->fontsize + 1 + subline, FALSE);
+		if (subline >= ent->lines_taken)
+			subline = ent->lines_taken - 1;
+	}
+
 	xtext->buffer->pagetop_ent = ent;
 	xtext->buffer->pagetop_subline = subline;
 	xtext->buffer->pagetop_line = startline;
@@ -3764,6 +3961,7 @@ static void gtk_xtext_remove_top(xtext_buffer * buffer)
 	ent = buffer->text_first;
 	if (!ent)
 		return;
+	gtk_xtext_index_remove(buffer, ent);
 	buffer->num_lines -= ent->lines_taken;
 	buffer->pagetop_line -= ent->lines_taken;
 	buffer->last_pixel_pos -= (ent->lines_taken * buffer->xtext->fontsize);
@@ -3792,6 +3990,9 @@ static void gtk_xtext_remove_top(xtext_buffer * buffer)
 	if (buffer->marker_pos == ent)
 		buffer->marker_pos = NULL;
 
+	if (buffer->reflow_ent == ent)
+		buffer->reflow_ent = ent->next;
+
 	free(ent);
 
 	if (visible) {
@@ -3827,6 +4028,9 @@ void gtk_xtext_clear(xtext_buffer * buf)
 		buf->text_first = next;
 	}
 	buf->text_last = NULL;
+	buf->reflow_ent = NULL;
+	buf->num_lines = 0;
+	gtk_xtext_index_free(buf);
 
 	if (buf->xtext->buffer == buf) {
 		gtk_xtext_calc_lines(buf, TRUE);
@@ -3923,7 +4127,9 @@ static void gtk_xtext_append_entry(xtext_buffer * buf, textentry * ent)
 	buf->text_last = ent;
 
 	ent->lines_taken = gtk_xtext_lines_taken(buf, ent);
+	ent->reflow_gen = buf->reflow_gen;
 	buf->num_lines += ent->lines_taken;
+	gtk_xtext_index_append(buf, ent);
 
 	if (buf->reset_marker_pos ||
 	    ((buf->marker_pos == NULL || buf->marker_seen) && (buf->xtext->buffer != buf ||
@@ -4200,6 +4406,10 @@ void gtk_xtext_buffer_free(xtext_buffer * buf) {
 		ent = next;
 	}
 
+	if (buf->reflow_tag)
+		g_source_remove(buf->reflow_tag);
+	gtk_xtext_index_free(buf);
+
 	free(buf);
 }
 
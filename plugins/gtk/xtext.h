@@ -56,6 +56,17 @@ typedef struct {
 	int num_lines;
 	int indent;		/* position of separator (pixels) from left */
 
+	textentry **index_ents;	/* entries in append order, NULL once removed */
+	int *index_tree;	/* fenwick tree over lines_taken (1-based) */
+	int index_size;
+	int index_first;	/* slot of text_first */
+	int index_last;		/* first free slot */
+
+	textentry *reflow_ent;	/* next entry to rewrap from idle */
+	guint reflow_tag;
+	guint16 reflow_gen;	/* bumped when all entries need rewrapping */
+	unsigned int reflow_widths;	/* XTEXT_REFLOW_* to redo with it */
+
 	textentry *marker_pos;
 
 	int window_width;	/* window size when last rendered. */
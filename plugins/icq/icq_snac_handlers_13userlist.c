@@ -110,8 +110,10 @@ static int icq_userlist_parse_entry(session_t *s, struct icq_tlv_list *tlvs, con
 				goto cleanup_user;
 			}
 
-			if (!u->nickname)
+			if (!u->nickname) {
 				u->nickname = xstrdup(nick);
+				userlist_replace(s, u);
+			}
 
 			set_userinfo_from_tlv(u, "email",	icq_tlv_get(tlvs, 0x0137));
 			set_userinfo_from_tlv(u, "phone",	icq_tlv_get(tlvs, 0x0138));	// phone number
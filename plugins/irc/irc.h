@@ -22,17 +22,37 @@
 
 /* irc_private->sopt */
 enum { USERMODES=0, CHANMODES, _005_PREFIX, _005_CHANTYPES,
-	_005_CHANMODES, _005_MODES, _005_CHANLIMIT, _005_NICKLEN, _005_IDCHAN, SERVOPTS };
+	_005_CHANMODES, _005_MODES, _005_CHANLIMIT, _005_NICKLEN, _005_IDCHAN, _005_TARGMAX, SERVOPTS };
 
 /* irc_private_t->casemapping values */
 enum { IRC_CASEMAPPING_ASCII, IRC_CASEMAPPING_RFC1459, IRC_CASEMAPPING_RFC1459_STRICT, IRC_CASEMAPPING_COUNT };
 
+/* irc_queue_t->lanes, in order of priority */
+enum { IRC_QUEUE_URGENT=0, IRC_QUEUE_USER, IRC_QUEUE_AUTO, IRC_QUEUE_LANES };
+
+/* output queue, see outqueue.c */
+typedef struct {
+	GQueue lanes[IRC_QUEUE_LANES];	/* queued lines, irc_queue_line_t */
+	gint64 clock;			/* message timer (RFC 1459, 8.10), in ms */
+	ekg_timer_t timer;		/* sends rest of the queue */
+	session_t *session;
+
+	/* statistics, shown by /irc:queue */
+	guint peak;			/* max number of queued lines */
+	guint sent, sent_bytes;
+	guint delayed;			/* lines which had to wait */
+	gint64 max_wait;		/* longest wait, in ms */
+	guint merged;			/* lines merged into other JOIN/MODE */
+	guint dropped;			/* lines dropped at disconnect or /queue --clear */
+} irc_queue_t;
+
 typedef struct _irc_private_t {
 	int autoreconnecting;		/* are we in reconnecting mode now? */
 	gboolean disconnecting;
 
 	GCancellable *connect_cancellable;
 	GDataOutputStream *send_stream;
+	irc_queue_t queue;
 
 	char *nick;			/* guess again ? ;> */
 	char *host_ident;		/* ident+host */
@@ -131,7 +151,16 @@ void irc_handle_disconnect(session_t *s, const char *reason, int type);
  */
 enum { IRC_GC_CHAN=0, IRC_GC_NOT_CHAN, IRC_GC_ANY };
 
-#define irc_write(s, args...) ekg_connection_write(irc_private(s)->send_stream, args)
+/* irc_write() is for lines caused by user, irc_write_urgent() for PONG & co.
+ * and irc_write_auto() for anything we send on our own */
+#define irc_write(s, args...) irc_queue_printf(s, IRC_QUEUE_USER, args)
+#define irc_write_urgent(s, args...) irc_queue_printf(s, IRC_QUEUE_URGENT, args)
+#define irc_write_auto(s, args...) irc_queue_printf(s, IRC_QUEUE_AUTO, args)
+
+void irc_queue_printf(session_t *s, int lane, const char *format, ...) G_GNUC_PRINTF(3, 4);	/* outqueue.c */
+void irc_queue_run(session_t *s);
+guint irc_queue_clear(session_t *s, int lane);
+COMMAND(irc_command_queue);
 
 int irc_parse_line(session_t *s, const char *l, int fd);	/* misc.c */
 
@@ -37,7 +37,7 @@
 #include "input.h"
 #include "autoacts.h"
 
-char *sopt_keys[SERVOPTS] = { NULL, NULL, "PREFIX", "CHANTYPES", "CHANMODES", "MODES", "CHANLIMIT", "NICKLEN", "IDCHAN" };
+char *sopt_keys[SERVOPTS] = { NULL, NULL, "PREFIX", "CHANTYPES", "CHANMODES", "MODES", "CHANLIMIT", "NICKLEN", "IDCHAN", "TARGMAX" };
 char sopt_casemapping[] = "CASEMAPPING";
 char *sopt_casemapping_values[IRC_CASEMAPPING_COUNT] = { "ascii", "rfc1459", "strict-rfc1459" };
 
@@ -616,7 +616,7 @@ IRC_COMMAND(irc_c_error)
 							session_name(s), altnick);
 					xfree(j->nick);
 					j->nick = xstrdup(altnick);
-					ekg_connection_write(j->send_stream, "NICK %s\r\n", j->nick);
+					irc_write_urgent(s, "NICK %s\r\n", j->nick);
 				}
 			}
 			break;
@@ -668,7 +668,7 @@ IRC_COMMAND(irc_c_error)
 			/* zero, identify with nickserv */
 			if (xstrlen(session_get(s, "identify"))) {
 				/* temporary */
-				ekg_connection_write(j->send_stream, "PRIVMSG nickserv :IDENTIFY %s\n", session_get(s, "identify"));
+				irc_write_auto(s, "PRIVMSG nickserv :IDENTIFY %s\n", session_get(s, "identify"));
 				/* XXX, bedzie:
 				 *	session_get(s, "identify") 
 				 *		<nick_ns> <host_ns *weryfikacja zeby nikt nie spoofowac*> "<NICK1 HASLO>" "<NICK2 HASLO>" "[GLOWNE HASLO]"
@@ -683,7 +683,7 @@ IRC_COMMAND(irc_c_error)
 
 			/* first we join */
 			if (xstrlen(session_get(s, "AUTO_JOIN")))
-				ekg_connection_write(j->send_stream, "JOIN %s\r\n", session_get(s, "AUTO_JOIN"));
+				irc_write_auto(s, "JOIN %s\r\n", session_get(s, "AUTO_JOIN"));
 		case 372:
 		case 375:
 			if (session_int_get(s, "SHOW_MOTD") != 0) {
@@ -993,7 +993,7 @@ IRC_COMMAND(irc_c_list)
  */
 IRC_COMMAND(irc_c_ping)
 {
-	ekg_connection_write(j->send_stream, "PONG %s\r\n", param[2]);
+	irc_write_urgent(s, "PONG %s\r\n", param[2]);
 	if (session_int_get(s, "DISPLAY_PONG"))
 		print_info("__status", s, "IRC_PINGPONG", session_name(s), OMITCOLON(param[2]));
 	return 0;
@@ -1046,8 +1046,10 @@ IRC_COMMAND(irc_c_nick)
 
 		temp = irc_uid(nick);
 		if ((w = window_find_s(s, temp))) {
-			xfree(w->target);
-			w->target = irc_uid(newnick);
+			char *uid = irc_uid(newnick);
+
+			window_target_set(w, uid);
+			xfree(uid);
 
 			query_emit(NULL, "ui-window-target-changed", &w);
 
@@ -1623,7 +1625,7 @@ IRC_COMMAND(irc_c_invite)
 	xfree(cchn);
 
 	if (session_int_get(s, "AUTO_JOIN_CHANS_ON_INVITE") == 1)
-		ekg_connection_write(j->send_stream, "JOIN %s\r\n", channel);
+		irc_write_auto(s, "JOIN %s\r\n", channel);
 
 	if (tmp) *tmp = '!';
 
@@ -0,0 +1,403 @@
+/*
+ *  (C) Copyright 2011 EKG2 authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License Version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Output queue with flood protection.
+ *
+ * Every line sent to the server goes through one of three lanes:
+ *  - IRC_QUEUE_URGENT - PONG, QUIT, registration; never held back,
+ *  - IRC_QUEUE_USER - everything user typed,
+ *  - IRC_QUEUE_AUTO - automatic traffic (WHO, MODE, JOIN on connect...).
+ *
+ * Pacing follows the penalty scheme of RFC 1459 (8.10) and ircd 2.x:
+ * each line moves client's message timer forward by flood_rate ms
+ * (+ flood_rate ms for every 240 bytes), and we stop sending when timer
+ * gets more than flood_burst * flood_rate ms ahead of current time.
+ * With the defaults (2000 ms, 5) it's exactly what the server enforces.
+ *
+ * Lines waiting in the queue may be merged: 'JOIN a' + 'JOIN b' becomes
+ * 'JOIN a,b' and 'MODE #c +o a' + 'MODE #c +v b' becomes 'MODE #c +o+v a b',
+ * as far as TARGMAX and MODES from 005 allow.
+ */
+
+#include "ekg2.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "irc.h"
+
+#define IRC_QUEUE_LINE_MAX	510	/* 512 with CRLF */
+#define IRC_QUEUE_PENALTY_BYTES	240	/* line of that size costs one flood_rate more */
+
+typedef struct {
+	GString *line;
+	gint64 since;		/* when it was queued, in ms */
+} irc_queue_line_t;
+
+static gint64 irc_queue_now(void) {
+#if GLIB_CHECK_VERSION(2, 28, 0)
+	return g_get_monotonic_time() / 1000;
+#else
+	GTimeVal tv;
+
+	g_get_current_time(&tv);
+	return (gint64) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#endif
+}
+
+static guint irc_queue_length(irc_queue_t *q) {
+	guint i, len = 0;
+
+	for (i = 0; i < IRC_QUEUE_LANES; i++)
+		len += g_queue_get_length(&q->lanes[i]);
+	return len;
+}
+
+/*
+ * irc_queue_targmax()
+ *
+ * maximal number of targets for @a cmd, from TARGMAX=CMD:n,... in 005.
+ * returns 0 if there's no limit.
+ */
+static int irc_queue_targmax(irc_private_t *j, const char *cmd) {
+	const char *p = SOP(_005_TARGMAX);
+	const size_t cmdlen = xstrlen(cmd);
+
+	while (p && *p) {
+		if (!xstrncasecmp(p, cmd, cmdlen) && p[cmdlen] == ':')
+			return atoi(p + cmdlen + 1);
+
+		if ((p = xstrchr(p, ',')))
+			p++;
+	}
+	return 0;
+}
+
+/*
+ * irc_queue_merge_join()
+ *
+ * 'JOIN a,b' + 'JOIN c' -> 'JOIN a,b,c'. channels with keys are left alone,
+ * keys would have to be merged in the same order.
+ */
+static gboolean irc_queue_merge_join(irc_private_t *j, GString *last, const char *line) {
+	const char *chans = line + 5;
+	const int targmax = irc_queue_targmax(j, "JOIN");
+	const char *p;
+	int count;
+
+	if (xstrncmp(last->str, "JOIN ", 5) || xstrncmp(line, "JOIN ", 5))
+		return FALSE;
+	if (xstrchr(last->str + 5, ' ') || xstrchr(chans, ' ') || !*chans)
+		return FALSE;
+		/* JOIN 0 means part all channels */
+	if (!xstrcmp(last->str + 5, "0") || !xstrcmp(chans, "0"))
+		return FALSE;
+	if (last->len + 1 + xstrlen(chans) > IRC_QUEUE_LINE_MAX)
+		return FALSE;
+
+	if (targmax) {
+		count = 2;
+		for (p = last->str + 5; (p = xstrchr(p, ',')); p++)
+			count++;
+		for (p = chans; (p = xstrchr(p, ',')); p++)
+			count++;
+		if (count > targmax)
+			return FALSE;
+	}
+
+	g_string_append_c(last, ',');
+	g_string_append(last, chans);
+	return TRUE;
+}
+
+/*
+ * irc_queue_mode_split()
+ *
+ * splits 'MODE target modes p1 p2...' if it sets only modes with parameters,
+ * so they can be concatenated safely. returns number of parameters, or -1.
+ */
+static int irc_queue_mode_split(const char *line, char ***out) {
+	char **v;
+	int i, letters = 0, params;
+
+	if (xstrncmp(line, "MODE ", 5) || xstrchr(line, ':'))
+		return -1;
+
+	v = g_strsplit(line, " ", 0);
+	params = g_strv_length(v) - 3;
+
+	if (params < 1 || (v[2][0] != '+' && v[2][0] != '-'))
+		goto fail;
+	for (i = 0; v[2][i]; i++)
+		if (v[2][i] != '+' && v[2][i] != '-')
+			letters++;
+	if (letters != params)
+		goto fail;
+	for (i = 3; v[i]; i++)
+		if (!*v[i])
+			goto fail;
+
+	*out = v;
+	return params;
+fail:
+	g_strfreev(v);
+	return -1;
+}
+
+static gboolean irc_queue_merge_mode(irc_private_t *j, GString *last, const char *line) {
+	const char *modes = SOP(_005_MODES);
+	char **a, **b;
+	int na, nb, i;
+	gboolean ret = FALSE;
+
+	if ((na = irc_queue_mode_split(last->str, &a)) == -1)
+		return FALSE;
+	if ((nb = irc_queue_mode_split(line, &b)) == -1) {
+		g_strfreev(a);
+		return FALSE;
+	}
+
+	if (!xstrcasecmp(a[1], b[1]) && (!modes || na + nb <= atoi(modes))
+			&& last->len + xstrlen(line) - 6 - xstrlen(b[1]) <= IRC_QUEUE_LINE_MAX)
+	{
+		g_string_printf(last, "MODE %s %s%s", a[1], a[2], b[2]);
+		for (i = 3; a[i]; i++)
+			g_string_append_printf(last, " %s", a[i]);
+		for (i = 3; b[i]; i++)
+			g_string_append_printf(last, " %s", b[i]);
+		ret = TRUE;
+	}
+
+	g_strfreev(a);
+	g_strfreev(b);
+	return ret;
+}
+
+static void irc_queue_line(irc_private_t *j, int lane, const char *line) {
+	irc_queue_t *q = &j->queue;
+	irc_queue_line_t *last = g_queue_peek_tail(&q->lanes[lane]);
+	irc_queue_line_t *l;
+	guint len;
+
+	if (last && lane != IRC_QUEUE_URGENT &&
+			(irc_queue_merge_join(j, last->line, line) || irc_queue_merge_mode(j, last->line, line)))
+	{
+		q->merged++;
+		return;
+	}
+
+	l = g_slice_new(irc_queue_line_t);
+	l->line = g_string_new(line);
+	l->since = irc_queue_now();
+	g_queue_push_tail(&q->lanes[lane], l);
+
+	if ((len = irc_queue_length(q)) > q->peak)
+		q->peak = len;
+}
+
+static void irc_queue_line_free(irc_queue_line_t *l) {
+	g_string_free(l->line, TRUE);
+	g_slice_free(irc_queue_line_t, l);
+}
+
+static gboolean irc_queue_timer(gpointer data) {
+	irc_queue_t *q = data;
+
+	irc_queue_run(q->session);
+	return (irc_queue_length(q) > 0);
+}
+
+static void irc_queue_timer_destroy(gpointer data) {
+	irc_queue_t *q = data;
+
+	q->timer = NULL;
+}
+
+/*
+ * irc_queue_run()
+ *
+ * sends as much as flood protection allows: urgent lane always,
+ * then user lane, then automatic one.
+ */
+void irc_queue_run(session_t *s) {
+	irc_private_t *j = irc_private(s);
+	irc_queue_t *q = &j->queue;
+	int rate = session_int_get(s, "flood_rate");
+	int burst = session_int_get(s, "flood_burst");
+	gint64 now, window;
+
+	if (!j->send_stream)
+		return;
+
+	if (rate < 0)
+		rate = 0;
+	if (burst < 1)
+		burst = 1;
+	window = (gint64) rate * burst;
+
+	now = irc_queue_now();
+	if (q->clock < now)
+		q->clock = now;
+
+	for (;;) {
+		irc_queue_line_t *l;
+		int lane;
+
+		if (!g_queue_is_empty(&q->lanes[IRC_QUEUE_URGENT]))
+			lane = IRC_QUEUE_URGENT;
+		else if (rate && q->clock - now >= window)
+			break;
+		else if (!g_queue_is_empty(&q->lanes[IRC_QUEUE_USER]))
+			lane = IRC_QUEUE_USER;
+		else if (!g_queue_is_empty(&q->lanes[IRC_QUEUE_AUTO]))
+			lane = IRC_QUEUE_AUTO;
+		else
+			break;
+
+		l = g_queue_pop_head(&q->lanes[lane]);
+		ekg_connection_write(j->send_stream, "%s\r\n", l->line->str);
+
+		q->clock += rate + (gint64) rate * (l->line->len + 2) / IRC_QUEUE_PENALTY_BYTES;
+		q->sent++;
+		q->sent_bytes += l->line->len + 2;
+		if (l->since < now) {
+			q->delayed++;
+			if (now - l->since > q->max_wait)
+				q->max_wait = now - l->since;
+		}
+		irc_queue_line_free(l);
+	}
+
+	if (!q->timer && irc_queue_length(q) > 0) {
+		q->session = s;
+		q->timer = ekg_timer_add(&irc_plugin, "%s:queue", CLAMP(rate / 4, 50, 1000),
+				irc_queue_timer, q, irc_queue_timer_destroy, session_uid_get(s));
+	}
+}
+
+/*
+ * irc_queue_printf()
+ *
+ * formats and queues one or more (separated with '\n') lines to server.
+ * don't use it directly, see irc_write() & friends in irc.h
+ */
+void irc_queue_printf(session_t *s, int lane, const char *format, ...) {
+	irc_private_t *j = irc_private(s);
+	va_list ap;
+	gchar *buf, *line, *next;
+
+	g_assert(lane >= 0 && lane < IRC_QUEUE_LANES);
+
+	if (!j->send_stream) {
+		debug_error("irc_queue_printf() not connected, dropping: %s\n", format);
+		return;
+	}
+
+	va_start(ap, format);
+	buf = g_strdup_vprintf(format, ap);
+	va_end(ap);
+
+	for (line = buf; line && *line; line = next) {
+		gsize len;
+
+		if ((next = xstrchr(line, '\n')))
+			*next++ = '\0';
+		if ((len = xstrlen(line)) && line[len - 1] == '\r')
+			line[len - 1] = '\0';
+
+		if (*line)
+			irc_queue_line(j, lane, line);
+	}
+	g_free(buf);
+
+	irc_queue_run(s);
+}
+
+/*
+ * irc_queue_clear()
+ *
+ * drops everything waiting in @a lane (or all lanes, if -1)
+ * and returns number of dropped lines.
+ */
+guint irc_queue_clear(session_t *s, int lane) {
+	irc_private_t *j = irc_private(s);
+	irc_queue_t *q = &j->queue;
+	guint count = 0;
+	int i;
+
+	for (i = 0; i < IRC_QUEUE_LANES; i++) {
+		irc_queue_line_t *l;
+
+		if (lane != -1 && lane != i)
+			continue;
+
+		while ((l = g_queue_pop_head(&q->lanes[i]))) {
+			irc_queue_line_free(l);
+			count++;
+		}
+	}
+	q->dropped += count;
+
+	if (q->timer && !irc_queue_length(q))
+		ekg_source_remove(q->timer);
+	if (lane == -1)
+		q->clock = 0;
+	return count;
+}
+
+/*
+ * irc_command_queue()
+ *
+ * /irc:queue [--clear]
+ */
+COMMAND(irc_command_queue) {
+	irc_private_t *j = irc_private(session);
+	irc_queue_t *q = &j->queue;
+
+	if (match_arg(params[0], 'c', "clear", 2)) {
+		printq("irc_queue_cleared", session_name(session),
+				ekg_itoa(irc_queue_clear(session, IRC_QUEUE_USER) + irc_queue_clear(session, IRC_QUEUE_AUTO)));
+		return 0;
+	}
+	if (params[0]) {
+		printq("invalid_params", name, params[0]);
+		return -1;
+	}
+
+	printq("irc_queue_stats", session_name(session),
+			ekg_itoa(irc_queue_length(q)),
+			ekg_itoa(g_queue_get_length(&q->lanes[IRC_QUEUE_URGENT])),
+			ekg_itoa(g_queue_get_length(&q->lanes[IRC_QUEUE_USER])),
+			ekg_itoa(g_queue_get_length(&q->lanes[IRC_QUEUE_AUTO])),
+			ekg_itoa(q->peak));
+	printq("irc_queue_sent", session_name(session),
+			ekg_itoa(q->sent), ekg_itoa(q->sent_bytes),
+			ekg_itoa(q->delayed), ekg_itoa(q->max_wait),
+			ekg_itoa(q->merged), ekg_itoa(q->dropped));
+	return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-file-style: "k&r"
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -184,6 +184,7 @@ au_retry:
 				else if (xstrcmp(u->nickname, url)) {
 					xfree(u->nickname);
 					u->nickname = url;
+					userlist_replace(js, u);
 				} else
 					xfree(url);
 			}
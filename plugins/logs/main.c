@@ -923,7 +923,8 @@ static const char *prepare_timestamp_format(const char *format, time_t t)  {
  */
 
 static QUERY(logs_handler) {
-	char *session	= *(va_arg(ap, char**));
+	session_t *s	= *(va_arg(ap, session_t**));
+	char *session	= s->uid;
 	char *uid	= *(va_arg(ap, char**));
 	char **rcpts	= *(va_arg(ap, char***));
 	char *text	= *(va_arg(ap, char**));
@@ -932,7 +933,6 @@ static QUERY(logs_handler) {
 	int  class	= *(va_arg(ap, int*));
 		char **UNUSED(seq)		= va_arg(ap, char**);
 
-	session_t *s = session_find(session); // session pointer
 	log_window_t *lw;
 	char *conf_uid = NULL;		/* conference-uid */
 	char *target_uid;
@@ -995,12 +995,7 @@ static QUERY(logs_handler) {
  * status handler
  */
 
-static QUERY(logs_status_handler) {
-	char *session	= *(va_arg(ap, char**));
-	char *uid	= *(va_arg(ap, char**));
-	int status	= *(va_arg(ap, int*));
-	char *descr	= *(va_arg(ap, char**));
-
+static void logs_status(char *session, char *uid, int status, char *descr) {
 	log_window_t *lw;
 
 	/* joiny, party	ircowe jakies inne query. lub zrobic to w pluginie irc... ? */
@@ -1008,17 +1003,15 @@ static QUERY(logs_status_handler) {
 	   if (session_check(s, 0, "irc") && !xstrcmp(logs_log_format(s), "irssi"))
 	   return 0;
 	   */
-	if (config_logs_log_status <= 0)
-		return 0;
 
 	if (!(lw = logs_log_find(session, uid, 1)->lw)) {
 		debug_error("[LOGS:%d] logs_status_handler, shit happen\n", __LINE__);
-		return 0;
+		return;
 	}
 
 	if ( !(lw->file) && !(lw->file = logs_open_file(lw->path, lw->logformat)) ) {
 		debug_error("[LOGS:%d] logs_status_handler Cannot open/create file: %s\n", __LINE__, __(lw->path));
-		return 0;
+		return;
 	}
 
 	if (!descr)
@@ -1045,6 +1038,32 @@ static QUERY(logs_status_handler) {
 			break;
 		}
 	}
+}
+
+static QUERY(logs_status_handler) {
+	char *session	= *(va_arg(ap, char**));
+	char *uid	= *(va_arg(ap, char**));
+	int status	= *(va_arg(ap, int*));
+	char *descr	= *(va_arg(ap, char**));
+
+	if (config_logs_log_status <= 0)
+		return 0;
+
+	logs_status(session, uid, status, descr);
+	return 0;
+}
+
+static QUERY(logs_status_batch_handler) {
+	char *session				= *(va_arg(ap, char**));
+	int count				= *(va_arg(ap, int*));
+	protocol_status_change_t *changes	= *(va_arg(ap, protocol_status_change_t**));
+	int i;
+
+	if (config_logs_log_status <= 0)
+		return 0;
+
+	for (i = 0; i < count; i++)
+		logs_status(session, (char *) changes[i].uid, changes[i].status, (char *) changes[i].descr);
 	return 0;
 }
 
@@ -1185,12 +1204,13 @@ EXPORT int logs_plugin_init(int prio) {
 	plugin_register(&logs_plugin, prio);
 	
 	query_connect(&logs_plugin, "set-vars-default",logs_setvar_default, NULL);
-	query_connect(&logs_plugin, "protocol-message-post", logs_handler, NULL);
+	query_connect(&logs_plugin, "protocol-message-post-session", logs_handler, NULL);
 	query_connect(&logs_plugin, "irc-protocol-message", logs_handler_irc, NULL);
 	query_connect(&logs_plugin, "ui-window-new",	logs_handler_newwin, NULL);
 	query_connect(&logs_plugin, "ui-window-print",	logs_handler_raw, NULL);
 	query_connect(&logs_plugin, "ui-window-kill",	logs_handler_killwin, NULL);
 	query_connect(&logs_plugin, "protocol-status", logs_status_handler, NULL);
+	query_connect(&logs_plugin, "protocol-status-batch", logs_status_batch_handler, NULL);
 	query_connect(&logs_plugin, "config-postinit", logs_postinit, NULL);
 	/* XXX, implement UI_WINDOW_TARGET_CHANGED, IMPORTANT!!!!!! */
 
@@ -521,14 +521,14 @@ void logsqlite_close_db(sqlite_t * db)
 
 QUERY(logsqlite_msg_handler)
 {
-	char	**__session = va_arg(ap, char**),    *session = *__session;
+	session_t     **__s = va_arg(ap, session_t**), *s = *__s;
+	char	    *session = s->uid;
 	char	    **__uid = va_arg(ap, char**),	 *uid = *__uid;
 	char	 ***__rcpts = va_arg(ap, char***),    **rcpts = *__rcpts;
 	char	   **__text = va_arg(ap, char**),	*text = *__text;
 	guint32 **__format = va_arg(ap, guint32**), *format = *__format;
 	time_t	    *__sent = va_arg(ap, time_t*),	 sent = *__sent;
 	int	   *__class = va_arg(ap, int*),		class = *__class;
-	session_t *s = session_find((const char*)session);
 	const char * gotten_uid = get_uid(s, uid);
 	const char * gotten_nickname = get_nickname(s, uid);
 	char * type = NULL;
@@ -659,72 +659,104 @@ QUERY(logsqlite_msg_handler)
 };
 
 /**
- * handler statusw
+ * zapisuje @a count zmian statusw z sesji @a session, jednym przygotowanym zapytaniem
  */
-QUERY(logsqlite_status_handler) {
-	char *session	= *(va_arg(ap, char**));
-	char *uid	= *(va_arg(ap, char**));
-	int nstatus	= *(va_arg(ap, int*));
-	char *descr	= *(va_arg(ap, char**));
-	const char *status;
-
+static void logsqlite_status_log(char *session, const protocol_status_change_t *changes, int count)
+{
 	session_t *s	= session_find(session);
-	const char * gotten_uid = get_uid(s, uid);
-	const char * gotten_nickname = get_nickname(s, uid);
 	sqlite_t * db;
+	int i;
 #ifdef HAVE_LIBSQLITE3	
 	sqlite3_stmt *stmt;
 #endif 
 
 	if (!config_logsqlite_log_status)
-		return 0;
+		return;
 
 	if (!session)
-		return 0;
+		return;
 
 	if (!xstrstr(session_get(s, "log_formats"), "sqlite"))
-		return 0;
+		return;
 
 	db = logsqlite_prepare_db(s, time(0), 1);
 	if (!db) {
-		return 0;
+		return;
 	}
 
-	if ( gotten_uid == NULL )
-		gotten_uid = uid;
-
-	if ( gotten_nickname == NULL )
-		gotten_nickname = uid;
-
-	status = ekg_status_string(nstatus, 0);
-
-	if ( descr == NULL )
-		descr = "";
-
 	debug("[logsqlite] running status query\n");
 
 #ifdef HAVE_LIBSQLITE3
 	sqlite3_prepare(db, "INSERT INTO log_status VALUES(?, ?, ?, ?, ?, ?)", -1, &stmt, NULL);
-	sqlite3_bind_text(stmt, 1, session, -1, SQLITE_STATIC);
-	sqlite3_bind_text(stmt, 2, gotten_uid, -1, SQLITE_STATIC);
-	sqlite3_bind_text(stmt, 3, gotten_nickname, -1, SQLITE_STATIC);
-	sqlite3_bind_int(stmt, 4, time(0));
-	sqlite3_bind_text(stmt, 5, status, -1, SQLITE_STATIC);
-	sqlite3_bind_text(stmt, 6, descr, -1, SQLITE_STATIC);
+#endif 
+	for (i = 0; i < count; i++) {
+		const char *uid = changes[i].uid;
+		const char *gotten_uid = get_uid(s, uid);
+		const char *gotten_nickname = get_nickname(s, uid);
+		const char *status = ekg_status_string(changes[i].status, 0);
+		const char *descr = changes[i].descr;
 
-	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+		if ( gotten_uid == NULL )
+			gotten_uid = uid;
 
+		if ( gotten_nickname == NULL )
+			gotten_nickname = uid;
+
+		if ( descr == NULL )
+			descr = "";
+
+#ifdef HAVE_LIBSQLITE3
+		sqlite3_bind_text(stmt, 1, session, -1, SQLITE_STATIC);
+		sqlite3_bind_text(stmt, 2, gotten_uid, -1, SQLITE_STATIC);
+		sqlite3_bind_text(stmt, 3, gotten_nickname, -1, SQLITE_STATIC);
+		sqlite3_bind_int(stmt, 4, time(0));
+		sqlite3_bind_text(stmt, 5, status, -1, SQLITE_STATIC);
+		sqlite3_bind_text(stmt, 6, descr, -1, SQLITE_STATIC);
+
+		sqlite3_step(stmt);
+		sqlite3_reset(stmt);
 #else
-	sqlite_exec_printf(db, "INSERT INTO log_status VALUES(%Q, %Q, %Q, %i, %Q, %Q)", 0, 0, 0,
-		session,
-		gotten_uid,
-		gotten_nickname,
-		time(0),
-		status,
-		descr);
+		sqlite_exec_printf(db, "INSERT INTO log_status VALUES(%Q, %Q, %Q, %i, %Q, %Q)", 0, 0, 0,
+			session,
+			gotten_uid,
+			gotten_nickname,
+			time(0),
+			status,
+			descr);
 #endif 
+	}
+#ifdef HAVE_LIBSQLITE3
+	sqlite3_finalize(stmt);
+#endif 
+}
+
+/**
+ * handler statusw
+ */
+QUERY(logsqlite_status_handler) {
+	char *session	= *(va_arg(ap, char**));
+	char *uid	= *(va_arg(ap, char**));
+	int nstatus	= *(va_arg(ap, int*));
+	char *descr	= *(va_arg(ap, char**));
+	protocol_status_change_t change;
+
+	change.uid	= uid;
+	change.status	= nstatus;
+	change.descr	= descr;
+
+	logsqlite_status_log(session, &change, 1);
+	return 0;
+}
+
+/**
+ * handler paczki statusw (protocol_status_batch_emit())
+ */
+QUERY(logsqlite_status_batch_handler) {
+	char *session				= *(va_arg(ap, char**));
+	int count				= *(va_arg(ap, int*));
+	protocol_status_change_t *changes	= *(va_arg(ap, protocol_status_change_t**));
 
+	logsqlite_status_log(session, changes, count);
 	return 0;
 }
 
@@ -845,8 +877,9 @@ int logsqlite_plugin_init(int prio)
 	command_add(&logsqlite_plugin, "logsqlite:laststatus", "puU puU puU puU puU", logsqlite_cmd_laststatus, 0, "-n --number -s --search");
 	command_add(&logsqlite_plugin, "logsqlite:sync", NULL, logsqlite_cmd_sync, 0, 0);
 
-	query_connect(&logsqlite_plugin, "protocol-message-post", logsqlite_msg_handler, NULL);
+	query_connect(&logsqlite_plugin, "protocol-message-post-session", logsqlite_msg_handler, NULL);
 	query_connect(&logsqlite_plugin, "protocol-status", logsqlite_status_handler, NULL);
+	query_connect(&logsqlite_plugin, "protocol-status-batch", logsqlite_status_batch_handler, NULL);
 	query_connect(&logsqlite_plugin, "ui-window-new",	logsqlite_newwin_handler, NULL);
 
 	variable_add(&logsqlite_plugin, ("last_open_window"), VAR_BOOL, 1, &config_logsqlite_last_open_window, NULL, NULL, NULL);
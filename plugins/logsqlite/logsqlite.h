@@ -34,6 +34,7 @@
 extern char *logsqlite_prepare_path();
 extern QUERY(logsqlite_msg_handler);
 extern QUERY(logsqlite_status_handler);
+extern QUERY(logsqlite_status_batch_handler);
 extern int logsqlite_theme_init();
 extern sqlite_t * logsqlite_prepare_db(session_t * session, time_t sent, int mode);
 extern sqlite_t * logsqlite_open_db(session_t * session, time_t sent, char * path);
@@ -24,6 +24,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#ifndef NO_POSIX_SYSTEM
+#include <sys/mman.h>
+#endif
 
 #include <dirent.h>
 #include <errno.h>
@@ -48,6 +51,16 @@
 #endif /*HAVE_SYS_INOTIFY_H*/
 
 
+/* how far we got with scanning mbox file */
+struct mail_mbox_state {
+	dev_t dev;
+	ino_t ino;
+	off_t offset;		/* everything before it was already scanned */
+	int count;		/* new messages found in scanned part */
+	int in_header;		/* whether scanner stopped inside message headers */
+	guint32 sum;		/* checksum of MAIL_MBOX_SUM_BLOCK bytes before offset */
+};
+
 struct mail_folder {
 	int fhash;
 	char *fname;
@@ -55,6 +68,7 @@ struct mail_folder {
 	off_t size;
 	int count;
 	int check;
+	struct mail_mbox_state mbox;
 
 #ifdef HAVE_SYS_INOTIFY_H
 	guint32 watch;
@@ -161,23 +175,16 @@ static TIMER(check_mail)
 #endif
 
 /*
- * check_mail_update()
- *
- * modyfikuje liczb nowych emaili i daje o tym zna.
+ * check_mail_set()
  *
- * 0/-1
+ * modyfikuje liczb nowych emaili w folderze o danym hashu
+ * i daje o tym zna.
  */
-static int check_mail_update(const char *s, int more)
+static void check_mail_set(int h, int c, int more)
 {
-	int h = 0, c = 0, new_count = 0;
+	int new_count = 0;
 	list_t l;
 
-	if (!s || !xstrchr(s, ','))
-		return -1;
-
-	h = atoi(s);
-	c = atoi(xstrchr(s, ',') + 1);
-
 	for (l = mail_folders; l; l = l->next) {
 		struct mail_folder *m = l->data;
 
@@ -188,7 +195,7 @@ static int check_mail_update(const char *s, int more)
 	}
 
 	if (new_count == mail_count)
-		return 0;
+		return;
 
 	if (!more) {
 		last_mail_count = mail_count;
@@ -214,7 +221,21 @@ static int check_mail_update(const char *s, int more)
 
 //		event_check(EVENT_NEWMAIL, 1, ekg_itoa(mail_count));
 	}
+}
+
+/*
+ * check_mail_update()
+ *
+ * parsuje lini "hash,liczba" od dzieciaka i uaktualnia liczb emaili.
+ *
+ * 0/-1
+ */
+static int check_mail_update(const char *s, int more)
+{
+	if (!s || !xstrchr(s, ','))
+		return -1;
 
+	check_mail_set(atoi(s), atoi(xstrchr(s, ',') + 1), more);
 	return 0;
 }
 
@@ -232,150 +253,345 @@ static WATCHER_LINE(mail_handler)
 	return 0;
 }
 
+#ifndef NO_POSIX_SYSTEM
+
+#define MAIL_MBOX_WINDOW	(64 << 20)	/* how much of mbox we mmap() at once */
+#define MAIL_MBOX_SUM_BLOCK	4096		/* tail of scanned part used to detect rewrites */
+
+struct mail_mbox_job {
+	int fhash;
+	char *fname;
+	struct mail_mbox_state st;
+	int rewritten;			/* set by worker, reported by mail_mbox_done() */
+};
+
+static GThread *mail_mbox_thread = NULL;
+static GSList *mail_mbox_jobs = NULL;		/* non-NULL while scan is in progress */
+static guint mail_mbox_done_id = 0;
+static int mail_mbox_again = 0;			/* folders changed during scan */
+
 /*
- * check_mail_mbox()
+ * mail_mbox_sum()
+ *
+ * FNV-1a over MAIL_MBOX_SUM_BLOCK bytes ending at offset. if they differ
+ * from what we remember, the file was rewritten (e.g. by MUA expunging
+ * messages) and we need to scan it again from the beginning.
+ */
+static guint32 mail_mbox_sum(int fd, off_t offset)
+{
+	char buf[MAIL_MBOX_SUM_BLOCK];
+	const size_t len = (offset < MAIL_MBOX_SUM_BLOCK) ? offset : MAIL_MBOX_SUM_BLOCK;
+	guint32 sum = 2166136261U;
+	size_t i;
+
+	if (!len || pread(fd, buf, len, offset - len) != (ssize_t) len)
+		return 0;
+
+	for (i = 0; i < len; i++) {
+		sum ^= (unsigned char) buf[i];
+		sum *= 16777619U;
+	}
+
+	return sum;
+}
+
+/*
+ * mail_mbox_line()
+ *
+ * counts single mbox line, the same way old read_file() loop did.
+ */
+static void mail_mbox_line(struct mail_mbox_state *s, const char *line, size_t len)
+{
+	size_t i;
+
+	if (len >= 5 && !memcmp(line, "From ", 5)) {
+		s->in_header = 1;
+		s->count++;
+	}
+
+	if (s->in_header && ((len >= 10 && !memcmp(line, "Status: RO", 10)) || (len >= 9 && !memcmp(line, "Status: O", 9))))
+		s->count--;
+
+	for (i = 0; i < len; i++) {
+		if (!xisspace(line[i]))
+			return;
+	}
+
+	s->in_header = 0;
+}
+
+/*
+ * mail_mbox_scan_range()
  *
- * tworzy dzieciaka, ktry sprawdza wszystkie pliki typu
- * mbox i liczy, ile jest nowych wiadomoci, potem zwraca
- * wynik rurk. sprawdza tylko te pliki, ktre byy
- * modyfikowane od czasu ostatniego sprawdzania.
+ * scans file from s->offset up to size, moving s->offset past the last
+ * complete line. incomplete line at the end is left for the next run.
  *
  * 0/-1
  */
-static int check_mail_mbox()
+static int mail_mbox_scan_range(int fd, struct mail_mbox_state *s, off_t size)
 {
-#ifndef NO_POSIX_SYSTEM
-	int fd[2], pid, to_check = 0;
-	list_t l;
+	const long pagesize = sysconf(_SC_PAGESIZE);
+	struct mail_mbox_state saved = *s;
+	off_t pos = s->offset;
+	int overlong = 0;
 
-	for (l = mail_folders; l; l = l->next) {
-		struct mail_folder *m = l->data;
-		struct stat st;
+	while (pos < size) {
+		const off_t base = pos - (pos % pagesize);
+		const size_t len = (size - base > MAIL_MBOX_WINDOW) ? MAIL_MBOX_WINDOW : (size_t) (size - base);
+		const char *map, *start, *p, *end, *nl;
 
-		/* plik mg zosta usunity, uaktualnijmy */
-		if (stat(m->fname, &st)) {
-			if (m->count) {
-				char *buf = saprintf("%d,%d", m->fhash, 0);
-				check_mail_update(buf, 0);
-				xfree(buf);
-			}
+		if ((map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, base)) == MAP_FAILED)
+			return -1;
 
-			m->mtime = 0;
-			m->size = 0;
-			m->check = 0;
-			m->count = 0;
+		start = p = map + (pos - base);
+		end = map + len;
 
-			continue;
+		while (p < end && (nl = memchr(p, '\n', end - p))) {
+			if (!overlong)
+				mail_mbox_line(s, p, nl - p);
+			overlong = 0;
+
+			p = nl + 1;
+			s->offset = base + (p - map);
 		}
 
-		if ((st.st_mtime != m->mtime) || (st.st_size != m->size)) {
-			m->mtime = st.st_mtime;
-			m->size = st.st_size;
-			m->check = 1;
-			to_check++;
+		munmap((void *) map, len);
+
+		if (p == end)
+			pos = base + len;
+		else if (base + len == size) {
+			/* line is still being written, forget we've seen its beginning */
+			if (overlong)
+				*s = saved;
+			break;
+		} else if (p == start) {
+			/* line doesn't fit in window, only its beginning matters */
+			if (!overlong) {
+				saved = *s;
+				mail_mbox_line(s, p, end - p);
+				overlong = 1;
+			}
+			pos = base + len;
 		} else
-			m->check = 0;
+			pos = base + (p - map);
 	}
 
-	if (!to_check || pipe(fd))
-		return -1;
+	return 0;
+}
 
-	if ((pid = fork()) < 0) {
-		close(fd[0]);
-		close(fd[1]);
-		return -1;
+/*
+ * mail_mbox_scan()
+ *
+ * uaktualnia stan jednego pliku mbox. jeli plik jedynie urs,
+ * czyta tylko dopisan kocwk, w przeciwnym wypadku cao.
+ */
+static void mail_mbox_scan(struct mail_mbox_job *j)
+{
+	struct mail_mbox_state *s = &j->st;
+	struct stat st;
+	int fd;
+
+	if ((fd = open(j->fname, O_RDONLY)) == -1 || fstat(fd, &st)) {
+		if (fd != -1)
+			close(fd);
+		memset(s, 0, sizeof(struct mail_mbox_state));
+		return;
 	}
 
-	if (!pid) {	/* born to be wild */
-		char *s = NULL, *line;
-		int f_new = 0, new = 0, in_header = 0, i = 0;
-		FILE *f;
-		struct stat st;
+	if (st.st_dev != s->dev || st.st_ino != s->ino || st.st_size < s->offset || mail_mbox_sum(fd, s->offset) != s->sum) {
+		/* no debug() here, we're not in main thread */
+		j->rewritten = (s->offset != 0);
 
-		close(fd[0]);
+		memset(s, 0, sizeof(struct mail_mbox_state));
+		s->dev = st.st_dev;
+		s->ino = st.st_ino;
+	}
 
-		for (l = mail_folders; l; l = l->next) {
-			struct mail_folder *m = l->data;
+	if (mail_mbox_scan_range(fd, s, st.st_size)) {
+		memset(s, 0, sizeof(struct mail_mbox_state));
+		close(fd);
+		return;
+	}
 
-			if (!m->check)
-				continue;
+	s->sum = mail_mbox_sum(fd, s->offset);
+	close(fd);
 
-			i++;
+	/* mmap() touched atime, MUAs use it to detect new mail */
+#ifdef HAVE_UTIMES
+	{
+		struct timeval foo[2];
 
-			if (stat(m->fname, &st) || !(f = fopen(m->fname, "r")))
-				continue;
+		foo[0].tv_sec = st.st_atime;
+		foo[0].tv_usec = 0;
+		foo[1].tv_sec = st.st_mtime;
+		foo[1].tv_usec = 0;
 
-			while ((line = read_file(f, 0))) {
-				if (!strncmp(line, "From ", 5)) {
-					in_header = 1;
-					f_new++;
-				}
+		utimes(j->fname, foo);
+	}
 
-				if (in_header && (!strncmp(line, "Status: RO", 10) || !strncmp(line, "Status: O", 9)))
-					f_new--;
+#else
+	{
+		struct utimbuf foo;
 
-				line = strip_spaces(line);
+		foo.actime = st.st_atime;
+		foo.modtime = st.st_mtime;
 
-				if (xstrlen(line) == 0)
-					in_header = 0;
-			}
+		utime(j->fname, &foo);
+	}
+#endif
+}
 
-			fclose(f);
+static void mail_mbox_job_free(gpointer data)
+{
+	struct mail_mbox_job *j = data;
 
-#ifdef HAVE_UTIMES
-			{
-				struct timeval foo[2];
+	xfree(j->fname);
+	xfree(j);
+}
 
-				foo[0].tv_sec = st.st_atime;
-				foo[1].tv_sec = st.st_mtime;
+static gboolean mail_mbox_done(gpointer data)
+{
+	GSList *l;
 
-				utimes(m->fname, foo);
-			}
+	/* worker has already queued us, so it's just returning */
+	if (mail_mbox_thread)
+		g_thread_join(mail_mbox_thread);
+	mail_mbox_thread = NULL;
+	mail_mbox_done_id = 0;
 
-#else
-			{
-				struct utimbuf foo;
+	for (l = mail_mbox_jobs; l; l = l->next) {
+		struct mail_mbox_job *j = l->data;
+		list_t ml;
+
+		if (j->rewritten)
+			debug("[mail] %s was rewritten, rescanned\n", j->fname);
 
-				foo.actime = st.st_atime;
-				foo.modtime = st.st_mtime;
+		/* folder list could have been changed in meantime */
+		for (ml = mail_folders; ml; ml = ml->next) {
+			struct mail_folder *m = ml->data;
 
-				utime(m->fname, &foo);
+			if (m->fhash == j->fhash && !xstrcmp(m->fname, j->fname)) {
+				m->mbox = j->st;
+				break;
 			}
+		}
+
+		if (ml)
+			check_mail_set(j->fhash, j->st.count, 1);
+	}
+	check_mail_set(0, 0, 0);
+
+	g_slist_free_full(mail_mbox_jobs, mail_mbox_job_free);
+	mail_mbox_jobs = NULL;
+
+	if (mail_mbox_again) {
+		mail_mbox_again = 0;
+		check_mail_mbox();
+	}
+
+	return FALSE;
+}
+
+static gpointer mail_mbox_worker(gpointer data)
+{
+	GSList *l;
+
+	for (l = mail_mbox_jobs; l; l = l->next)
+		mail_mbox_scan(l->data);
+
+	mail_mbox_done_id = g_idle_add(mail_mbox_done, NULL);
+	return NULL;
+}
+
+/*
+ * mail_mbox_wait()
+ *
+ * czeka na zakoczenie wtku i zapomina jego wyniki.
+ */
+static void mail_mbox_wait()
+{
+	if (mail_mbox_thread)
+		g_thread_join(mail_mbox_thread);
+	mail_mbox_thread = NULL;
+
+	if (mail_mbox_done_id)
+		g_source_remove(mail_mbox_done_id);
+	mail_mbox_done_id = 0;
+
+	g_slist_free_full(mail_mbox_jobs, mail_mbox_job_free);
+	mail_mbox_jobs = NULL;
+	mail_mbox_again = 0;
+}
+
 #endif
 
-			s = saprintf("%d,%d\n", m->fhash, f_new);
+/*
+ * check_mail_mbox()
+ *
+ * odpala wtek, ktry sprawdza wszystkie pliki typu mbox
+ * i liczy, ile jest nowych wiadomoci. sprawdza tylko te
+ * pliki, ktre byy modyfikowane od czasu ostatniego
+ * sprawdzania, a z nich tylko to, co zostao dopisane.
+ *
+ * 0/-1
+ */
+static int check_mail_mbox()
+{
+#ifndef NO_POSIX_SYSTEM
+	list_t l;
 
-			{
-				int sent = 0, left = xstrlen(s);
-				char *ptr = s;
+	if (mail_mbox_jobs) {
+		mail_mbox_again = 1;
+		return 0;
+	}
 
-				while (left > 0) {
-					sent = write(fd[1], ptr, sizeof(ptr));
+	for (l = mail_folders; l; l = l->next) {
+		struct mail_folder *m = l->data;
+		struct mail_mbox_job *j;
+		struct stat st;
 
-					if (sent == -1)
-						break;
+		/* plik mg zosta usunity, uaktualnijmy */
+		if (stat(m->fname, &st)) {
+			if (m->count)
+				check_mail_set(m->fhash, 0, 0);
 
-					left -= sent;
-					ptr += sent;
-				}
-			}
+			m->mtime = 0;
+			m->size = 0;
+			m->check = 0;
+			m->count = 0;
+			memset(&m->mbox, 0, sizeof(m->mbox));
 
-			xfree(s);
+			continue;
+		}
 
-			new += f_new;
-			f_new = 0;
+		if ((st.st_mtime != m->mtime) || (st.st_size != m->size)) {
+			m->mtime = st.st_mtime;
+			m->size = st.st_size;
+			m->check = 1;
+		} else {
+			m->check = 0;
+			continue;
 		}
 
-		close(fd[1]);
-		exit(0);
+		j = xmalloc(sizeof(struct mail_mbox_job));
+		j->fhash = m->fhash;
+		j->fname = xstrdup(m->fname);
+		j->st = m->mbox;
+
+		mail_mbox_jobs = g_slist_prepend(mail_mbox_jobs, j);
 	}
 
-	close(fd[1]);
-	fcntl(fd[0], F_SETFL, O_NONBLOCK);
+	if (!mail_mbox_jobs)
+		return -1;
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+	if (!(mail_mbox_thread = g_thread_try_new("mail", mail_mbox_worker, NULL, NULL)))
+		debug_error("[mail] unable to start mbox scanning thread\n");
+#endif
+	/* no threads, scan it here (results are still delivered from idle) */
+	if (!mail_mbox_thread)
+		mail_mbox_worker(NULL);
 
-	ekg_child_add(&mail_plugin, "mail", pid, NULL, NULL, NULL, NULL);
-	watch_add_line(&mail_plugin, fd[0], WATCH_READ_LINE, mail_handler, NULL);
-	/* XXX czy tutaj potrzebny jest timeout? */
 	return 0;
 #else
 	return -1;
@@ -679,6 +895,9 @@ static void check_mail_free()
 
 static int mail_plugin_destroy()
 {
+#ifndef NO_POSIX_SYSTEM
+	mail_mbox_wait();
+#endif
 	check_mail_free();
 
 #ifdef HAVE_SYS_INOTIFY_H
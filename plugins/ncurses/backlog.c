@@ -313,6 +313,7 @@ int ncurses_backlog_add_real(window_t *w, /*locale*/ fstring_t *str) {
 	n->backlog[0] = str;
 
 	n->backlog_size++;
+	n->backlog_seq++;
 
 	for (i = 0; i < n->lines_count; i++)
 		n->lines[i].backlog++;
@@ -23,6 +23,8 @@
 
 #include "ekg2.h"
 
+#include <string.h>
+
 #include "backlog.h"
 #include "bindings.h"
 #include "contacts.h"
@@ -66,16 +68,34 @@ static inline char *get_short_status(const char *status_t) {
 	return buf;
 }
 
+/*
+ * contacts_sort_t
+ *
+ * entry of contacts list being sorted, with collation key of nickname
+ * computed once, instead of g_utf8_collate() on every comparison.
+ */
+typedef struct {
+	gchar *key;
+	userlist_t *u;
+} contacts_sort_t;
+
 /*
  * contacts_compare()
  *
- * helps list_add_sorted()
+ * helps g_array_sort(), ties are resolved by uid, so the order doesn't
+ * change between updates.
  */
-static int contacts_compare(void *data1, void *data2)
+static int contacts_compare(const void *data1, const void *data2)
 {
-	userlist_t *a = data1, *b = data2;
+	const contacts_sort_t *a = data1, *b = data2;
+	int ret;
+
+	if ((ret = strcmp(a->key, b->key)))
+		return ret;
+	if ((ret = xstrcmp(a->u->uid, b->u->uid)))
+		return ret;
 
-	return g_utf8_collate(a->nickname, b->nickname);
+	return (a->u->priv_data > b->u->priv_data) - (a->u->priv_data < b->u->priv_data);
 }
 
 /*
@@ -93,6 +113,129 @@ static inline userlist_t *userlist_dup(userlist_t *up, const char *uid, char *ni
 	return u;
 }
 
+static void contacts_sort_add(GArray *sorting, userlist_t *u) {
+	contacts_sort_t e;
+
+	e.key	= g_utf8_collate_key(u->nickname, -1);
+	e.u	= u;
+	g_array_append_val(sorting, e);
+}
+
+/*
+ * contacts_row_t
+ *
+ * line of contacts window, already formatted and recoded to locale.
+ * rows are kept in contacts_rows by key (format, arguments and mouse
+ * handler data), so entry is formatted again only when it has changed.
+ */
+typedef struct {
+	char *key;
+	fstring_t *fstr;
+	unsigned int used;		/* contacts_generation, when it was used last time */
+} contacts_row_t;
+
+static GHashTable *contacts_rows = NULL;
+static GPtrArray *contacts_view = NULL;		/* rows shown in contacts window */
+static unsigned int contacts_generation = 0;
+
+#define CONTACTS_REDRAW_INTERVAL 50	/* ms */
+
+static guint contacts_redraw_id = 0;
+static int contacts_redraw_save_pos = 1;
+
+static void contacts_row_free(contacts_row_t *row) {
+	fstring_free(row->fstr);
+	g_free(row->key);
+	g_free(row);
+}
+
+static gboolean contacts_row_unused(gpointer key, gpointer value, gpointer data) {
+	return (((contacts_row_t *) value)->used != contacts_generation);
+}
+
+/*
+ * contacts_row_add()
+ *
+ * appends to @a rows line formatted with @a format, reuses one formatted
+ * earlier if possible. @a priv is used by mouse handler.
+ */
+static void contacts_row_add(GPtrArray *rows, const char *format, const char *arg1, const char *arg2, const char *priv) {
+	contacts_row_t *row;
+	char *key;
+
+	if (!contacts_rows)
+		contacts_rows = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify) contacts_row_free);
+
+	key = g_strconcat(format, "\001", arg1 ? arg1 : "", "\001", arg2 ? arg2 : "", "\001", priv ? priv : "", NULL);
+
+	if (!(row = g_hash_table_lookup(contacts_rows, key))) {
+		fstring_t *fstr = fstring_new_format(format, arg1, arg2);
+
+		row = xmalloc(sizeof(contacts_row_t));
+		row->key = key;
+		row->fstr = ekg_recode_fstr_to_locale(fstr);
+		row->fstr->priv_data = g_strdup(priv);	/* used in mouse handler, do not recode */
+		fstring_free(fstr);
+
+		g_hash_table_insert(contacts_rows, row->key, row);
+	} else
+		g_free(key);
+
+	row->used = contacts_generation;
+	g_ptr_array_add(rows, row);
+}
+
+/*
+ * contacts_view_set()
+ *
+ * replaces content of contacts window with @a rows.
+ *
+ * if rows are the same as shown now, backlog is left untouched.
+ * otherwise it's filled at once, and lines are splitted once,
+ * not after every added line.
+ *
+ * returns 1 if window content was changed.
+ */
+static int contacts_view_set(window_t *w, GPtrArray *rows) {
+	ncurses_window_t *n = w->priv_data;
+	int count = MIN((int) rows->len, config_backlog_size);
+	int changed;
+	int i;
+
+	changed = !contacts_view || contacts_view->len != rows->len || n->backlog_size != count ||
+		(rows->len && memcmp(contacts_view->pdata, rows->pdata, rows->len * sizeof(gpointer)));
+
+	if (changed) {
+		ncurses_clear(w, 1);
+
+		if (count > 0) {
+			n->backlog = xmalloc(count * sizeof(fstring_t *));
+
+			/* backlog[0] is the last line, keep the last config_backlog_size rows, like ncurses_backlog_add() */
+			for (i = 0; i < count; i++) {
+				contacts_row_t *row = g_ptr_array_index(rows, rows->len - 1 - i);
+				fstring_t *fstr = fstring_dup(row->fstr);
+
+				fstr->priv_data = g_strdup(row->fstr->priv_data);
+				n->backlog[i] = fstr;
+			}
+			n->backlog_size = count;
+			n->backlog_seq += count;
+			ncurses_backlog_split(w, 1, 0);
+		}
+	}
+
+	if (contacts_view)
+		g_ptr_array_free(contacts_view, TRUE);
+	contacts_view = rows;
+
+	/* forget rows not shown anymore */
+	if (contacts_rows)
+		g_hash_table_foreach_remove(contacts_rows, contacts_row_unused, NULL);
+
+	return changed;
+}
+
 /*
  * ncurses_contacts_update()
  *
@@ -107,23 +250,27 @@ int ncurses_contacts_update(window_t *w, int save_pos) {
 
 	const char *header = NULL, *footer = NULL;
 	char *group = NULL;
+	int group_id = -1;
 	int j;
 	int all = 0; /* 1 - all, 2 - metacontacts */
 	ncurses_window_t *n;
 	newconference_t *c	= NULL;
-	userlist_t *sorted_all	= NULL;
-	int (*comp)(void *, void *) = NULL;		/* coz userlist's list are sorted we don't need to sort it again...
-								unfortunetly if we create list from serveral userlists (for instance: session && window)
-								we must resort... --- in ekg2 we do
-									list_add_sorted(...., NULL) on session userlist &&
-									list_add_sorted(...., contacts_compare) on window userlist
-							*/
-
+	GPtrArray *sorted_all	= NULL;
+	GPtrArray *rows;
 
 	if (!w) w = window_exist(WINDOW_CONTACTS_ID);
 	if (!w)
 		return -1;
 
+	/* we're updating now, pending update is not needed anymore */
+	if (contacts_redraw_id) {
+		g_source_remove(contacts_redraw_id);
+		contacts_redraw_id = 0;
+	}
+	if (!contacts_redraw_save_pos)
+		save_pos = 0;
+	contacts_redraw_save_pos = 1;
+
 	n = w->priv_data;
 
 	if (save_pos)
@@ -131,7 +278,8 @@ int ncurses_contacts_update(window_t *w, int save_pos) {
 	else
 		old_start = 0;
 
-	ncurses_clear(w, 1);
+	contacts_generation++;
+	rows = g_ptr_array_new();
 
 	if (!session_current)
 		goto kon;
@@ -180,51 +328,25 @@ int ncurses_contacts_update(window_t *w, int save_pos) {
 		footer = format_find("contacts_footer");
 	}
 
-	if (format_ok(header)) {
-		fstring_t *fstr = fstring_new_format(header, group);
-		ncurses_backlog_add(w, fstr);
-		fstring_free(fstr);
-	}
-
-	if (all == 1) {
-		userlist_t *l;
-		session_t *s;
-
-		for (s = sessions; s; s = s->next) {
-			userlist_t *lp;
-
-			if (!s->userlist)
-				continue;
-
-			for (lp = s->userlist; lp; lp = lp->next) {
-				userlist_t *u = lp;
+	if (format_ok(header))
+		contacts_row_add(rows, header, group, NULL, NULL);
 
-				if (!u->nickname)	/* don't add users without nickname.. */
-					continue;
+	/* resolve group once, not for every contact */
+	if (group)
+		group_id = ekg_group_id(group[0] == '!' ? group + 1 : group);
 
-				LIST_ADD_SORTED2(&sorted_all, userlist_dup(u, u->uid, u->nickname, s), comp);
-			}
-
-			comp = contacts_compare;		/* turn on sorting */
-		}
-
-		for (l = c ? c->participants : window_current->userlist; l; l = l->next) {
-			userlist_t *u = l;
-
-			if (!u->nickname)	/* don't add users without nickname.. */
-				continue;
-
-			LIST_ADD_SORTED2(&sorted_all, userlist_dup(u, u->uid, u->nickname, w->session), comp);
-		}
-
-		if (sorted_all) comp = contacts_compare;	/* like above */
-	}
+	sorted_all = g_ptr_array_new();
 
 	if (all == 1 || all == 2) {
+		GArray *sorting = g_array_new(FALSE, FALSE, sizeof(contacts_sort_t));
+		GHashTable *swallowed = NULL;
 		metacontact_t *m;
+		guint k;
 
 		/* Remove contacts contained in metacontacts. */
 		if (all == 1 && config_contacts_metacontacts_swallow) {
+			swallowed = g_hash_table_new(g_str_hash, g_str_equal);
+
 			for (m = metacontacts; m; m = m->next) {
 				metacontact_item_t *i;
 
@@ -235,23 +357,40 @@ int ncurses_contacts_update(window_t *w, int save_pos) {
 */
 				for (i = m->metacontact_items; i; i = i->next) {
 					userlist_t *u;
-					userlist_t *sl;
 
-					if (!(u = userlist_find_n(i->s_uid, i->name)))
-						continue;
+					if ((u = userlist_find_n(i->s_uid, i->name)) && u->uid)
+						g_hash_table_insert(swallowed, (gpointer) u->uid, (gpointer) u->uid);
+				}
+			}
+		}
 
-					for (sl = sorted_all; sl;) {
-						userlist_t *up = sl;
-						userlist_t *next = sl->next;;
+		if (all == 1) {
+			userlist_t *l;
+			session_t *s;
 
-			/* up->uid == u->uid (?) */
-						if (up->uid && !xstrcmp(up->uid, u->uid))
-							LIST_REMOVE2(&sorted_all, up, NULL);
+			for (s = sessions; s; s = s->next) {
+				userlist_t *u;
+
+				for (u = s->userlist; u; u = u->next) {
+					if (!u->nickname)	/* don't add users without nickname.. */
+						continue;
+					if (swallowed && u->uid && g_hash_table_lookup(swallowed, u->uid))
+						continue;
 
-						sl = next;
-					}
+					contacts_sort_add(sorting, userlist_dup(u, u->uid, u->nickname, s));
 				}
 			}
+
+			for (l = c ? c->participants : window_current->userlist; l; l = l->next) {
+				userlist_t *u = l;
+
+				if (!u->nickname)	/* don't add users without nickname.. */
+					continue;
+				if (swallowed && u->uid && g_hash_table_lookup(swallowed, u->uid))
+					continue;
+
+				contacts_sort_add(sorting, userlist_dup(u, u->uid, u->nickname, w->session));
+			}
 		}
 
 		for (m = metacontacts; m; m = m->next) {
@@ -267,34 +406,45 @@ int ncurses_contacts_update(window_t *w, int save_pos) {
 			if (!m->name)	/* don't add metacontacts without name.. */
 				continue;
 
-			LIST_ADD_SORTED2(&sorted_all, userlist_dup(u, NULL, m->name, (void *) 2), comp);
+			contacts_sort_add(sorting, userlist_dup(u, NULL, m->name, (void *) 2));
 		}
-	}
 
-	if (!all) {
-		sorted_all = session_current->userlist;
+		g_array_sort(sorting, contacts_compare);
+
+		for (k = 0; k < sorting->len; k++) {
+			contacts_sort_t *e = &g_array_index(sorting, contacts_sort_t, k);
+
+			g_ptr_array_add(sorted_all, e->u);
+			g_free(e->key);
+		}
+		g_array_free(sorting, TRUE);
+
+		if (swallowed)
+			g_hash_table_destroy(swallowed);
+	} else {
+		userlist_t *l = session_current->userlist;
 
 		if (c && c->participants)
-			sorted_all = c->participants;
+			l = c->participants;
 		else if (window_current->userlist)
-			sorted_all = window_current->userlist;
-	}
+			l = window_current->userlist;
 
-	if (!sorted_all)
-		goto after_loop;	/* it skips this loop below */
+		for (; l; l = l->next)
+			g_ptr_array_add(sorted_all, l);
+	}
 
-	for (j = 0; j < corderlen; /* xstrlen(contacts_order); */ j += 2) {
+	for (j = 0; sorted_all->len && j < corderlen; /* xstrlen(contacts_order); */ j += 2) {
 		const char *footer_status = NULL;
 		int count = 0;
 		char tmp[100];
-		userlist_t *ul;
+		guint k;
 
-		for (ul = sorted_all; ul; ul = ul->next) {
-			userlist_t *u = ul;
+		for (k = 0; k < sorted_all->len; k++) {
+			userlist_t *u = g_ptr_array_index(sorted_all, k);
 
 			const char *status_t;
 			const char *format;
-			fstring_t *string;
+			char *priv;
 
 			if (!u->nickname || !u->status)
 				continue;
@@ -308,19 +458,16 @@ int ncurses_contacts_update(window_t *w, int save_pos) {
 
 			if (group && (!u->priv_data || (void *) 2 != u->priv_data)) {
 				userlist_t *tmp = userlist_find(u->priv_data ? u->priv_data : session_current, u->uid);
-				if ((group[0]=='!' && ekg_group_member(tmp, group+1)) ||
-						(group[0]!='!' && !ekg_group_member(tmp, group)))
+				if ((group[0]=='!' && ekg_group_member_id(tmp, group_id)) ||
+						(group[0]!='!' && !ekg_group_member_id(tmp, group_id)))
 					continue;
 			}
 
 			if (!count) {
 				snprintf(tmp, sizeof(tmp), "contacts_%s_header", status_t);
 				format = format_find(tmp);
-				if (format_ok(format)) {
-					fstring_t *fstr = fstring_new_format(format);
-					ncurses_backlog_add(w, fstr);
-					fstring_free(fstr);
-				}
+				if (format_ok(format))
+					contacts_row_add(rows, format, NULL, NULL, NULL);
 				footer_status = status_t;
 			}
 
@@ -336,17 +483,14 @@ int ncurses_contacts_update(window_t *w, int save_pos) {
 			if (u->typing)
 				xstrcat(tmp, "_typing");
 
-			string = fstring_new_format(format_find(tmp), u->nickname, u->descr);
-
-				/* used in mouse handler, do not recode */
+				/* used in mouse handler */
 			if (u->priv_data == (void *) 2)
-				string->priv_data = g_strdup(u->nickname);
+				priv = g_strdup(u->nickname);
 			else
-				string->priv_data = g_strdup_printf("%s/%s", (u->priv_data) ? ((session_t *) u->priv_data)->uid : session_current->uid, u->nickname);
+				priv = g_strdup_printf("%s/%s", (u->priv_data) ? ((session_t *) u->priv_data)->uid : session_current->uid, u->nickname);
 
-			ncurses_backlog_add(w, string);
-			string->priv_data = NULL; /* XXX: stop freeing this in fstring_free()! */
-			fstring_free(string);
+			contacts_row_add(rows, format_find(tmp), u->nickname, u->descr, priv);
+			g_free(priv);
 
 			count++;
 		}
@@ -357,29 +501,31 @@ int ncurses_contacts_update(window_t *w, int save_pos) {
 			snprintf(tmp, sizeof(tmp), "contacts_%s_footer", footer_status);
 			format = format_find(tmp);
 
-			if (format_ok(format)) {
-				fstring_t *fstr = fstring_new_format(format);
-				ncurses_backlog_add(w, fstr);
-				fstring_free(fstr);
-			}
+			if (format_ok(format))
+				contacts_row_add(rows, format, NULL, NULL, NULL);
 		}
 
 		if (!config_contacts_orderbystate)
 			break;
 	}
 
-after_loop:
-	if (format_ok(footer)) {
-		fstring_t *fstr = fstring_new_format(footer, group);
-		ncurses_backlog_add(w, fstr);
-		fstring_free(fstr);
+	if (format_ok(footer))
+		contacts_row_add(rows, footer, group, NULL, NULL);
+
+	if (all) {
+		guint k;
+
+		for (k = 0; k < sorted_all->len; k++)
+			g_free(g_ptr_array_index(sorted_all, k));
 	}
-	if (all)
-		LIST_DESTROY2(sorted_all, NULL);
+	g_ptr_array_free(sorted_all, TRUE);
 
 	xfree(group);
 
 kon:
+	if (!contacts_view_set(w, rows) && n->start == old_start)
+		return -1;
+
 /* restore old index */
 	n->start = old_start;
 
@@ -396,6 +542,60 @@ kon:
 	return -1;
 }
 
+static gboolean contacts_redraw_timer(gpointer data) {
+	window_t *w;
+
+	contacts_redraw_id = 0;
+
+	if ((w = window_exist(WINDOW_CONTACTS_ID))) {
+		ncurses_contacts_update(w, 1);
+		ncurses_commit();
+	}
+	contacts_redraw_save_pos = 1;
+
+	return FALSE;
+}
+
+/*
+ * ncurses_contacts_schedule()
+ *
+ * marks contacts window as outdated. it'll be updated once, within
+ * CONTACTS_REDRAW_INTERVAL ms, no matter how many userlist changes
+ * come in the meantime (for example: presence of whole roster after
+ * connecting).
+ *
+ * if @a save_pos is 0, position in contacts window will be reset.
+ */
+void ncurses_contacts_schedule(int save_pos) {
+	if (!save_pos)
+		contacts_redraw_save_pos = 0;
+
+	if (!contacts_redraw_id)
+		contacts_redraw_id = g_timeout_add(CONTACTS_REDRAW_INTERVAL, contacts_redraw_timer, NULL);
+}
+
+/*
+ * ncurses_contacts_destroy()
+ *
+ * frees rows cache and removes pending update.
+ */
+void ncurses_contacts_destroy(void) {
+	if (contacts_redraw_id) {
+		g_source_remove(contacts_redraw_id);
+		contacts_redraw_id = 0;
+	}
+
+	if (contacts_view) {
+		g_ptr_array_free(contacts_view, TRUE);
+		contacts_view = NULL;
+	}
+
+	if (contacts_rows) {
+		g_hash_table_destroy(contacts_rows);
+		contacts_rows = NULL;
+	}
+}
+
 /*
  * ncurses_contacts_changed()
  *
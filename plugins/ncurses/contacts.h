@@ -20,6 +20,8 @@ extern int contacts_group_index;
 int ncurses_contacts_update(window_t *w, int save_pos);
 void ncurses_contacts_changed(const char *name);
 void ncurses_contacts_set(window_t *w);
+void ncurses_contacts_schedule(int save_pos);
+void ncurses_contacts_destroy(void);
 
 #endif /* __EKG_NCURSES_CONTACTS_H */
 
@@ -20,26 +20,88 @@
 
 #include "ekg2.h"
 
+#include <ctype.h>
+#include <string.h>
+
 #include "backlog.h"
 #include "mouse.h"
 #include "nc-stuff.h"
 
+#include "lastlog_index.inc"
+
 int config_lastlog_noitems = 0;
 int config_lastlog_case = 0;
 int config_lastlog_display_all = 0;
 
 window_lastlog_t *lastlog_current = NULL;
 
+struct lastlog_state {
+	lastlog_index_t index;
+	lastlog_matches_t matches[2];	/* for lastlog_current, and for w->lastlog */
+};
+
+typedef struct {
+	window_lastlog_t *lastlog;
+	int casense;
+} lastlog_query_t;
+
+static gboolean lastlog_match(const char *str, gpointer data) {
+	lastlog_query_t *q = data;
+
+	if (q->lastlog->isregex)		/* regexp */
+		return g_regex_match(q->lastlog->reg, str, 0, NULL);
+					/* substring */
+	if (q->casense)
+		return !!xstrstr(str, q->lastlog->expression);
+	else
+		return !!xstrcasestr(str, q->lastlog->expression);
+}
+
+/*
+ * ncurses_lastlog_forget()
+ *
+ * frees lastlog matches and index of window, called when its backlog is cleared.
+ */
+void ncurses_lastlog_forget(ncurses_window_t *n) {
+	struct lastlog_state *st = n->lastlog_state;
+
+	if (!st)
+		return;
+
+	lastlog_index_clear(&st->index);
+	lastlog_matches_clear(&st->matches[0]);
+	lastlog_matches_clear(&st->matches[1]);
+	g_free(st);
+	n->lastlog_state = NULL;
+}
+
+/* regex is compiled with case of the moment, compile it again if lastlog_matchcase was changed since then */
+static void lastlog_regex_case(window_lastlog_t *lastlog, int casense) {
+	GRegexCompileFlags flags = g_regex_get_compile_flags(lastlog->reg);
+	GRegex *reg;
+
+	if (!(flags & G_REGEX_CASELESS) != !casense)
+		return;
+
+	if ((reg = g_regex_new(g_regex_get_pattern(lastlog->reg), flags ^ G_REGEX_CASELESS, 0, NULL))) {
+		g_regex_unref(lastlog->reg);
+		lastlog->reg = reg;
+	}
+}
+
 static int ncurses_ui_window_lastlog(window_t *lastlog_w, window_t *w) {
 	const char *header;
 
 	ncurses_window_t *n;
 	window_lastlog_t *lastlog;
+	lastlog_matches_t *m;
+	lastlog_query_t q;
+	char *literal;
 
 	int local_config_lastlog_case;
 
 	int items = 0;
-	int i;
+	guint i;
 
 	static int lock = 0;
 
@@ -80,19 +142,27 @@ static int ncurses_ui_window_lastlog(window_t *lastlog_w, window_t *w) {
 
 	local_config_lastlog_case = (lastlog->casense == -1) ? config_lastlog_case : lastlog->casense;
 
-	for (i = n->backlog_size-1; i >= 0; i--) {
-		gboolean found = FALSE;
+	if (lastlog->isregex)
+		lastlog_regex_case(lastlog, local_config_lastlog_case);
 
-		if (lastlog->isregex) {		/* regexp */
-			found = g_regex_match(lastlog->reg, n->backlog[i]->str, 0, NULL);
-		} else {				/* substring */
-			if (local_config_lastlog_case)
-				found = !!xstrstr(n->backlog[i]->str, lastlog->expression);
-			else	
-				found = !!xstrcasestr(n->backlog[i]->str, lastlog->expression);
-		}
+	/* only lines added since the last time are checked */
+	if (!n->lastlog_state)
+		n->lastlog_state = g_new0(struct lastlog_state, 1);
+	m = &n->lastlog_state->matches[lastlog == lastlog_current ? 0 : 1];
+
+	q.lastlog = lastlog;
+	q.casense = local_config_lastlog_case;
+	literal = lastlog->isregex ? lastlog_regex_literal(lastlog->expression) : NULL;
 
-		if (!config_lastlog_noitems && found && !items) { /* add header only when found */
+	lastlog_matches_update(m, &n->lastlog_state->index, lastlog->expression, lastlog->isregex, local_config_lastlog_case,
+			lastlog->isregex ? literal : lastlog->expression, lastlog_match, &q, n->backlog, n->backlog_size, n->backlog_seq);
+	g_free(literal);
+
+	/* the oldest first */
+	for (i = 0; i < m->matches->len; i++) {
+		fstring_t *line = n->backlog[n->backlog_seq - 1 - g_array_index(m->matches, guint, i)];
+
+		if (!config_lastlog_noitems && !items) { /* add header only when found */
 			gchar *titleexpr = ekg_recode_from_locale(lastlog->expression);
 			fstring_t *fstr = fstring_new_format(header, window_target(w), titleexpr);
 			ncurses_backlog_add(lastlog_w, fstr);
@@ -100,10 +170,8 @@ static int ncurses_ui_window_lastlog(window_t *lastlog_w, window_t *w) {
 			g_free(titleexpr);
 		}
 
-		if (found) {
-			ncurses_backlog_add_real(lastlog_w, fstring_dup(n->backlog[i]));
-			items++;
-		}
+		ncurses_backlog_add_real(lastlog_w, fstring_dup(line));
+		items++;
 	}
 	return items;
 }
@@ -268,9 +336,9 @@ COMMAND(ncurses_cmd_lastlog) {
 		GError *err = NULL;
 		char *tmp = ekg_recode_to_locale(str);
 
-		/* XXX, when config_lastlog_case is toggled.. we need to recompile regex's */
+		/* when lastlog_matchcase is toggled, it's compiled again in lastlog_regex_case() */
 		/* XXX, this won't really work -- we run regex in raw mode, backlog is not utf */
-		if (!lastlog->casense || (lastlog->casense == -1 && !config_lastlog_case))
+		if (!iscase || (iscase == -1 && !config_lastlog_case))
 			flags |= G_REGEX_CASELESS;
 
 		if (!((lastlog->reg = g_regex_new(tmp, flags, 0, &err)))) {
@@ -54,6 +54,7 @@ int config_text_bottomalign		= 0;
 static int config_traditional_clear	= 1;
 
 static int redraw_timer_id = 0;
+static int redraw_pending = 0;		/* redraw_timer() couldn't commit, window was locked */
 
 int ncurses_initialized;
 int ncurses_plugin_destroyed;
@@ -92,26 +93,52 @@ static int dd_contacts(const char *name)
 	return (config_contacts);
 }
 
+/*
+ * ncurses_commit_needed()
+ *
+ * tells if there's something drawn (or to be drawn by ncurses_refresh())
+ * which wasn't sent to terminal yet.
+ */
+static int ncurses_commit_needed(void) {
+	window_t *w;
+
+	if (redraw_pending)
+		return 1;
+
+	for (w = windows; w; w = w->next) {
+		ncurses_window_t *n = w->priv_data;
+
+		if (n && n->redraw && (w == window_current || (w->floating && !w->hide)))
+			return 1;
+	}
+	return 0;
+}
+
 /**
  * ncurses_statusbar_timer()
  *
  * Timer, executed every second.
- * It call update_statusbar(1)
+ * It call ncurses_statusbar_refresh(), and commits only if statusbar
+ * has changed (or something else waits for commit).
  *
- * @sa update_statusbar()
+ * @sa ncurses_statusbar_refresh()
  *
  * @return 0	[permanent timer]
  */
 
 static TIMER(ncurses_statusbar_timer) {
 	if (type) return 0;
-	update_statusbar(1);
+	if (ncurses_statusbar_refresh() || ncurses_commit_needed()) {
+		redraw_pending = 0;
+		ncurses_commit();
+	}
 	return 0;
 }
 
 static QUERY(ncurses_statusbar_query)
 {
-	update_statusbar(1);
+	if (ncurses_statusbar_refresh())
+		ncurses_commit();
 	return 0;
 }
 
@@ -185,6 +212,8 @@ static int redraw_timer(gpointer data) {
 		ncurses_redraw(w);
 		if (w->lock == 0)
 			ncurses_commit();
+		else
+			redraw_pending = 1;
 	}
 
 	redraw_timer_id = 0;
@@ -274,7 +303,8 @@ static QUERY(ncurses_ui_window_kill)
 
 static QUERY(ncurses_ui_window_act_changed)
 {
-	update_statusbar(1);
+	if (ncurses_statusbar_refresh())
+		ncurses_commit();
 
 	return 0;
 }
@@ -331,14 +361,11 @@ static QUERY(ncurses_ui_window_clear)
 /* podanie NULL jako data do ncurses_all_contacts_changed() nie spowoduje zmiany polozenia userlisty (co wcale nie znaczy ze bedzie pokazywac na stary element) */
 static QUERY(ncurses_all_contacts_changed)
 {
-	window_t *w;
-
 /*	ncurses_contacts_changed(data); */
 
-	if ((w = window_exist(WINDOW_CONTACTS_ID))) {
-		ncurses_contacts_update(w, !data);
-		ncurses_commit();
-	}
+	/* there can be lots of them in a row (i.e. after connecting), redraw once */
+	if (window_exist(WINDOW_CONTACTS_ID))
+		ncurses_contacts_schedule(!data);
 	return 0;
 }
 
@@ -381,8 +408,7 @@ static QUERY(ncurses_conference_renamed)
 
 	for (w = windows; w; w = w->next) {
 		if (w->target && !xstrcasecmp(w->target, oldname)) {
-			xfree(w->target);
-			w->target = xstrdup(newname);
+			window_target_set(w, newname);
 			ncurses_prompt_set(w, newname);
 		}
 	}
@@ -676,6 +702,8 @@ EXPORT int ncurses_plugin_init(int prio)
 	query_connect(&ncurses_plugin, "session-removed", ncurses_statusbar_query, NULL);
 	query_connect(&ncurses_plugin, "session-event", ncurses_statusbar_query, NULL);
 	query_connect(&ncurses_plugin, "session-renamed", ncurses_statusbar_query, NULL);
+	query_connect(&ncurses_plugin, "userlist-changed", ncurses_statusbar_query, NULL);
+	query_connect(&ncurses_plugin, "userlist-refresh", ncurses_statusbar_query, NULL);
 	query_connect(&ncurses_plugin, "binding-set", ncurses_binding_set_query, NULL);
 	query_connect(&ncurses_plugin, "binding-command", ncurses_binding_adddelete_query, NULL);
 	query_connect(&ncurses_plugin, "binding-default", ncurses_binding_default, NULL);
@@ -830,6 +858,8 @@ static int ncurses_plugin_destroy()
 	timer_remove(&ncurses_plugin, "ncurses:clock");
 	if (redraw_timer_id>0)
 		g_source_remove(redraw_timer_id);
+	ncurses_contacts_destroy();
+	ncurses_statusbar_destroy();
 
 	ncurses_deinit();
 	g_free(ncurses_hellip);
@@ -695,6 +695,7 @@ void ncurses_clear(window_t *w, int full)
 		n->backlog = NULL;
 		n->backlog_size = 0;
 	}
+	ncurses_lastlog_forget(n);
 
 	if (n->lines) {
 		int i;
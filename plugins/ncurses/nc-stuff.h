@@ -18,6 +18,8 @@ extern int ncurses_plugin_destroyed;
 #define ncurses_current ((ncurses_window_t *) window_current->priv_data)
 
 void update_statusbar(int commit);
+int ncurses_statusbar_refresh(void);
+void ncurses_statusbar_destroy(void);
 
 struct screen_line { /* everything locale-encoded */
 	int len;		/* line length */
@@ -56,6 +58,9 @@ typedef struct {
 
 	fstring_t **backlog;	/* buffer with lines */
 	int backlog_size;	/* backlog size */
+	guint backlog_seq;	/* number of lines ever added to backlog, see lastlog.c */
+	struct lastlog_state *lastlog_state;
+				/* lastlog matches and index, NULL if never searched */
 
 	int redraw;		/* does it have to be redrawn before display */
 
@@ -117,6 +122,7 @@ extern int config_text_bottomalign;
 
 int ncurses_lastlog_update(window_t *w);
 void ncurses_lastlog_new(window_t *w);
+void ncurses_lastlog_forget(ncurses_window_t *n);
 extern int config_lastlog_size;
 extern int config_lastlog_lock;
 extern int config_mark_on_window_change;
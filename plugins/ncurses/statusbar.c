@@ -52,6 +52,24 @@ static inline int color_pair_bold(int fg, int bold, int bg) {
 		return color_pair(fg, bg);
 }
 
+static GByteArray *printat_drawn = NULL;	/* what window_printat() draws goes here too */
+
+static inline void printat_addch(WINDOW *w, unsigned char ch) {
+	waddch(w, ch);
+	if (printat_drawn)
+		g_byte_array_append(printat_drawn, &ch, 1);
+}
+
+static inline void printat_attrset(WINDOW *w, int attr) {
+	wattrset(w, attr);
+	if (printat_drawn) {
+		guint8 tmp[1 + sizeof(int)] = { 0 };	/* '\0' is never drawn */
+
+		memcpy(&tmp[1], &attr, sizeof(int));
+		g_byte_array_append(printat_drawn, tmp, sizeof(tmp));
+	}
+}
+
 
 /*
  * window_printat()
@@ -76,7 +94,7 @@ static void window_printat(WINDOW *w, const /*locale*/ char *format, /*locale*/
 		int i, nest;
 
 		if (*p != '%') {
-			waddch(w, (unsigned char) *p);
+			printat_addch(w, *p);
 			p++;
 			continue;
 		}
@@ -118,7 +136,7 @@ static void window_printat(WINDOW *w, const /*locale*/ char *format, /*locale*/
 			}
 			p++;
 
-			wattrset(w, color_pair_bold(fgcolor, bold, bgcolor));
+			printat_attrset(w, color_pair_bold(fgcolor, bold, bgcolor));
 
 			continue;
 		}
@@ -174,9 +192,9 @@ static void window_printat(WINDOW *w, const /*locale*/ char *format, /*locale*/
 						}
 
 						text++;
-						wattrset(w, color_pair_bold(fgcolor, bold, bgcolor));
+						printat_attrset(w, color_pair_bold(fgcolor, bold, bgcolor));
 					} else {
-						waddch(w, (unsigned char) *text);
+						printat_addch(w, *text);
 						text++;
 					}
 				}
@@ -235,11 +253,13 @@ next:
 	}
 }
 
-static char *ncurses_window_activity(void) {
-	string_t s = string_init("");
+/* puts activity of windows into @a s, returns 0 if there isn't any */
+static int ncurses_window_activity(string_t s) {
 	int act = 0;
 	window_t *w;
 
+	string_clear(s);
+
 	for (w = windows; w; w = w->next) {
 		char tmp[36];
 
@@ -271,231 +291,397 @@ static char *ncurses_window_activity(void) {
 		act = 1;
 	}
 
-	if (!act) {
-		string_free(s, 1);
-		return NULL;
-	} else
-		return string_free(s, 0);
+	return act;
 }
 
-static void reprint_statusbar(WINDOW *w, int y, const gchar *format, /*locale*/ struct format_data *data) {
+#include "statusbar_fields.inc"
+
+#define STATUSBAR_LINES 5		/* max header_size and statusbar_size */
+
+enum {
+	STATUSBAR_TIME = 0,
+	STATUSBAR_WINDOW,
+	STATUSBAR_SESSION,
+	STATUSBAR_DESCR,
+	STATUSBAR_QUERY,
+	STATUSBAR_QUERY_NICKNAME,
+	STATUSBAR_DEBUG,
+	STATUSBAR_MORE,
+	STATUSBAR_MAIL,
+	STATUSBAR_IRCTOPIC,
+	STATUSBAR_IRCTOPICBY,
+	STATUSBAR_IRCMODE,
+	STATUSBAR_ACTIVITY,
+
+	STATUSBAR_AWAY,
+	STATUSBAR_AVAIL,
+	STATUSBAR_DND,
+	STATUSBAR_CHAT,
+	STATUSBAR_XA,
+	STATUSBAR_GONE,
+	STATUSBAR_INVISIBLE,
+	STATUSBAR_NOTAVAIL,
+
+	STATUSBAR_QUERY_AWAY,
+	STATUSBAR_QUERY_AVAIL,
+	STATUSBAR_QUERY_INVISIBLE,
+	STATUSBAR_QUERY_NOTAVAIL,
+	STATUSBAR_QUERY_DND,
+	STATUSBAR_QUERY_CHAT,
+	STATUSBAR_QUERY_XA,
+	STATUSBAR_QUERY_GONE,
+	STATUSBAR_QUERY_BLOCKING,
+	STATUSBAR_QUERY_ERROR,
+	STATUSBAR_QUERY_UNKNOWN,
+	STATUSBAR_TYPING,
+	STATUSBAR_QUERY_DESCR,
+	STATUSBAR_QUERY_IP,
+
+	STATUSBAR_URL,
+	STATUSBAR_VERSION,
+
+	STATUSBAR_FIELDS
+};
+
+/* in order of enum above */
+static statusbar_field_t statusbar_fields[STATUSBAR_FIELDS] = {
+	{ "time", 1 },
+	{ "window", 0 },
+	{ "session", 0 },
+	{ "descr", 0 },
+	{ "query", 0 },
+	{ "query_nickname", 0 },
+	{ "debug", 0 },
+	{ "more", 0 },
+	{ "mail", 0 },
+	{ "irctopic", 1 },
+	{ "irctopicby", 0 },
+	{ "ircmode", 0 },
+	{ "activity", 1 },
+
+	{ "away", 0 },
+	{ "avail", 0 },
+	{ "dnd", 0 },
+	{ "chat", 0 },
+	{ "xa", 0 },
+	{ "gone", 0 },
+	{ "invisible", 0 },
+	{ "notavail", 0 },
+
+	{ "query_away", 0 },
+	{ "query_avail", 0 },
+	{ "query_invisible", 0 },
+	{ "query_notavail", 0 },
+	{ "query_dnd", 0 },
+	{ "query_chat", 0 },
+	{ "query_xa", 0 },
+	{ "query_gone", 0 },
+	{ "query_blocking", 0 },
+	{ "query_error", 0 },
+	{ "query_unknown", 0 },
+	{ "typing", 0 },
+	{ "query_descr", 0 },
+	{ "query_ip", 0 },
+
+	{ "url", 0 },
+	{ "version", 0 },
+};
+
+static const struct {
+	int status;
+	int field;
+} statusbar_session_statuses[] = {
+	{ EKG_STATUS_AWAY,	STATUSBAR_AWAY },
+	{ EKG_STATUS_AVAIL,	STATUSBAR_AVAIL },
+	{ EKG_STATUS_DND,	STATUSBAR_DND },
+	{ EKG_STATUS_FFC,	STATUSBAR_CHAT },
+	{ EKG_STATUS_XA,	STATUSBAR_XA },
+	{ EKG_STATUS_GONE,	STATUSBAR_GONE },
+	{ EKG_STATUS_INVISIBLE,	STATUSBAR_INVISIBLE },
+	{ EKG_STATUS_NA,	STATUSBAR_NOTAVAIL },		/* XXX, session shouldn't be connected here */
+}, statusbar_query_statuses[] = {
+	{ EKG_STATUS_AWAY,	STATUSBAR_QUERY_AWAY },
+	{ EKG_STATUS_AVAIL,	STATUSBAR_QUERY_AVAIL },
+	{ EKG_STATUS_INVISIBLE,	STATUSBAR_QUERY_INVISIBLE },
+	{ EKG_STATUS_NA,	STATUSBAR_QUERY_NOTAVAIL },
+	{ EKG_STATUS_DND,	STATUSBAR_QUERY_DND },
+	{ EKG_STATUS_FFC,	STATUSBAR_QUERY_CHAT },
+	{ EKG_STATUS_XA,	STATUSBAR_QUERY_XA },
+	{ EKG_STATUS_GONE,	STATUSBAR_QUERY_GONE },
+	{ EKG_STATUS_BLOCKED,	STATUSBAR_QUERY_BLOCKING },
+	{ EKG_STATUS_ERROR,	STATUSBAR_QUERY_ERROR },
+	{ EKG_STATUS_UNKNOWN,	STATUSBAR_QUERY_UNKNOWN },
+};
+
+static statusbar_line_t header_lines[STATUSBAR_LINES];
+static statusbar_line_t status_lines[STATUSBAR_LINES];
+static statusbar_clock_t statusbar_clock;
+
+static string_t statusbar_query = NULL;		/* for %{query}, reused */
+static string_t statusbar_activity = NULL;	/* for %{activity}, reused */
+
+#define statusbar_set(x, set, value) statusbar_field_set(&statusbar_fields[x], set, value)
+
+static int reprint_statusbar(WINDOW *w, int y, const /*locale*/ char *format, /*locale*/ struct format_data *data, statusbar_line_t *l) {
+	static GByteArray *drawn = NULL;
 	int backup_display_color = config_display_color;
-	char *tmp;
+	int x, maxx;
 
-	if (!w)
-		return;
+	if (!w || !format)
+		return 0;
+
+	if (!drawn)
+		drawn = g_byte_array_new();
+	g_byte_array_set_size(drawn, 0);
 
 	if (config_display_color == 2)
 		config_display_color = 0;
 
-	wattrset(w, color_pair(COLOR_WHITE, COLOR_BLUE));
+	printat_drawn = drawn;
+	printat_attrset(w, color_pair(COLOR_WHITE, COLOR_BLUE));
 
 	wmove(w, y, 0);
-	tmp = ekg_recode_to_locale(format);
-	window_printat(w, tmp, data, COLOR_WHITE, 0, COLOR_BLUE);
-	g_free(tmp);
+	window_printat(w, format, data, COLOR_WHITE, 0, COLOR_BLUE);
+	printat_drawn = NULL;
+
+	x = getcurx(w);
+	mvwhline(w, y, x, ' ', w->_maxx);
 
-	mvwhline(w, y, getcurx(w), ' ', w->_maxx);
+	/* where the rest was cleared, and how wide it is */
+	maxx = w->_maxx;
+	g_byte_array_append(drawn, (guint8 *) &x, sizeof(x));
+	g_byte_array_append(drawn, (guint8 *) &maxx, sizeof(maxx));
 
 	config_display_color = backup_display_color;
+
+	return statusbar_line_drawn(l, drawn);
+}
+
+/* format of line @a y of header or statusbar */
+static const char *statusbar_line_find(const char *prefix, int y) {
+	char name[16];
+	const char *p;
+
+	g_snprintf(name, sizeof(name), "%s%d", prefix, y + 1);
+	p = format_find(name);
+
+	if (!y && !format_ok(p))
+		p = format_find(prefix);
+
+	return p;
 }
 
 /*
- * update_statusbar()
- *
- * uaktualnia pasek stanu i wywietla go ponownie.
+ * statusbar_update()
  *
- *  - commit - czy wywietli od razu?
+ * sets all fields of statusbar, from what they're made of.
+ * text of the ones which have changed is made again.
  */
-void update_statusbar(int commit)
-{
-	static const char empty_format[] = "";
+static void statusbar_update(void) {
 	static int connecting_counter = 0;
 
-	struct format_data formats[32];	/* if someone add his own format increment it. */
-	int formats_count = 0, i = 0, y;
 	session_t *sess = window_current->session;
 	userlist_t *q = userlist_find(sess, window_current->target);
+	const char *ts = format_find("statusbar_timestamp");
+	time_t now = time(NULL);
 
-	char *query_tmp;
 	char *irctopic, *irctopicby, *ircmode;
-	int mail_count;
-
-	wattrset(ncurses_status, color_pair(COLOR_WHITE, COLOR_BLUE));
-	if (ncurses_header)
-		wattrset(ncurses_header, color_pair(COLOR_WHITE, COLOR_BLUE));
-
-	/* inicjalizujemy wszystkie opisowe bzdurki */
-#define __add_format_(x, z, p) \
-	{ \
-		formats[formats_count].name = x; \
-		formats[formats_count].text = z; \
-		formats[formats_count].percent_ok = p; \
-		formats_count++; \
-	}
-
-#define __add_format(x, y, z) \
-	{ \
-		char *tmp = y; \
-		__add_format_(x, ekg_recode_to_locale(tmp), z); \
-		g_free(tmp); \
+	char *ip = NULL;
+	int mail_count, online, ok, y;
+	guint i;
+
+	if (statusbar_clock_due(&statusbar_clock, ts, now))
+		statusbar_set(STATUSBAR_TIME, 1, format_ok(ts) ? timestamp_time(ts, now) : "");
+
+	statusbar_set(STATUSBAR_WINDOW, 1, window_current->id ? ekg_itoa(window_current->id) : NULL);
+	statusbar_set(STATUSBAR_SESSION, 1, sess ? (sess->alias ? sess->alias : sess->uid) : NULL);
+	statusbar_set(STATUSBAR_DESCR, 1, (sess && sess->descr && sess->connected) ? sess->descr : NULL);
+
+	if (sess && q && q->nickname) {
+		if (!statusbar_query)
+			statusbar_query = string_init(NULL);
+		string_clear(statusbar_query);
+		string_append(statusbar_query, q->nickname);
+		string_append_c(statusbar_query, '/');
+		string_append(statusbar_query, q->uid);
+
+		statusbar_set(STATUSBAR_QUERY, 1, statusbar_query->str);
+		statusbar_set(STATUSBAR_QUERY_NICKNAME, 1, q->nickname);
+	} else {
+		const char *name = window_current->alias ? window_current->alias : window_current->target;
+
+		statusbar_set(STATUSBAR_QUERY, 1, name);
+		statusbar_set(STATUSBAR_QUERY_NICKNAME, 1, name);
 	}
 
-#define __add_format_emp(x, y)		__add_format_(x, y ? (char*) empty_format : NULL, 0)
-#define __add_format_dup(x, y, z)	__add_format_(x, y ? ekg_recode_to_locale(z) : NULL, 0)
-
-	__add_format("time", xstrdup(timestamp(format_find("statusbar_timestamp"))), 1);
-
-	__add_format_dup("window", window_current->id, ekg_itoa(window_current->id));
-	__add_format_dup("session", (sess), (sess->alias) ? sess->alias : sess->uid);
-	__add_format_dup("descr", (sess && sess->descr && sess->connected), sess->descr);
-
-	query_tmp = (sess && q && q->nickname) ? saprintf("%s/%s", q->nickname, q->uid) : xstrdup(window_current->alias ? window_current->alias : window_current->target);
-	__add_format("query", query_tmp, 0);
-	__add_format("query_nickname", (sess && q && q->nickname) ? xstrdup(q->nickname) : xstrdup(window_current->alias ? window_current->alias : window_current->target), 0);
-
-	__add_format_emp("debug", (!window_current->id));
-	__add_format_emp("more", (window_current->more));
+	statusbar_set(STATUSBAR_DEBUG, 1, !window_current->id ? "" : NULL);
+	statusbar_set(STATUSBAR_MORE, 1, window_current->more ? "" : NULL);
 
+	/* plugins don't tell when these change, ask every time */
 	mail_count = -1;
-	if (query_emit(NULL, "mail-count", &mail_count) != -2)
-		__add_format_dup("mail", (mail_count > 0), ekg_itoa(mail_count));
+	ok = (query_emit(NULL, "mail-count", &mail_count) != -2);
+	statusbar_set(STATUSBAR_MAIL, ok, (mail_count > 0) ? ekg_itoa(mail_count) : NULL);
 
 	irctopic = irctopicby = ircmode = NULL;
-	if (query_emit(NULL, "irc-topic", &irctopic, &irctopicby, &ircmode) != -2) {
-		__add_format("irctopic", irctopic, 1);
-		__add_format("irctopicby", irctopicby, 0);
-		__add_format("ircmode", ircmode, 0);
+	ok = (query_emit(NULL, "irc-topic", &irctopic, &irctopicby, &ircmode) != -2);
+	statusbar_set(STATUSBAR_IRCTOPIC, ok, irctopic);
+	statusbar_set(STATUSBAR_IRCTOPICBY, ok, irctopicby);
+	statusbar_set(STATUSBAR_IRCMODE, ok, ircmode);
+	xfree(irctopic);
+	xfree(irctopicby);
+	xfree(ircmode);
+
+	if (!statusbar_activity)
+		statusbar_activity = string_init(NULL);
+	ok = ncurses_window_activity(statusbar_activity);
+	statusbar_set(STATUSBAR_ACTIVITY, 1, ok ? statusbar_activity->str : NULL);
+
+	online = (sess && (sess->connected || (sess->connecting && connecting_counter)));
+	for (i = 0; i < G_N_ELEMENTS(statusbar_session_statuses); i++) {
+		int status = statusbar_session_statuses[i].status;
+
+		statusbar_set(statusbar_session_statuses[i].field, online ? (sess->status == status) : (status == EKG_STATUS_NA), "");
 	}
 
-	__add_format("activity", ncurses_window_activity(), 1);
-
-	if (sess && (sess->connected || (sess->connecting && connecting_counter))) {
-#define __add_format_emp_st(x, y) case y: __add_format_(x, (char *) empty_format, 0) break
-		switch (sess->status) {
-				/* XXX: rewrite? */
-			__add_format_emp_st("away", EKG_STATUS_AWAY);
-			__add_format_emp_st("avail", EKG_STATUS_AVAIL);
-			__add_format_emp_st("dnd", EKG_STATUS_DND);
-			__add_format_emp_st("chat", EKG_STATUS_FFC);
-			__add_format_emp_st("xa", EKG_STATUS_XA);
-			__add_format_emp_st("gone", EKG_STATUS_GONE);
-			__add_format_emp_st("invisible", EKG_STATUS_INVISIBLE);
-
-			__add_format_emp_st("notavail", EKG_STATUS_NA);		/* XXX, session shouldn't be connected here */
-			default: ;
-		}
-#undef __add_format_emp_st
-	} else
-		__add_format_emp("notavail", 1);
-
 	if (sess && sess->connecting) /* statusbar update shall be called at least once per second */
 		connecting_counter ^= 1;
 
+	for (i = 0; i < G_N_ELEMENTS(statusbar_query_statuses); i++)
+		statusbar_set(statusbar_query_statuses[i].field, (q && q->status == statusbar_query_statuses[i].status), "");
+
 	if (q) {
 		int __ip = user_private_item_get_int(q, "ip");
-		char *ip = __ip ? inet_ntoa(*((struct in_addr*) &__ip)) : NULL;;
-#define __add_format_emp_st(x, y) case y: __add_format_("query_" x, (char *) empty_format, 0); break
-		switch (q->status) {
-				/* XXX: rewrite? */
-			__add_format_emp_st("away", EKG_STATUS_AWAY);
-			__add_format_emp_st("avail", EKG_STATUS_AVAIL);
-			__add_format_emp_st("invisible", EKG_STATUS_INVISIBLE);
-			__add_format_emp_st("notavail", EKG_STATUS_NA);
-			__add_format_emp_st("dnd", EKG_STATUS_DND);
-			__add_format_emp_st("chat", EKG_STATUS_FFC);
-			__add_format_emp_st("xa", EKG_STATUS_XA);
-			__add_format_emp_st("gone", EKG_STATUS_GONE);
-			__add_format_emp_st("blocking", EKG_STATUS_BLOCKED);
-			__add_format_emp_st("error", EKG_STATUS_ERROR);
-			__add_format_emp_st("unknown", EKG_STATUS_UNKNOWN);
-			default: ;
-		}
-#undef __add_format_emp_st
-
-		__add_format_emp("typing", q->typing);
-
-		__add_format_dup("query_descr", (q->descr1line), q->descr1line);
 
-		__add_format_dup("query_ip", 1, ip);
+		ip = __ip ? inet_ntoa(*((struct in_addr*) &__ip)) : NULL;
 	}
 
-	__add_format_dup("url", 1, "http://www.ekg2.org/");
-	__add_format_dup("version", 1, VERSION);
+	statusbar_set(STATUSBAR_TYPING, !!q, (q && q->typing) ? "" : NULL);
+	statusbar_set(STATUSBAR_QUERY_DESCR, !!q, q ? q->descr1line : NULL);
+	statusbar_set(STATUSBAR_QUERY_IP, !!q, ip);
 
-	__add_format(NULL, NULL, 0);	/* NULL-terminator */
+	statusbar_set(STATUSBAR_URL, 1, "http://www.ekg2.org/");
+	statusbar_set(STATUSBAR_VERSION, 1, VERSION);
 
-#undef __add_format_emp
-#undef __add_format_dup
-#undef __add_format
-#undef __add_format_
+	for (y = 0; y < MIN(config_header_size, STATUSBAR_LINES); y++)
+		statusbar_line_format(&header_lines[y], statusbar_line_find("header", y));
 
-	for (y = 0; y < config_header_size; y++) {
-		const char *p;
+	for (y = 0; y < MIN(config_statusbar_size, STATUSBAR_LINES); y++)
+		statusbar_line_format(&status_lines[y], statusbar_line_find("statusbar", y));
 
-		if (!y) {
-			p = format_find("header1");
+	/* what debug lines show isn't tracked */
+	if (ncurses_debug)
+		statusbar_changed = 1;
+}
 
-			if (!format_ok(p))
-				p = format_find("header");
-		} else {
-			char *tmp = saprintf("header%d", y + 1);
-			p = format_find(tmp);
-			xfree(tmp);
-		}
+/*
+ * statusbar_draw()
+ *
+ * draws header and statusbar, returns 1 if they look different than before.
+ */
+static int statusbar_draw(void) {
+	struct format_data formats[STATUSBAR_FIELDS + 1];
+	session_t *sess = window_current->session;
+	int count = 0, changed = 0, y;
+	guint i;
 
-		reprint_statusbar(ncurses_header, y, p, formats);
+	for (i = 0; i < STATUSBAR_FIELDS; i++) {
+		if (!statusbar_fields[i].set)
+			continue;
+
+		formats[count].name = (char *) statusbar_fields[i].name;
+		formats[count].text = statusbar_fields[i].text;
+		formats[count].percent_ok = statusbar_fields[i].percent_ok;
+		count++;
 	}
+	formats[count].name = NULL;	/* NULL-terminator */
+	formats[count].text = NULL;
 
-	for (y = 0; y < config_statusbar_size; y++) {
-		const char *p;
+	wattrset(ncurses_status, color_pair(COLOR_WHITE, COLOR_BLUE));
+	if (ncurses_header)
+		wattrset(ncurses_header, color_pair(COLOR_WHITE, COLOR_BLUE));
 
-		if (!y) {
-			p = format_find("statusbar1");
+	for (y = 0; y < MIN(config_header_size, STATUSBAR_LINES); y++)
+		changed |= reprint_statusbar(ncurses_header, y, header_lines[y].text, formats, &header_lines[y]);
 
-			if (!format_ok(p))
-				p = format_find("statusbar");
-		} else {
-			char *tmp = saprintf("statusbar%d", y + 1);
-			p = format_find(tmp);
-			xfree(tmp);
-		}
+	for (y = 0; y < MIN(config_statusbar_size, STATUSBAR_LINES); y++) {
+		char *debug = NULL, *tmp;
 
 		switch (ncurses_debug) {
-			char *tmp;
-			case 0:
-				reprint_statusbar(ncurses_status, y, p, formats);
-				break;
-
 			case 1:
-				tmp = saprintf(" debug: lines_count=%d start=%d height=%d overflow=%d screen_width=%d", ncurses_current->lines_count, ncurses_current->start, window_current->height, ncurses_current->overflow, ncurses_screen_width);
-				reprint_statusbar(ncurses_status, y, tmp, formats);
-				xfree(tmp);
+				debug = saprintf(" debug: lines_count=%d start=%d height=%d overflow=%d screen_width=%d", ncurses_current->lines_count, ncurses_current->start, window_current->height, ncurses_current->overflow, ncurses_screen_width);
 				break;
 
 			case 2:
-				tmp = saprintf(" debug: lines(count=%d,start=%d,index=%d), line(start=%d,index=%d)", ncurses_lines ? g_strv_length((char **) ncurses_lines) : 0, lines_start, lines_index, line_start, line_index);
-				reprint_statusbar(ncurses_status, y, tmp, formats);
-				xfree(tmp);
+				debug = saprintf(" debug: lines(count=%d,start=%d,index=%d), line(start=%d,index=%d)", ncurses_lines ? g_strv_length((char **) ncurses_lines) : 0, lines_start, lines_index, line_start, line_index);
 				break;
 
 			case 3:
-				tmp = saprintf(" debug: session=%p uid=%s alias=%s / target=%s session_current->uid=%s", sess, (sess && sess->uid) ? sess->uid : "", (sess && sess->alias) ? sess->alias : "", (window_current->target) ? window_current->target : "", (session_current && session_current->uid) ? session_current->uid : "");
-				reprint_statusbar(ncurses_status, y, tmp, formats);
-				xfree(tmp);
+				debug = saprintf(" debug: session=%p uid=%s alias=%s / target=%s session_current->uid=%s", sess, (sess && sess->uid) ? sess->uid : "", (sess && sess->alias) ? sess->alias : "", (window_current->target) ? window_current->target : "", (session_current && session_current->uid) ? session_current->uid : "");
 				break;
 		}
-	}
 
-	for (i = 0; i < formats_count; i++) {
-		if (formats[i].text != empty_format)
-			xfree(formats[i].text);
+		if (!debug) {
+			changed |= reprint_statusbar(ncurses_status, y, status_lines[y].text, formats, &status_lines[y]);
+			continue;
+		}
+
+		tmp = ekg_recode_to_locale(debug);
+		changed |= reprint_statusbar(ncurses_status, y, tmp, formats, &status_lines[y]);
+		g_free(tmp);
+		xfree(debug);
 	}
 
+	return changed;
+}
+
+/*
+ * update_statusbar()
+ *
+ * uaktualnia pasek stanu i wywietla go ponownie.
+ *
+ *  - commit - czy wywietli od razu?
+ */
+void update_statusbar(int commit)
+{
+	statusbar_refresh_with(statusbar_update, statusbar_draw, 1);
+
 	if (commit)
 		ncurses_commit();
 }
 
+/*
+ * ncurses_statusbar_refresh()
+ *
+ * like update_statusbar(0), but header and statusbar are drawn only if
+ * something they show has changed (so when nothing happens, timer doesn't
+ * draw anything).
+ *
+ * returns 1 if they look different, and ncurses_commit() is needed.
+ */
+int ncurses_statusbar_refresh(void)
+{
+	return statusbar_refresh_with(statusbar_update, statusbar_draw, 0);
+}
+
+/*
+ * ncurses_statusbar_destroy()
+ *
+ * frees fields and everything remembered about header and statusbar.
+ */
+void ncurses_statusbar_destroy(void)
+{
+	statusbar_fields_clear(statusbar_fields, STATUSBAR_FIELDS);
+	statusbar_lines_clear(header_lines, STATUSBAR_LINES);
+	statusbar_lines_clear(status_lines, STATUSBAR_LINES);
+	statusbar_clock_clear(&statusbar_clock);
+
+	if (statusbar_query)
+		string_free(statusbar_query, 1);
+	if (statusbar_activity)
+		string_free(statusbar_activity, 1);
+	statusbar_query = statusbar_activity = NULL;
+}
+
 /*
  * header_statusbar_resize()
  *
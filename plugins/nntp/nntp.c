@@ -358,13 +358,7 @@ typedef enum {
 	NNTP_DOWNLOADING,
 } nntp_newsgroup_state_t;
 
-typedef struct {
-	int artid;
-	char *msgid;
-	int new;
-	string_t header;
-	string_t body;
-} nntp_article_t;
+#include "nntp_pipeline.inc"
 
 typedef struct {
 	char *uid;
@@ -376,7 +370,7 @@ typedef struct {
 	int fart;	/* first article in the group		*/
 	int cart;	/* current artcile (downloading)	*/
 	int lart;	/* last article				*/
-	list_t articles;/* list of articles, nntp_article_t	*/
+	nntp_articles_t articles;	/* by number and message-id	*/
 } nntp_newsgroup_t;
 
 typedef struct {
@@ -385,36 +379,34 @@ typedef struct {
 	int lock;
 	int authed;
 
-	int last_code;			/* last code */
 	nntp_newsgroup_t *newsgroup;	/* current newsgroup */
 
-	string_t buf;
+	nntp_reader_t reader;		/* response being read */
+	nntp_pipeline_t pipeline;	/* requests sent and to be sent */
 	list_t newsgroups;
 
 	watch_t *send_watch;
 } nntp_private_t;
 
-static nntp_article_t *nntp_article_find(nntp_newsgroup_t *group, int articleid, char *msgid) {
-	nntp_article_t *article;
-	list_t l;
+/* overview cache of group: nntp/<session>/<group>.overview */
+static const char *nntp_overview_path(session_t *s, nntp_newsgroup_t *group) {
+	char *sess = xstrdup(s->uid), *name = xstrdup(group->name);
+	const char *path;
 
-	for (l = group->articles; l; l = l->next) {
-		article = l->data;
+	g_strdelimit(sess, "/", '_');
+	g_strdelimit(name, "/", '_');
+	path = prepare_pathf("nntp/%s/%s.overview", sess, name);
 
-		if (article->artid == articleid) {
-			if (!article->msgid && msgid) article->msgid = xstrdup(msgid);
-			return article;
-		}
-	}
-	article		= xmalloc(sizeof(nntp_article_t));
-	article->new	= 1;
-	article->artid	= articleid;
-	article->msgid	= xstrdup(msgid);
-	article->header	= string_init(NULL);
-	article->body	= string_init(NULL);
-
-	list_add(&group->articles, article);
-	return article;
+	xfree(sess);
+	xfree(name);
+	return path;
+}
+
+static void nntp_overview_store(session_t *s, nntp_newsgroup_t *group) {
+	const char *path = nntp_overview_path(s, group);
+
+	if (mkdir_recursive(path, 0) || nntp_overview_save(&group->articles, path, NNTP_OVERVIEW_MAX))
+		debug_error("nntp_overview_store() %s: can't write %s\n", group->name, path);
 }
 
 static nntp_newsgroup_t *nntp_newsgroup_find(session_t *s, const char *name) {
@@ -435,6 +427,9 @@ static nntp_newsgroup_t *nntp_newsgroup_find(session_t *s, const char *name) {
 	newsgroup->uid	= saprintf("nntp:%s", name);
 	newsgroup->name = xstrdup(name);
 
+	nntp_articles_init(&newsgroup->articles);
+	nntp_overview_load(&newsgroup->articles, nntp_overview_path(s, newsgroup));
+
 	list_add(&(j->newsgroups), newsgroup);
 	return newsgroup;
 }
@@ -457,7 +452,8 @@ static void nntp_handle_disconnect(session_t *s, const char *reason, int type) {
 		j->newsgroup->state = NNTP_IDLE;
 	j->newsgroup = NULL;
 
-	j->last_code	= -1;
+	nntp_pipeline_clear(&j->pipeline);
+	nntp_reader_reset(&j->reader);
 	j->authed	= 0;
 
 	j->connecting = 0;
@@ -509,6 +505,41 @@ fail:
 	xfree(d);
 }
 
+static void nntp_write(const char *line, void *data) {
+	nntp_private_t *j = data;
+
+	watch_write(j->send_watch, "%s\r\n", line);
+}
+
+/*
+ * nntp_send()
+ *
+ * queues command (without \r\n), it's sent when pipeline has room for it.
+ * @a first and @a last are numbers of articles it's about.
+ */
+static void nntp_send(session_t *s, nntp_request_type_t type, int first, int last, const char *format, ...) {
+	nntp_private_t *j = nntp_private(s);
+	va_list ap;
+
+	va_start(ap, format);
+	nntp_pipeline_add(&j->pipeline, type, first, last, g_strdup_vprintf(format, ap));
+	va_end(ap);
+
+	nntp_pipeline_send(&j->pipeline, nntp_write, j);
+}
+
+/* ARTICLE, HEAD or BODY, whatever display_mode needs, NULL if nothing */
+static const char *nntp_article_command(session_t *s) {
+	switch (session_int_get(s, "display_mode")) {
+		case -1:
+		case 0:	return NULL;
+		case 2:	return "HEAD";
+		case 3:
+		case 4:	return "ARTICLE";
+	}
+	return "BODY";
+}
+
 #define NNTP_HANDLER(x) static int x(session_t *s, int code, char *str, void *data)
 typedef int (*nntp_handler) (session_t *, int, char *, void *);
 
@@ -543,28 +574,29 @@ NNTP_HANDLER(nntp_message_process) {			/* 220, 221, 222 */
 
 	if (!(mbody = split_line(&str))) return -1;
 
-	tmpbody = array_make(mbody, " ", 3, 1, 0);		/* header [id <message-id> type] */
-
-	if (!tmpbody || !tmpbody[0] || !tmpbody[1] || !tmpbody[2]) {
-		debug("nntp_message_process() tmpbody? mbody: %s\n", mbody);
-		g_strfreev(tmpbody);
+	if (!j->newsgroup) {
+		debug("nntp_message_process() j->newsgroup == NULL!!!!\n");
 		return -1;
 	}
 
-	if (!(art = nntp_article_find(j->newsgroup, atoi(tmpbody[0]), tmpbody[1]))) {
-		debug("nntp_message_process nntp_article_find() failed\n");
+	tmpbody = array_make(mbody, " ", 3, 1, 0);		/* header [id <message-id> [type]] */
+
+	if (!tmpbody || !tmpbody[0] || !tmpbody[1]) {
+		debug("nntp_message_process() tmpbody? mbody: %s\n", mbody);
 		g_strfreev(tmpbody);
 		return -1;
 	}
 
+	art = nntp_article_get(&j->newsgroup->articles, atoi(tmpbody[0]), tmpbody[1]);
+
 	if (article_headers)	string_clear(art->header);
 	if (article_body)	string_clear(art->body);
 
 	if (article_headers && article_body) {
 		char *tmp;
-		if ((tmp = xstrchr(str, '\r'))) {
-			string_append_n(art->header, str, tmp-str-1);
-			str = tmp + 2;		/* +\r\n */
+		if ((tmp = xstrstr(str, "\n\n"))) {
+			string_append_n(art->header, str, tmp-str);
+			str = tmp + 2;		/* +\n\n */
 		} else {
 			debug("ERROR, It's really article_headers with article_body?!\n");
 		}
@@ -701,9 +733,7 @@ NNTP_HANDLER(nntp_message_process) {			/* 220, 221, 222 */
 		query_emit(NULL, "nntp-message", &(s->uid), &uid, &sheaders, &headers, &artid, &(art->msgid), &body, &(art->new), &modify);
 	}
 
-	if (j->newsgroup) {
-		j->newsgroup->state = NNTP_IDLE;
-	} else debug("nntp_message_process() j->newsgroup == NULL!!!!\n");
+	j->newsgroup->state = NNTP_IDLE;
 
 	g_strfreev(tmpbody);
 	return 0;
@@ -724,10 +754,10 @@ NNTP_HANDLER(nntp_auth_process) {
 			xfree(tmp);
 
 			if (!j->authed && session_get(s, "username"))
-				watch_write(j->send_watch, "AUTHINFO USER %s\r\n", session_get(s, "username"));
+				nntp_send(s, NNTP_REQ_COMMAND, 0, 0, "AUTHINFO USER %s", session_get(s, "username"));
 			break;
 		case 381:
-			watch_write(j->send_watch, "AUTHINFO PASS %s\r\n", session_get(s, "password"));
+			nntp_send(s, NNTP_REQ_COMMAND, 0, 0, "AUTHINFO PASS %s", session_get(s, "password"));
 			break;
 		case 281:
 			j->authed = 1;
@@ -756,7 +786,11 @@ NNTP_HANDLER(nntp_group_process) {
 	group		= nntp_newsgroup_find(s, p[3]);
 	group->fart	= atoi(p[1]);
 	group->lart	= atoi(p[2]);
-	if (!group->cart) group->cart = group->lart;
+
+	/* the first check: from what we've checked before (overview cache), or only new ones */
+	if (!group->cart) group->cart = group->articles.hwm ? group->articles.hwm : group->lart;
+	if (group->cart > group->lart)		group->cart = group->lart;	/* renumbered? */
+	if (group->cart < group->fart - 1)	group->cart = group->fart - 1;	/* expired */
 
 	if ((u = userlist_find(s, group->uid))) {
 		if (u->status == EKG_STATUS_AWAY) {
@@ -793,61 +827,83 @@ NNTP_HANDLER(nntp_group_error) {
 	return 0;
 }
 
-NNTP_HANDLER(nntp_xover_process) {
-	debug("xover: %s\n", str);
+NNTP_HANDLER(nntp_xover_process) {			/* 224 */
+	nntp_private_t *j	= nntp_private(s);
+	int mode		= session_int_get(s, "display_mode");
+	char *line;
+
+	if (!j->newsgroup) return -1;
+
+	split_line(&str);		/* status line */
+
+	while ((line = split_line(&str))) {
+		nntp_article_t *art;
+
+		if (!(art = nntp_overview_add(&j->newsgroup->articles, line))) {
+			debug("nntp_xover_process() bad line: %s\n", line);
+			continue;
+		}
+
+		/* articles won't be downloaded, notify about them now */
+		if ((mode == 0 || mode == -1) && art->new) {
+			char *uid	= j->newsgroup->uid;
+			char *sheaders	= NULL;
+			char *headers	= NULL;
+			char *body	= NULL;
+			char *artid	= (char *) ekg_itoa(art->artid);
+			int modify	= 0;
+
+			query_emit(NULL, "nntp-message", &(s->uid), &uid, &sheaders, &headers, &artid, &(art->msgid), &body, &(art->new), &modify);
+		}
+	}
 	return 0;
 }
 
 typedef	struct {
 	int		num;
 	nntp_handler	handler;
-	int is_multi;
 	void *data;
 } nntp_handler_t;
 
-nntp_handler_t nntp_handlers[] = {
-	{100, nntp_help_process,	1, NULL},
-	{200, nntp_auth_process,	0, NULL},
-	{201, nntp_auth_process,	0, NULL},
-	{281, nntp_auth_process,	0, NULL},
-	{381, nntp_auth_process,	0, NULL},
-	{480, nntp_auth_process,	0, NULL},
-
-	{220, nntp_message_process,	1, NULL},
-	{221, nntp_message_process,	1, NULL},
-	{222, nntp_message_process,	1, NULL},
-	{423, nntp_message_error,	0, NULL},
-
-	{211, nntp_group_process,	0, NULL},
-	{411, nntp_group_error,		0, NULL},
-
-	{224, nntp_xover_process,	1, "xover"},
-
-	{282, nntp_null_process,	1, "xgitle"},
-	{-1, NULL,			0, NULL},
+static nntp_handler_t nntp_handlers[] = {
+	{100, nntp_help_process,	NULL},
+	{200, nntp_auth_process,	NULL},
+	{201, nntp_auth_process,	NULL},
+	{281, nntp_auth_process,	NULL},
+	{381, nntp_auth_process,	NULL},
+	{480, nntp_auth_process,	NULL},
+
+	{220, nntp_message_process,	NULL},
+	{221, nntp_message_process,	NULL},
+	{222, nntp_message_process,	NULL},
+	{412, nntp_message_error,	NULL},
+	{420, nntp_message_error,	NULL},
+	{423, nntp_message_error,	NULL},
+	{430, nntp_message_error,	NULL},
+
+	{211, nntp_group_process,	NULL},
+	{411, nntp_group_error,		NULL},
+
+	{224, nntp_xover_process,	NULL},
+
+	{282, nntp_null_process,	"xgitle"},
+	{-1, NULL,			NULL},
 };
 
-static void nntp_string_append(session_t *s, const char *str) {
-	nntp_private_t *j	= nntp_private(s);
-	string_t buf		= j->buf;
-
-	string_append(buf, str);
-	string_append_c(buf, '\n');
-}
+static nntp_handler_t *nntp_handlers_by_code[600];	/* filled by nntp_init() */
 
 static nntp_handler_t *nntp_handler_find(int code) {
-	int i;
-	for (i = 0; nntp_handlers[i].num != -1; i++) {
-		if (nntp_handlers[i].num == code) return &(nntp_handlers[i]);
-	}
-	return NULL;
+	if (code < 0 || code >= (int) G_N_ELEMENTS(nntp_handlers_by_code))
+		return NULL;
+	return nntp_handlers_by_code[code];
 }
 
 static WATCHER_LINE(nntp_handle_stream) {
 	session_t *s = session_find(data);
 	nntp_private_t *j = nntp_private(s);
 
-	char **p;
+	nntp_handler_t *handler;
+	nntp_request_t *req;
 
 	if (type == 1) {
 		nntp_handle_disconnect(s, strerror(errno), EKG_DISCONNECT_NETWORK);
@@ -857,46 +913,32 @@ static WATCHER_LINE(nntp_handle_stream) {
 
 	if (!watch || !s) return -1;
 
-	if (j->last_code != -1) {
-		nntp_handler_t *handler = nntp_handler_find(j->last_code);
-
-		if (!xstrcmp(watch, ".")) {
-			int res = -1;
-
-			if (handler && handler->is_multi) res = handler->handler(s, j->last_code, j->buf->str, handler->data);
-
-			debug("nntp_handlers() retval: %d code: %d\n", res, j->last_code);
-
-			string_clear(j->buf);
-			j->last_code = -1;
-			if (res != -1) return 0;
-		}
-
-		if (handler && handler->is_multi) {
-			nntp_string_append(s, watch);
+	switch (nntp_reader_line(&j->reader, watch)) {
+		case NNTP_RESPONSE_PARTIAL:
 			return 0;
-		}
+		case NNTP_RESPONSE_INVALID:
+			debug("nntp_handle_stream() buf: %s\n", watch);
+			return 0;
+		case NNTP_RESPONSE_DONE:
+			break;
 	}
 
-	if ((p = array_make(watch, " ", 2, 1, 0)) && p[0] && atoi(p[0])) {
-		int code = atoi(p[0]);
+	/* responses come in order, it's for the oldest request sent */
+	req = nntp_pipeline_current(&j->pipeline);
 
-		nntp_handler_t *handler = nntp_handler_find(code);
+	if ((handler = nntp_handler_find(j->reader.code))) {
+		int res = handler->handler(s, j->reader.code, j->reader.buf->str, handler->data);
 
-		if (handler && handler->is_multi) {
-			nntp_string_append(s, p[1]);
-			j->last_code = code;
-		} else if (handler) {
-			handler->handler(s, code, p[1], handler->data);
-			j->last_code = code;
-		} else {
-			debug("nntp_handle_stream() unhandled: %d (%s)\n", code, p[1]);
-		}
-	} else {
-		debug("nntp_handle_stream() buf: %s (last: %d)\n", watch, j->last_code);
-	}
-	g_strfreev(p);
+		debug("nntp_handlers() retval: %d code: %d request: %s\n", res, j->reader.code, req && req->line ? req->line : "-");
+	} else
+		debug("nntp_handle_stream() unhandled: %d (%s)\n", j->reader.code, j->reader.buf->str);
 
+	/* handler could have disconnected us */
+	if (!j->send_watch)
+		return 0;
+
+	nntp_pipeline_done(&j->pipeline);
+	nntp_pipeline_send(&j->pipeline, nntp_write, j);
 	return 0;
 }
 
@@ -923,6 +965,10 @@ static WATCHER(nntp_handle_connect) {
 
 	watch_add_line(&nntp_plugin, fd, WATCH_READ_LINE, nntp_handle_stream, xstrdup(data));
 	j->send_watch = watch_add_line(&nntp_plugin, fd, WATCH_WRITE_LINE, NULL, NULL);
+
+	/* server talks first, nothing is sent till it greets us */
+	nntp_pipeline_add(&j->pipeline, NNTP_REQ_GREETING, 0, 0, NULL);
+	nntp_pipeline_send(&j->pipeline, nntp_write, j);
 	return -1;
 }
 
@@ -935,7 +981,7 @@ static COMMAND(nntp_command_disconnect)
 		return -1;
 	}
 
-	if (session_connected_get(session))
+	if (session_connected_get(session))		/* we don't wait for response */
 		watch_write(j->send_watch, "QUIT\r\n");
 
 	if (j->connecting)
@@ -989,14 +1035,13 @@ static COMMAND(nntp_command_connect) {
 }
 
 static COMMAND(nntp_command_raw) {
-	nntp_private_t *j = nntp_private(session);
-	watch_write(j->send_watch, "%s\r\n", params[0]);
+	nntp_send(session, NNTP_REQ_COMMAND, 0, 0, "%s", params[0]);
 	return 0;
 }
 
 static COMMAND(nntp_command_nextprev) {
 	nntp_private_t *j = nntp_private(session);
-	int mode = session_int_get(session, "display_mode");
+	const char *comm = nntp_article_command(session);
 
 	if (!j->newsgroup) {
 		printq("invalid_params", name, "???");	/* XXX */
@@ -1005,10 +1050,8 @@ static COMMAND(nntp_command_nextprev) {
 	if (!xstrcmp(name, "next"))	j->newsgroup->article++;
 	else				j->newsgroup->article--;
 
-	if (mode == 2)				watch_write(j->send_watch, "HEAD %d\r\n", j->newsgroup->article);
-	else if (mode == 3 || mode == 4)	watch_write(j->send_watch, "ARTICLE %d\r\n", j->newsgroup->article);
-	else if (mode == 0 || mode == -1)	;
-	else					watch_write(j->send_watch, "BODY %d\r\n", j->newsgroup->article);
+	if (comm)
+		nntp_send(session, NNTP_REQ_ARTICLE, j->newsgroup->article, j->newsgroup->article, "%s %d", comm, j->newsgroup->article);
 
 	return 0;
 }
@@ -1041,25 +1084,34 @@ static COMMAND(nntp_command_get) {
 	if (!j->newsgroup || xstrcmp(j->newsgroup->name, group)) {
 /* zmienic grupe na target jesli != aktualnej .. */
 		j->newsgroup = nntp_newsgroup_find(session, group);
-		watch_write(j->send_watch, "GROUP %s\r\n", group);
+		nntp_send(session, NNTP_REQ_GROUP, 0, 0, "GROUP %s", group);
 	}
 
 	j->newsgroup->article = atoi(article);
 
-				art = nntp_article_find(j->newsgroup, j->newsgroup->article, NULL);
+				art = nntp_article_get(&j->newsgroup->articles, j->newsgroup->article, NULL);
 	if (!art->new)		art->new = 3;	/* turn on display flag. */
 			/* XXX, wyswietlic artykul z kesza ? */
 
 	if (!xstrcmp(name, "body")) comm = "BODY";
 
-	watch_write(j->send_watch, "%s %s\r\n", comm, article);
+	nntp_send(session, NNTP_REQ_ARTICLE, j->newsgroup->article, j->newsgroup->article, "%s %s", comm, article);
 	return 0;
 }
 
-static COMMAND(nntp_command_check) {
+/* runs main loop till all requests are answered (or we're disconnected) */
+static void nntp_wait(session_t *s) {
 	extern void ekg_loop();
 
+	nntp_private_t *j = nntp_private(s);
+
+	while (nntp_pipeline_busy(&j->pipeline) && session_connected_get(s))
+		ekg_loop();
+}
+
+static COMMAND(nntp_command_check) {
 	nntp_private_t *j = nntp_private(session);
+	const char *comm = nntp_article_command(session);
 	userlist_t *ul;
 
 	if (j->lock) {
@@ -1081,34 +1133,36 @@ static COMMAND(nntp_command_check) {
 
 		j->newsgroup	= n;
 		n->state	= NNTP_CHECKING;
-		watch_write(j->send_watch, "GROUP %s\r\n", n->name);
+		nntp_send(session, NNTP_REQ_GROUP, 0, 0, "GROUP %s", n->name);
 
-		while (n->state == NNTP_CHECKING) ekg_loop();
+		nntp_wait(session);
+		if (!session_connected_get(session)) break;
 		if (u->status == EKG_STATUS_ERROR) continue;
 
-		if (n->cart == n->lart) {	/* nothing new */
+		if (n->cart >= n->lart) {	/* nothing new */
 			nntp_set_status(u, EKG_STATUS_DND);
 			continue;
 		}
 
-		for (i = n->cart+1; i <= n->lart; i++) {
-			int mode = session_int_get(session, "display_mode");
-
-			n->state	= NNTP_DOWNLOADING;
-			j->newsgroup	= n;
-			nntp_set_descr(u, saprintf("Downloading %d article from %d", i, n->lart));
+		/* overview of new articles first (and cached), then articles; all pipelined */
+		n->state	= NNTP_DOWNLOADING;
+		nntp_set_descr(u, saprintf("Downloading articles %d-%d", n->cart + 1, n->lart));
 
-			if (mode == 2)				watch_write(j->send_watch, "HEAD %d\r\n", i);
-			else if (mode == 3 || mode == 4)	watch_write(j->send_watch, "ARTICLE %d\r\n", i);
-			else if (mode == 0 || mode == -1)	;
-			else					watch_write(j->send_watch, "BODY %d\r\n", i);
+		for (i = n->cart + 1; i <= n->lart; i += NNTP_OVERVIEW_CHUNK) {
+			int last = MIN(i + NNTP_OVERVIEW_CHUNK - 1, n->lart);
 
-			while (n->state == NNTP_DOWNLOADING) ekg_loop();
+			nntp_send(session, NNTP_REQ_OVERVIEW, i, last, "XOVER %d-%d", i, last);
 		}
+		for (i = n->cart + 1; comm && i <= n->lart; i++)
+			nntp_send(session, NNTP_REQ_ARTICLE, i, i, "%s %d", comm, i);
+
+		nntp_wait(session);
 		n->state		= NNTP_IDLE;
+		if (!session_connected_get(session)) break;
 
 		nntp_set_statusdescr(u, EKG_STATUS_AVAIL, saprintf("%d new articles", n->lart - n->cart));
-		j->newsgroup->cart = n->lart;
+		n->cart = n->articles.hwm = n->lart;
+		nntp_overview_store(session, n);
 
 		if (params[0]) break;
 	}
@@ -1151,14 +1205,39 @@ static COMMAND(nntp_command_unsubscribe) {
 
 void *nntp_protocol_init() {
 	nntp_private_t *p	= xmalloc(sizeof(nntp_private_t));
-	p->buf			= string_init(NULL);
+	p->fd			= -1;
+	nntp_reader_init(&p->reader);
+	nntp_pipeline_init(&p->pipeline, NNTP_PIPELINE_WINDOW);
 	return p;
 }
 
 void nntp_protocol_deinit(void *priv) {
+	nntp_private_t *j = priv;
+	list_t l;
+
+	if (!j)
+		return;
+
+	for (l = j->newsgroups; l; l = l->next) {
+		nntp_newsgroup_t *n = l->data;
+
+		nntp_articles_free(&n->articles);
+		xfree(n->uid);
+		xfree(n->name);
+	}
+	list_destroy(j->newsgroups, 1);
+
+	nntp_reader_free(&j->reader);
+	nntp_pipeline_free(&j->pipeline);
+	xfree(j);
 }
 
 void nntp_init() {
+	int i;
+
+	for (i = 0; nntp_handlers[i].num != -1; i++)
+		nntp_handlers_by_code[nntp_handlers[i].num] = &nntp_handlers[i];
+
 /*XXX,	:msg -- wysylanie wiadomosc na serwer... BE CAREFULL cause news aren't IM ;) */
 	command_add(&nntp_plugin, ("nntp:connect"), "?",	nntp_command_connect, NNTP_ONLY, NULL);
 	command_add(&nntp_plugin, ("nntp:disconnect"), "?", nntp_command_disconnect, NNTP_ONLY, NULL);
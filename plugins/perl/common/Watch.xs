@@ -5,11 +5,10 @@ PROTOTYPES: ENABLE
 
 void watches()
 PREINIT:
-	list_t l;
+	watch_t *w;
 PPCODE:
-        for (l = watches; l; l = l->next) {
-		watch_t *w = l->data;
-		if (w)
+        for (w = watches; w; w = w->next) {
+		if (!w->destroyed)
 			XPUSHs(sv_2mortal(bless_watch( w )));
         }
 
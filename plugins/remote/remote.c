@@ -705,12 +705,10 @@ static rc_input_t *rc_input_find(const char *path)
 }
 
 static watch_t *rc_watch_find(int fd) {
-	list_t l;
+	watch_t *w;
 	
-	for (l = watches; l; l = l->next) {
-		watch_t *w = l->data;
-
-		if (w && w->plugin == &remote_plugin && w->fd == fd)
+	for (w = watches; w; w = w->next) {
+		if (!w->destroyed && w->plugin == &remote_plugin && w->fd == fd)
 			return w;
 	}
 
@@ -1329,6 +1327,22 @@ static QUERY(remote_userlist_changed) {
 	return 0;
 }
 
+static QUERY(remote_userlist_changed_session) {
+	session_t *s = *(va_arg(ap, session_t **));
+	char *uid = *(va_arg(ap, char **));
+
+	userlist_t *u;
+
+	if (!(u = userlist_find(s, uid))) {
+		debug_error("remote_userlist_changed_session(%s, %s) damn!\n", s->uid, uid);
+		return 0;
+	}
+
+	remote_broadcast("USERINFO", s->uid, u->uid, ekg_itoa(u->status), u->descr, NULL);
+
+	return 0;
+}
+
 static QUERY(remote_userlist_refresh) {
 	/* ze wstepnej analizy wynika ze ulubionym query po userlist_add() jest emitowanie USERLIST_REFRESH...
 	 * bez parametrow, najwygodniejsze, 
@@ -1543,6 +1557,7 @@ EXPORT int remote_plugin_init(int prio) {
 	query_connect(&remote_plugin, "session-renamed", remote_session_renamed, NULL);
 
 	query_connect(&remote_plugin, "userlist-changed", remote_userlist_changed, NULL);
+	query_connect(&remote_plugin, "userlist-changed-session", remote_userlist_changed_session, NULL);
 	query_connect(&remote_plugin, "userlist-refresh", remote_userlist_refresh, NULL);
 #if 0
 
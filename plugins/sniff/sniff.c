@@ -32,6 +32,7 @@
 #include <arpa/inet.h>
 
 #include "sniff_ip.h"
+#include "sniff_flow.h"
 #include "sniff_gg.h"
 #include "sniff_dns.h"
 #include "sniff_rivchat.h"
@@ -41,16 +42,17 @@ PLUGIN_DEFINE(sniff, PLUGIN_PROTOCOL, sniff_theme_init);
 
 #define SNAPLEN 2000
 #define PROMISC 0
-
-#define GET_DEV(s) ((pcap_t *) ((session_t *) s)->priv)
+#define DISPATCH_BATCH 256	/* max packets handled by one watch wakeup */
 
 typedef struct {
-	struct in_addr srcip;
-	guint16 srcport;
+	pcap_t *dev;
+	sniff_flows_t flows;
+} sniff_private_t;
+
+#define GET_DEV(s) (((sniff_private_t *) ((session_t *) s)->priv)->dev)
+#define GET_FLOWS(s) (&((sniff_private_t *) ((session_t *) s)->priv)->flows)
 
-	struct in_addr dstip;
-	guint16 dstport;
-} connection_t;
+#include "sniff_flow.inc"
 
 static char *build_code(const unsigned char *code) {
 	static char buf[100];
@@ -133,46 +135,17 @@ static connection_t *sniff_udp_get(const struct iphdr *ip, const struct udphdr *
 	return &d;
 }
 
-/* XXX, make it only session-visible */
-static list_t tcp_connections;
-
-/* XXX, sniff_tcp_close_connection(connection_t *) */
-
-static connection_t *sniff_tcp_find_connection(const struct iphdr *ip, const struct tcphdr *tcp) {
-#if 0
-	connection_t *d;
-	list_t l;
-
-	for (l = tcp_connections; l; l = l->next) {
-		connection_t *c = l->data;
+static void sniff_private_free(session_t *s) {
+	sniff_private_t *j = s->priv;
 
-		if (	c->srcip.s_addr == ip->ip_src.s_addr && c->srcport == g_ntohs(tcp->th_sport) &&
-			c->dstip.s_addr == ip->ip_dst.s_addr && c->dstport == g_ntohs(tcp->th_dport)) 
-				return c;
-
-		if (	c->srcip.s_addr == ip->ip_dst.s_addr && c->srcport == g_ntohs(tcp->th_dport) &&
-			c->dstip.s_addr == ip->ip_src.s_addr && c->dstport == g_ntohs(tcp->th_sport))
-				return c;
-	}
-
-	d	= xmalloc(sizeof(connection_t));
-
-	d->srcip	= ip->ip_src;
-	d->srcport	= g_ntohs(tcp->th_sport);
-	
-	d->dstip	= ip->ip_dst;
-	d->dstport	= g_ntohs(tcp->th_dport);
+	if (!j)
+		return;
 
-	list_add(&tcp_connections, d, 0);
-#endif
-	static connection_t d;
-	
-	d.srcip		= ip->ip_src;
-	d.srcport	= g_ntohs(tcp->th_sport);
+	pcap_close(j->dev);
+	sniff_flows_destroy(&j->flows);
+	xfree(j);
 
-	d.dstip		= ip->ip_dst;
-	d.dstport	= g_ntohs(tcp->th_dport);
-	return &d;
+	s->priv = NULL;
 }
 
 static void tcp_print_payload(u_char *payload, size_t len) {
@@ -256,50 +229,13 @@ typedef enum {
 	}
 
 
-/* XXX, some notes about tcp fragment*
- *		@ sniff_loop_tcp() we'll do: sniff_find_tcp_connection(connection_t *hdr);
- *		it'll find (or create) struct with inited string_t buf...
- *		than we append to that string_t recv data from packet, and than pass this to sniff_gg() [or anyother sniff handler]
- *		than in sniff_loop() we'll remove already data.. [of length len, len returned from sniff_gg()]
- */
+/* tcp stream dissector, called by sniff_flow_feed() with reassembled data,
+ *	returns number of bytes consumed, -1 if frame is incomplete, or 0 if it's unknown protocol */
 
-static inline void sniff_loop_tcp(session_t *s, int len, const u_char *packet, const struct iphdr *ip, int size_ip) {
-	/* XXX here, make some struct with known TCP services, and demangler-function */
-	const struct tcphdr *tcp;
-	int size_tcp;
-	connection_t *hdr;
+#define SNIFF_GG_MAX_LEN	65536	/* longer gg frame means it's not gg */
 
-	const char *payload;
-	int size_payload;
-
-	CHECK_LEN(sizeof(struct tcphdr))	tcp = (struct tcphdr*) (packet);
-	size_tcp = TH_OFF(tcp)*4;
-
-	if (size_tcp < 20) {
-		debug_error("sniff_loop_tcp()	* Invalid TCP header length: %u bytes\n", size_tcp);
-		return;
-	}
-
-	size_payload = g_ntohs(ip->ip_len) - (size_ip + size_tcp);
-
-	CHECK_LEN(size_tcp + size_payload);
-
-	payload = (char *) (packet + size_tcp);
-
-	hdr = sniff_tcp_find_connection(ip, tcp);
-
-	debug_function("sniff_loop_tcp() IP/TCP %15s:%5d <==> %15s:%5d %s (SEQ: %lx ACK: %lx len: %d)\n", 
-			_inet_ntoa(hdr->srcip),		/* src ip */
-			hdr->srcport,			/* src port */
-			_inet_ntoa(hdr->dstip),		/* dest ip */
-			hdr->dstport,			/* dest port */
-			tcp_print_flags(tcp->th_flags), /* tcp flags */
-			g_htonl(tcp->th_seq),		/* seq */
-			g_htonl(tcp->th_ack),		/* ack */
-			size_payload);			/* payload len */
-
-	/* XXX check tcp flags */
-	if (!size_payload) return;
+static int sniff_tcp_dissect(void *priv, const connection_t *hdr, const unsigned char *payload, int size_payload) {
+	/* XXX here, make some struct with known TCP services, and demangler-function */
 
 	/* XXX what proto ? check based on ip + port? */
 
@@ -318,7 +254,7 @@ static inline void sniff_loop_tcp(session_t *s, int len, const u_char *packet, c
 //				debug_error("HTTP DATA FOLLOW\n");
 //				tcp_print_payload((u_char *) payload, size_payload);
 
-			return;		/* done */
+			return size_payload;		/* done */
 		}
 
 
@@ -331,11 +267,56 @@ static inline void sniff_loop_tcp(session_t *s, int len, const u_char *packet, c
 //				debug_error("HTTP DATA FOLLOW?\n");
 //				tcp_print_payload((u_char *) payload, size_payload);
 
-			return;		/* done */
+			return size_payload;		/* done */
 		}
 	}
 
-	sniff_gg(s, hdr, (gg_header *) payload, size_payload);		/* GG		[no check, ~3% hit] */
+	if (size_payload >= sizeof(gg_header) && ((gg_header *) payload)->len > SNIFF_GG_MAX_LEN)
+		return 0;
+
+	return sniff_gg((session_t *) priv, hdr, (gg_header *) payload, size_payload);		/* GG		[length check, ~3% hit] */
+}
+
+static inline void sniff_loop_tcp(session_t *s, time_t now, int len, const u_char *packet, const struct iphdr *ip, int size_ip) {
+	const struct tcphdr *tcp;
+	int size_tcp;
+	sniff_flows_t *flows = GET_FLOWS(s);
+	sniff_flow_t *flow;
+	const connection_t *hdr;
+	int way;
+
+	const char *payload;
+	int size_payload;
+
+	CHECK_LEN(sizeof(struct tcphdr))	tcp = (struct tcphdr*) (packet);
+	size_tcp = TH_OFF(tcp)*4;
+
+	if (size_tcp < 20) {
+		debug_error("sniff_loop_tcp()	* Invalid TCP header length: %u bytes\n", size_tcp);
+		return;
+	}
+
+	size_payload = g_ntohs(ip->ip_len) - (size_ip + size_tcp);
+
+	CHECK_LEN(size_tcp + size_payload);
+
+	payload = (char *) (packet + size_tcp);
+
+	sniff_flows_expire(flows, now);
+	flow = sniff_flow_get(flows, ip, tcp, now, &way);
+	hdr = &flow->way[way].hdr;
+
+	debug_function("sniff_loop_tcp() IP/TCP %15s:%5d <==> %15s:%5d %s (SEQ: %lx ACK: %lx len: %d)\n", 
+			_inet_ntoa(hdr->srcip),		/* src ip */
+			hdr->srcport,			/* src port */
+			_inet_ntoa(hdr->dstip),		/* dest ip */
+			hdr->dstport,			/* dest port */
+			tcp_print_flags(tcp->th_flags), /* tcp flags */
+			g_htonl(tcp->th_seq),		/* seq */
+			g_htonl(tcp->th_ack),		/* ack */
+			size_payload);			/* payload len */
+
+	sniff_flow_segment(flows, flow, way, tcp, (const unsigned char *) payload, size_payload, sniff_tcp_dissect, s);
 }
 
 static inline void sniff_loop_udp(session_t *s, int len, const u_char *packet, const struct iphdr *ip) {
@@ -376,7 +357,7 @@ static inline void sniff_loop_udp(session_t *s, int len, const u_char *packet, c
 	}
 }
 
-static inline void sniff_loop_ip(session_t *s, int len, const u_char *packet) {
+static inline void sniff_loop_ip(session_t *s, time_t now, int len, const u_char *packet) {
 	const struct iphdr *ip;
 	int size_ip;
 
@@ -389,7 +370,7 @@ static inline void sniff_loop_ip(session_t *s, int len, const u_char *packet) {
 	}
 	
 	if (ip->ip_p == IPPROTO_TCP)
-		sniff_loop_tcp(s, len - size_ip, packet + size_ip, ip, size_ip);
+		sniff_loop_tcp(s, now, len - size_ip, packet + size_ip, ip, size_ip);
 	else if (ip->ip_p == IPPROTO_UDP) 
 		sniff_loop_udp(s, len - size_ip, packet + size_ip, ip);
 	else if (ip->ip_p == IPPROTO_ICMP) {	/* ICMP, stub only */
@@ -431,7 +412,7 @@ static inline void sniff_loop_ether(u_char *data, const struct pcap_pkthdr *head
 	if (ethtype == ETHERTYPE_ARP)
 		debug_function("sniff_loop_ether() ARP\n");
 	else if (ethtype == ETHERTYPE_IP) 
-		sniff_loop_ip((session_t *) data, header->caplen - sizeof(struct ethhdr), packet + SIZE_ETHERNET);
+		sniff_loop_ip((session_t *) data, header->ts.tv_sec, header->caplen - sizeof(struct ethhdr), packet + SIZE_ETHERNET);
 	else
 		debug_error("sniff_loop_ether() ethtype [0x%x] != ETHERTYPE_IP, CUL\n", ethtype);
 }
@@ -449,7 +430,7 @@ void sniff_loop_sll(u_char *data, const struct pcap_pkthdr *header, const u_char
 	ethtype = g_ntohs(sll->sll_protocol);
 	
 	if (ethtype == ETHERTYPE_IP) 
-		sniff_loop_ip((session_t *) data, header->caplen - sizeof(struct sll_header), packet + SIZE_SLL);
+		sniff_loop_ip((session_t *) data, header->ts.tv_sec, header->caplen - sizeof(struct sll_header), packet + SIZE_SLL);
 	else
 		debug_error("sniff_loop_sll() ethtype [0x%x] != ETHERTYPE_IP, CUL\n", ethtype);
 }
@@ -461,7 +442,7 @@ void sniff_loop_sll(u_char *data, const struct pcap_pkthdr *header, const u_char
 			debug_error("sniff_pcap_read() no session!\n");	\
 			return -1;					\
 		}							\
-		pcap_dispatch(GET_DEV(s), 1, y, (void *) s);		\
+		pcap_dispatch(GET_DEV(s), DISPATCH_BATCH, y, (void *) s);	\
 		return 0;						\
 	}
 	
@@ -476,6 +457,7 @@ WATCHER_PCAP(sniff_pcap_read, sniff_loop_ether);
 static COMMAND(sniff_command_connect) {
 	struct bpf_program fp;
 	char errbuf[PCAP_ERRBUF_SIZE] = { 0 };
+	sniff_private_t *j;
 	pcap_t *dev;
 	const char *filter;
 	char *device;
@@ -529,8 +511,11 @@ static COMMAND(sniff_command_connect) {
 		/* pcap_freecode(&fp); */
 	}
 
-	session->priv = dev;
-	
+	j = xmalloc(sizeof(sniff_private_t));
+	j->dev = dev;
+	sniff_flows_init(&j->flows, session_int_get(session, "flow_timeout"), session_int_get(session, "flow_buffer"));
+	session->priv = j;
+
 	switch (pcap_datalink(dev)) {
 		case DLT_LINUX_SLL:
 			watch_add_session(session, pcap_fileno(dev), WATCH_READ, sniff_pcap_read_SLL);
@@ -559,31 +544,44 @@ static COMMAND(sniff_command_disconnect) {
 
 	protocol_disconnected_emit(session, NULL, EKG_DISCONNECT_USER);
 
-	if (!GET_DEV(session)) {
+	if (!session->priv) {
 		debug_error("sniff_command_disconnect() not dev?!\n");
 		return -1;
 	}
 
-	pcap_close(GET_DEV(session));
-	session->priv = NULL;
+	sniff_private_free(session);
 
 	return 0;
 }
 
 static COMMAND(sniff_command_connections) {
-	list_t l;
+	sniff_flow_t *f;
+
+	if (!session->priv)
+		return -1;
 
-	for (l = tcp_connections; l; l = l->next) {
-		connection_t *c = l->data;
+	/* from least recently active */
+	for (f = GET_FLOWS(session)->head; f; f = f->next) {
+		const sniff_half_t *a = &f->way[0];
+		const sniff_half_t *b = &f->way[1];
 		char src_ip[INET_ADDRSTRLEN];
 		char dst_ip[INET_ADDRSTRLEN];
+		char *pkts	= g_strdup_printf("%" G_GUINT64_FORMAT, a->packets + b->packets);
+		char *bytes	= g_strdup_printf("%" G_GUINT64_FORMAT, a->bytes + b->bytes);
 
 		print_window("__status", session, EKG_WINACT_MSG, 1,
 			"sniff_tcp_connection", 
-				inet_ntop(AF_INET, &c->srcip, src_ip, sizeof(src_ip)),
-				ekg_itoa(c->srcport),
-				inet_ntop(AF_INET, &c->dstip, dst_ip, sizeof(dst_ip)),
-				ekg_itoa(c->dstport));
+				inet_ntop(AF_INET, &f->key.ip[0], src_ip, sizeof(src_ip)),
+				ekg_itoa(f->key.port[0]),
+				inet_ntop(AF_INET, &f->key.ip[1], dst_ip, sizeof(dst_ip)),
+				ekg_itoa(f->key.port[1]),
+				pkts, bytes,
+				ekg_itoa(a->buf->len + b->buf->len),
+				ekg_itoa(a->gaps + b->gaps),
+				ekg_itoa(a->overflows + b->overflows));
+
+		g_free(pkts);
+		g_free(bytes);
 	}
 	return 0;
 }
@@ -595,10 +593,8 @@ static QUERY(sniff_session_deinit) {
 	if (!s || !s->priv || s->plugin != &sniff_plugin)
 		return 1;
 
-	debug("sniff closing pcap dev: 0x%x\n", s->priv);
-	pcap_close(GET_DEV(s));	
-
-	s->priv = NULL;
+	debug("sniff closing pcap dev: 0x%x\n", GET_DEV(s));
+	sniff_private_free(s);
 	return 0;
 }
 
@@ -644,7 +640,7 @@ static QUERY(sniff_status_show) {
 	debug("pcap_stats() recv: %d drop: %d ifdrop: %d\n", stats.ps_recv, stats.ps_drop, stats.ps_ifdrop);
 	print("sniff_pkt_rcv",	session_name(s), ekg_itoa(stats.ps_recv));
 	print("sniff_pkt_drop",	session_name(s), ekg_itoa(stats.ps_drop));
-	print("sniff_conn_db",	session_name(s), ekg_itoa(list_count(tcp_connections)));
+	print("sniff_conn_db",	session_name(s), ekg_itoa(g_hash_table_size(GET_FLOWS(s)->flows)));
 
 	return 0;
 }
@@ -729,7 +725,7 @@ static int sniff_theme_init() {
 	format_add("sniff_pkt_drop",		("%) %2 packets dropped"), 1);
 
 	format_add("sniff_conn_db",		("%) %2 connections founded"), 1);
-	format_add("sniff_tcp_connection",	"TCP %1:%2 <==> %3:%4", 1);
+	format_add("sniff_tcp_connection",	"TCP %1:%2 <==> %3:%4 (%5 pkts, %6 bytes, %7 buffered, %8 gaps, %9 overflows)", 1);
 
 	return 0;
 }
@@ -738,6 +734,8 @@ static plugins_params_t sniff_plugin_vars[] = {
 	PLUGIN_VAR_ADD("alias",			VAR_STR, 0, 0, NULL),
 	PLUGIN_VAR_ADD("auto_connect",		VAR_BOOL, "0", 0, NULL),
 	PLUGIN_VAR_ADD("filter",		VAR_STR, DEFAULT_FILTER, 0, NULL),
+	PLUGIN_VAR_ADD("flow_buffer",		VAR_INT, "65536", 0, NULL),
+	PLUGIN_VAR_ADD("flow_timeout",		VAR_INT, "300", 0, NULL),
 
 	PLUGIN_VAR_END()
 };
@@ -0,0 +1,60 @@
+/* TCP flow tracking and stream reassembly for sniff plugin.
+ *
+ * needs sniff_ip.h and glib.h included before.
+ */
+
+typedef struct {
+	struct in_addr srcip;
+	guint16 srcport;
+
+	struct in_addr dstip;
+	guint16 dstport;
+} connection_t;
+
+typedef struct {
+	connection_t hdr;	/* addresses in way of this half (sender ==> receiver) */
+
+	guint32 next_seq;	/* next expected sequence number */
+	int seq_valid;		/* next_seq is known */
+	int fin;		/* got FIN */
+	int passthru;		/* not reassembled: rejected by dissector, or buffer overflowed */
+	GByteArray *buf;	/* reassembled data not yet consumed by dissector */
+
+	guint64 packets;
+	guint64 bytes;		/* payload bytes */
+	guint64 dissected;	/* bytes consumed by dissectors */
+	guint32 retrans;	/* segments with already seen data */
+	guint32 gaps;		/* data lost (or reordered), stream was resynced */
+	guint32 overflows;	/* buffer exceeded limit and was dropped */
+} sniff_half_t;
+
+typedef struct {
+	struct in_addr ip[2];	/* ip[0]:port[0] is lower endpoint */
+	guint16 port[2];
+	guint8 proto;
+} sniff_flow_key_t;
+
+typedef struct sniff_flow {
+	sniff_flow_key_t key;
+	sniff_half_t way[2];	/* [0] from lower endpoint, [1] from higher */
+
+	time_t first_seen;
+	time_t last_seen;
+
+	struct sniff_flow *prev, *next;	/* LRU, least recently seen first */
+} sniff_flow_t;
+
+/* dissector gets contiguous stream data, returns number of bytes consumed,
+ * -1 when it needs more data, or 0 if it's not its protocol */
+typedef int (*sniff_flow_dissector_t)(void *priv, const connection_t *hdr, const unsigned char *data, int len);
+
+typedef struct {
+	GHashTable *flows;		/* sniff_flow_key_t -> sniff_flow_t */
+	sniff_flow_t *head, *tail;	/* LRU list */
+
+	time_t timeout;			/* idle timeout */
+	guint max_buf;			/* max buffered bytes per direction */
+
+	guint64 created;
+	guint64 expired;
+} sniff_flows_t;
@@ -23,11 +23,11 @@ struct ethhdr { /* Ethernet header */
 #define SLL_ADDRLEN	8		/* length of address field */
 
 struct sll_header {
-	u_gint16	sll_pkttype;	/* packet type */
-	u_gint16	sll_hatype;	/* link-layer address type */
-	u_gint16	sll_halen;	/* link-layer address length */
-	u_gint8	sll_addr[SLL_ADDRLEN];	/* link-layer address */
-	u_gint16	sll_protocol;	/* protocol */
+	guint16	sll_pkttype;	/* packet type */
+	guint16	sll_hatype;	/* link-layer address type */
+	guint16	sll_halen;	/* link-layer address length */
+	guint8	sll_addr[SLL_ADDRLEN];	/* link-layer address */
+	guint16	sll_protocol;	/* protocol */
 };
 
 struct iphdr { /* IP header */